@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2024, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <unistd.h>
+
+#include <base/channel.h>
+#include <base/log.h>
+#include <base/sv.h>
+
+#define CHANNEL_SPIN 1000
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+// Spinning only helps if the other side can run at the same time.
+static int channel_spin_limit()
+{
+    static int s_spin_limit = -1;
+    int        ret = __atomic_load_n(&s_spin_limit, __ATOMIC_RELAXED);
+    if (ret < 0) {
+        ret = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? CHANNEL_SPIN : 0;
+        __atomic_store_n(&s_spin_limit, ret, __ATOMIC_RELAXED);
+    }
+    return ret;
+}
+
+static bool channel_full(Channel *channel)
+{
+    return atomic_load(&channel->head) - atomic_load(&channel->tail) == CHANNEL_SIZE;
+}
+
+bool channel_empty(Channel *channel)
+{
+    return atomic_load(&channel->head) == atomic_load(&channel->tail);
+}
+
+static bool channel_send_blocked(Channel *channel)
+{
+    return channel_full(channel) && !atomic_load(&channel->closed);
+}
+
+static bool channel_receive_blocked(Channel *channel)
+{
+    return channel_empty(channel) && !atomic_load(&channel->closed);
+}
+
+// The sleeper reads the sequence number and announces itself before its
+// final check of the queue. The other side changes the queue before looking
+// for sleepers. All of these are sequentially consistent, so either the check
+// sees the change, or the other side sees the sleeper and bumps the sequence
+// number, which makes the futex wait return.
+static void channel_wait(Channel *channel, bool (*blocked)(Channel *))
+{
+    for (int spin = channel_spin_limit(); spin > 0; --spin) {
+        if (!blocked(channel)) {
+            return;
+        }
+        cpu_relax();
+    }
+    while (true) {
+        uint32_t sequence = __atomic_load_n(&channel->sequence, __ATOMIC_SEQ_CST);
+        atomic_fetch_add(&channel->sleepers, 1);
+        if (!blocked(channel)) {
+            atomic_fetch_sub(&channel->sleepers, 1);
+            return;
+        }
+        futex_wait(&channel->sequence, sequence);
+        atomic_fetch_sub(&channel->sleepers, 1);
+    }
+}
+
+static void channel_notify(Channel *channel)
+{
+    if (atomic_load(&channel->sleepers) > 0) {
+        __atomic_add_fetch(&channel->sequence, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&channel->sequence, true);
+    }
+}
+
+bool channel_send(Channel *channel, void *message)
+{
+    if (channel_send_blocked(channel)) {
+        channel_wait(channel, channel_send_blocked);
+    }
+    if (atomic_load(&channel->closed)) {
+        return false;
+    }
+    size_t head = atomic_load_explicit(&channel->head, memory_order_relaxed);
+    channel->slots[head % CHANNEL_SIZE] = message;
+    atomic_store(&channel->head, head + 1);
+    channel_notify(channel);
+    return true;
+}
+
+void *channel_receive(Channel *channel)
+{
+    if (channel_receive_blocked(channel)) {
+        channel_wait(channel, channel_receive_blocked);
+    }
+    if (channel_empty(channel)) {
+        return NULL;
+    }
+    size_t tail = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+    void  *ret = channel->slots[tail % CHANNEL_SIZE];
+    atomic_store(&channel->tail, tail + 1);
+    channel_notify(channel);
+    return ret;
+}
+
+// Closing changes what the blocked predicates return, so sleepers are woken
+// up the same way a send or receive wakes them.
+void channel_close(Channel *channel)
+{
+    atomic_store(&channel->closed, true);
+    channel_notify(channel);
+}
+
+// #define CHANNEL_TEST
+#ifdef CHANNEL_TEST
+
+#include <pthread.h>
+
+#define MESSAGES 1000000
+
+static Channel s_ping = { 0 };
+static Channel s_pong = { 0 };
+
+static void *consumer(void *)
+{
+    for (uintptr_t ix = 1; ix <= MESSAGES; ++ix) {
+        uintptr_t msg = (uintptr_t) channel_receive(&s_ping);
+        if (msg != ix) {
+            fatal("Expected message %zu, got %zu", ix, msg);
+        }
+    }
+    for (uintptr_t ix = 1; ix <= 1000; ++ix) {
+        channel_send(&s_pong, channel_receive(&s_ping));
+    }
+    return NULL;
+}
+
+static void *closer(void *)
+{
+    usleep(10000);
+    channel_close(&s_pong);
+    return NULL;
+}
+
+int main()
+{
+    pthread_t thread;
+    pthread_create(&thread, NULL, consumer, NULL);
+    for (uintptr_t ix = 1; ix <= MESSAGES; ++ix) {
+        channel_send(&s_ping, (void *) ix);
+    }
+    for (uintptr_t ix = 1; ix <= 1000; ++ix) {
+        channel_send(&s_ping, (void *) ix);
+        if ((uintptr_t) channel_receive(&s_pong) != ix) {
+            fatal("Ping-pong out of order");
+        }
+    }
+    pthread_join(thread, NULL);
+    if (!channel_empty(&s_ping) || !channel_empty(&s_pong)) {
+        fatal("Channels not empty");
+    }
+
+    // A receiver asleep on an empty channel wakes up when it is closed.
+    pthread_create(&thread, NULL, closer, NULL);
+    if (channel_receive(&s_pong) != NULL || channel_send(&s_pong, (void *) 1)) {
+        fatal("Closed channel still delivers messages");
+    }
+    pthread_join(thread, NULL);
+    printf("%d messages streamed, 1000 ping-pongs\n", MESSAGES);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2024, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef BASE_CHANNEL_H
+#define BASE_CHANNEL_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <base/mutex.h>
+
+#define CHANNEL_SIZE 256
+
+/*
+ * Single-producer, single-consumer queue of pointers between two threads.
+ * Sending and receiving are lock-free while the queue is neither full nor
+ * empty. A thread that has to wait spins for a bit and then sleeps on the
+ * sequence futex; the other side only makes a system call to wake it if
+ * someone sleeps. A zero-initialized Channel is empty and ready to use.
+ *
+ * Either side can close the channel, which wakes the other side up. Once
+ * closed, channel_send drops its message and returns false, and
+ * channel_receive returns NULL when no messages are left. NULL can
+ * therefore not be sent as a message.
+ */
+typedef struct channel {
+    void         *slots[CHANNEL_SIZE];
+    atomic_size_t head;
+    atomic_size_t tail;
+    atomic_int    sleepers;
+    atomic_bool   closed;
+    uint32_t      sequence;
+} Channel;
+
+extern bool  channel_send(Channel *channel, void *message);
+extern void *channel_receive(Channel *channel);
+extern bool  channel_empty(Channel *channel);
+extern void  channel_close(Channel *channel);
+
+#endif /* BASE_CHANNEL_H */
@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2024, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+
+#include <base/charclass.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define CC_D (CC_DIGIT | CC_XDIGIT)
+#define CC_X (CC_ALPHA | CC_XDIGIT)
+
+// clang-format off
+uint8_t const cc_table[256] = {
+    ['\t'] = CC_BLANK, ['\n'] = CC_NEWLINE, ['\v'] = CC_BLANK, ['\f'] = CC_BLANK, ['\r'] = CC_BLANK, [' '] = CC_BLANK,
+    ['0'] = CC_D | CC_BDIGIT, ['1'] = CC_D | CC_BDIGIT, ['2' ... '9'] = CC_D,
+    ['A' ... 'F'] = CC_X, ['G' ... 'Z'] = CC_ALPHA,
+    ['a' ... 'f'] = CC_X, ['g' ... 'z'] = CC_ALPHA,
+    ['_'] = CC_UNDERSCORE,
+};
+// clang-format on
+
+#undef CC_D
+#undef CC_X
+
+/*
+ * The vector paths classify 16 bytes at a time and turn the comparison
+ * result into a bit mask. SSE2 has movemask, which yields one bit per byte.
+ * NEON does not; narrowing the byte-wide results to nibbles yields four bits
+ * per byte, so the index of the first set byte is ctz(mask) / 4.
+ */
+#if defined(__SSE2__)
+
+typedef __m128i Block;
+
+#define MASK_SHIFT 0
+#define MASK_ALL 0xFFFFull
+
+static inline Block block_load(char const *ptr)
+{
+    return _mm_loadu_si128((__m128i const *) ptr);
+}
+
+static inline Block block_zero()
+{
+    return _mm_setzero_si128();
+}
+
+static inline Block block_or(Block b1, Block b2)
+{
+    return _mm_or_si128(b1, b2);
+}
+
+static inline Block block_eq(Block b, char ch)
+{
+    return _mm_cmpeq_epi8(b, _mm_set1_epi8(ch));
+}
+
+static inline Block block_in_range(Block b, char lo, char hi)
+{
+    Block l = _mm_set1_epi8(lo);
+    Block h = _mm_set1_epi8(hi);
+    return _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(b, l), b), _mm_cmpeq_epi8(_mm_min_epu8(b, h), b));
+}
+
+static inline Block block_fold(Block b)
+{
+    return _mm_or_si128(b, _mm_set1_epi8(0x20));
+}
+
+static inline uint64_t block_mask(Block b)
+{
+    return (uint64_t) _mm_movemask_epi8(b);
+}
+
+#elif defined(__ARM_NEON)
+
+typedef uint8x16_t Block;
+
+#define MASK_SHIFT 2
+#define MASK_ALL (~0ull)
+
+static inline Block block_load(char const *ptr)
+{
+    return vld1q_u8((uint8_t const *) ptr);
+}
+
+static inline Block block_zero()
+{
+    return vdupq_n_u8(0);
+}
+
+static inline Block block_or(Block b1, Block b2)
+{
+    return vorrq_u8(b1, b2);
+}
+
+static inline Block block_eq(Block b, char ch)
+{
+    return vceqq_u8(b, vdupq_n_u8((uint8_t) ch));
+}
+
+static inline Block block_in_range(Block b, char lo, char hi)
+{
+    return vandq_u8(vcgeq_u8(b, vdupq_n_u8((uint8_t) lo)), vcleq_u8(b, vdupq_n_u8((uint8_t) hi)));
+}
+
+static inline Block block_fold(Block b)
+{
+    return vorrq_u8(b, vdupq_n_u8(0x20));
+}
+
+static inline uint64_t block_mask(Block b)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(b), 4)), 0);
+}
+
+#endif
+
+#ifdef MASK_SHIFT
+
+// Mirrors cc_table: sets every byte of the result that belongs to one of
+// the given classes. Folding with 0x20 maps 'A'-'Z' onto 'a'-'z' and
+// nothing else onto that range.
+static inline Block block_classify(Block b, uint8_t classes)
+{
+    Block ret = block_zero();
+    if (classes & CC_BLANK) {
+        ret = block_or(ret, block_or(block_eq(b, ' '), block_eq(b, '\t')));
+        ret = block_or(ret, block_in_range(b, '\v', '\r'));
+    }
+    if (classes & CC_NEWLINE) {
+        ret = block_or(ret, block_eq(b, '\n'));
+    }
+    if (classes & (CC_DIGIT | CC_XDIGIT)) {
+        ret = block_or(ret, block_in_range(b, '0', '9'));
+    } else if (classes & CC_BDIGIT) {
+        ret = block_or(ret, block_in_range(b, '0', '1'));
+    }
+    if (classes & CC_ALPHA) {
+        ret = block_or(ret, block_in_range(block_fold(b), 'a', 'z'));
+    } else if (classes & CC_XDIGIT) {
+        ret = block_or(ret, block_in_range(block_fold(b), 'a', 'f'));
+    }
+    if (classes & CC_UNDERSCORE) {
+        ret = block_or(ret, block_eq(b, '_'));
+    }
+    return ret;
+}
+
+#endif
+
+// Returns the length of the prefix of ptr[0..len) consisting of characters
+// in any of the given classes.
+size_t cc_span(char const *ptr, size_t len, uint8_t classes)
+{
+    size_t ix = 0;
+#ifdef MASK_SHIFT
+    for (; ix + 16 <= len; ix += 16) {
+        uint64_t outside = ~block_mask(block_classify(block_load(ptr + ix), classes)) & MASK_ALL;
+        if (outside) {
+            return ix + (__builtin_ctzll(outside) >> MASK_SHIFT);
+        }
+    }
+#endif
+    for (; ix < len && cc_is(ptr[ix], classes); ++ix)
+        ;
+    return ix;
+}
+
+// Returns the index of the first character in ptr[0..len) that is either
+// one of the characters in stops or '\0', or len if there is none. Stopping
+// at '\0' lets callers use this on NUL-terminated buffers.
+size_t cc_scan_to(char const *ptr, size_t len, char const *stops)
+{
+    size_t num_stops = strlen(stops);
+    size_t ix = 0;
+#ifdef MASK_SHIFT
+    if (num_stops <= 3) {
+        char s0 = (num_stops > 0) ? stops[0] : '\0';
+        char s1 = (num_stops > 1) ? stops[1] : '\0';
+        char s2 = (num_stops > 2) ? stops[2] : '\0';
+        for (; ix + 16 <= len; ix += 16) {
+            Block    b = block_load(ptr + ix);
+            Block    hit = block_or(block_or(block_eq(b, '\0'), block_eq(b, s0)), block_or(block_eq(b, s1), block_eq(b, s2)));
+            uint64_t mask = block_mask(hit);
+            if (mask) {
+                return ix + (__builtin_ctzll(mask) >> MASK_SHIFT);
+            }
+        }
+    }
+#endif
+    for (; ix < len && ptr[ix] && !memchr(stops, ptr[ix], num_stops); ++ix)
+        ;
+    return ix;
+}
+
+#ifdef CHARCLASS_TEST
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <base/log.h>
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static size_t naive_span(char const *ptr, size_t len, uint8_t classes)
+{
+    size_t ix = 0;
+    for (; ix < len; ++ix) {
+        int  ch = (unsigned char) ptr[ix];
+        bool in = ((classes & CC_BLANK) && isspace(ch) && ch != '\n')
+            || ((classes & CC_NEWLINE) && ch == '\n')
+            || ((classes & CC_DIGIT) && isdigit(ch))
+            || ((classes & CC_XDIGIT) && isxdigit(ch))
+            || ((classes & CC_BDIGIT) && (ch == '0' || ch == '1'))
+            || ((classes & CC_ALPHA) && isalpha(ch))
+            || ((classes & CC_UNDERSCORE) && ch == '_');
+        if (!in) {
+            break;
+        }
+    }
+    return ix;
+}
+
+int main()
+{
+    for (int ch = 0; ch < 256; ++ch) {
+        assert(cc_is(ch, CC_SPACE) == (isspace(ch) != 0));
+        assert(cc_is(ch, CC_DIGIT) == (isdigit(ch) != 0));
+        assert(cc_is(ch, CC_XDIGIT) == (isxdigit(ch) != 0));
+        assert(cc_is(ch, CC_ALPHA) == (isalpha(ch) != 0));
+        assert(cc_is(ch, CC_ALNUM) == (isalnum(ch) != 0));
+    }
+
+    uint8_t const classes[] = { CC_BLANK, CC_SPACE, CC_DIGIT, CC_XDIGIT, CC_BDIGIT, CC_ALPHA, CC_IDENT, CC_XDIGIT | CC_UNDERSCORE };
+    char          buffer[256];
+    srand(42);
+    for (int round = 0; round < 100000; ++round) {
+        size_t  len = rand() % 64;
+        uint8_t cls = classes[rand() % sizeof(classes)];
+        for (size_t ix = 0; ix < len; ++ix) {
+            // Mostly class members, with the occasional arbitrary byte.
+            do {
+                buffer[ix] = (char) (rand() % 256);
+            } while ((rand() % 8) && !cc_is(buffer[ix], cls));
+        }
+        assert(cc_span(buffer, len, cls) == naive_span(buffer, len, cls));
+        char const *stops = (round % 2) ? "\"\\" : "\n";
+        size_t      expected = 0;
+        while (expected < len && buffer[expected] && !strchr(stops, buffer[expected])) {
+            ++expected;
+        }
+        assert(cc_scan_to(buffer, len, stops) == expected);
+    }
+
+    size_t size = 16 * 1024 * 1024;
+    char  *text = malloc(size);
+    for (size_t ix = 0; ix < size; ++ix) {
+        text[ix] = (ix % 64 == 63) ? '\n' : "abcdefghij_0123456789ABCDEFGHIJ"[ix % 31];
+    }
+    double start = now();
+    size_t total = 0;
+    for (size_t ix = 0; ix < size; ix += total + 1) {
+        total = naive_span(text + ix, size - ix, CC_IDENT);
+    }
+    double naive_time = now() - start;
+    start = now();
+    for (size_t ix = 0; ix < size; ix += total + 1) {
+        total = cc_span(text + ix, size - ix, CC_IDENT);
+    }
+    double span_time = now() - start;
+    start = now();
+    for (size_t ix = 0; ix < size; ix += total + 1) {
+        total = cc_scan_to(text + ix, size - ix, "\n");
+    }
+    double scan_time = now() - start;
+    printf("identifier spans over 16 MiB: <ctype.h> %.2f GB/s, cc_span %.2f GB/s, cc_scan_to %.2f GB/s\n",
+        size / naive_time / 1e9, size / span_time / 1e9, size / scan_time / 1e9);
+    free(text);
+    return 0;
+}
+
+#endif /* CHARCLASS_TEST */
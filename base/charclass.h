@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2024, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef BASE_CHARCLASS_H
+#define BASE_CHARCLASS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * ASCII character classes, looked up in a 256 entry table instead of
+ * going through the locale-aware <ctype.h> functions. The classes match
+ * the "C" locale; bytes >= 0x80 belong to no class.
+ */
+typedef enum {
+    CC_BLANK = 0x01,      // ' ', '\t', '\v', '\f', '\r'
+    CC_NEWLINE = 0x02,    // '\n'
+    CC_DIGIT = 0x04,      // '0'-'9'
+    CC_XDIGIT = 0x08,     // '0'-'9', 'a'-'f', 'A'-'F'
+    CC_BDIGIT = 0x10,     // '0', '1'
+    CC_ALPHA = 0x20,      // 'a'-'z', 'A'-'Z'
+    CC_UNDERSCORE = 0x40, // '_'
+} CharClass;
+
+#define CC_SPACE (CC_BLANK | CC_NEWLINE)
+#define CC_ALNUM (CC_ALPHA | CC_DIGIT)
+#define CC_IDENT (CC_ALPHA | CC_DIGIT | CC_UNDERSCORE)
+
+extern uint8_t const cc_table[256];
+
+static inline bool cc_is(int ch, uint8_t classes)
+{
+    return (cc_table[(uint8_t) ch] & classes) != 0;
+}
+
+extern size_t cc_span(char const *ptr, size_t len, uint8_t classes);
+extern size_t cc_scan_to(char const *ptr, size_t len, char const *stops);
+
+#endif /* BASE_CHARCLASS_H */
@@ -10,34 +10,62 @@
 #include <da.h>
 #include <log.h>
 
+#define DA_INITIAL_CAPACITY 16
+
+// Growth policy shared by the DA_ functions and the DIA_ macros: start at
+// DA_INITIAL_CAPACITY and double until the required size fits.
+size_t da_capacity_for(size_t cap, size_t required)
+{
+    size_t new_cap = (cap) ? cap : DA_INITIAL_CAPACITY;
+    while (new_cap < required) {
+        new_cap = new_cap * 2;
+    }
+    return new_cap;
+}
+
+void *da_reallocate(void *elements, size_t elem_size, size_t cap)
+{
+    if (cap == 0) {
+        free(elements);
+        return NULL;
+    }
+    void *new_elements = realloc(elements, cap * elem_size);
+    if (!new_elements) {
+        fatal("Out of memory reallocating array to %zu elements of size %zu", cap, elem_size);
+    }
+    return new_elements;
+}
+
 void da_resize(DA_void *array, size_t elem_size, size_t cap, char const *type)
 {
     if (array->cap >= cap) {
         return;
     }
-    size_t new_cap = array->cap;
-    if (new_cap == 0) {
+    if (array->cap == 0) {
         assert(array->size == 0);
         assert(array->elements == NULL);
-        // new_cap = 15;
-        new_cap = 16;
     }
-    while (new_cap < cap) {
-        // new_cap = (new_cap + 1) * 2 - 1;
-        new_cap = new_cap * 2;
+    size_t new_cap = da_capacity_for(array->cap, cap);
+    array->elements = da_reallocate(array->elements, elem_size, new_cap);
+    array->cap = new_cap;
+}
+
+void da_reserve(DA_void *array, size_t elem_size, size_t cap, char const *type)
+{
+    if (array->cap >= cap) {
+        return;
     }
-    void *new_elements = NULL;
-    if (array->elements == NULL) {
-        // new_elements = calloc(new_cap + 1, elem_size);
-        new_elements = calloc(new_cap, elem_size);
-    } else {
-        // new_elements = realloc(array->elements - elem_size, (new_cap + 1 ) * elem_size);
-        new_elements = realloc(array->elements, new_cap * elem_size);
+    array->elements = da_reallocate(array->elements, elem_size, cap);
+    array->cap = cap;
+}
+
+void da_shrink_to_fit(DA_void *array, size_t elem_size, char const *type)
+{
+    if (array->cap == array->size) {
+        return;
     }
-    assert(new_elements);
-    // array->elements = new_elements + elem_size;
-    array->elements = new_elements;
-    array->cap = new_cap;
+    array->elements = da_reallocate(array->elements, elem_size, array->size);
+    array->cap = array->size;
 }
 
 void *da_append(DA_void *array, void *elem, size_t elem_size, char const *type)
@@ -91,3 +119,99 @@ DA_IMPL(int)
 DA_IMPL(uint32_t)
 DA_IMPL(size_t)
 DA_IMPL(char)
+
+#ifdef DA_TEST
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NUM_ELEMENTS (1024 * 1024)
+#define ROUNDS 8
+
+typedef struct {
+    DIA(size_t);
+} Payload;
+
+static size_t peak_rss()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef IS_APPLE
+    return usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024;
+#endif
+}
+
+static void dia_rounds()
+{
+    for (int round = 0; round < ROUNDS; ++round) {
+        Payload p = { 0 };
+        for (size_t ix = 0; ix < NUM_ELEMENTS; ++ix) {
+            DIA_APPEND(size_t, (&p), ix);
+        }
+        for (size_t ix = 0; ix < NUM_ELEMENTS; ++ix) {
+            assert(p.elements[ix] == ix);
+        }
+        DIA_SHRINK_TO_FIT(size_t, (&p));
+        assert(p.cap == p.size);
+        DIA_FREE((&p));
+    }
+}
+
+static void da_rounds()
+{
+    for (int round = 0; round < ROUNDS; ++round) {
+        Sizes sizes = { 0 };
+        for (size_t ix = 0; ix < NUM_ELEMENTS; ++ix) {
+            da_append_size_t(&sizes, ix);
+        }
+        da_shrink_to_fit_size_t(&sizes);
+        assert(sizes.cap == sizes.size);
+        da_free_size_t(&sizes);
+
+        da_reserve_size_t(&sizes, NUM_ELEMENTS);
+        assert(sizes.cap == NUM_ELEMENTS);
+        for (size_t ix = 0; ix < NUM_ELEMENTS; ++ix) {
+            da_append_size_t(&sizes, ix);
+        }
+        assert(sizes.cap == NUM_ELEMENTS);
+        da_free_size_t(&sizes);
+    }
+}
+
+// The peak RSS is a high-water mark for the lifetime of the process, so
+// every container is measured in a child of its own.
+static void check_peak(char const *what, void (*rounds)())
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fatal("%s: fork failed", what);
+    }
+    if (pid == 0) {
+        size_t payload = NUM_ELEMENTS * sizeof(size_t);
+        size_t baseline = peak_rss();
+        rounds();
+        size_t growth = peak_rss() - baseline;
+        printf("%-4s: payload %6zu KiB, peak RSS growth %6zu KiB (%.2fx)\n", what, payload / 1024, growth / 1024, (double) growth / (double) payload);
+        if (growth > 2 * payload + payload / 2) {
+            fatal("%s: peak RSS growth %zu exceeds 2.5x payload %zu", what, growth, payload);
+        }
+        exit(0);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fatal("%s: RSS check failed", what);
+    }
+}
+
+int main()
+{
+    check_peak("DIA", dia_rounds);
+    check_peak("DA", da_rounds);
+    return 0;
+}
+
+#endif /* DA_TEST */
@@ -10,6 +10,9 @@
 #include <base/optional.h>
 #include <stdlib.h>
 
+extern size_t da_capacity_for(size_t cap, size_t required);
+extern void  *da_reallocate(void *elements, size_t elem_size, size_t cap);
+
 #define DIA_ELEMENTS(T, E) \
     size_t size;           \
     size_t cap;            \
@@ -17,27 +20,41 @@
 
 #define DIA(T) DIA_ELEMENTS(T, elements)
 
-#define DIA_APPEND_ELEMENT(T, E, obj, elem)                             \
-    do {                                                                \
-        if ((obj)->size == obj->cap) {                                  \
-            if ((obj)->cap == 0) {                                      \
-                (obj)->E = MALLOC_ARR(T, 4);                            \
-                (obj)->cap = 4;                                         \
-            } else {                                                    \
-                size_t new_cap = (obj)->cap;                            \
-                do {                                                    \
-                    new_cap *= 2;                                       \
-                } while (new_cap < (obj)->size);                        \
-                T *new_elements = MALLOC_ARR(T, new_cap);               \
-                memcpy(new_elements, (obj)->E, (obj)->cap * sizeof(T)); \
-                (obj)->E = new_elements;                                \
-                (obj)->cap = new_cap;                                   \
-            }                                                           \
-        }                                                               \
-        (obj)->E[(obj)->size++] = (elem);                               \
+#define DIA_RESERVE_ELEMENTS(T, E, obj, num)                              \
+    do {                                                                  \
+        if ((size_t) (num) > (obj)->cap) {                                \
+            size_t new_cap = da_capacity_for((obj)->cap, (num));          \
+            (obj)->E = (T *) da_reallocate((obj)->E, sizeof(T), new_cap); \
+            (obj)->cap = new_cap;                                         \
+        }                                                                 \
+    } while (0)
+
+#define DIA_APPEND_ELEMENT(T, E, obj, elem)               \
+    do {                                                  \
+        DIA_RESERVE_ELEMENTS(T, E, obj, (obj)->size + 1); \
+        (obj)->E[(obj)->size++] = (elem);                 \
+    } while (0)
+
+#define DIA_SHRINK_TO_FIT_ELEMENTS(T, E, obj)                                 \
+    do {                                                                      \
+        if ((obj)->cap > (obj)->size) {                                       \
+            (obj)->E = (T *) da_reallocate((obj)->E, sizeof(T), (obj)->size); \
+            (obj)->cap = (obj)->size;                                         \
+        }                                                                     \
+    } while (0)
+
+#define DIA_FREE_ELEMENTS(E, obj) \
+    do {                          \
+        free((obj)->E);           \
+        (obj)->E = NULL;          \
+        (obj)->size = 0;          \
+        (obj)->cap = 0;           \
     } while (0)
 
 #define DIA_APPEND(T, obj, elem) DIA_APPEND_ELEMENT(T, elements, obj, elem)
+#define DIA_RESERVE(T, obj, num) DIA_RESERVE_ELEMENTS(T, elements, obj, num)
+#define DIA_SHRINK_TO_FIT(T, obj) DIA_SHRINK_TO_FIT_ELEMENTS(T, elements, obj)
+#define DIA_FREE(obj) DIA_FREE_ELEMENTS(elements, obj)
 
 typedef struct {
     size_t size;
@@ -45,12 +62,14 @@ typedef struct {
     void  *elements;
 } DA_void;
 
-#define DA_FUNCTIONS_TYPE(T, S)                    \
-    void da_resize_##T(DA_##T *array, size_t cap); \
-    S   *da_append_##T(DA_##T *array, S elem);     \
-    S   *da_element_##T(DA_##T *array, size_t ix); \
-    void da_free_##T(DA_##T *array);               \
-    S    da_pop_front_##T(DA_##T *array);          \
+#define DA_FUNCTIONS_TYPE(T, S)                     \
+    void da_resize_##T(DA_##T *array, size_t cap);  \
+    void da_reserve_##T(DA_##T *array, size_t cap); \
+    void da_shrink_to_fit_##T(DA_##T *array);       \
+    S   *da_append_##T(DA_##T *array, S elem);      \
+    S   *da_element_##T(DA_##T *array, size_t ix);  \
+    void da_free_##T(DA_##T *array);                \
+    S    da_pop_front_##T(DA_##T *array);           \
     S    da_pop_##T(DA_##T *array);
 
 #define DA_FUNCTIONS(T) DA_FUNCTIONS_TYPE(T, T)
@@ -64,6 +83,8 @@ typedef struct {
     DA_FUNCTIONS_TYPE(T, S)
 
 extern void  da_resize(DA_void *array, size_t elem_size, size_t cap, char const *type);
+extern void  da_reserve(DA_void *array, size_t elem_size, size_t cap, char const *type);
+extern void  da_shrink_to_fit(DA_void *array, size_t elem_size, char const *type);
 extern void *da_append(DA_void *array, void *elem, size_t elem_size, char const *type);
 extern void *da_element(DA_void *array, size_t ix, size_t elem_size, char const *type);
 // extern void *da_pop(DA_void *array, size_t elem_size, char const *type);
@@ -81,6 +102,14 @@ extern void da_free(DA_void *array, size_t elem_size, char const *type);
     {                                                                                 \
         da_resize((DA_void *) array, sizeof(S), cap, #T);                             \
     }                                                                                 \
+    void da_reserve_##T(DA_##T *array, size_t cap)                                    \
+    {                                                                                 \
+        da_reserve((DA_void *) array, sizeof(S), cap, #T);                            \
+    }                                                                                 \
+    void da_shrink_to_fit_##T(DA_##T *array)                                          \
+    {                                                                                 \
+        da_shrink_to_fit((DA_void *) array, sizeof(S), #T);                           \
+    }                                                                                 \
     S *da_append_##T(DA_##T *array, S elem)                                           \
     {                                                                                 \
         return (S *) da_append((DA_void *) array, &elem, sizeof(S), #T);              \
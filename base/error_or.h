@@ -62,7 +62,10 @@ extern char const *Error_to_string(Error error);
         ret.error.line = line;                                                                                                           \
         ret.error.cat = cat;                                                                                                             \
         ret.error.code = code;                                                                                                           \
-        size_t msg_len = vsnprintf(NULL, 0, msg, args) + 1;                                                                              \
+        va_list args_copy;                                                                                                               \
+        va_copy(args_copy, args);                                                                                                        \
+        size_t msg_len = vsnprintf(NULL, 0, msg, args_copy) + 1;                                                                         \
+        va_end(args_copy);                                                                                                               \
         ret.error.message = (char *) mem_allocate(msg_len);                                                                              \
         vsnprintf(ret.error.message, msg_len, msg, args);                                                                                \
         return ret;                                                                                                                      \
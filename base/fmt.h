@@ -34,8 +34,31 @@ typedef struct fmt_arg {
 DA(FMTArg)
 typedef DA_FMTArg FMTArgs;
 
-extern StringView fmt_format(StringView fmt, FMTArgs);
-extern StringView vformat(StringView fmt, va_list args);
-extern StringView format(StringView fmt, ...);
+/*
+ * A parsed format string. Obtained from fmt_compile and never freed; the
+ * format functions taking a StringView look their format up in the same
+ * cache, keyed on the address of the format text.
+ */
+typedef struct format_string FormatString;
+
+extern FormatString *fmt_compile(StringView fmt);
+extern StringView    fmt_format_compiled(FormatString *fs, FMTArgs args);
+extern StringView    vformat_compiled(FormatString *fs, va_list args);
+extern StringView    format_compiled(FormatString *fs, ...);
+extern StringView    fmt_format(StringView fmt, FMTArgs);
+extern StringView    vformat(StringView fmt, va_list args);
+extern StringView    format(StringView fmt, ...);
+
+// Formats with a format string literal that is compiled once per call site.
+#define FORMAT(fmt, ...)                                                                  \
+    ({                                                                                    \
+        static FormatString *_fmt_compiled = NULL;                                        \
+        FormatString        *_fmt_fs = __atomic_load_n(&_fmt_compiled, __ATOMIC_ACQUIRE); \
+        if (_fmt_fs == NULL) {                                                            \
+            _fmt_fs = fmt_compile(sv_from(fmt));                                          \
+            __atomic_store_n(&_fmt_compiled, _fmt_fs, __ATOMIC_RELEASE);                  \
+        }                                                                                 \
+        format_compiled(_fmt_fs __VA_OPT__(, ) __VA_ARGS__);                              \
+    })
 
 #endif /* BASE_FMT_H */
@@ -59,21 +59,17 @@ StringView fn_extension(StringView path)
     };
 }
 
+// Splits a path into its components. An absolute path yields an empty
+// first component; repeated and trailing slashes are ignored.
 StringList fn_split_path(StringView path)
 {
     StringList result = sl_create();
-    StringView rest = path;
-    while (sv_not_empty(rest)) {
-        int slash = sv_first(rest, '/');
-        if (slash < 0) {
-            sl_push(&result, rest);
-            break;
+    SplitIter  it = sv_split_iter(path, sv_from("/"));
+    StringView component;
+    while (sv_split_next(&it, &component)) {
+        if (sv_not_empty(component) || sl_empty(&result)) {
+            sl_push(&result, component);
         }
-        sl_push(&result, (StringView) { .ptr = rest.ptr, .length = slash });
-        rest = (StringView) {
-            .ptr = rest.ptr + slash + 1,
-            .length = rest.length - slash - 1
-        };
     }
     return result;
 }
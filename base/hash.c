@@ -8,42 +8,444 @@
 
 #include <hash.h>
 
-unsigned int hash(void const *buf, size_t size)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Short and medium keys are hashed with wyhash (Wang Yi, public domain).
+// Keys of HASH_BULK_THRESHOLD bytes or more first go through an XXH3-style
+// stripe accumulator with eight 64-bit lanes, which maps directly onto
+// SSE2/NEON 32x32->64 multiplies. The vector and scalar versions of the
+// accumulator produce identical results.
+
+#define HASH_BULK_THRESHOLD 512
+#define HASH_STRIPE_SIZE 64
+#define HASH_STRIPES_PER_BLOCK 16
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t const s_wyp[4] = {
+    0x2d358dccaa6c78a5ULL,
+    0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL,
+    0x4d5a2da51de1aa47ULL,
+};
+
+static uint64_t const s_stripe_secret[8] = {
+    0xbe4ba423396cfeb8ULL,
+    0x1cad21f72c81017cULL,
+    0xdb979083e96dd4deULL,
+    0x1f67b3b7a4a44072ULL,
+    0x78e5c0cc4ee679cbULL,
+    0x2172ffcc7dd05a82ULL,
+    0x8e2443f7744608b8ULL,
+    0x4c263a81e69035e0ULL,
+};
+
+static inline void wymum(uint64_t *a, uint64_t *b)
 {
-    int            hash = 5381;
-    size_t         i;
-    int            c;
-    unsigned char *data = (unsigned char *) buf;
+    __uint128_t r = (__uint128_t) *a * *b;
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+}
 
-    for (i = 0; i < size; i++) {
-        c = *data++;
-        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+static inline uint64_t wymix(uint64_t a, uint64_t b)
+{
+    wymum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t read64(uint8_t const *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read32(uint8_t const *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read_small(uint8_t const *p, size_t k)
+{
+    return (((uint64_t) p[0]) << 16) | (((uint64_t) p[k >> 1]) << 8) | p[k - 1];
+}
+
+static uint64_t wyhash(uint8_t const *p, size_t len, uint64_t seed)
+{
+    uint64_t a;
+    uint64_t b;
+    seed ^= wymix(seed ^ s_wyp[0], s_wyp[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (read32(p) << 32) | read32(p + ((len >> 3) << 2));
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = read_small(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed;
+            uint64_t see2 = seed;
+            do {
+                seed = wymix(read64(p) ^ s_wyp[1], read64(p + 8) ^ seed);
+                see1 = wymix(read64(p + 16) ^ s_wyp[2], read64(p + 24) ^ see1);
+                see2 = wymix(read64(p + 32) ^ s_wyp[3], read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(read64(p) ^ s_wyp[1], read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    a ^= s_wyp[1];
+    b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ s_wyp[0] ^ len, b ^ s_wyp[1]);
+}
+
+// The portable version. Without SIMD it is the only one; otherwise it is
+// only needed by HASH_TEST to check the vector versions against.
+#if defined(HASH_TEST) || !(defined(__SSE2__) || defined(__ARM_NEON))
+static void accumulate_scalar(uint64_t *acc, uint8_t const *p, size_t stripes)
+{
+    for (size_t stripe = 0; stripe < stripes; ++stripe) {
+        uint8_t const *s = p + stripe * HASH_STRIPE_SIZE;
+        uint64_t       salt = (stripe % HASH_STRIPES_PER_BLOCK) * PRIME64_2;
+        for (size_t i = 0; i < 8; ++i) {
+            uint64_t d = read64(s + 8 * i);
+            uint64_t dk = d ^ (s_stripe_secret[i] + salt);
+            acc[i] += (dk & 0xFFFFFFFF) * (dk >> 32);
+            acc[i ^ 1] += d;
+        }
+        if ((stripe % HASH_STRIPES_PER_BLOCK) == HASH_STRIPES_PER_BLOCK - 1) {
+            for (size_t i = 0; i < 8; ++i) {
+                acc[i] ^= acc[i] >> 47;
+                acc[i] ^= s_stripe_secret[i];
+                acc[i] *= PRIME32_1;
+            }
+        }
     }
-    return hash;
+}
+#endif
+
+#if defined(__SSE2__)
+
+static void accumulate(uint64_t *acc, uint8_t const *p, size_t stripes)
+{
+    __m128i lanes[4];
+    __m128i secret[4];
+    __m128i prime = _mm_set1_epi32((int) PRIME32_1);
+    for (size_t j = 0; j < 4; ++j) {
+        lanes[j] = _mm_loadu_si128((__m128i const *) (acc + 2 * j));
+        secret[j] = _mm_loadu_si128((__m128i const *) (s_stripe_secret + 2 * j));
+    }
+    for (size_t stripe = 0; stripe < stripes; ++stripe) {
+        uint8_t const *s = p + stripe * HASH_STRIPE_SIZE;
+        __m128i        salt = _mm_set1_epi64x((long long) ((stripe % HASH_STRIPES_PER_BLOCK) * PRIME64_2));
+        for (size_t j = 0; j < 4; ++j) {
+            __m128i d = _mm_loadu_si128((__m128i const *) (s + 16 * j));
+            __m128i dk = _mm_xor_si128(d, _mm_add_epi64(secret[j], salt));
+            __m128i dk_hi = _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1));
+            __m128i product = _mm_mul_epu32(dk, dk_hi);
+            __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+            lanes[j] = _mm_add_epi64(lanes[j], _mm_add_epi64(product, swapped));
+        }
+        if ((stripe % HASH_STRIPES_PER_BLOCK) == HASH_STRIPES_PER_BLOCK - 1) {
+            for (size_t j = 0; j < 4; ++j) {
+                __m128i a = _mm_xor_si128(lanes[j], _mm_srli_epi64(lanes[j], 47));
+                a = _mm_xor_si128(a, secret[j]);
+                __m128i lo = _mm_mul_epu32(a, prime);
+                __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+                lanes[j] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+            }
+        }
+    }
+    for (size_t j = 0; j < 4; ++j) {
+        _mm_storeu_si128((__m128i *) (acc + 2 * j), lanes[j]);
+    }
+}
+
+#elif defined(__ARM_NEON)
+
+static void accumulate(uint64_t *acc, uint8_t const *p, size_t stripes)
+{
+    uint64x2_t lanes[4];
+    uint64x2_t secret[4];
+    uint32x2_t prime = vdup_n_u32(PRIME32_1);
+    for (size_t j = 0; j < 4; ++j) {
+        lanes[j] = vld1q_u64(acc + 2 * j);
+        secret[j] = vld1q_u64(s_stripe_secret + 2 * j);
+    }
+    for (size_t stripe = 0; stripe < stripes; ++stripe) {
+        uint8_t const *s = p + stripe * HASH_STRIPE_SIZE;
+        uint64x2_t     salt = vdupq_n_u64((stripe % HASH_STRIPES_PER_BLOCK) * PRIME64_2);
+        for (size_t j = 0; j < 4; ++j) {
+            uint64x2_t d = vreinterpretq_u64_u8(vld1q_u8(s + 16 * j));
+            uint64x2_t dk = veorq_u64(d, vaddq_u64(secret[j], salt));
+            lanes[j] = vaddq_u64(lanes[j], vextq_u64(d, d, 1));
+            lanes[j] = vmlal_u32(lanes[j], vmovn_u64(dk), vshrn_n_u64(dk, 32));
+        }
+        if ((stripe % HASH_STRIPES_PER_BLOCK) == HASH_STRIPES_PER_BLOCK - 1) {
+            for (size_t j = 0; j < 4; ++j) {
+                uint64x2_t a = veorq_u64(lanes[j], vshrq_n_u64(lanes[j], 47));
+                a = veorq_u64(a, secret[j]);
+                uint64x2_t hi = vshlq_n_u64(vmull_u32(vshrn_n_u64(a, 32), prime), 32);
+                lanes[j] = vmlal_u32(hi, vmovn_u64(a), prime);
+            }
+        }
+    }
+    for (size_t j = 0; j < 4; ++j) {
+        vst1q_u64(acc + 2 * j, lanes[j]);
+    }
+}
+
+#else
+
+static void accumulate(uint64_t *acc, uint8_t const *p, size_t stripes)
+{
+    accumulate_scalar(acc, p, stripes);
+}
+
+#endif
+
+typedef void (*AccumulateFnc)(uint64_t *, uint8_t const *, size_t);
+
+static uint64_t hash_bulk(uint8_t const *p, size_t len, uint64_t seed, AccumulateFnc accumulate_fnc)
+{
+    uint64_t acc[8] = {
+        PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3,
+        PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1
+    };
+    size_t stripes = len / HASH_STRIPE_SIZE;
+    accumulate_fnc(acc, p, stripes);
+    for (size_t i = 0; i < 8; i += 2) {
+        seed ^= wymix(acc[i] ^ s_wyp[i / 2], acc[i + 1] ^ seed);
+    }
+    size_t tail = len - stripes * HASH_STRIPE_SIZE;
+    return wyhash(p + stripes * HASH_STRIPE_SIZE, tail, seed ^ len);
+}
+
+uint64_t hash64_seeded(void const *buf, size_t size, uint64_t seed)
+{
+    if (size >= HASH_BULK_THRESHOLD) {
+        return hash_bulk((uint8_t const *) buf, size, seed, accumulate);
+    }
+    return wyhash((uint8_t const *) buf, size, seed);
+}
+
+uint64_t hash64(void const *buf, size_t size)
+{
+    return hash64_seeded(buf, size, 0);
+}
+
+uint64_t hash64_u64(uint64_t val)
+{
+    return wymix(val ^ s_wyp[0], s_wyp[1]);
+}
+
+uint64_t hash64_ptr(void const *ptr)
+{
+    return hash64_u64((uint64_t) (uintptr_t) ptr);
+}
+
+uint64_t hash64_blend(uint64_t h1, uint64_t h2)
+{
+    return wymix(h1 ^ s_wyp[2], h2 ^ s_wyp[3]);
+}
+
+unsigned int hash(void const *buf, size_t size)
+{
+    return (unsigned int) hash64(buf, size);
 }
 
 unsigned int hashptr(void const *ptr)
 {
-    return hash(&ptr, sizeof(void *));
+    return (unsigned int) hash64_ptr(ptr);
 }
 
 unsigned int hashlong(long val)
 {
-    return hash(&val, sizeof(long));
+    return (unsigned int) hash64_u64((uint64_t) val);
 }
 
 unsigned int hashdouble(double val)
 {
-    return hash(&val, sizeof(double));
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return (unsigned int) hash64_u64(bits);
 }
 
 unsigned int hashblend(unsigned int h1, unsigned int h2)
 {
-    unsigned int arr[] = { h1, h2 };
-    return hash(arr, sizeof(arr));
+    return (unsigned int) hash64_blend(h1, h2);
 }
 
 unsigned int hashstr(char const *str)
 {
     return hash(str, strlen(str));
 }
+
+#ifdef HASH_TEST
+
+#include <stdio.h>
+#include <time.h>
+
+#define NUM_KEYS (256 * 1024)
+#define ROUNDS 20
+
+static unsigned int djb2(void const *buf, size_t size)
+{
+    unsigned int         h = 5381;
+    unsigned char const *data = (unsigned char const *) buf;
+    for (size_t i = 0; i < size; i++) {
+        h = ((h << 5) + h) + data[i];
+    }
+    return h;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    char  *ptr;
+    size_t length;
+} Key;
+
+static Key *s_keys;
+
+static void make_identifiers()
+{
+    static char const *words[] = { "buffer", "lexer", "token", "scope", "type", "node", "json", "value", "peek", "next", "index", "line" };
+    for (size_t ix = 0; ix < NUM_KEYS; ++ix) {
+        char buf[64];
+        int  len = snprintf(buf, sizeof(buf), "%s_%s%zu", words[ix % 12], words[(ix / 12) % 12], ix / 144);
+        s_keys[ix].ptr = strdup(buf);
+        s_keys[ix].length = len;
+    }
+}
+
+static void make_paths()
+{
+    for (size_t ix = 0; ix < NUM_KEYS; ++ix) {
+        char buf[128];
+        int  len = snprintf(buf, sizeof(buf), "/Users/jan/projects/eddy_v2/scribble/src/module%zu/file_%zu.c", ix % 97, ix);
+        s_keys[ix].ptr = strdup(buf);
+        s_keys[ix].length = len;
+    }
+}
+
+static void free_keys()
+{
+    for (size_t ix = 0; ix < NUM_KEYS; ++ix) {
+        free(s_keys[ix].ptr);
+    }
+}
+
+static size_t collisions(uint64_t (*fnc)(void const *, size_t))
+{
+    size_t   buckets = 2 * NUM_KEYS;
+    uint8_t *used = calloc(buckets, 1);
+    size_t   ret = 0;
+    for (size_t ix = 0; ix < NUM_KEYS; ++ix) {
+        size_t b = fnc(s_keys[ix].ptr, s_keys[ix].length) & (buckets - 1);
+        ret += used[b];
+        used[b] = 1;
+    }
+    free(used);
+    return ret;
+}
+
+static uint64_t djb2_64(void const *buf, size_t size)
+{
+    return djb2(buf, size);
+}
+
+static void bench(char const *name)
+{
+    uint64_t sink = 0;
+    double   start = now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (size_t ix = 0; ix < NUM_KEYS; ++ix) {
+            sink += djb2(s_keys[ix].ptr, s_keys[ix].length);
+        }
+    }
+    double djb2_time = now() - start;
+    start = now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (size_t ix = 0; ix < NUM_KEYS; ++ix) {
+            sink += hash64(s_keys[ix].ptr, s_keys[ix].length);
+        }
+    }
+    double hash64_time = now() - start;
+    double n = (double) NUM_KEYS * ROUNDS;
+    printf("%-12s djb2 %6.2f ns/key %7zu collisions | hash64 %6.2f ns/key %7zu collisions (%llx)\n",
+        name, djb2_time * 1e9 / n, collisions(djb2_64), hash64_time * 1e9 / n, collisions(hash64), (unsigned long long) sink & 0xF);
+}
+
+static void bench_bulk()
+{
+    size_t   size = 16 * 1024 * 1024;
+    uint8_t *buf = malloc(size);
+    for (size_t ix = 0; ix < size; ++ix) {
+        buf[ix] = (uint8_t) (ix * 131 + (ix >> 9));
+    }
+    for (size_t len = HASH_BULK_THRESHOLD - 3; len < 4 * HASH_BULK_THRESHOLD; len += 61) {
+        if (hash_bulk(buf + 1, len, 7, accumulate) != hash_bulk(buf + 1, len, 7, accumulate_scalar)) {
+            fprintf(stderr, "Vector and scalar bulk hashes differ for length %zu\n", len);
+            exit(1);
+        }
+    }
+    uint64_t sink = 0;
+    double   start = now();
+    sink += djb2(buf, size);
+    double djb2_time = now() - start;
+    start = now();
+    sink += hash64(buf, size);
+    double hash64_time = now() - start;
+    printf("%-12s djb2 %6.2f GB/s                    | hash64 %6.2f GB/s (%llx)\n",
+        "16 MiB", size / djb2_time / 1e9, size / hash64_time / 1e9, (unsigned long long) sink & 0xF);
+    free(buf);
+}
+
+int main()
+{
+    s_keys = malloc(NUM_KEYS * sizeof(Key));
+    make_identifiers();
+    bench("identifiers");
+    free_keys();
+    make_paths();
+    bench("paths");
+    free_keys();
+    bench_bulk();
+    free(s_keys);
+    return 0;
+}
+
+#endif /* HASH_TEST */
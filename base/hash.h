@@ -10,6 +10,11 @@
 #ifndef BASE_HASH_H
 #define BASE_HASH_H
 
+uint64_t     hash64(void const *buf, size_t size);
+uint64_t     hash64_seeded(void const *buf, size_t size, uint64_t seed);
+uint64_t     hash64_u64(uint64_t val);
+uint64_t     hash64_ptr(void const *ptr);
+uint64_t     hash64_blend(uint64_t h1, uint64_t h2);
 unsigned int hash(void const *buf, size_t size);
 unsigned int hashptr(void const *ptr);
 unsigned int hashlong(long val);
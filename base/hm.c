@@ -6,76 +6,311 @@
 
 #include <base/hm.h>
 
-typedef struct {
-    unsigned int bucket;
-    size_t       entry;
-} EntryIndex;
+#define HM_INITIAL_CAPACITY 16
 
-OPTIONAL(EntryIndex);
+static uint64_t sv_key_hash(void const *key)
+{
+    return sv_hash64(*((StringView *) key));
+}
+
+static bool sv_key_eq(void const *key1, void const *key2)
+{
+    return sv_eq(*((StringView *) key1), *((StringView *) key2));
+}
+
+HashMap hm_create(size_t key_size, size_t value_size, HashFnc hash, HashEqFnc eq)
+{
+    assert(key_size > 0 && hash != NULL && eq != NULL);
+    HashMap ret = { 0 };
+    ret.key_size = key_size;
+    ret.value_size = value_size;
+    ret.stride = (key_size + value_size + 7) & ~(size_t) 7;
+    ret.hash = hash;
+    ret.eq = eq;
+    return ret;
+}
+
+static void hm_initialize(HashMap *hm)
+{
+    if (!hm->key_size) {
+        *hm = hm_create(sizeof(StringView), sizeof(StringView), sv_key_hash, sv_key_eq);
+    }
+}
+
+static inline char *entry_at(HashMap *hm, size_t ix)
+{
+    return hm->entries + ix * hm->stride;
+}
+
+// Two scratch entries live past the end of the entries array. They hold the
+// entry being displaced while Robin Hood insertion swaps its way down a
+// probe sequence.
+static void hm_allocate(HashMap *hm, size_t capacity)
+{
+    hm->capacity = capacity;
+    hm->slots = calloc(capacity, sizeof(HashSlot));
+    hm->entries = malloc((capacity + 2) * hm->stride);
+    if (!hm->slots || !hm->entries) {
+        fatal("Out of memory allocating hash map of capacity %zu", capacity);
+    }
+}
+
+static void *hm_insert(HashMap *hm, uint32_t hash, void const *key, void const *value);
 
-void initialize_buckets(HashBuckets *buckets, size_t num_buckets)
+static void hm_rehash(HashMap *hm, size_t capacity)
 {
-    da_resize_HashEntries(buckets, num_buckets);
-    buckets->size = 0;
-    for (size_t ix = 0; ix < num_buckets; ++ix) {
-        da_append_HashEntries(buckets, (HashEntries) { 0 });
+    HashSlot *old_slots = hm->slots;
+    char     *old_entries = hm->entries;
+    size_t    old_capacity = hm->capacity;
+    hm_allocate(hm, capacity);
+    hm->size = 0;
+    for (size_t ix = 0; ix < old_capacity; ++ix) {
+        if (old_slots[ix].distance) {
+            char *entry = old_entries + ix * hm->stride;
+            hm_insert(hm, old_slots[ix].hash, entry, entry + hm->key_size);
+        }
+    }
+    free(old_slots);
+    free(old_entries);
+}
+
+void hm_reserve(HashMap *hm, size_t num)
+{
+    hm_initialize(hm);
+    size_t capacity = (hm->capacity) ? hm->capacity : HM_INITIAL_CAPACITY;
+    while (num > capacity - capacity / 8) {
+        capacity *= 2;
+    }
+    if (capacity > hm->capacity) {
+        hm_rehash(hm, capacity);
     }
 }
 
-void rehash_map(HashMap *hm)
+static OptionalUInt64 hm_find(HashMap *hm, uint32_t hash, void const *key)
 {
-    HashBuckets new_buckets = { 0 };
-    initialize_buckets(&new_buckets, hm->buckets.size * 2);
-    for (size_t bix = 0; bix < hm->buckets.size; ++bix) {
-        HashEntries *entries = hm->buckets.elements + bix;
-        for (size_t eix = 0; eix < entries->size; ++eix) {
-            HashEntry    entry = entries->elements[eix];
-            unsigned int h = sv_hash(&entry.key) % new_buckets.size;
-            da_append_HashEntry(new_buckets.elements + h, entry);
+    if (!hm->size) {
+        RETURN_EMPTY(UInt64);
+    }
+    size_t   mask = hm->capacity - 1;
+    size_t   ix = hash & mask;
+    uint32_t distance = 1;
+    while (hm->slots[ix].distance >= distance) {
+        if (hm->slots[ix].hash == hash && hm->eq(entry_at(hm, ix), key)) {
+            RETURN_VALUE(UInt64, ix);
         }
+        ix = (ix + 1) & mask;
+        ++distance;
     }
-    da_free_HashEntries(&hm->buckets);
-    hm->buckets = new_buckets;
+    RETURN_EMPTY(UInt64);
 }
 
-OptionalEntryIndex find_entry(HashMap *hm, StringView key)
+// Assumes key is not in the map and there is room for one more entry.
+// Returns a pointer to the value of the inserted entry.
+static void *hm_insert(HashMap *hm, uint32_t hash, void const *key, void const *value)
 {
-    unsigned int h = sv_hash(&key) % hm->buckets.size;
-    HashEntries *bucket = hm->buckets.elements + h;
-    for (size_t ix = 0; ix < bucket->size; ++ix) {
-        if (sv_eq(bucket->elements[ix].key, key)) {
-            RETURN_VALUE(EntryIndex, ((EntryIndex) { h, ix }));
+    size_t   mask = hm->capacity - 1;
+    size_t   ix = hash & mask;
+    HashSlot carry = { .distance = 1, .hash = hash };
+    char    *carry_entry = entry_at(hm, hm->capacity);
+    char    *swap_entry = entry_at(hm, hm->capacity + 1);
+    char    *ret = NULL;
+    memcpy(carry_entry, key, hm->key_size);
+    if (hm->value_size) {
+        memcpy(carry_entry + hm->key_size, value, hm->value_size);
+    }
+    while (true) {
+        HashSlot *slot = hm->slots + ix;
+        if (!slot->distance) {
+            *slot = carry;
+            memcpy(entry_at(hm, ix), carry_entry, hm->stride);
+            ++hm->size;
+            return (ret) ? ret : entry_at(hm, ix) + hm->key_size;
         }
+        if (slot->distance < carry.distance) {
+            HashSlot tmp = *slot;
+            *slot = carry;
+            carry = tmp;
+            memcpy(swap_entry, entry_at(hm, ix), hm->stride);
+            memcpy(entry_at(hm, ix), carry_entry, hm->stride);
+            memcpy(carry_entry, swap_entry, hm->stride);
+            if (!ret) {
+                ret = entry_at(hm, ix) + hm->key_size;
+            }
+        }
+        ix = (ix + 1) & mask;
+        ++carry.distance;
     }
-    RETURN_EMPTY(EntryIndex);
 }
 
-void hm_put(HashMap *hm, StringView key, StringView value)
+void *hm_put_raw(HashMap *hm, void const *key, void const *value)
+{
+    hm_initialize(hm);
+    uint32_t       hash = (uint32_t) hm->hash(key);
+    OptionalUInt64 ix_maybe = hm_find(hm, hash, key);
+    if (ix_maybe.has_value) {
+        char *entry = entry_at(hm, ix_maybe.value);
+        if (hm->value_size) {
+            memcpy(entry + hm->key_size, value, hm->value_size);
+        }
+        return entry + hm->key_size;
+    }
+    hm_reserve(hm, hm->size + 1);
+    return hm_insert(hm, hash, key, value);
+}
+
+void *hm_get_raw(HashMap *hm, void const *key)
+{
+    if (!hm->size) {
+        return NULL;
+    }
+    OptionalUInt64 ix_maybe = hm_find(hm, (uint32_t) hm->hash(key), key);
+    if (!ix_maybe.has_value) {
+        return NULL;
+    }
+    return entry_at(hm, ix_maybe.value) + hm->key_size;
+}
+
+bool hm_remove_raw(HashMap *hm, void const *key)
 {
-    if (hm->buckets.size == 0) {
-        initialize_buckets(&hm->buckets, 4);
+    if (!hm->size) {
+        return false;
     }
-    if ((float) (hm->size + 1) / (float) (hm->buckets.size) > 0.75) {
-        rehash_map(hm);
-        da_resize_HashEntries(&hm->buckets, 2 * hm->buckets.size);
+    OptionalUInt64 ix_maybe = hm_find(hm, (uint32_t) hm->hash(key), key);
+    if (!ix_maybe.has_value) {
+        return false;
     }
-    unsigned int bucket = sv_hash(&key) % hm->buckets.size;
-    da_append_HashEntry(hm->buckets.elements + bucket, (HashEntry) { .key = key, .value = value });
+    size_t mask = hm->capacity - 1;
+    size_t ix = ix_maybe.value;
+    size_t next = (ix + 1) & mask;
+    while (hm->slots[next].distance > 1) {
+        hm->slots[ix] = hm->slots[next];
+        --hm->slots[ix].distance;
+        memcpy(entry_at(hm, ix), entry_at(hm, next), hm->stride);
+        ix = next;
+        next = (next + 1) & mask;
+    }
+    hm->slots[ix] = (HashSlot) { 0 };
+    --hm->size;
+    return true;
+}
+
+void hm_clear(HashMap *hm)
+{
+    if (hm->slots) {
+        memset(hm->slots, 0, hm->capacity * sizeof(HashSlot));
+    }
+    hm->size = 0;
+}
+
+void hm_free(HashMap *hm)
+{
+    free(hm->slots);
+    free(hm->entries);
+    hm->slots = NULL;
+    hm->entries = NULL;
+    hm->size = 0;
+    hm->capacity = 0;
+}
+
+void hm_put(HashMap *hm, StringView key, StringView value)
+{
+    hm_initialize(hm);
+    assert(hm->key_size == sizeof(StringView) && hm->value_size == sizeof(StringView));
+    hm_put_raw(hm, &key, &value);
 }
 
 bool hm_has(HashMap *hm, StringView key)
 {
-    OptionalEntryIndex entry_maybe = find_entry(hm, key);
-    return entry_maybe.has_value;
+    return hm_get_raw(hm, &key) != NULL;
 }
 
 OptionalStringView hm_get(HashMap *hm, StringView key)
 {
-    OptionalEntryIndex entry_maybe = find_entry(hm, key);
-    if (entry_maybe.has_value) {
-        HashEntries *bucket = hm->buckets.elements + entry_maybe.value.bucket;
-        HashEntry *entry = bucket->elements + entry_maybe.value.entry;
-        RETURN_VALUE(StringView, entry->value);
+    StringView *value = hm_get_raw(hm, &key);
+    if (value) {
+        RETURN_VALUE(StringView, *value);
     }
     RETURN_EMPTY(StringView);
 }
+
+bool hm_remove(HashMap *hm, StringView key)
+{
+    return hm_remove_raw(hm, &key);
+}
+
+HashMapIterator hm_iterator(HashMap *hm)
+{
+    return (HashMapIterator) { .hm = hm, .index = 0 };
+}
+
+bool hm_next(HashMapIterator *it)
+{
+    HashMap *hm = it->hm;
+    while (it->index < hm->capacity) {
+        size_t ix = it->index++;
+        if (hm->slots[ix].distance) {
+            it->key = entry_at(hm, ix);
+            it->value = entry_at(hm, ix) + hm->key_size;
+            return true;
+        }
+    }
+    it->key = it->value = NULL;
+    return false;
+}
+
+#ifdef HM_TEST
+
+#include <base/hash.h>
+
+static uint64_t int_hash(void const *key)
+{
+    return hash64_u64(*((long *) key));
+}
+
+static bool int_eq(void const *key1, void const *key2)
+{
+    return *((long *) key1) == *((long *) key2);
+}
+
+int main()
+{
+    HashMap hm = { 0 };
+    hm_put(&hm, sv_from("foo"), sv_from("bar"));
+    hm_put(&hm, sv_from("foo"), sv_from("baz"));
+    assert(hm.size == 1);
+    assert(sv_eq_cstr(MUST_OPTIONAL(StringView, hm_get(&hm, sv_from("foo"))), "baz"));
+    assert(!hm_has(&hm, sv_from("quux")));
+    assert(hm_remove(&hm, sv_from("foo")));
+    assert(!hm_has(&hm, sv_from("foo")));
+    assert(hm.size == 0);
+    hm_free(&hm);
+
+    HashMap ints = hm_create(sizeof(long), sizeof(long), int_hash, int_eq);
+    long    num = 100000;
+    for (long ix = 0; ix < num; ++ix) {
+        long value = ix * 2;
+        hm_put_raw(&ints, &ix, &value);
+    }
+    assert(ints.size == num);
+    for (long ix = 0; ix < num; ix += 2) {
+        assert(hm_remove_raw(&ints, &ix));
+    }
+    assert(ints.size == num / 2);
+    for (long ix = 0; ix < num; ++ix) {
+        long *value = hm_get_raw(&ints, &ix);
+        assert((ix % 2 == 0) == (value == NULL));
+        assert(!value || *value == ix * 2);
+    }
+    size_t          count = 0;
+    HashMapIterator it = hm_iterator(&ints);
+    while (hm_next(&it)) {
+        assert(*((long *) it.value) == *((long *) it.key) * 2);
+        ++count;
+    }
+    assert(count == ints.size);
+    hm_free(&ints);
+    printf("hm_test: OK\n");
+    return 0;
+}
+
+#endif /* HM_TEST */
@@ -7,27 +7,57 @@
 #ifndef BASE_HM_H
 #define BASE_HM_H
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #include <base/sv.h>
 
-typedef unsigned int (*HashFnc)(void const *);
+typedef uint64_t (*HashFnc)(void const *);
+typedef bool (*HashEqFnc)(void const *, void const *);
 
 typedef struct {
-    StringView key;
-    StringView value;
-} HashEntry;
-
-DA_WITH_NAME(HashEntry, HashEntries);
-DA_WITH_NAME(HashEntries, HashBuckets);
+    uint32_t distance; // Probe sequence length + 1. 0 means the slot is empty.
+    uint32_t hash;
+} HashSlot;
 
+/*
+ * Open-addressing hash map using Robin Hood probing with backward-shift
+ * deletion. Keys and values are stored inline as blobs of key_size and
+ * value_size bytes. A zero-initialized HashMap maps StringView keys to
+ * StringView values and hashes them with sv_hash64; use hm_create for other
+ * key or value types or to swap the hash function.
+ */
 typedef struct {
-    size_t      size;
-    HashBuckets buckets;
+    size_t    size;
+    size_t    capacity;
+    size_t    key_size;
+    size_t    value_size;
+    size_t    stride;
+    HashFnc   hash;
+    HashEqFnc eq;
+    HashSlot *slots;
+    char     *entries;
 } HashMap;
 
+typedef struct {
+    HashMap *hm;
+    size_t   index;
+    void    *key;
+    void    *value;
+} HashMapIterator;
+
+extern HashMap            hm_create(size_t key_size, size_t value_size, HashFnc hash, HashEqFnc eq);
+extern void               hm_free(HashMap *hm);
+extern void               hm_clear(HashMap *hm);
+extern void               hm_reserve(HashMap *hm, size_t num);
+extern void              *hm_put_raw(HashMap *hm, void const *key, void const *value);
+extern void              *hm_get_raw(HashMap *hm, void const *key);
+extern bool               hm_remove_raw(HashMap *hm, void const *key);
 extern void               hm_put(HashMap *hm, StringView key, StringView value);
 extern bool               hm_has(HashMap *hm, StringView key);
 extern OptionalStringView hm_get(HashMap *hm, StringView key);
+extern bool               hm_remove(HashMap *hm, StringView key);
+extern HashMapIterator    hm_iterator(HashMap *hm);
+extern bool               hm_next(HashMapIterator *it);
 
 #endif /* BASE_HM_H */
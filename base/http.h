@@ -131,6 +131,33 @@ typedef struct {
 
 ERROR_OR_ALIAS(HttpResponse, HttpResponse);
 
+/*
+ * How requests and responses are put on the wire. HTTP_FRAMING_TEXT is plain
+ * HTTP/1.1, which is easy to follow in traces. HTTP_FRAMING_BINARY sends each
+ * message as a fixed-size frame header followed by the URL, the headers, and
+ * the body, without any text to parse. Both ends agree on binary framing
+ * during the /hello handshake; see http_hello and http_hello_respond.
+ * In-process sockets always use binary framing, and pass each frame to the
+ * other thread as a buffer instead of writing it out.
+ */
+typedef enum {
+    HTTP_FRAMING_TEXT = 0,
+    HTTP_FRAMING_BINARY,
+} HttpFraming;
+
+/*
+ * Pipelining: http_request_pipeline sends a request without waiting for the
+ * response. Responses to pipelined requests are read and dropped by the next
+ * http_response_receive or http_pipeline_flush, and once HTTP_PIPELINE_DEPTH
+ * of them are outstanding. http_batch sends a number of requests and
+ * collects all their responses, in order.
+ */
+#define HTTP_PIPELINE_DEPTH 32
+
+HttpFraming         http_framing(socket_t socket);
+void                http_set_framing(socket_t socket, HttpFraming framing);
+HttpStatus          http_hello(socket_t socket, bool binary);
+ErrorOrInt          http_hello_respond(socket_t socket, HttpRequest *request, bool binary);
 void                http_request_free(HttpRequest *request);
 ErrorOrInt          http_request_send(socket_t socket, HttpRequest *request);
 ErrorOrHttpRequest  http_request_receive(socket_t socket);
@@ -141,6 +168,10 @@ HttpResponse        http_get_request(socket_t socket, StringView url, StringList
 HttpResponse        http_post_request(socket_t socket, StringView url, JSONValue body);
 HttpStatus          http_get_message(socket_t socket, StringView url, StringList params);
 HttpStatus          http_post_message(socket_t socket, StringView url, JSONValue body);
+ErrorOrInt          http_request_pipeline(socket_t socket, HttpRequest *request);
+ErrorOrInt          http_pipeline_flush(socket_t socket);
+ErrorOrInt          http_batch(socket_t socket, HttpRequest *requests, size_t count, HttpResponse *responses);
+void                http_post_pipelined(socket_t socket, StringView url, JSONValue body);
 
 typedef HttpResponse (*HttpCallback)(void *ctx, HttpResponse response);
 
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <base/hm.h>
+#include <base/intern.h>
+#include <base/mutex.h>
+#include <base/threadonce.h>
+
+static HashMap     s_ids = { 0 };
+static StringViews s_strings = { 0 };
+static Allocator   s_alloc = { 0 };
+static Mutex       s_mutex;
+static size_t      s_bytes = 0;
+static size_t      s_lookups = 0;
+static size_t      s_hits = 0;
+
+THREAD_ONCE(s_intern_once);
+
+static uint64_t intern_key_hash(void const *key)
+{
+    return sv_hash64(*((StringView *) key));
+}
+
+static bool intern_key_eq(void const *key1, void const *key2)
+{
+    return sv_eq(*((StringView *) key1), *((StringView *) key2));
+}
+
+static void intern_report(void)
+{
+    InternStats stats = intern_stats();
+    trace(INTERN, "%zu strings, %zu bytes, %zu lookups, %.1f%% hits",
+        stats.strings, stats.bytes, stats.lookups,
+        (stats.lookups) ? 100.0 * (double) stats.hits / (double) stats.lookups : 0.0);
+}
+
+static void intern_init(void)
+{
+    s_mutex = mutex_create();
+    s_alloc = allocator_new();
+    s_ids = hm_create(sizeof(StringView), sizeof(InternID), intern_key_hash, intern_key_eq);
+    // Slot 0 is INTERN_NONE, which maps to the null string.
+    da_append_StringView(&s_strings, sv_null());
+    atexit(intern_report);
+}
+
+static InternID intern_locked(StringView sv, bool insert)
+{
+    ++s_lookups;
+    InternID *id = hm_get_raw(&s_ids, &sv);
+    if (id) {
+        ++s_hits;
+        return *id;
+    }
+    if (!insert) {
+        return INTERN_NONE;
+    }
+    char *copy = allocator_allocate(s_alloc, sv.length + 1);
+    memcpy(copy, sv.ptr, sv.length);
+    copy[sv.length] = '\0';
+    StringView canonical = { copy, sv.length };
+    InternID   ret = (InternID) s_strings.size;
+    da_append_StringView(&s_strings, canonical);
+    hm_put_raw(&s_ids, &canonical, &ret);
+    s_bytes += sv.length;
+    return ret;
+}
+
+static InternID intern(StringView sv, bool insert)
+{
+    if (sv_empty(sv)) {
+        return INTERN_NONE;
+    }
+    ONCE(s_intern_once, intern_init);
+    mutex_lock(&s_mutex);
+    InternID ret = intern_locked(sv, insert);
+    mutex_unlock(&s_mutex);
+    return ret;
+}
+
+InternID sv_intern_id(StringView sv)
+{
+    return intern(sv, true);
+}
+
+InternID sv_intern_find_id(StringView sv)
+{
+    return intern(sv, false);
+}
+
+StringView intern_string(InternID id)
+{
+    if (id == INTERN_NONE) {
+        return sv_null();
+    }
+    mutex_lock(&s_mutex);
+    assert(id < s_strings.size);
+    StringView ret = s_strings.strings[id];
+    mutex_unlock(&s_mutex);
+    return ret;
+}
+
+StringView sv_intern(StringView sv)
+{
+    return intern_string(sv_intern_id(sv));
+}
+
+StringView sv_intern_cstr(char const *s)
+{
+    return sv_intern(sv_from(s));
+}
+
+// Returns the canonical copy of sv if it was interned before, and the null
+// string otherwise. Useful for lookups in tables keyed on interned strings:
+// a string that was never interned cannot be a key.
+StringView sv_intern_find(StringView sv)
+{
+    return intern_string(sv_intern_find_id(sv));
+}
+
+InternStats intern_stats()
+{
+    InternStats ret = { 0 };
+    ONCE(s_intern_once, intern_init);
+    mutex_lock(&s_mutex);
+    ret.strings = s_strings.size - 1;
+    ret.bytes = s_bytes;
+    ret.lookups = s_lookups;
+    ret.hits = s_hits;
+    mutex_unlock(&s_mutex);
+    return ret;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2024, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef BASE_INTERN_H
+#define BASE_INTERN_H
+
+#include <stdint.h>
+
+#include <base/sv.h>
+
+/*
+ * Process-wide string interning. Every distinct string is stored once, in
+ * an arena that lives until exit, and gets a stable small id. Two interned
+ * StringViews are equal if and only if their ptr fields are equal. The
+ * table is safe to use from multiple threads.
+ */
+
+typedef uint32_t InternID;
+
+#define INTERN_NONE ((InternID) 0)
+
+typedef struct {
+    size_t strings;
+    size_t bytes;
+    size_t lookups;
+    size_t hits;
+} InternStats;
+
+extern StringView  sv_intern(StringView sv);
+extern StringView  sv_intern_cstr(char const *s);
+extern StringView  sv_intern_find(StringView sv);
+extern InternID    sv_intern_id(StringView sv);
+extern InternID    sv_intern_find_id(StringView sv);
+extern StringView  intern_string(InternID id);
+extern InternStats intern_stats();
+
+static inline bool sv_interned_eq(StringView s1, StringView s2)
+{
+    return s1.ptr == s2.ptr;
+}
+
+#endif /* BASE_INTERN_H */
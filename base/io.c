@@ -5,6 +5,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <poll.h>
@@ -12,6 +13,7 @@
 #include <sys/fcntl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 
@@ -19,7 +21,21 @@
 #include <base/io.h>
 
 #define BUF_SZ 65536
+
+// glibc only declares IOV_MAX in X/Open and GNU builds.
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 #define NO_SOCKET ((socket_t) - 1)
+#define IN_PROCESS_FD (-2)
+
+// One Channel per direction. Closing either socket closes both channels,
+// which wakes up and fails the other end. The link is freed when both
+// sockets are closed; messages still queued at that point are dropped.
+struct in_process_link {
+    Channel    channels[2];
+    atomic_int open;
+};
 
 DA_IMPL(Socket);
 
@@ -43,11 +59,17 @@ Socket * socket_get(socket_t socket)
 
 socket_t socket_allocate(int fd)
 {
+    // Sockets must not leak into spawned processes.
+    if (fd >= 0) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
     for (size_t ix = 0; ix < s_sockets.size; ++ix) {
         if (s_sockets.elements[ix].fd == -1) {
             Socket *s = s_sockets.elements + ix;
             s->fd = fd;
-            s->buffer.length = 0;
+            s->framing = 0;
+            s->pending = 0;
+            s->start = s->end = 0;
             return ix;
         }
     }
@@ -57,8 +79,62 @@ socket_t socket_allocate(int fd)
 
 void socket_close(socket_t socket)
 {
-    close(s_sockets.elements[socket].fd);
-    s_sockets.elements[socket].fd = -1;
+    Socket *s = s_sockets.elements + socket;
+    if (s->link != NULL) {
+        channel_close(s->link->channels + 0);
+        channel_close(s->link->channels + 1);
+        if (atomic_fetch_sub(&s->link->open, 1) == 1) {
+            free(s->link);
+        }
+        s->link = NULL;
+    } else {
+        close(s->fd);
+    }
+    s->fd = -1;
+    s->framing = 0;
+    s->pending = 0;
+    s->start = s->end = 0;
+}
+
+void socket_in_process_pair(socket_t *a, socket_t *b)
+{
+    struct in_process_link *link = calloc(1, sizeof(struct in_process_link));
+    if (link == NULL) {
+        fatal("Out of memory allocating in-process socket pair");
+    }
+    atomic_init(&link->open, 2);
+    *a = socket_allocate(IN_PROCESS_FD);
+    *b = socket_allocate(IN_PROCESS_FD);
+    s_sockets.elements[*a].link = link;
+    s_sockets.elements[*a].side = 0;
+    s_sockets.elements[*b].link = link;
+    s_sockets.elements[*b].side = 1;
+}
+
+bool socket_is_in_process(socket_t socket)
+{
+    return s_sockets.elements[socket].link != NULL;
+}
+
+ErrorOrInt socket_send(socket_t socket, void *message)
+{
+    Socket *s = s_sockets.elements + socket;
+    assert(s->link != NULL);
+    if (!channel_send(s->link->channels + s->side, message)) {
+        ERROR(Int, IOError, 0, "Socket connection closed");
+    }
+    RETURN(Int, 0);
+}
+
+ErrorOrVoidPtr socket_receive(socket_t socket)
+{
+    Socket *s = s_sockets.elements + socket;
+    assert(s->link != NULL);
+    void *ret = channel_receive(s->link->channels + 1 - s->side);
+    if (ret == NULL) {
+        ERROR(VoidPtr, IOError, 0, "Socket connection closed");
+    }
+    RETURN(VoidPtr, ret);
 }
 
 ErrorOrInt fd_make_nonblocking(int fd)
@@ -186,12 +262,50 @@ ErrorOrSocket tcpip_socket_connect(StringView ip_address, int port)
     RETURN(Socket, socket_allocate(conn_fd));
 }
 
+// Makes sure the buffer can hold needed bytes from the start of the
+// unconsumed ones, and at least one more than are buffered. Unconsumed bytes
+// are only moved to the front when the space after them is too small, so
+// reading a run of short messages out of a full buffer doesn't move the rest
+// of it every time.
+static void socket_make_room(Socket *s, size_t needed)
+{
+    size_t unconsumed = s->end - s->start;
+    if (needed < unconsumed + 1) {
+        needed = unconsumed + 1;
+    }
+    if (s->capacity - s->start >= needed) {
+        return;
+    }
+    if (s->start > 0) {
+        memmove(s->buffer, s->buffer + s->start, unconsumed);
+        s->start = 0;
+        s->end = unconsumed;
+    }
+    if (needed <= s->capacity) {
+        return;
+    }
+    size_t capacity = (s->capacity > 0) ? s->capacity : BUF_SZ;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    s->buffer = realloc(s->buffer, capacity);
+    if (s->buffer == NULL) {
+        fatal("Out of memory growing socket buffer to %zu bytes", capacity);
+    }
+    s->capacity = capacity;
+}
+
+// Reads straight into the receive buffer until the socket has nothing more
+// to give. A full buffer is compacted, or grown if it holds nothing but
+// unconsumed bytes.
 ErrorOrSize read_available_bytes(Socket *s)
 {
-    char   buffer[BUF_SZ];
     size_t total = 0;
     while (true) {
-        ssize_t bytes_read = read(s->fd, buffer, BUF_SZ);
+        if (s->end == s->capacity) {
+            socket_make_room(s, s->end - s->start + 1);
+        }
+        ssize_t bytes_read = read(s->fd, s->buffer + s->end, s->capacity - s->end);
         if (bytes_read < 0) {
             if (errno == EAGAIN) {
                 break;
@@ -205,19 +319,19 @@ ErrorOrSize read_available_bytes(Socket *s)
             break;
         }
         total += bytes_read;
-        sb_append_chars(&s->buffer, buffer, bytes_read);
-        if (bytes_read < BUF_SZ) {
+        s->end += bytes_read;
+        if (s->end < s->capacity) {
             break;
         }
     }
     RETURN(Size, total);
 }
 
+// Waits until at least one byte more than what is buffered has arrived.
 ErrorOrSize socket_fill_buffer(Socket *s)
 {
-    TRY(Size, read_available_bytes(s));
-    if (s->buffer.length > 0) {
-        RETURN(Size, s->buffer.length);
+    if (TRY(Size, read_available_bytes(s)) > 0) {
+        RETURN(Size, s->end - s->start);
     }
 
     struct pollfd poll_fd = { 0 };
@@ -238,119 +352,144 @@ ErrorOrSize socket_fill_buffer(Socket *s)
             ERROR(Size, IOError, -1, "Socket connection closed");
         }
     }
-    TRY(Size, read_available_bytes(s));
-    assert(s->buffer.length > 0);
-    RETURN(Size, s->buffer.length);
+    if (TRY(Size, read_available_bytes(s)) == 0) {
+        ERROR(Size, IOError, -1, "Socket connection closed");
+    }
+    RETURN(Size, s->end - s->start);
 }
 
-ErrorOrStringView socket_read(socket_t socket, size_t count)
+size_t socket_buffered(socket_t socket)
 {
-    Socket       *s = s_sockets.elements + socket;
-    StringBuilder out = { 0 };
+    Socket *s = s_sockets.elements + socket;
+    return s->end - s->start;
+}
 
-    size_t total = 0;
+ErrorOrStringView socket_read(socket_t socket, size_t count)
+{
+    Socket *s = s_sockets.elements + socket;
     trace(SOCKET, "socket_read(%zu)", count);
-    do {
+    if (!count) {
+        RETURN(StringView, sv_null());
+    }
+    socket_make_room(s, count);
+    while (s->end - s->start < count) {
         TRY_TO(Size, StringView, socket_fill_buffer(s));
-        if (!count && (s->buffer.length > 0)) {
-            trace(SOCKET, "socket_read(%zu) => NULL", count);
-            RETURN(StringView, sv_null());
-        }
-        size_t available = s->buffer.length;
-        size_t remaining = count - total;
-        if (available <= remaining) {
-            if (out.length == 0) {
-                out = s->buffer;
-                s->buffer = (StringBuilder) {0};
-            } else {
-                sb_append_sv(&out, s->buffer.view);
-                s->buffer.length = 0;
-            }
-            total += available;
-        } else {
-            if (out.length == 0) {
-                out = s->buffer;
-                s->buffer = sb_copy_chars(out.ptr + remaining, available - remaining);
-                out.length = remaining;
-            } else {
-                sb_append_chars(&out, s->buffer.view.ptr, remaining);
-                memmove((char *) s->buffer.ptr, s->buffer.ptr + remaining, available - remaining);
-                s->buffer.length -= available - remaining;
-            }
-            total = count;
-        }
-        trace(SOCKET, "socket_read(%zu): read chunk of %zu total %zu", count, available, total);
-    } while (total < count);
-    trace(SOCKET, "socket_read(%zu) => %zu", count, out.view.length);
-    RETURN(StringView, out.view);
+        trace(SOCKET, "socket_read(%zu): %zu bytes available", count, s->end - s->start);
+    }
+    StringView ret = { s->buffer + s->start, count };
+    s->start += count;
+    trace(SOCKET, "socket_read(%zu) => %zu", count, ret.length);
+    RETURN(StringView, ret);
 }
 
+// The returned line does not include the line terminator, which can be
+// either "\n" or "\r\n".
 ErrorOrStringView socket_readln(socket_t socket)
 {
-    Socket       *s = s_sockets.elements + socket;
-    StringBuilder out = sb_create();
+    Socket *s = s_sockets.elements + socket;
+    size_t  scanned = 0;
     while (true) {
-        TRY_TO(Size, StringView, socket_fill_buffer(s));
-        trace(SOCKET, "socket_readln: %zu bytes available", s->buffer.length);
-        for (size_t ix = 0; ix < s->buffer.length; ++ix) {
-            char ch = s->buffer.ptr[ix];
-            switch (ch) {
-            case '\r':
-                break;
-            case '\n':
-                if (ix < s->buffer.length - 1) {
-                    memmove((char *) s->buffer.ptr, s->buffer.ptr + ix + 1, s->buffer.length - ix + 1);
-                }
-                s->buffer.length -= ix + 1;
-                trace(SOCKET, "socket_readln: %zu bytes consumed", ix + 1);
-                RETURN(StringView, out.view);
-            default:
-                sb_append_char(&out, ch);
-                break;
+        char *line = s->buffer + s->start;
+        char *eol = (s->end - s->start > scanned) ? memchr(line + scanned, '\n', s->end - s->start - scanned) : NULL;
+        if (eol != NULL) {
+            size_t consumed = eol - line + 1;
+            size_t length = consumed - 1;
+            if (length > 0 && line[length - 1] == '\r') {
+                --length;
             }
+            s->start += consumed;
+            trace(SOCKET, "socket_readln: %zu bytes consumed", consumed);
+            RETURN(StringView, ((StringView) { line, length }));
         }
+        scanned = s->end - s->start;
         trace(SOCKET, "socket_readln: buffer depleted");
-        s->buffer.length = 0;
+        TRY_TO(Size, StringView, socket_fill_buffer(s));
     }
 }
 
 ErrorOrSize socket_write(socket_t socket, char const *buffer, size_t num)
 {
-    Socket *s = s_sockets.elements + socket;
-    ssize_t total = 0;
-    trace(SOCKET, "socket_write(%zu)", num);
+    StringView part = { buffer, num };
+    return socket_writev(socket, &part, 1);
+}
+
+static ErrorOrInt socket_wait_writable(Socket *s)
+{
+    struct pollfd poll_fd = { 0 };
+    poll_fd.fd = s->fd;
+    poll_fd.events = POLLOUT;
+    while (poll(&poll_fd, 1, -1) == -1) {
+        if (errno != EINTR) {
+            ERROR(Int, IOError, 0, "Error polling socket connection: %s", errorcode_to_string(errno));
+        }
+    }
+    if (poll_fd.revents & (POLLHUP | POLLERR)) {
+        ERROR(Int, IOError, -1, "Socket connection closed");
+    }
+    RETURN(Int, 0);
+}
+
+// Writes all parts with as few writev calls as the socket allows, so that for
+// example an HTTP header and body go out together without being copied into
+// one buffer first.
+ErrorOrSize socket_writev(socket_t socket, StringView const *parts, size_t count)
+{
+    Socket      *s = s_sockets.elements + socket;
+    struct iovec iov[count];
+    size_t       num = 0;
+    int          iov_count = 0;
+    for (size_t ix = 0; ix < count; ++ix) {
+        if (parts[ix].length > 0) {
+            iov[iov_count++] = (struct iovec) { .iov_base = (void *) parts[ix].ptr, .iov_len = parts[ix].length };
+            num += parts[ix].length;
+        }
+    }
+    trace(SOCKET, "socket_writev(%zu bytes in %d parts)", num, iov_count);
+    struct iovec *current = iov;
+    size_t        total = 0;
     while (total < num) {
-        ssize_t written = write(s->fd, buffer + total, num - total);
+        int     iov_left = iov_count - (int) (current - iov);
+        ssize_t written = writev(s->fd, current, (iov_left < IOV_MAX) ? iov_left : IOV_MAX);
         if (written < 0) {
             if (errno == EAGAIN) {
-                trace(SOCKET, "socket_write(%zu) - EAGAIN (retrying)", num);
+                trace(SOCKET, "socket_writev(%zu) - EAGAIN (waiting)", num);
+                TRY_TO(Int, Size, socket_wait_writable(s));
+                continue;
+            }
+            if (errno == EINTR) {
                 continue;
             }
-            trace(SOCKET, "socket_write(%zu) - error %s", num, errorcode_to_string(errno));
+            trace(SOCKET, "socket_writev(%zu) - error %s", num, errorcode_to_string(errno));
             ERROR(Size, IOError, 0, "Error writing to socket: %s", errorcode_to_string(errno));
         }
         if (written == 0) {
-            trace(SOCKET, "socket_write(%zu) - incomplete write", num);
-            ERROR(Size, IOError, 0, "Incomplete write to socket: %d < %d", written, num);
+            trace(SOCKET, "socket_writev(%zu) - incomplete write", num);
+            ERROR(Size, IOError, 0, "Incomplete write to socket: %zu < %zu", total, num);
         }
-        trace(SOCKET, "socket_write: chunk %zu", written);
+        trace(SOCKET, "socket_writev: chunk %zd", written);
         total += written;
+        while (written > 0 && (size_t) written >= current->iov_len) {
+            written -= current->iov_len;
+            ++current;
+        }
+        if (written > 0) {
+            current->iov_base = (char *) current->iov_base + written;
+            current->iov_len -= written;
+        }
     }
-    trace(SOCKET, "socket_write: %zu", total);
+    trace(SOCKET, "socket_writev: %zu", total);
     RETURN(Size, total);
 }
 
 ErrorOrSize socket_writeln(socket_t socket, StringView sv)
 {
-    TRY(Size, socket_write(socket, sv.ptr, sv.length));
-    char eol = '\n';
-    TRY(Size, socket_write(socket, &eol, 1));
-    RETURN(Size, sv.length + 1);
+    StringView parts[2] = { sv, sv_from("\n") };
+    return socket_writev(socket, parts, 2);
 }
 
 ErrorOrStringView read_file_by_name(StringView file_name)
 {
-    int fd = open(sv_cstr(file_name, NULL), O_RDONLY);
+    int fd = open(sv_cstr(file_name, NULL), O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
         ERROR(StringView, IOError, errno, "Could not open file");
     }
@@ -362,7 +501,7 @@ ErrorOrStringView read_file_by_name(StringView file_name)
 ErrorOrStringView read_file_at(int dir_fd, StringView file_name)
 {
     char buf[file_name.length + 1];
-    int  fd = openat(dir_fd, sv_cstr(file_name, buf), O_RDONLY);
+    int  fd = openat(dir_fd, sv_cstr(file_name, buf), O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
         ERROR(StringView, IOError, errno, "Could not open file");
     }
@@ -384,7 +523,7 @@ ErrorOrStringView read_file(int fd)
 ErrorOrSize write_file_by_name(StringView file_name, StringView contents)
 {
     char buf[file_name.length + 1];
-    int  fd = open(sv_cstr(file_name, buf), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int  fd = open(sv_cstr(file_name, buf), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
     if (fd < 0) {
         ERROR(Size, IOError, errno, "Could not open file");
     }
@@ -396,7 +535,7 @@ ErrorOrSize write_file_by_name(StringView file_name, StringView contents)
 ErrorOrSize write_file_at(int dir_fd, StringView file_name, StringView contents)
 {
     char buf[file_name.length + 1];
-    int  fd = openat(dir_fd, sv_cstr(file_name, buf), O_RDONLY);
+    int  fd = openat(dir_fd, sv_cstr(file_name, buf), O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
         ERROR(Size, IOError, errno, "Could not open file");
     }
@@ -417,3 +556,73 @@ ErrorOrSize write_file(int fd, StringView contents)
     }
     RETURN(Size, total);
 }
+
+// #define IO_TEST
+#ifdef IO_TEST
+
+#include <pthread.h>
+
+#define LINES 10000
+#define BODY_SZ (1024 * 1024)
+
+static socket_t s_writer;
+static char    *s_body;
+
+static void *writer(void *)
+{
+    for (int ix = 0; ix < LINES; ++ix) {
+        char line[32];
+        snprintf(line, sizeof(line), "line %d", ix);
+        MUST(Size, socket_writeln(s_writer, sv_from(line)));
+    }
+    StringView parts[3] = { sv_from("Body\r\n"), (StringView) { s_body, BODY_SZ }, sv_from("done\n") };
+    MUST(Size, socket_writev(s_writer, parts, 3));
+    return NULL;
+}
+
+int main()
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        fatal("socketpair() failed");
+    }
+    MUST(Int, fd_make_nonblocking(fds[0]));
+    MUST(Int, fd_make_nonblocking(fds[1]));
+    socket_t reader = socket_allocate(fds[0]);
+    s_writer = socket_allocate(fds[1]);
+    s_body = malloc(BODY_SZ);
+    for (size_t ix = 0; ix < BODY_SZ; ++ix) {
+        s_body[ix] = (char) ('a' + ix % 26);
+    }
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, writer, NULL);
+    for (int ix = 0; ix < LINES; ++ix) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "line %d", ix);
+        StringView line = MUST(StringView, socket_readln(reader));
+        if (!sv_eq_cstr(line, expected)) {
+            fatal("Expected '%s', got '%.*s'", expected, SV_ARG(line));
+        }
+    }
+    if (!sv_eq_cstr(MUST(StringView, socket_readln(reader)), "Body")) {
+        fatal("Expected 'Body'");
+    }
+    StringView body = MUST(StringView, socket_read(reader, BODY_SZ));
+    if (body.length != BODY_SZ || memcmp(body.ptr, s_body, BODY_SZ) != 0) {
+        fatal("Body corrupted");
+    }
+    if (!sv_eq_cstr(MUST(StringView, socket_readln(reader)), "done")) {
+        fatal("Expected 'done'");
+    }
+    pthread_join(thread, NULL);
+    if (socket_buffered(reader) != 0) {
+        fatal("%zu bytes left in buffer", socket_buffered(reader));
+    }
+    printf("%d lines and a %d byte body, buffer capacity %zu\n", LINES, BODY_SZ, socket_get(reader)->capacity);
+    socket_close(reader);
+    socket_close(s_writer);
+    return 0;
+}
+
+#endif
@@ -9,6 +9,7 @@
 
 #include <netinet/in.h>
 
+#include <base/channel.h>
 #include <base/error_or.h>
 #include <base/sv.h>
 
@@ -17,14 +18,34 @@ ERROR_OR_ALIAS(Socket, socket_t);
 
 ERROR_OR_ALIAS(SockAddrIn, struct sockaddr_in);
 
+/*
+ * Received bytes live in buffer[start..end). Reads hand out views into this
+ * buffer instead of copies; a view stays valid until the next read on the
+ * same socket, which may move the unconsumed bytes to the front or grow the
+ * buffer. The framing and pending fields belong to the protocol spoken over
+ * the socket, see http.c.
+ *
+ * In-process sockets have no file descriptor. They connect two threads of
+ * the same process through a pair of Channels, and carry messages instead of
+ * bytes: socket_send hands a pointer to the other end and socket_receive
+ * takes one. Both fail once either end is closed.
+ */
 typedef struct {
-    int           fd;
-    StringBuilder buffer;
+    int                     fd;
+    int                     framing;
+    size_t                  pending;
+    char                   *buffer;
+    size_t                  capacity;
+    size_t                  start;
+    size_t                  end;
+    struct in_process_link *link;
+    int                     side;
 } Socket;
 
 DA_WITH_NAME(Socket, Sockets);
 
 Socket *          socket_get(socket_t socket);
+socket_t          socket_allocate(int fd);
 ErrorOrSockAddrIn tcpip_address_resolve(StringView ip_address);
 ErrorOrInt        fd_make_nonblocking(int fd);
 ErrorOrInt        socket_fd(socket_t socket);
@@ -33,9 +54,15 @@ ErrorOrSocket     tcpip_socket_listen(StringView ip_address, int port);
 ErrorOrSocket     socket_accept(socket_t socket);
 ErrorOrSocket     unix_socket_connect(StringView socket_name);
 ErrorOrSocket     tcpip_socket_connect(StringView ip_address, int port);
+void              socket_in_process_pair(socket_t *a, socket_t *b);
+bool              socket_is_in_process(socket_t socket);
+ErrorOrInt        socket_send(socket_t socket, void *message);
+ErrorOrVoidPtr    socket_receive(socket_t socket);
 ErrorOrStringView socket_read(socket_t socket, size_t count);
 ErrorOrStringView socket_readln(socket_t socket);
+size_t            socket_buffered(socket_t socket);
 ErrorOrSize       socket_write(socket_t socket, char const *buffer, size_t num);
+ErrorOrSize       socket_writev(socket_t socket, StringView const *parts, size_t count);
 ErrorOrSize       socket_writeln(socket_t socket, StringView sv);
 void              socket_close(socket_t socket);
 ErrorOrStringView read_file_by_name(StringView file_name);
@@ -7,9 +7,16 @@
 #include <stdarg.h>
 #include <stdlib.h>
 
-#include <ctype.h>
 #include <json.h>
 
+#include <base/charclass.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 DA_IMPL(JSONValue);
 DA_IMPL(JSONNVPair);
 
@@ -33,6 +40,20 @@ char const *JSONType_name(JSONType type)
     }
 }
 
+char const *JSONEvent_name(JSONEvent event)
+{
+    switch (event) {
+#undef S
+#define S(T)             \
+    case JSON_EVENT_##T: \
+        return #T;
+        JSONEVENTS(S)
+#undef S
+    default:
+        UNREACHABLE();
+    }
+}
+
 void json_encode_to_builder(JSONValue *value, JSONEncoder *encoder)
 {
     switch (value->type) {
@@ -142,6 +163,11 @@ JSONValue json_string(StringView sv)
     return (JSONValue) { .type = JSON_TYPE_STRING, .string = sv_copy(sv) };
 }
 
+JSONValue json_string_view(StringView sv)
+{
+    return (JSONValue) { .type = JSON_TYPE_STRING, .borrowed = true, .string = sv };
+}
+
 JSONValue json_number(double number)
 {
     return (JSONValue) { .type = JSON_TYPE_DOUBLE, .double_number = number };
@@ -171,6 +197,13 @@ JSONValue json_bool(bool value)
 
 void json_free(JSONValue value)
 {
+    if (value.borrowed) {
+        if (value.arena) {
+            Allocator alloc = *value.arena;
+            allocator_free(&alloc);
+        }
+        return;
+    }
     switch (value.type) {
     case JSON_TYPE_OBJECT: {
         for (size_t ix = 0; ix < value.object.size; ++ix) {
@@ -198,30 +231,21 @@ void json_free(JSONValue value)
 JSONValue json_move(JSONValue *from)
 {
     JSONValue dest = *from;
-    switch (from->type) {
-    case JSON_TYPE_OBJECT:
-        from->object = (JSONNVPairs) { 0 };
-        break;
-    case JSON_TYPE_STRING:
-        from->string = (StringView) { 0 };
-        break;
-    default:
-        break;
-    }
-    from->type = JSON_TYPE_NULL;
+    *from = json_null();
     return dest;
 }
 
 JSONValue json_copy(JSONValue value)
 {
     JSONValue ret = value;
+    ret.borrowed = false;
+    ret.arena = NULL;
     switch (value.type) {
     case JSON_TYPE_OBJECT: {
         ret.object = (JSONNVPairs) { 0 };
         for (size_t ix = 0; ix < value.object.size; ++ix) {
             JSONNVPair pair = *(da_element_JSONNVPair(&value.object, ix));
-            char       attr_name[pair.name.length + 1];
-            json_set(&ret, sv_cstr(pair.name, attr_name), json_copy(pair.value));
+            json_set_sv(&ret, pair.name, json_copy(pair.value));
         }
     } break;
     case JSON_TYPE_ARRAY: {
@@ -297,7 +321,7 @@ int json_compare(JSONValue a, JSONValue b)
 
 void json_append(JSONValue *array, JSONValue elem)
 {
-    assert(array->type == JSON_TYPE_ARRAY);
+    assert(array->type == JSON_TYPE_ARRAY && !array->borrowed);
     da_append_JSONValue(&array->array, elem);
 }
 
@@ -372,19 +396,107 @@ size_t json_len(JSONValue *array)
     return array->object.size;
 }
 
-static void _json_add_nvp(JSONValue *obj, StringView attr, JSONValue value)
+/*
+ * Objects with more than JSON_INDEX_THRESHOLD members keep a hash index of
+ * their members, so that lookups and json_set do not have to scan. The
+ * index is an open-addressing table of member positions plus one, stored
+ * behind the member array in the same allocation; it is built when an
+ * object grows past the threshold, and rebuilt when the member array moves
+ * or a member is deleted. The members themselves stay in insertion order.
+ */
+#define JSON_INDEX_THRESHOLD 8
+
+static size_t json_index_slots(size_t cap)
 {
-    assert(obj->type == JSON_TYPE_OBJECT);
-    for (size_t ix = 0; ix < obj->object.size; ++ix) {
-        JSONNVPair *p = da_element_JSONNVPair(&obj->object, ix);
-        if (sv_eq(attr, p->name)) {
-            json_free(p->value);
-            p->value = value;
-            return;
+    size_t ret = 16;
+    while (ret < 2 * cap) {
+        ret *= 2;
+    }
+    return ret;
+}
+
+static size_t json_object_bytes(size_t cap)
+{
+    size_t ret = cap * sizeof(JSONNVPair);
+    if (cap > JSON_INDEX_THRESHOLD) {
+        ret += json_index_slots(cap) * sizeof(uint32_t);
+    }
+    return ret;
+}
+
+static uint32_t *json_index(JSONNVPairs *object)
+{
+    return (uint32_t *) ((JSONNVPair *) object->elements + object->cap);
+}
+
+static void json_index_insert(JSONNVPairs *object, size_t ix)
+{
+    uint32_t *slots = json_index(object);
+    size_t    mask = json_index_slots(object->cap) - 1;
+    size_t    slot = sv_hash64(((JSONNVPair *) object->elements)[ix].name) & mask;
+    while (slots[slot]) {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = ix + 1;
+}
+
+static void json_index_build(JSONNVPairs *object)
+{
+    memset(json_index(object), 0, json_index_slots(object->cap) * sizeof(uint32_t));
+    for (size_t ix = 0; ix < object->size; ++ix) {
+        json_index_insert(object, ix);
+    }
+}
+
+static JSONNVPair *json_member(JSONNVPairs *object, StringView name)
+{
+    JSONNVPair *members = object->elements;
+    if (object->size <= JSON_INDEX_THRESHOLD) {
+        for (size_t ix = 0; ix < object->size; ++ix) {
+            if (sv_eq(members[ix].name, name)) {
+                return members + ix;
+            }
+        }
+        return NULL;
+    }
+    uint32_t *slots = json_index(object);
+    size_t    mask = json_index_slots(object->cap) - 1;
+    for (size_t slot = sv_hash64(name) & mask; slots[slot]; slot = (slot + 1) & mask) {
+        if (sv_eq(members[slots[slot] - 1].name, name)) {
+            return members + slots[slot] - 1;
+        }
+    }
+    return NULL;
+}
+
+static void json_object_push(JSONNVPairs *object, JSONNVPair member)
+{
+    bool moved = false;
+    if (object->size == object->cap) {
+        object->cap = da_capacity_for(object->cap, object->size + 1);
+        object->elements = da_reallocate(object->elements, 1, json_object_bytes(object->cap));
+        moved = true;
+    }
+    ((JSONNVPair *) object->elements)[object->size++] = member;
+    if (object->size > JSON_INDEX_THRESHOLD) {
+        if (moved || object->size == JSON_INDEX_THRESHOLD + 1) {
+            json_index_build(object);
+        } else {
+            json_index_insert(object, object->size - 1);
         }
     }
-    JSONNVPair pair = { .name = sv_copy(attr), .value = value };
-    da_append_JSONNVPair(&obj->object, pair);
+}
+
+static void _json_add_nvp(JSONValue *obj, StringView attr, JSONValue value)
+{
+    assert(obj->type == JSON_TYPE_OBJECT && !obj->borrowed);
+    JSONNVPair *p = json_member(&obj->object, attr);
+    if (p != NULL) {
+        json_free(p->value);
+        p->value = value;
+        return;
+    }
+    json_object_push(&obj->object, (JSONNVPair) { .name = sv_copy(attr), .value = value });
 }
 
 void json_set(JSONValue *obj, char const *attr, JSONValue elem)
@@ -432,13 +544,7 @@ bool json_has(JSONValue *value, char const *attr)
 bool json_has_sv(JSONValue *value, StringView attr)
 {
     assert(value->type == JSON_TYPE_OBJECT);
-    for (size_t ix = 0; ix < value->object.size; ++ix) {
-        JSONNVPair const *pair = da_element_JSONNVPair(&value->object, ix);
-        if (sv_eq(pair->name, attr)) {
-            return true;
-        }
-    }
-    return false;
+    return json_member(&value->object, attr) != NULL;
 }
 
 void json_delete(JSONValue *value, char const *attr)
@@ -448,16 +554,16 @@ void json_delete(JSONValue *value, char const *attr)
 
 void json_delete_sv(JSONValue *value, StringView attr)
 {
-    assert(value->type == JSON_TYPE_OBJECT);
-    for (size_t ix = 0; ix < value->object.size; ++ix) {
-        JSONNVPair *pair = da_element_JSONNVPair(&value->object, ix);
-        if (sv_eq(pair->name, attr)) {
-            if (ix < value->object.size - 1) {
-                memmove(pair, da_element_JSONNVPair(&value->object, ix + 1), sizeof(JSONNVPair));
-            }
-            --value->object.size;
-            return;
-        }
+    assert(value->type == JSON_TYPE_OBJECT && !value->borrowed);
+    JSONNVPair *pair = json_member(&value->object, attr);
+    if (pair == NULL) {
+        return;
+    }
+    size_t ix = pair - (JSONNVPair *) value->object.elements;
+    memmove(pair, pair + 1, (value->object.size - ix - 1) * sizeof(JSONNVPair));
+    --value->object.size;
+    if (value->object.size > JSON_INDEX_THRESHOLD) {
+        json_index_build(&value->object);
     }
 }
 
@@ -505,13 +611,8 @@ OptionalJSONValue json_get_sv(JSONValue *value, StringView attr)
 JSONValue *json_get_ref(JSONValue *value, StringView attr)
 {
     assert(value->type == JSON_TYPE_OBJECT);
-    for (size_t ix = 0; ix < value->object.size; ++ix) {
-        JSONNVPair const *pair = da_element_JSONNVPair(&value->object, ix);
-        if (sv_eq(pair->name, attr)) {
-            return (JSONValue *) &pair->value;
-        }
-    }
-    return NULL;
+    JSONNVPair *pair = json_member(&value->object, attr);
+    return (pair != NULL) ? &pair->value : NULL;
 }
 
 JSONValue json_get_default(JSONValue *value, char const *attr, JSONValue default_)
@@ -586,188 +687,1527 @@ StringView json_encode(JSONValue value)
     return encoder.sb.view;
 }
 
+/*
+ * json_write streams the compact encoding of a value to a writev-style
+ * sink without building the encoded text. Punctuation, numbers, escape
+ * sequences and short strings are gathered in a fixed scratch buffer;
+ * longer runs of string text that need no escaping go to the sink as views
+ * of the value itself. json_encoded_length returns the length of the same
+ * encoding, so that a length header can be sent in the same batch.
+ */
+#define JSON_WRITER_SCRATCH 16384
+#define JSON_WRITER_IOVECS 64
+#define JSON_WRITER_MIN_VIEW 256
+
 typedef struct {
-    StringScanner ss;
-} JSONDecoder;
-
-ErrorOrStringView json_decode_string(JSONDecoder *decoder)
-{
-    assert(ss_peek(&decoder->ss) == '\"');
-    StringBuilder sb = {0};
-    ss_skip_one(&decoder->ss);
-    ss_reset(&decoder->ss);
-    while (true) {
-        int ch = ss_peek(&decoder->ss);
-        if (ch == '\\') {
-            ss_skip_one(&decoder->ss);
-            ch = ss_peek(&decoder->ss);
-            switch (ch) {
-            case 0:
-                ERROR(StringView, JSONError, decoder->ss.point.line, "Bad escape");
-            case 'n':
-                sb_append_char(&sb, '\n');
-                break;
-            case 'r':
-                sb_append_char(&sb, '\r');
-                break;
-            case 't':
-                sb_append_char(&sb, '\t');
-                break;
-            case '\"':
-                sb_append_char(&sb, '\"');
-                break;
-            default:
-                sb_append_char(&sb, ch);
-                break;
-            }
-            ss_skip_one(&decoder->ss);
-        } else if (ch == '"') {
-            ss_skip_one(&decoder->ss);
-            StringView ret = sb.view;
-            RETURN(StringView, ret);
-        } else if (ch == 0) {
-            ERROR(StringView, JSONError, 0, "Unterminated string");
-        } else {
-            sb_append_char(&sb, ch);
-            ss_skip_one(&decoder->ss);
+    JSONWriteV   writev;
+    void        *context;
+    size_t       total;
+    int          iovcnt;
+    size_t       used;
+    struct iovec iov[JSON_WRITER_IOVECS];
+    char         scratch[JSON_WRITER_SCRATCH];
+} JSONWriter;
+
+static inline bool json_needs_escape(char ch)
+{
+    return (unsigned char) ch < 0x20 || ch == '"' || ch == '\\';
+}
+
+// Returns the length of the prefix of ptr[0..len) that needs no escaping.
+static size_t json_plain_span(char const *ptr, size_t len)
+{
+    size_t ix = 0;
+#if defined(__SSE2__)
+    for (; ix + 16 <= len; ix += 16) {
+        __m128i b = _mm_loadu_si128((__m128i const *) (ptr + ix));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('"')), _mm_cmpeq_epi8(b, _mm_set1_epi8('\\')));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_min_epu8(b, _mm_set1_epi8(0x1F)), b));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) {
+            return ix + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__ARM_NEON)
+    for (; ix + 16 <= len; ix += 16) {
+        uint8x16_t b = vld1q_u8((uint8_t const *) (ptr + ix));
+        uint8x16_t hit = vorrq_u8(vceqq_u8(b, vdupq_n_u8('"')), vceqq_u8(b, vdupq_n_u8('\\')));
+        hit = vorrq_u8(hit, vcltq_u8(b, vdupq_n_u8(0x20)));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+        if (mask) {
+            return ix + (__builtin_ctzll(mask) >> 2);
         }
     }
+#endif
+    for (; ix < len && !json_needs_escape(ptr[ix]); ++ix)
+        ;
+    return ix;
 }
 
-ErrorOrJSONValue json_decode_value(JSONDecoder *decoder)
+static size_t json_escape(char ch, char *out)
 {
-    ss_skip_whitespace(&decoder->ss);
-    switch (ss_peek(&decoder->ss)) {
-    case 0:
-        ERROR(JSONValue, JSONError, 0, "Expected value");
-    case '{': {
-        JSONValue result = json_object();
-        ss_skip_one(&decoder->ss);
-        ss_skip_whitespace(&decoder->ss);
-        while (ss_peek(&decoder->ss) != '}') {
-            if (ss_peek(&decoder->ss) != '"') {
-                ERROR(JSONValue, JSONError, 0, "At position %zu: Expected '\"', got '%c'", decoder->ss.point, ss_peek(&decoder->ss));
-            }
-            StringView name = TRY_TO(StringView, JSONValue, json_decode_string(decoder));
-            trace(JSON, "Name: %.*s", SV_ARG(name));
-            ss_skip_whitespace(&decoder->ss);
-            if (!ss_expect(&decoder->ss, ':')) {
-                ERROR(JSONValue, JSONError, 0, "Expected ':'");
-            }
-            ss_skip_whitespace(&decoder->ss);
-            JSONValue value = TRY(JSONValue, json_decode_value(decoder));
-            trace(JSON, "NVP: %.*s: %.*s", SV_ARG(name), SV_ARG(json_encode(value)));
-            json_set_sv(&result, name, value);
-            sv_free(name);
-            ss_skip_whitespace(&decoder->ss);
-            ss_expect(&decoder->ss, ',');
-            ss_skip_whitespace(&decoder->ss);
-        }
-        ss_skip_one(&decoder->ss);
-        RETURN(JSONValue, result);
+    char const *short_escapes = "\"\\\b\f\n\r\t";
+    char const *short_codes = "\"\\bfnrt";
+    char const *found = (ch) ? strchr(short_escapes, ch) : NULL;
+    if (found) {
+        out[0] = '\\';
+        out[1] = short_codes[found - short_escapes];
+        return 2;
     }
-    case '[': {
-        JSONValue result = json_array();
-        ss_skip_one(&decoder->ss);
-        ss_skip_whitespace(&decoder->ss);
-        while (ss_peek(&decoder->ss) != ']') {
-            JSONValue value = TRY(JSONValue, json_decode_value(decoder));
-            trace(JSON, "Array elem: %.*s", SV_ARG(json_encode(value)));
-            ss_skip_whitespace(&decoder->ss);
-            json_append(&result, value);
-            if (ss_peek(&decoder->ss) == ',') {
-                ss_skip_one(&decoder->ss);
-            }
-            ss_skip_whitespace(&decoder->ss);
+    return snprintf(out, 7, "\\u%04x", (unsigned char) ch);
+}
+
+static size_t json_render_number(JSONValue const *value, char *out, size_t len)
+{
+    if (value->type == JSON_TYPE_DOUBLE) {
+        return snprintf(out, len, "%f", value->double_number);
+    }
+    OptionalInt64 signed_value = integer_signed_value(value->int_number);
+    if (signed_value.has_value) {
+        return snprintf(out, len, "%lld", (long long) signed_value.value);
+    }
+    return snprintf(out, len, "%llu", (unsigned long long) integer_unsigned_value(value->int_number).value);
+}
+
+static size_t json_string_length(StringView str)
+{
+    size_t ret = 2 + str.length;
+    for (size_t ix = json_plain_span(str.ptr, str.length); ix < str.length; ix += 1 + json_plain_span(str.ptr + ix + 1, str.length - ix - 1)) {
+        char escape[8];
+        ret += json_escape(str.ptr[ix], escape) - 1;
+    }
+    return ret;
+}
+
+size_t json_encoded_length(JSONValue value)
+{
+    switch (value.type) {
+    case JSON_TYPE_OBJECT: {
+        size_t ret = 2 + ((value.object.size > 0) ? value.object.size - 1 : 0);
+        for (size_t ix = 0; ix < value.object.size; ++ix) {
+            JSONNVPair *nvp = da_element_JSONNVPair(&value.object, ix);
+            ret += json_string_length(nvp->name) + 1 + json_encoded_length(nvp->value);
         }
-        ss_skip_one(&decoder->ss);
-        RETURN(JSONValue, result);
+        return ret;
     }
-    case '"': {
-        StringView str = TRY_TO(StringView, JSONValue, json_decode_string(decoder));
-        RETURN(JSONValue, json_string(str));
+    case JSON_TYPE_ARRAY: {
+        size_t ret = 2 + ((value.array.size > 0) ? value.array.size - 1 : 0);
+        for (size_t ix = 0; ix < value.array.size; ++ix) {
+            ret += json_encoded_length(*da_element_JSONValue(&value.array, ix));
+        }
+        return ret;
     }
-    default: {
-        if (isdigit(ss_peek(&decoder->ss)) || ss_peek(&decoder->ss) == '-') {
-            ss_reset(&decoder->ss);
-            ss_skip_one(&decoder->ss);
-            while (isdigit(ss_peek(&decoder->ss))) {
-                ss_skip_one(&decoder->ss);
-            }
-            if (ss_peek(&decoder->ss) == '.') {
-                ss_skip_one(&decoder->ss);
-                while (isdigit(ss_peek(&decoder->ss))) {
-                    ss_skip_one(&decoder->ss);
-                }
-                StringView sv = ss_read_from_mark(&decoder->ss);
-                char       ch = sv.ptr[sv.length];
-                ((char *) sv.ptr)[sv.length] = '\0';
-                double dbl = strtod(sv.ptr, NULL);
-                ((char *) sv.ptr)[sv.length] = ch;
-                RETURN(JSONValue, json_number(dbl));
-            }
-            StringView         sv = ss_read_from_mark(&decoder->ss);
-            IntegerParseResult parse_result = sv_parse_integer(sv, I64);
-            if (parse_result.success) {
-                RETURN(JSONValue, json_integer(parse_result.integer));
+    case JSON_TYPE_STRING:
+        return json_string_length(value.string);
+    case JSON_TYPE_INT:
+    case JSON_TYPE_DOUBLE: {
+        char number[512];
+        return json_render_number(&value, number, sizeof(number));
+    }
+    case JSON_TYPE_BOOLEAN:
+        return (value.boolean) ? 4 : 5;
+    case JSON_TYPE_NULL:
+        return 4;
+    default:
+        UNREACHABLE();
+    }
+}
+
+static ErrorOrSize json_writer_flush(JSONWriter *writer)
+{
+    if (writer->iovcnt > 0) {
+        writer->total += TRY(Size, writer->writev(writer->context, writer->iov, writer->iovcnt));
+    }
+    writer->iovcnt = 0;
+    writer->used = 0;
+    RETURN(Size, writer->total);
+}
+
+static ErrorOrSize json_writer_copy(JSONWriter *writer, char const *ptr, size_t len)
+{
+    while (len > 0) {
+        if (writer->used == JSON_WRITER_SCRATCH) {
+            TRY(Size, json_writer_flush(writer));
+        }
+        char         *dest = writer->scratch + writer->used;
+        struct iovec *last = (writer->iovcnt > 0) ? writer->iov + writer->iovcnt - 1 : NULL;
+        if (last == NULL || (char *) last->iov_base + last->iov_len != dest) {
+            if (writer->iovcnt == JSON_WRITER_IOVECS) {
+                TRY(Size, json_writer_flush(writer));
+                continue;
             }
-            RETURN(JSONValue, json_integer(parse_result.integer));
+            last = writer->iov + writer->iovcnt++;
+            *last = (struct iovec) { .iov_base = dest, .iov_len = 0 };
         }
-        if (ss_expect_sv(&decoder->ss, sv_from("true"))) {
-            RETURN(JSONValue, json_bool(true));
+        size_t count = (len < JSON_WRITER_SCRATCH - writer->used) ? len : JSON_WRITER_SCRATCH - writer->used;
+        memcpy(dest, ptr, count);
+        last->iov_len += count;
+        writer->used += count;
+        ptr += count;
+        len -= count;
+    }
+    RETURN(Size, writer->total);
+}
+
+static ErrorOrSize json_writer_view(JSONWriter *writer, char const *ptr, size_t len)
+{
+    if (len < JSON_WRITER_MIN_VIEW) {
+        return json_writer_copy(writer, ptr, len);
+    }
+    if (writer->iovcnt == JSON_WRITER_IOVECS) {
+        TRY(Size, json_writer_flush(writer));
+    }
+    writer->iov[writer->iovcnt++] = (struct iovec) { .iov_base = (void *) ptr, .iov_len = len };
+    RETURN(Size, writer->total);
+}
+
+static ErrorOrSize json_write_string(JSONWriter *writer, StringView str)
+{
+    TRY(Size, json_writer_copy(writer, "\"", 1));
+    for (size_t ix = 0; ix < str.length; ++ix) {
+        size_t run = json_plain_span(str.ptr + ix, str.length - ix);
+        TRY(Size, json_writer_view(writer, str.ptr + ix, run));
+        ix += run;
+        if (ix < str.length) {
+            char escape[8];
+            TRY(Size, json_writer_copy(writer, escape, json_escape(str.ptr[ix], escape)));
         }
-        if (ss_expect_sv(&decoder->ss, sv_from("false"))) {
-            RETURN(JSONValue, json_bool(false));
+    }
+    return json_writer_copy(writer, "\"", 1);
+}
+
+static ErrorOrSize json_write_value(JSONWriter *writer, JSONValue *value)
+{
+    switch (value->type) {
+    case JSON_TYPE_OBJECT: {
+        TRY(Size, json_writer_copy(writer, "{", 1));
+        for (size_t ix = 0; ix < value->object.size; ix++) {
+            JSONNVPair *nvp = da_element_JSONNVPair(&value->object, ix);
+            if (ix > 0) {
+                TRY(Size, json_writer_copy(writer, ",", 1));
+            }
+            TRY(Size, json_write_string(writer, nvp->name));
+            TRY(Size, json_writer_copy(writer, ":", 1));
+            TRY(Size, json_write_value(writer, &nvp->value));
         }
-        if (ss_expect_sv(&decoder->ss, sv_from("null"))) {
-            RETURN(JSONValue, json_null());
+        return json_writer_copy(writer, "}", 1);
+    }
+    case JSON_TYPE_ARRAY: {
+        TRY(Size, json_writer_copy(writer, "[", 1));
+        for (size_t ix = 0; ix < value->array.size; ix++) {
+            if (ix > 0) {
+                TRY(Size, json_writer_copy(writer, ",", 1));
+            }
+            TRY(Size, json_write_value(writer, da_element_JSONValue(&value->array, ix)));
         }
-        ERROR(JSONValue, JSONError, 0, "%d:%d: Invalid JSON", decoder->ss.point.line, decoder->ss.point.column);
+        return json_writer_copy(writer, "]", 1);
+    }
+    case JSON_TYPE_STRING:
+        return json_write_string(writer, value->string);
+    case JSON_TYPE_INT:
+    case JSON_TYPE_DOUBLE: {
+        char number[512];
+        return json_writer_copy(writer, number, json_render_number(value, number, sizeof(number)));
     }
+    case JSON_TYPE_BOOLEAN:
+        return (value->boolean) ? json_writer_copy(writer, "true", 4) : json_writer_copy(writer, "false", 5);
+    case JSON_TYPE_NULL:
+        return json_writer_copy(writer, "null", 4);
+    default:
+        UNREACHABLE();
     }
 }
 
-ErrorOrJSONValue json_decode(StringView json)
+// Writes prefix followed by the compact encoding of value to writev. Returns
+// the number of bytes written.
+ErrorOrSize json_write(JSONValue value, StringView prefix, JSONWriteV writev, void *context)
 {
-    JSONDecoder      decoder = { .ss = ss_create(json) };
-    ErrorOrJSONValue ret = json_decode_value(&decoder);
+    JSONWriter *writer = MALLOC(JSONWriter);
+    writer->writev = writev;
+    writer->context = context;
+    writer->total = 0;
+    writer->iovcnt = 0;
+    writer->used = 0;
+    ErrorOrSize ret = json_writer_copy(writer, prefix.ptr, prefix.length);
+    if (!ErrorOrSize_is_error(ret)) {
+        ret = json_write_value(writer, &value);
+    }
+    if (!ErrorOrSize_is_error(ret)) {
+        ret = json_writer_flush(writer);
+    }
+    free(writer);
     return ret;
 }
 
-#ifdef JSON_FORMAT
+/*
+ * The decoder works in two stages, after simdjson. The first stage
+ * classifies the text 64 bytes at a time into bit masks of quotes,
+ * backslashes, structural characters and whitespace, works out which bytes
+ * are inside strings, and records the offsets of all structural characters,
+ * all unescaped quotes, and the first byte of every number or literal. The
+ * second stage builds the JSONValue by walking that index, so it never has
+ * to look at the bytes between two entries except to copy them. The pull
+ * reader runs the first stage lazily, a few chunks ahead of where it reads,
+ * so reading the first members of a large message doesn't index all of it.
+ */
 
-#include <io.h>
+typedef struct {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t structural;
+    uint64_t whitespace;
+} JSONChunkMasks;
 
-int main(int argc, char **argv)
+// Chunks the reader indexes at a time.
+#define JSON_READER_CHUNKS 16
+
+struct json_decoder {
+    StringView  text;
+    UInt32s     index;
+    size_t      current;
+    size_t      indexed;        // Bytes of text indexed so far
+    uint64_t    prev_escaped;   // Index state carried from chunk to chunk
+    uint64_t    prev_in_string;
+    uint64_t    prev_scalar;
+    Allocator   alloc;          // Set when decoding into an arena
+    JSONValues  values;         // Elements of the arrays being decoded
+    JSONNVPairs members;        // Members of the objects being decoded
+};
+
+#if defined(__SSE2__)
+
+static inline uint64_t json_eq_mask(__m128i b, char ch)
 {
-    if (argc != 2) {
-        return -1;
+    return (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(b, _mm_set1_epi8(ch)));
+}
+
+static JSONChunkMasks json_classify_chunk(char const *ptr)
+{
+    JSONChunkMasks ret = { 0 };
+    for (int ix = 0; ix < 4; ++ix) {
+        __m128i b = _mm_loadu_si128((__m128i const *) (ptr + 16 * ix));
+        // '[' and ']' differ from '{' and '}' only in bit 5.
+        __m128i folded = _mm_or_si128(b, _mm_set1_epi8(0x20));
+        int     shift = 16 * ix;
+        ret.quote |= json_eq_mask(b, '"') << shift;
+        ret.backslash |= json_eq_mask(b, '\\') << shift;
+        ret.structural |= (json_eq_mask(folded, '{') | json_eq_mask(folded, '}') | json_eq_mask(b, ':') | json_eq_mask(b, ',')) << shift;
+        ret.whitespace |= (json_eq_mask(b, ' ') | json_eq_mask(b, '\n') | json_eq_mask(b, '\r') | json_eq_mask(b, '\t')) << shift;
     }
-    log_init();
-    StringView sv = MUST(StringView, read_file_by_name(sv_from(argv[1])));
-    JSONValue  json = MUST(JSONValue, json_decode(sv));
-    printf("%.*s\n", SV_ARG(json_encode(json)));
-    return 0;
+    return ret;
+}
+
+#elif defined(__ARM_NEON)
+
+// NEON has no movemask. Weighting each lane with its bit position and
+// adding pairwise three times packs four 16 byte comparison results into
+// one 64 bit mask.
+static inline uint64_t json_neon_mask(uint8x16_t r0, uint8x16_t r1, uint8x16_t r2, uint8x16_t r3)
+{
+    uint8x16_t const weights = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80 };
+    uint8x16_t       sum0 = vpaddq_u8(vandq_u8(r0, weights), vandq_u8(r1, weights));
+    uint8x16_t       sum1 = vpaddq_u8(vandq_u8(r2, weights), vandq_u8(r3, weights));
+    sum0 = vpaddq_u8(sum0, sum1);
+    sum0 = vpaddq_u8(sum0, sum0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+static JSONChunkMasks json_classify_chunk(char const *ptr)
+{
+    uint8x16_t quote[4], backslash[4], structural[4], whitespace[4];
+    for (int ix = 0; ix < 4; ++ix) {
+        uint8x16_t b = vld1q_u8((uint8_t const *) ptr + 16 * ix);
+        // '[' and ']' differ from '{' and '}' only in bit 5.
+        uint8x16_t folded = vorrq_u8(b, vdupq_n_u8(0x20));
+        quote[ix] = vceqq_u8(b, vdupq_n_u8('"'));
+        backslash[ix] = vceqq_u8(b, vdupq_n_u8('\\'));
+        structural[ix] = vorrq_u8(vorrq_u8(vceqq_u8(folded, vdupq_n_u8('{')), vceqq_u8(folded, vdupq_n_u8('}'))),
+            vorrq_u8(vceqq_u8(b, vdupq_n_u8(':')), vceqq_u8(b, vdupq_n_u8(','))));
+        whitespace[ix] = vorrq_u8(vorrq_u8(vceqq_u8(b, vdupq_n_u8(' ')), vceqq_u8(b, vdupq_n_u8('\n'))),
+            vorrq_u8(vceqq_u8(b, vdupq_n_u8('\r')), vceqq_u8(b, vdupq_n_u8('\t'))));
+    }
+    return (JSONChunkMasks) {
+        .quote = json_neon_mask(quote[0], quote[1], quote[2], quote[3]),
+        .backslash = json_neon_mask(backslash[0], backslash[1], backslash[2], backslash[3]),
+        .structural = json_neon_mask(structural[0], structural[1], structural[2], structural[3]),
+        .whitespace = json_neon_mask(whitespace[0], whitespace[1], whitespace[2], whitespace[3]),
+    };
+}
+
+#else
+
+static JSONChunkMasks json_classify_chunk(char const *ptr)
+{
+    JSONChunkMasks ret = { 0 };
+    for (int ix = 0; ix < 64; ++ix) {
+        uint64_t bit = 1ull << ix;
+        switch (ptr[ix]) {
+        case '"':
+            ret.quote |= bit;
+            break;
+        case '\\':
+            ret.backslash |= bit;
+            break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            ret.structural |= bit;
+            break;
+        case ' ':
+        case '\n':
+        case '\r':
+        case '\t':
+            ret.whitespace |= bit;
+            break;
+        default:
+            break;
+        }
+    }
+    return ret;
 }
 
 #endif
 
-#ifdef JSON_TEST
+// Returns the mask of characters preceded by an odd number of backslashes.
+// Runs of backslashes starting on an even position are separated from
+// those starting on an odd position by adding the run starts to the runs;
+// the carry out of that addition tells the next chunk whether its first
+// character is escaped.
+static inline uint64_t json_find_escaped(uint64_t backslash, uint64_t *prev_escaped)
+{
+    uint64_t const even_bits = 0x5555555555555555ull;
+    backslash &= ~*prev_escaped;
+    uint64_t follows_escape = (backslash << 1) | *prev_escaped;
+    uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+    uint64_t even_sequences;
+    *prev_escaped = __builtin_add_overflow(odd_starts, backslash, &even_sequences);
+    return (even_bits ^ (even_sequences << 1)) & follows_escape;
+}
 
-int main(int argc, char **argv)
+// Bit i of the result is the xor of bits 0..i of the argument. Applied to
+// the quote mask this yields the mask of bytes inside strings, including
+// the opening quote but not the closing one.
+static inline uint64_t json_prefix_xor(uint64_t bits)
 {
-    JSONValue obj = json_object();
-    json_set(&obj, "foo", json_string(sv_from("bar")));
-    json_set(&obj, "quux", json_string(sv_from("hello")));
-    StringView json = json_encode(obj);
-    printf("%.*s\n", SV_ARG(json));
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
 
-    ErrorOrJSONValue decoded = json_decode(json);
-    if (ErrorOrJSONValue_is_error(decoded)) {
-        printf("Decoding error: %s\n", Error_to_string(decoded.error));
-    } else {
-        json = json_encode(decoded.value);
-        printf("%.*s\n", SV_ARG(json));
+// Indexes up to chunks more 64 byte chunks of the text.
+static void json_index_chunks(JSONDecoder *decoder, size_t chunks)
+{
+    char const *text = decoder->text.ptr;
+    size_t      len = decoder->text.length;
+    char        tail[64];
+
+    assert(len < UINT32_MAX);
+    for (; decoder->indexed < len && chunks > 0; decoder->indexed += 64, --chunks) {
+        size_t      base = decoder->indexed;
+        char const *chunk = text + base;
+        if (len - base < 64) {
+            memset(tail, ' ', 64);
+            memcpy(tail, chunk, len - base);
+            chunk = tail;
+        }
+        JSONChunkMasks masks = json_classify_chunk(chunk);
+        uint64_t       quotes = masks.quote & ~json_find_escaped(masks.backslash, &decoder->prev_escaped);
+        uint64_t       in_string = json_prefix_xor(quotes) ^ decoder->prev_in_string;
+        decoder->prev_in_string = (uint64_t) ((int64_t) in_string >> 63);
+        uint64_t scalar = ~(masks.structural | masks.whitespace | masks.quote | in_string);
+        uint64_t scalar_starts = scalar & ~((scalar << 1) | decoder->prev_scalar);
+        decoder->prev_scalar = scalar >> 63;
+
+        uint64_t bits = (masks.structural & ~in_string) | quotes | scalar_starts;
+        DIA_RESERVE(uint32_t, &decoder->index, decoder->index.size + __builtin_popcountll(bits));
+        for (; bits; bits &= bits - 1) {
+            decoder->index.elements[decoder->index.size++] = (uint32_t) (base + __builtin_ctzll(bits));
+        }
+    }
+    if (decoder->indexed > len) {
+        decoder->indexed = len;
+    }
+}
+
+static void json_index_structurals(JSONDecoder *decoder)
+{
+    DIA_RESERVE(uint32_t, &decoder->index, decoder->text.length / 8 + 64);
+    json_index_chunks(decoder, SIZE_MAX);
+}
+
+// Makes sure there is an index entry at current, indexing more of the text
+// if needed. Returns false at the end of the text.
+static bool json_index_current(JSONDecoder *decoder)
+{
+    while (decoder->current >= decoder->index.size) {
+        if (decoder->indexed >= decoder->text.length) {
+            return false;
+        }
+        json_index_chunks(decoder, JSON_READER_CHUNKS);
+    }
+    return true;
+}
+
+// Only used for error messages, so the line is recounted from the start.
+static void json_position(JSONDecoder *decoder, size_t offset, size_t *line, size_t *column)
+{
+    *line = 1;
+    *column = 1;
+    for (size_t ix = 0; ix < offset && ix < decoder->text.length; ++ix) {
+        if (decoder->text.ptr[ix] == '\n') {
+            ++*line;
+            *column = 1;
+        } else {
+            ++*column;
+        }
+    }
+}
+
+static ErrorOrJSONValue json_invalid(JSONDecoder *decoder, size_t offset, char const *msg)
+{
+    size_t line, column;
+    json_position(decoder, offset, &line, &column);
+    ERROR(JSONValue, JSONError, 0, "%zu:%zu: %s", line, column, msg);
+}
+
+static char json_peek(JSONDecoder *decoder)
+{
+    if (!json_index_current(decoder)) {
+        return 0;
+    }
+    return decoder->text.ptr[decoder->index.elements[decoder->current]];
+}
+
+// Strings without escapes are returned as views into the text; the others
+// are unescaped into memory owned by the document: the arena, or a fresh
+// buffer when decoding to the heap.
+static bool json_is_view(JSONDecoder *decoder, StringView str)
+{
+    return str.ptr >= decoder->text.ptr && str.ptr < decoder->text.ptr + decoder->text.length;
+}
+
+// Returns the value of the four hex digits at raw[ix], or UINT32_MAX if
+// there are none.
+static uint32_t json_hex4(StringView raw, size_t ix)
+{
+    if (ix + 4 > raw.length) {
+        return UINT32_MAX;
+    }
+    uint32_t ret = 0;
+    for (size_t digit = ix; digit < ix + 4; ++digit) {
+        char ch = raw.ptr[digit];
+        if (!cc_is(ch, CC_XDIGIT)) {
+            return UINT32_MAX;
+        }
+        ret = 16 * ret + ((ch <= '9') ? ch - '0' : (ch | 0x20) - 'a' + 10);
+    }
+    return ret;
+}
+
+// Encodes code_point as UTF-8. Never writes more bytes than the escape
+// sequence it replaces.
+static size_t json_utf8(uint32_t code_point, char *out)
+{
+    if (code_point < 0x80) {
+        out[0] = (char) code_point;
+        return 1;
+    }
+    if (code_point < 0x800) {
+        out[0] = (char) (0xC0 | (code_point >> 6));
+        out[1] = (char) (0x80 | (code_point & 0x3F));
+        return 2;
+    }
+    if (code_point < 0x10000) {
+        out[0] = (char) (0xE0 | (code_point >> 12));
+        out[1] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+        out[2] = (char) (0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    out[0] = (char) (0xF0 | (code_point >> 18));
+    out[1] = (char) (0x80 | ((code_point >> 12) & 0x3F));
+    out[2] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+    out[3] = (char) (0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+static size_t json_unescape(StringView raw, char *out)
+{
+    size_t len = 0;
+    for (size_t ix = 0; ix < raw.length; ++ix) {
+        size_t run = cc_scan_to(raw.ptr + ix, raw.length - ix, "\\");
+        memcpy(out + len, raw.ptr + ix, run);
+        len += run;
+        ix += run;
+        if (ix >= raw.length) {
+            break;
+        }
+        if (raw.ptr[ix] != '\\') {
+            // cc_scan_to also stops at NUL characters.
+            out[len++] = raw.ptr[ix];
+            continue;
+        }
+        // Stage one guarantees that a backslash is never the last
+        // character of a string.
+        switch (raw.ptr[++ix]) {
+        case 'b':
+            out[len++] = '\b';
+            break;
+        case 'f':
+            out[len++] = '\f';
+            break;
+        case 'n':
+            out[len++] = '\n';
+            break;
+        case 'r':
+            out[len++] = '\r';
+            break;
+        case 't':
+            out[len++] = '\t';
+            break;
+        case 'u': {
+            uint32_t code_point = json_hex4(raw, ix + 1);
+            if (code_point == UINT32_MAX) {
+                out[len++] = 'u';
+                break;
+            }
+            ix += 4;
+            if (code_point >= 0xD800 && code_point < 0xDC00 && ix + 2 < raw.length && raw.ptr[ix + 1] == '\\' && raw.ptr[ix + 2] == 'u') {
+                uint32_t low = json_hex4(raw, ix + 3);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                    ix += 6;
+                }
+            }
+            len += json_utf8(code_point, out + len);
+        } break;
+        default:
+            out[len++] = raw.ptr[ix];
+            break;
+        }
+    }
+    return len;
+}
+
+static ErrorOrStringView json_decode_string(JSONDecoder *decoder)
+{
+    size_t start = decoder->index.elements[decoder->current++];
+    assert(decoder->text.ptr[start] == '"');
+    if (!json_index_current(decoder)) {
+        ERROR(StringView, JSONError, 0, "Unterminated string");
+    }
+    size_t     end = decoder->index.elements[decoder->current++];
+    StringView raw = { decoder->text.ptr + start + 1, end - start - 1 };
+    if (!memchr(raw.ptr, '\\', raw.length)) {
+        RETURN(StringView, raw);
+    }
+    if (decoder->alloc.arena) {
+        char *out = allocator_allocate(decoder->alloc, raw.length);
+        RETURN(StringView, ((StringView) { out, json_unescape(raw, out) }));
+    }
+    char      *out = malloc_fatal(raw.length, "unescaping JSON string");
+    StringView ret = sv_copy((StringView) { out, json_unescape(raw, out) });
+    free(out);
+    RETURN(StringView, ret);
+}
+
+// Returns a string value or member name owned by the document being built.
+static StringView json_adopt_string(JSONDecoder *decoder, StringView str)
+{
+    if (str.length == 0) {
+        return sv_null();
+    }
+    if (decoder->alloc.arena || !json_is_view(decoder, str)) {
+        return str;
+    }
+    return sv_copy(str);
+}
+
+static ErrorOrJSONValue json_decode_scalar(JSONDecoder *decoder)
+{
+    size_t      start = decoder->index.elements[decoder->current++];
+    char const *ptr = decoder->text.ptr + start;
+    size_t      len = decoder->text.length - start;
+    size_t      ix = 0;
+    JSONValue   ret = { 0 };
+    if (ptr[0] == '-' || cc_is(ptr[0], CC_DIGIT)) {
+        // A sign must be followed by at least one digit.
+        if (ptr[0] == '-' && (len < 2 || !cc_is(ptr[1], CC_DIGIT))) {
+            return json_invalid(decoder, start, "Invalid number");
+        }
+        bool is_double = false;
+        ix = 1 + cc_span(ptr + 1, len - 1, CC_DIGIT);
+        if (ix < len && ptr[ix] == '.') {
+            is_double = true;
+            ++ix;
+            ix += cc_span(ptr + ix, len - ix, CC_DIGIT);
+        }
+        if (ix < len && (ptr[ix] == 'e' || ptr[ix] == 'E')) {
+            is_double = true;
+            ++ix;
+            if (ix < len && (ptr[ix] == '+' || ptr[ix] == '-')) {
+                ++ix;
+            }
+            ix += cc_span(ptr + ix, len - ix, CC_DIGIT);
+        }
+        if (is_double) {
+            char number[64];
+            if (ix >= sizeof(number)) {
+                return json_invalid(decoder, start, "Number too long");
+            }
+            memcpy(number, ptr, ix);
+            number[ix] = '\0';
+            ret = json_number(strtod(number, NULL));
+        } else if (ix <= 18) {
+            // Eighteen characters always fit in an int64_t.
+            int64_t n = 0;
+            for (size_t digit = (ptr[0] == '-'); digit < ix; ++digit) {
+                n = 10 * n + (ptr[digit] - '0');
+            }
+            ret = json_integer(i64((ptr[0] == '-') ? -n : n));
+        } else {
+            ret = json_integer(sv_parse_integer((StringView) { ptr, ix }, I64).integer);
+        }
+    } else if (len >= 4 && memcmp(ptr, "true", 4) == 0) {
+        ix = 4;
+        ret = json_bool(true);
+    } else if (len >= 5 && memcmp(ptr, "false", 5) == 0) {
+        ix = 5;
+        ret = json_bool(false);
+    } else if (len >= 4 && memcmp(ptr, "null", 4) == 0) {
+        ix = 4;
+        ret = json_null();
+    }
+    if (ix == 0 || (ix < len && !cc_is(ptr[ix], CC_SPACE) && !strchr("{}[]:,\"", ptr[ix]))) {
+        return json_invalid(decoder, start, "Invalid JSON");
+    }
+    RETURN(JSONValue, ret);
+}
+
+// Containers are built on the decoder's stacks and get an array of exactly
+// the right size, from the arena or the heap, when they are closed.
+static void *json_decoder_elements(JSONDecoder *decoder, void *from, size_t elem_size, size_t num)
+{
+    if (num == 0) {
+        return NULL;
+    }
+    void *ret = (decoder->alloc.arena) ? allocator_allocate_array(decoder->alloc, elem_size, num) : da_reallocate(NULL, elem_size, num);
+    memcpy(ret, from, elem_size * num);
+    return ret;
+}
+
+// Like json_set, a repeated name replaces the earlier value. Duplicates are
+// weeded out here, using the member index of large objects, rather than
+// while the members are read.
+static JSONNVPairs json_decoder_members(JSONDecoder *decoder, size_t base)
+{
+    JSONNVPair *from = (JSONNVPair *) decoder->members.elements + base;
+    JSONNVPairs ret = { .cap = decoder->members.size - base };
+    if (ret.cap == 0) {
+        return ret;
+    }
+    size_t bytes = json_object_bytes(ret.cap);
+    ret.elements = (decoder->alloc.arena) ? allocator_allocate(decoder->alloc, bytes) : da_reallocate(NULL, 1, bytes);
+    if (ret.cap > JSON_INDEX_THRESHOLD) {
+        json_index_build(&ret);
+    }
+    for (size_t ix = 0; ix < ret.cap; ++ix) {
+        JSONNVPair *existing = json_member(&ret, from[ix].name);
+        if (existing != NULL) {
+            json_free(existing->value);
+            existing->value = from[ix].value;
+            if (!decoder->alloc.arena) {
+                sv_free(from[ix].name);
+            }
+            continue;
+        }
+        ((JSONNVPair *) ret.elements)[ret.size] = from[ix];
+        if (ret.cap > JSON_INDEX_THRESHOLD) {
+            json_index_insert(&ret, ret.size);
+        }
+        ++ret.size;
+    }
+    return ret;
+}
+
+static ErrorOrJSONValue json_decode_value(JSONDecoder *decoder)
+{
+    JSONValue ret = { 0 };
+    switch (json_peek(decoder)) {
+    case 0:
+        ERROR(JSONValue, JSONError, 0, "Expected value");
+    case '{': {
+        size_t base = decoder->members.size;
+        ++decoder->current;
+        while (json_peek(decoder) != '}') {
+            if (json_peek(decoder) != '"') {
+                ERROR(JSONValue, JSONError, 0, "At position %zu: Expected '\"', got '%c'",
+                    (decoder->current < decoder->index.size) ? decoder->index.elements[decoder->current] : decoder->text.length,
+                    json_peek(decoder));
+            }
+            StringView name = TRY_TO(StringView, JSONValue, json_decode_string(decoder));
+            if (json_peek(decoder) != ':') {
+                if (!decoder->alloc.arena && !json_is_view(decoder, name)) {
+                    sv_free(name);
+                }
+                ERROR(JSONValue, JSONError, 0, "Expected ':'");
+            }
+            ++decoder->current;
+            JSONNVPair member = { .name = json_adopt_string(decoder, name) };
+            ErrorOrJSONValue value = json_decode_value(decoder);
+            if (ErrorOrJSONValue_is_error(value)) {
+                if (!decoder->alloc.arena) {
+                    sv_free(member.name);
+                }
+                return value;
+            }
+            member.value = value.value;
+            DIA_RESERVE(JSONNVPair, &decoder->members, decoder->members.size + 1);
+            ((JSONNVPair *) decoder->members.elements)[decoder->members.size++] = member;
+            if (json_peek(decoder) == ',') {
+                ++decoder->current;
+            }
+        }
+        ++decoder->current;
+        ret = json_object();
+        ret.object = json_decoder_members(decoder, base);
+        decoder->members.size = base;
+    } break;
+    case '[': {
+        size_t base = decoder->values.size;
+        ++decoder->current;
+        while (json_peek(decoder) != ']') {
+            JSONValue elem = TRY(JSONValue, json_decode_value(decoder));
+            DIA_RESERVE(JSONValue, &decoder->values, decoder->values.size + 1);
+            ((JSONValue *) decoder->values.elements)[decoder->values.size++] = elem;
+            if (json_peek(decoder) == ',') {
+                ++decoder->current;
+            }
+        }
+        ++decoder->current;
+        ret = json_array();
+        ret.array.size = ret.array.cap = decoder->values.size - base;
+        ret.array.elements = json_decoder_elements(decoder, (JSONValue *) decoder->values.elements + base, sizeof(JSONValue), ret.array.size);
+        decoder->values.size = base;
+    } break;
+    case '"': {
+        StringView str = TRY_TO(StringView, JSONValue, json_decode_string(decoder));
+        ret = (JSONValue) { .type = JSON_TYPE_STRING, .string = json_adopt_string(decoder, str) };
+    } break;
+    case '}':
+    case ']':
+    case ':':
+    case ',':
+        return json_invalid(decoder, decoder->index.elements[decoder->current], "Invalid JSON");
+    default:
+        ret = TRY(JSONValue, json_decode_scalar(decoder));
+        break;
+    }
+    ret.borrowed = decoder->alloc.arena != NULL;
+    RETURN(JSONValue, ret);
+}
+
+// Whatever was built before an error is still on the stacks above the
+// given bases.
+static void json_decoder_unwind(JSONDecoder *decoder, size_t values_base, size_t members_base)
+{
+    if (!decoder->alloc.arena) {
+        for (size_t ix = values_base; ix < decoder->values.size; ++ix) {
+            json_free(((JSONValue *) decoder->values.elements)[ix]);
+        }
+        for (size_t ix = members_base; ix < decoder->members.size; ++ix) {
+            JSONNVPair *member = (JSONNVPair *) decoder->members.elements + ix;
+            sv_free(member->name);
+            json_free(member->value);
+        }
+    }
+    decoder->values.size = values_base;
+    decoder->members.size = members_base;
+}
+
+static ErrorOrJSONValue json_decode_document(JSONDecoder *decoder)
+{
+    json_index_structurals(decoder);
+    ErrorOrJSONValue ret = json_decode_value(decoder);
+    if (ErrorOrJSONValue_is_error(ret)) {
+        json_decoder_unwind(decoder, 0, 0);
+    }
+    da_free_uint32_t(&decoder->index);
+    da_free_JSONValue(&decoder->values);
+    da_free_JSONNVPair(&decoder->members);
+    return ret;
+}
+
+ErrorOrJSONValue json_decode(StringView json)
+{
+    JSONDecoder decoder = { .text = json };
+    return json_decode_document(&decoder);
+}
+
+// Decodes json into a document that lives in a single arena: the text is
+// copied into the arena once, strings and member names are slices of that
+// copy, and containers are allocated from the arena as well. The document
+// is read-only, and json_free on its root releases the arena as a whole.
+// Values taken from it must be copied with json_copy if they need to
+// outlive it.
+ErrorOrJSONValue json_decode_arena(StringView json)
+{
+    Allocator alloc = allocator_new_with_chunk_size(2 * json.length + 4096);
+    char     *text = allocator_allocate(alloc, json.length + 1);
+    memcpy(text, json.ptr, json.length);
+    JSONDecoder decoder = { .text = { text, json.length }, .alloc = alloc };
+    ErrorOrJSONValue ret = json_decode_document(&decoder);
+    if (ErrorOrJSONValue_is_error(ret)) {
+        allocator_free(&alloc);
+        return ret;
+    }
+    ret.value.arena = allocator_alloc_new(alloc, Allocator);
+    *ret.value.arena = alloc;
+    return ret;
+}
+
+/*
+ * The reader walks the same index as the decoder, but hands out one event
+ * at a time instead of building a document. in_object has an entry for
+ * every object or array that is open, true for objects; it tells the reader
+ * whether the next string is a member name or a value.
+ */
+
+JSONReader json_reader(StringView json_text)
+{
+    JSONReader reader = { 0 };
+    reader.decoder = MALLOC(JSONDecoder);
+    *reader.decoder = (JSONDecoder) { .text = json_text, .alloc = allocator_new_with_chunk_size(4096) };
+    return reader;
+}
+
+void json_reader_free(JSONReader *reader)
+{
+    if (reader->decoder == NULL) {
+        return;
+    }
+    da_free_uint32_t(&reader->decoder->index);
+    da_free_JSONValue(&reader->decoder->values);
+    da_free_JSONNVPair(&reader->decoder->members);
+    allocator_free(&reader->decoder->alloc);
+    free(reader->decoder);
+    DIA_FREE(&reader->in_object);
+    reader->decoder = NULL;
+}
+
+static JSONEvent json_reader_error(JSONReader *reader, Error error)
+{
+    reader->error = error;
+    reader->event = JSON_EVENT_ERROR;
+    return reader->event;
+}
+
+static JSONEvent json_reader_invalid(JSONReader *reader, char const *msg)
+{
+    JSONDecoder *decoder = reader->decoder;
+    size_t       offset = (decoder->current < decoder->index.size) ? decoder->index.elements[decoder->current] : decoder->text.length;
+    return json_reader_error(reader, json_invalid(decoder, offset, msg).error);
+}
+
+static bool json_reader_in_object(JSONReader *reader)
+{
+    return reader->in_object.size > 0 && reader->in_object.elements[reader->in_object.size - 1];
+}
+
+static JSONEvent json_reader_close(JSONReader *reader)
+{
+    ++reader->decoder->current;
+    reader->event = (reader->in_object.elements[--reader->in_object.size]) ? JSON_EVENT_END_OBJECT : JSON_EVENT_END_ARRAY;
+    return reader->event;
+}
+
+// Steps over the comma after a complete value, and reads member names.
+// Returns true if a value starts at the current index entry, and false if
+// the next event has been produced already.
+static bool json_reader_advance(JSONReader *reader)
+{
+    JSONDecoder *decoder = reader->decoder;
+    reader->key = sv_null();
+    reader->value = json_null();
+    switch (reader->event) {
+    case JSON_EVENT_ERROR:
+    case JSON_EVENT_DONE:
+        return false;
+    case JSON_EVENT_KEY:
+        return true;
+    case JSON_EVENT_VALUE:
+    case JSON_EVENT_END_OBJECT:
+    case JSON_EVENT_END_ARRAY:
+        if (reader->in_object.size == 0) {
+            if (json_peek(decoder) != 0) {
+                json_reader_invalid(reader, "Unexpected data after JSON value");
+                return false;
+            }
+            reader->event = JSON_EVENT_DONE;
+            return false;
+        }
+        if (json_peek(decoder) == ',') {
+            ++decoder->current;
+        }
+        reader->event = JSON_EVENT_NONE;
+        break;
+    default:
+        break;
+    }
+    if (!json_reader_in_object(reader)) {
+        return true;
+    }
+    switch (json_peek(decoder)) {
+    case '}':
+        json_reader_close(reader);
+        return false;
+    case '"':
+        break;
+    default:
+        json_reader_invalid(reader, "Expected member name");
+        return false;
+    }
+    ErrorOrStringView name = json_decode_string(decoder);
+    if (ErrorOrStringView_is_error(name)) {
+        json_reader_error(reader, name.error);
+        return false;
+    }
+    if (json_peek(decoder) != ':') {
+        json_reader_invalid(reader, "Expected ':'");
+        return false;
+    }
+    ++decoder->current;
+    reader->key = json_adopt_string(decoder, name.value);
+    reader->event = JSON_EVENT_KEY;
+    return false;
+}
+
+// Steps to the next event. key and value point into the text, or into the
+// reader's arena for strings with escapes, and stay valid until the reader
+// is freed. Once the reader reports DONE or ERROR it keeps doing so.
+JSONEvent json_reader_next(JSONReader *reader)
+{
+    JSONDecoder *decoder = reader->decoder;
+    if (!json_reader_advance(reader)) {
+        return reader->event;
+    }
+    switch (json_peek(decoder)) {
+    case 0:
+        return json_reader_invalid(reader, "Expected value");
+    case '{':
+    case '[':
+        DIA_APPEND(bool, &reader->in_object, json_peek(decoder) == '{');
+        ++decoder->current;
+        reader->event = (json_reader_in_object(reader)) ? JSON_EVENT_BEGIN_OBJECT : JSON_EVENT_BEGIN_ARRAY;
+        return reader->event;
+    case ']':
+        if (reader->event != JSON_EVENT_KEY && reader->in_object.size > 0) {
+            return json_reader_close(reader);
+        }
+        return json_reader_invalid(reader, "Invalid JSON");
+    case '}':
+    case ':':
+    case ',':
+        return json_reader_invalid(reader, "Invalid JSON");
+    case '"': {
+        ErrorOrStringView str = json_decode_string(decoder);
+        if (ErrorOrStringView_is_error(str)) {
+            return json_reader_error(reader, str.error);
+        }
+        reader->value = json_string_view(json_adopt_string(decoder, str.value));
+    } break;
+    default: {
+        ErrorOrJSONValue scalar = json_decode_scalar(decoder);
+        if (ErrorOrJSONValue_is_error(scalar)) {
+            return json_reader_error(reader, scalar.error);
+        }
+        reader->value = scalar.value;
+    } break;
+    }
+    reader->event = JSON_EVENT_VALUE;
+    return reader->event;
+}
+
+// For reading arrays: returns true if another element follows, and false
+// once the closing bracket has been read, or on error.
+bool json_reader_more(JSONReader *reader)
+{
+    if (!json_reader_advance(reader)) {
+        return false;
+    }
+    char ch = json_peek(reader->decoder);
+    if (ch == ']' || ch == 0) {
+        json_reader_next(reader);
+        return false;
+    }
+    return true;
+}
+
+// Skips the rest of the innermost object or array, up to and including its
+// closing bracket. Only the nesting of the skipped text is checked.
+void json_reader_leave(JSONReader *reader)
+{
+    JSONDecoder *decoder = reader->decoder;
+    if (reader->event == JSON_EVENT_ERROR || reader->in_object.size == 0) {
+        return;
+    }
+    reader->key = sv_null();
+    reader->value = json_null();
+    for (size_t depth = 1; true; ++decoder->current) {
+        switch (json_peek(decoder)) {
+        case 0:
+            json_reader_invalid(reader, "Unterminated object or array");
+            return;
+        case '{':
+        case '[':
+            ++depth;
+            break;
+        case '}':
+        case ']':
+            if (--depth == 0) {
+                json_reader_close(reader);
+                return;
+            }
+            break;
+        case '"':
+            // The opening and closing quotes are separate entries.
+            ++decoder->current;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Skips the next value, however deeply nested it is.
+void json_reader_skip(JSONReader *reader)
+{
+    JSONEvent event = json_reader_next(reader);
+    if (event == JSON_EVENT_BEGIN_OBJECT || event == JSON_EVENT_BEGIN_ARRAY) {
+        json_reader_leave(reader);
+    }
+}
+
+// Reads the next value, and returns true if it produced the given event:
+// VALUE, BEGIN_OBJECT or BEGIN_ARRAY. Values of another kind are skipped.
+bool json_reader_expect(JSONReader *reader, JSONEvent event)
+{
+    JSONEvent next = json_reader_next(reader);
+    if (next == event) {
+        return true;
+    }
+    if (next == JSON_EVENT_BEGIN_OBJECT || next == JSON_EVENT_BEGIN_ARRAY) {
+        json_reader_leave(reader);
+    }
+    return false;
+}
+
+size_t json_reader_depth(JSONReader *reader)
+{
+    return reader->in_object.size;
+}
+
+// Leaves objects and arrays until no more than depth are open. This gets a
+// reader back in step after giving up on a value halfway through.
+void json_reader_unwind(JSONReader *reader, size_t depth)
+{
+    while (reader->in_object.size > depth && reader->event != JSON_EVENT_ERROR) {
+        json_reader_leave(reader);
+    }
+}
+
+// Reads up to the member called name of the object that is being read, or
+// that starts at the next value, and leaves the reader in front of the
+// member's value. Returns false if there is no such member.
+bool json_reader_member(JSONReader *reader, StringView name)
+{
+    if (!json_reader_in_object(reader) && !json_reader_expect(reader, JSON_EVENT_BEGIN_OBJECT)) {
+        return false;
+    }
+    while (json_reader_next(reader) == JSON_EVENT_KEY) {
+        if (sv_eq(reader->key, name)) {
+            return true;
+        }
+        json_reader_skip(reader);
+    }
+    return false;
+}
+
+// Decodes the next value into a document owned by the caller, for the parts
+// of a text that are easier to deal with as a whole.
+OptionalJSONValue json_reader_decode(JSONReader *reader)
+{
+    JSONDecoder *decoder = reader->decoder;
+    if (!json_reader_advance(reader)) {
+        RETURN_EMPTY(JSONValue);
+    }
+    if (json_peek(decoder) != '{' && json_peek(decoder) != '[') {
+        if (json_reader_next(reader) != JSON_EVENT_VALUE) {
+            RETURN_EMPTY(JSONValue);
+        }
+        RETURN_VALUE(JSONValue, json_copy(reader->value));
+    }
+    Allocator alloc = decoder->alloc;
+    decoder->alloc = (Allocator) { 0 };
+    ErrorOrJSONValue ret = json_decode_value(decoder);
+    if (ErrorOrJSONValue_is_error(ret)) {
+        json_decoder_unwind(decoder, 0, 0);
+    }
+    decoder->alloc = alloc;
+    if (ErrorOrJSONValue_is_error(ret)) {
+        json_reader_error(reader, ret.error);
+        RETURN_EMPTY(JSONValue);
+    }
+    reader->event = JSON_EVENT_VALUE;
+    RETURN_VALUE(JSONValue, ret.value);
+}
+
+#ifdef JSON_FORMAT
+
+#include <io.h>
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        return -1;
+    }
+    log_init();
+    StringView sv = MUST(StringView, read_file_by_name(sv_from(argv[1])));
+    JSONValue  json = MUST(JSONValue, json_decode(sv));
+    printf("%.*s\n", SV_ARG(json_encode(json)));
+    return 0;
+}
+
+#endif
+
+#ifdef JSON_TEST
+
+#include <time.h>
+
+#include <io.h>
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Backslashes, quotes and structural characters in strings, at random
+// offsets, exercise the escape and in-string tracking of the first stage
+// across chunk boundaries. The encoder does not escape member names, so
+// those only get structural characters.
+static StringView random_string(bool escapes)
+{
+    char const   *alphabet = (escapes) ? "ab \\\\\"\"{}[]:,\n\t" : "ab {}[]:,";
+    StringBuilder sb = { 0 };
+    for (int len = rand() % 80; len > 0; --len) {
+        sb_append_char(&sb, alphabet[rand() % strlen(alphabet)]);
+    }
+    return sb.view;
+}
+
+static ErrorOrSize append_iov(void *context, struct iovec const *iov, int iovcnt)
+{
+    size_t total = 0;
+    for (int ix = 0; ix < iovcnt; ++ix) {
+        sb_append_chars((StringBuilder *) context, iov[ix].iov_base, iov[ix].iov_len);
+        total += iov[ix].iov_len;
+    }
+    RETURN(Size, total);
+}
+
+// Checks that json_write produces json_encoded_length bytes of JSON that
+// decodes back to value.
+static void check_write(JSONValue value)
+{
+    StringBuilder sb = { 0 };
+    size_t        written = MUST(Size, json_write(value, sv_from("##"), append_iov, &sb));
+    assert(written == sb.view.length && written == json_encoded_length(value) + 2);
+    JSONValue decoded = MUST(JSONValue, json_decode(sv_lchop(sb.view, 2)));
+    assert(json_compare(value, decoded) == 0);
+    json_free(decoded);
+    sv_free(sb.view);
+}
+
+// Checks that the reader produces the events that describe value.
+static void check_reader(JSONReader *reader, JSONValue value)
+{
+    switch (value.type) {
+    case JSON_TYPE_OBJECT:
+        assert(json_reader_next(reader) == JSON_EVENT_BEGIN_OBJECT);
+        for (size_t ix = 0; ix < value.object.size; ++ix) {
+            JSONNVPair *member = (JSONNVPair *) value.object.elements + ix;
+            assert(json_reader_next(reader) == JSON_EVENT_KEY && sv_eq(reader->key, member->name));
+            check_reader(reader, member->value);
+        }
+        assert(json_reader_next(reader) == JSON_EVENT_END_OBJECT);
+        break;
+    case JSON_TYPE_ARRAY:
+        assert(json_reader_next(reader) == JSON_EVENT_BEGIN_ARRAY);
+        for (size_t ix = 0; ix < value.array.size; ++ix) {
+            assert(json_reader_more(reader));
+            check_reader(reader, ((JSONValue *) value.array.elements)[ix]);
+        }
+        assert(!json_reader_more(reader) && reader->event == JSON_EVENT_END_ARRAY);
+        break;
+    default:
+        assert(json_reader_next(reader) == JSON_EVENT_VALUE && json_compare(reader->value, value) == 0);
+        break;
+    }
+}
+
+static JSONValue random_value(int depth)
+{
+    switch ((depth > 3) ? 2 + rand() % 5 : rand() % 7) {
+    case 0: {
+        JSONValue ret = json_object();
+        for (int count = rand() % 6; count > 0; --count) {
+            json_set_sv(&ret, random_string(false), random_value(depth + 1));
+        }
+        return ret;
+    }
+    case 1: {
+        JSONValue ret = json_array();
+        for (int count = rand() % 6; count > 0; --count) {
+            json_append(&ret, random_value(depth + 1));
+        }
+        return ret;
+    }
+    case 2:
+        return json_string(random_string(true));
+    case 3:
+        return json_int(rand() - RAND_MAX / 2);
+    case 4:
+        return json_number((double) (rand() % 1000) / 8.0);
+    case 5:
+        return json_bool(rand() % 2);
+    default:
+        return json_null();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    JSONValue obj = json_object();
+    json_set(&obj, "foo", json_string(sv_from("bar")));
+    json_set(&obj, "quux", json_string(sv_from("hello")));
+    StringView json = json_encode(obj);
+    printf("%.*s\n", SV_ARG(json));
+
+    ErrorOrJSONValue decoded = json_decode(json);
+    if (ErrorOrJSONValue_is_error(decoded)) {
+        printf("Decoding error: %s\n", Error_to_string(decoded.error));
+    } else {
+        json = json_encode(decoded.value);
+        printf("%.*s\n", SV_ARG(json));
+    }
+
+    srand(42);
+    for (int round = 0; round < 2000; ++round) {
+        JSONValue value = random_value(0);
+        json = json_encode(value);
+        JSONValue round_trip = MUST(JSONValue, json_decode(json));
+        assert(json_compare(value, round_trip) == 0);
+        check_write(value);
+        JSONValue borrowed = MUST(JSONValue, json_decode_arena(json));
+        assert(json_compare(value, borrowed) == 0);
+        JSONValue copy = json_copy(borrowed);
+        json_free(borrowed);
+        assert(json_compare(value, copy) == 0);
+        JSONReader reader = json_reader(json);
+        check_reader(&reader, value);
+        assert(json_reader_next(&reader) == JSON_EVENT_DONE);
+        json_reader_free(&reader);
+        reader = json_reader(json);
+        OptionalJSONValue read = json_reader_decode(&reader);
+        assert(read.has_value && json_compare(value, read.value) == 0 && json_reader_next(&reader) == JSON_EVENT_DONE);
+        json_free(read.value);
+        json_reader_free(&reader);
+        reader = json_reader(json);
+        json_reader_skip(&reader);
+        assert(json_reader_next(&reader) == JSON_EVENT_DONE);
+        json_reader_free(&reader);
+        json_free(value);
+        json_free(round_trip);
+        json_free(copy);
+        sv_free(json);
+    }
+
+    char const *valid[] = { "[1,2,]", "{\"a\":1,}", "[-12.5e3, 1E2, 0]", "\"a\\\\\\\"b\"", "[true,false,null]", NULL };
+    for (int ix = 0; valid[ix]; ++ix) {
+        assert(!ErrorOrJSONValue_is_error(json_decode(sv_from(valid[ix]))));
+    }
+    char const *invalid[] = { "", "{", "[1,", "\"abc", "\"abc\\\"", "{\"a\" 1}", "{1:2}", "tru", "[1 2x]", "[,]", "-", "[-]", "[-x]", "{\"a\":-.5}", NULL };
+    for (int ix = 0; invalid[ix]; ++ix) {
+        assert(ErrorOrJSONValue_is_error(json_decode(sv_from(invalid[ix]))));
+        assert(ErrorOrJSONValue_is_error(json_decode_arena(sv_from(invalid[ix]))));
+        JSONReader reader = json_reader(sv_from(invalid[ix]));
+        while (json_reader_next(&reader) != JSON_EVENT_ERROR) {
+            assert(reader.event != JSON_EVENT_DONE);
+        }
+        json_reader_free(&reader);
+    }
+    {
+        // Skipping members, and getting back in step after giving up on a
+        // value halfway through.
+        JSONReader reader = json_reader(sv_from("{\"a\":[1,{\"x\":\"]}\"}],\"b\":{\"c\":[2,3],\"d\":4},\"e\":\"\\u00e9t\\u00e9\"}"));
+        assert(json_reader_member(&reader, sv_from("b")));
+        assert(json_reader_expect(&reader, JSON_EVENT_BEGIN_OBJECT) && json_reader_next(&reader) == JSON_EVENT_KEY);
+        assert(json_reader_expect(&reader, JSON_EVENT_BEGIN_ARRAY) && json_reader_more(&reader));
+        assert(json_reader_next(&reader) == JSON_EVENT_VALUE && json_int_value(reader.value) == 2);
+        json_reader_unwind(&reader, 1);
+        assert(json_reader_member(&reader, sv_from("e")));
+        assert(json_reader_next(&reader) == JSON_EVENT_VALUE && sv_eq_cstr(reader.value.string, "\xc3\xa9t\xc3\xa9"));
+        assert(!json_reader_member(&reader, sv_from("f")) && json_reader_next(&reader) == JSON_EVENT_DONE);
+        json_reader_free(&reader);
+    }
+    {
+        // The reader only indexes as far as it reads, and strings with
+        // escaped quotes come out right across index batches.
+        StringBuilder sb = sb_create();
+        sb_append_cstr(&sb, "{\"id\":7,\"result\":[");
+        for (int ix = 0; ix < 10000; ++ix) {
+            sb_printf(&sb, "%s\"a\\\"b\\\\\"", (ix) ? "," : "");
+        }
+        sb_append_cstr(&sb, "]}");
+        JSONReader reader = json_reader(sb.view);
+        assert(json_reader_member(&reader, sv_from("id")));
+        assert(json_reader_next(&reader) == JSON_EVENT_VALUE && json_int_value(reader.value) == 7);
+        assert(reader.decoder->indexed < sb.view.length);
+        assert(json_reader_member(&reader, sv_from("result")) && json_reader_expect(&reader, JSON_EVENT_BEGIN_ARRAY));
+        int count = 0;
+        while (json_reader_more(&reader)) {
+            assert(json_reader_next(&reader) == JSON_EVENT_VALUE && sv_eq_cstr(reader.value.string, "a\"b\\"));
+            ++count;
+        }
+        assert(count == 10000 && json_reader_next(&reader) == JSON_EVENT_END_OBJECT);
+        assert(json_reader_next(&reader) == JSON_EVENT_DONE && reader.decoder->indexed == sb.view.length);
+        json_reader_free(&reader);
+        sv_free(sb.view);
+    }
+
+    // Sets, replacements and deletes on objects either side of the index
+    // threshold, checked against the expected contents in insertion order.
+    for (int size = 1; size <= 200; size += 13) {
+        JSONValue obj = json_object();
+        for (int ix = 0; ix < size; ++ix) {
+            json_set_int_sv(&obj, sv_printf("key%d", ix), ix);
+        }
+        for (int ix = 0; ix < size; ix += 3) {
+            json_set_int_sv(&obj, sv_printf("key%d", ix), -ix);
+        }
+        for (int ix = 1; ix < size; ix += 4) {
+            json_delete_sv(&obj, sv_printf("key%d", ix));
+        }
+        size_t pos = 0;
+        for (int ix = 0; ix < size; ++ix) {
+            StringView name = sv_printf("key%d", ix);
+            JSONValue *ref = json_get_ref(&obj, name);
+            assert((ref != NULL) == (ix % 4 != 1) && json_has_sv(&obj, name) == (ref != NULL));
+            if (ref != NULL) {
+                assert(json_int_value(*ref) == ((ix % 3) ? ix : -ix));
+                assert(sv_eq(((JSONNVPair *) obj.object.elements)[pos++].name, name));
+            }
+        }
+        assert(pos == obj.object.size);
+        json = json_encode(obj);
+        JSONValue round_trip = MUST(JSONValue, json_decode(json));
+        JSONValue borrowed = MUST(JSONValue, json_decode_arena(json));
+        assert(json_compare(obj, round_trip) == 0 && json_compare(obj, borrowed) == 0);
+        assert(json_get_ref(&borrowed, sv_from("key0")) != NULL && json_get_ref(&borrowed, sv_from("key1")) == NULL);
+        json_free(obj);
+        json_free(round_trip);
+        json_free(borrowed);
+    }
+    JSONValue dups = MUST(JSONValue, json_decode(sv_from("{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"f\":6,\"g\":7,\"h\":8,\"i\":9,\"a\":10,\"j\":11,\"b\":12}")));
+    assert(dups.object.size == 10 && json_get_int(&dups, "a", 0) == 10 && json_get_int(&dups, "b", 0) == 12);
+    assert(sv_eq_cstr(((JSONNVPair *) dups.object.elements)[9].name, "j"));
+    json_free(dups);
+
+    {
+        size_t      count = 20000;
+        StringView *names = malloc(count * sizeof(StringView));
+        for (size_t ix = 0; ix < count; ++ix) {
+            names[ix] = sv_printf("member%zu", ix);
+        }
+        JSONValue big = json_object();
+        double    start = now();
+        for (size_t ix = 0; ix < count; ++ix) {
+            json_set_int_sv(&big, names[ix], (int) ix);
+        }
+        double set_time = now() - start;
+        start = now();
+        for (size_t ix = 0; ix < count; ++ix) {
+            assert(json_get_ref(&big, names[ix]) != NULL);
+        }
+        double get_time = now() - start;
+        printf("%zu members: json_set %.0f ns, json_get_ref %.0f ns per member\n", count, set_time / count * 1e9, get_time / count * 1e9);
+        json_free(big);
+        for (size_t ix = 0; ix < count; ++ix) {
+            sv_free(names[ix]);
+        }
+        free(names);
+    }
+
+    {
+        // A document that needs several batches, with long runs between
+        // escapes that are written as views, and control characters.
+        StringBuilder text = { 0 };
+        for (int line = 0; line < 20000; ++line) {
+            sb_printf(&text, "%*s\"line\" %d\x01\t\n", line % 700, "", line);
+        }
+        JSONValue doc = json_object();
+        json_set(&doc, "text", json_string_view(text.view));
+        json_set(&doc, "copy", json_string(text.view));
+        check_write(doc);
+        json_free(doc);
+        sv_free(text.view);
+    }
+
+    // Throughput on recorded clangd traffic, or on the files given.
+    StringList files = { 0 };
+    if (argc > 1) {
+        for (int ix = 1; ix < argc; ++ix) {
+            sl_push(&files, sv_from(argv[ix]));
+        }
+    } else {
+        StringView dir = sv_from(__FILE__);
+        dir.length = strrchr(__FILE__, '/') - __FILE__;
+        sl_push(&files, sv_printf("%.*s/test/lsp-initialize-response.json", SV_ARG(dir)));
+        sl_push(&files, sv_printf("%.*s/test/lsp-publish-diagnostics-request.json", SV_ARG(dir)));
+    }
+    for (size_t ix = 0; ix < files.size; ++ix) {
+        StringView text = MUST(StringView, read_file_by_name(files.strings[ix]));
+        size_t     rounds = 1 + (64 * 1024 * 1024) / (text.length + 1);
+        double     start = now();
+        for (size_t round = 0; round < rounds; ++round) {
+            json_free(MUST(JSONValue, json_decode(text)));
+        }
+        double heap_time = now() - start;
+        start = now();
+        for (size_t round = 0; round < rounds; ++round) {
+            json_free(MUST(JSONValue, json_decode_arena(text)));
+        }
+        double arena_time = now() - start;
+        start = now();
+        for (size_t round = 0; round < rounds; ++round) {
+            JSONReader reader = json_reader(text);
+            while (json_reader_next(&reader) != JSON_EVENT_DONE) {
+                assert(reader.event != JSON_EVENT_ERROR);
+            }
+            json_reader_free(&reader);
+        }
+        double reader_time = now() - start;
+        printf("%.*s: %zu bytes, heap %.1f MB/s, arena %.1f MB/s, reader %.1f MB/s\n", SV_ARG(files.strings[ix]), text.length,
+            (double) (rounds * text.length) / heap_time / 1e6, (double) (rounds * text.length) / arena_time / 1e6,
+            (double) (rounds * text.length) / reader_time / 1e6);
     }
     return 0;
 }
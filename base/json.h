@@ -7,7 +7,10 @@
 #ifndef __JSON_H__
 #define __JSON_H__
 
+#include <sys/uio.h>
+
 #include <base/integer.h>
+#include <base/mem.h>
 #include <base/sv.h>
 
 #define JSONTYPES(S) \
@@ -26,11 +29,38 @@ typedef enum {
 #undef S
 } JSONType;
 
+#define JSONEVENTS(S) \
+    S(NONE)           \
+    S(BEGIN_OBJECT)   \
+    S(END_OBJECT)     \
+    S(BEGIN_ARRAY)    \
+    S(END_ARRAY)      \
+    S(KEY)            \
+    S(VALUE)          \
+    S(DONE)           \
+    S(ERROR)
+
+typedef enum {
+#undef S
+#define S(T) JSON_EVENT_##T,
+    JSONEVENTS(S)
+#undef S
+} JSONEvent;
+
 DA_VOID_WITH_NAME(JSONValue, JSONValues);
 DA_VOID_WITH_NAME(JSONNVPair, JSONNVPairs);
 
+/*
+ * Values decoded by json_decode_arena are borrowed: they, their strings and
+ * their member arrays live in an arena owned by the root of the document,
+ * which is the only one with arena set. json_free on a borrowed value is a
+ * no-op, except on that root, where it releases the whole arena. Strings
+ * made by json_string_view are borrowed as well; they refer to text owned
+ * by the caller.
+ */
 typedef struct json_value {
     JSONType type;
+    bool     borrowed;
     union {
         JSONNVPairs object;
         JSONValues  array;
@@ -39,6 +69,7 @@ typedef struct json_value {
         double      double_number;
         bool        boolean;
     };
+    Allocator *arena;
 } JSONValue;
 
 typedef struct {
@@ -52,11 +83,33 @@ OPTIONAL(JSONValue)
 ERROR_OR(JSONValue)
 OPTIONAL(JSONValues)
 
+typedef struct json_decoder JSONDecoder;
+
+/*
+ * Pull reader: json_reader_next steps through the text one event at a time,
+ * without building a document. A KEY event carries the member name in key,
+ * a VALUE event a scalar in value; strings are borrowed from the text,
+ * which must outlive the reader. Errors are reported with an ERROR event
+ * and error.
+ */
+typedef struct {
+    JSONEvent    event;
+    StringView   key;
+    JSONValue    value;
+    Error        error;
+    JSONDecoder *decoder;
+    Bools        in_object;
+} JSONReader;
+
+typedef ErrorOrSize (*JSONWriteV)(void *context, struct iovec const *iov, int iovcnt);
+
 extern char const       *JSONType_name(JSONType type);
+extern char const       *JSONEvent_name(JSONEvent event);
 extern JSONValue         json_object(void);
 extern JSONValue         json_array(void);
 extern JSONValue         json_null(void);
 extern JSONValue         json_string(StringView sv);
+extern JSONValue         json_string_view(StringView sv);
 extern JSONValue         json_number(double number);
 extern JSONValue         json_int(int number);
 extern JSONValue         json_integer(Integer number);
@@ -97,7 +150,21 @@ extern void              json_delete_sv(JSONValue *value, StringView attr);
 extern void              json_merge(JSONValue *value, JSONValue sub);
 extern StringView        json_to_string(JSONValue value);
 extern StringView        json_encode(JSONValue value);
+extern size_t            json_encoded_length(JSONValue value);
+extern ErrorOrSize       json_write(JSONValue value, StringView prefix, JSONWriteV writev, void *context);
 extern ErrorOrJSONValue  json_decode(StringView json_text);
+extern ErrorOrJSONValue  json_decode_arena(StringView json_text);
+extern JSONReader        json_reader(StringView json_text);
+extern void              json_reader_free(JSONReader *reader);
+extern JSONEvent         json_reader_next(JSONReader *reader);
+extern bool              json_reader_more(JSONReader *reader);
+extern void              json_reader_leave(JSONReader *reader);
+extern void              json_reader_skip(JSONReader *reader);
+extern bool              json_reader_expect(JSONReader *reader, JSONEvent event);
+extern size_t            json_reader_depth(JSONReader *reader);
+extern void              json_reader_unwind(JSONReader *reader, size_t depth);
+extern bool              json_reader_member(JSONReader *reader, StringView name);
+extern OptionalJSONValue json_reader_decode(JSONReader *reader);
 
 #define json_get(JSON, ...) _json_get((JSON) __VA_OPT__(, ) __VA_ARGS__, NULL)
 
@@ -6,26 +6,21 @@
 
 #include <stdarg.h>
 
+#include <base/charclass.h>
 #include <base/error_or.h>
 #include <base/io.h>
 #include <base/lexer.h>
 
-static int   isbdigit(int ch);
-static Token scan_number(char const *buffer);
+static Token scan_number(char const *buffer, size_t len);
 
-int isbdigit(int ch)
-{
-    return ch == '0' || ch == '1';
-}
-
-Token scan_number(char const *buffer)
+Token scan_number(char const *buffer, size_t len)
 {
     NumberType type = NTInteger;
-    int        ix = 0;
-    int (*predicate)(int) = isdigit;
-    if (buffer[1] && buffer[0] == '0') {
+    size_t     ix = 0;
+    uint8_t    digits = CC_DIGIT;
+    if (len > 1 && buffer[0] == '0') {
         if (buffer[1] == 'x' || buffer[1] == 'X') {
-            if (!buffer[2] || !isxdigit(buffer[2])) {
+            if (len < 3 || !cc_is(buffer[2], CC_XDIGIT)) {
                 return (Token) {
                     .kind = TK_NUMBER,
                     .text = { buffer, 1 },
@@ -34,10 +29,10 @@ Token scan_number(char const *buffer)
                 };
             }
             type = NTHexNumber;
-            predicate = isxdigit;
+            digits = CC_XDIGIT;
             ix = 2;
         } else if (buffer[1] == 'b' || buffer[1] == 'B') {
-            if (!buffer[2] || !isxdigit(buffer[2])) {
+            if (len < 3 || !cc_is(buffer[2], CC_XDIGIT)) {
                 return (Token) {
                     .kind = TK_NUMBER,
                     .text = { buffer, 1 },
@@ -46,14 +41,15 @@ Token scan_number(char const *buffer)
                 };
             }
             type = NTBinaryNumber;
-            predicate = isbdigit;
+            digits = CC_BDIGIT;
             ix = 2;
         }
     }
 
     while (true) {
-        char ch = buffer[ix];
-        if (!predicate(ch) && ((ch != '.') || (type == NTDecimal))) {
+        ix += cc_span(buffer + ix, len - ix, digits);
+        char ch = (ix < len) ? buffer[ix] : '\0';
+        if ((ch != '.') || (type == NTDecimal)) {
             // FIXME lex '1..10' as '1', '..', '10'. It will now lex as '1.', '.', '10'
             return (Token) {
                 .kind = TK_NUMBER,
@@ -62,21 +58,151 @@ Token scan_number(char const *buffer)
                 .number_type = type,
             };
         }
-        if (ch == '.') {
-            if (type != NTInteger) {
-                return (Token) {
-                    .kind = TK_NUMBER,
-                    .text = { buffer, ix },
-                    .location = 0,
-                    .number_type = type,
-                };
-            }
-            type = NTDecimal;
+        if (type != NTInteger) {
+            return (Token) {
+                .kind = TK_NUMBER,
+                .text = { buffer, ix },
+                .location = 0,
+                .number_type = type,
+            };
         }
+        type = NTDecimal;
         ++ix;
     }
 }
 
+typedef struct {
+    uint16_t next;  // Next sibling, 0 if none
+    uint16_t child; // First child, 0 if none
+    int      value; // -1 if no keyword ends here
+    char     ch;
+} KeywordNode;
+
+struct keyword_trie {
+    uint16_t     root[256];
+    KeywordNode *nodes;
+    size_t       size;
+    size_t       cap;
+};
+
+KeywordTrie *keyword_trie_create()
+{
+    KeywordTrie *ret = MALLOC(KeywordTrie);
+    memset(ret, 0, sizeof(KeywordTrie));
+    // Node 0 is never used, so that 0 can mean 'no node'.
+    ret->size = 1;
+    ret->cap = da_capacity_for(0, 1);
+    ret->nodes = da_reallocate(NULL, sizeof(KeywordNode), ret->cap);
+    return ret;
+}
+
+void keyword_trie_free(KeywordTrie *trie)
+{
+    if (trie) {
+        free(trie->nodes);
+        free(trie);
+    }
+}
+
+static uint16_t keyword_trie_new_node(KeywordTrie *trie, char ch)
+{
+    assert(trie->size < UINT16_MAX);
+    if (trie->size == trie->cap) {
+        trie->cap = da_capacity_for(trie->cap, trie->size + 1);
+        trie->nodes = da_reallocate(trie->nodes, sizeof(KeywordNode), trie->cap);
+    }
+    trie->nodes[trie->size] = (KeywordNode) { .next = 0, .child = 0, .value = -1, .ch = ch };
+    return (uint16_t) trie->size++;
+}
+
+static uint16_t keyword_trie_child(KeywordTrie *trie, uint16_t node, char ch)
+{
+    for (uint16_t ix = trie->nodes[node].child; ix; ix = trie->nodes[ix].next) {
+        if (trie->nodes[ix].ch == ch) {
+            return ix;
+        }
+    }
+    return 0;
+}
+
+void keyword_trie_add(KeywordTrie *trie, StringView keyword, int value)
+{
+    assert(keyword.length > 0 && value >= 0);
+    uint8_t  first = (uint8_t) keyword.ptr[0];
+    uint16_t node = trie->root[first];
+    if (!node) {
+        node = keyword_trie_new_node(trie, keyword.ptr[0]);
+        trie->root[first] = node;
+    }
+    for (size_t ix = 1; ix < keyword.length; ++ix) {
+        uint16_t child = keyword_trie_child(trie, node, keyword.ptr[ix]);
+        if (!child) {
+            child = keyword_trie_new_node(trie, keyword.ptr[ix]);
+            trie->nodes[child].next = trie->nodes[node].child;
+            trie->nodes[node].child = child;
+        }
+        node = child;
+    }
+    // Duplicates keep the first value, like a linear scan would.
+    if (trie->nodes[node].value < 0) {
+        trie->nodes[node].value = value;
+    }
+}
+
+// Returns the value of the keyword equal to text, or -1.
+int keyword_trie_find(KeywordTrie *trie, StringView text)
+{
+    if (text.length == 0) {
+        return -1;
+    }
+    uint16_t node = trie->root[(uint8_t) text.ptr[0]];
+    for (size_t ix = 1; node && ix < text.length; ++ix) {
+        node = keyword_trie_child(trie, node, text.ptr[ix]);
+    }
+    return (node) ? trie->nodes[node].value : -1;
+}
+
+// Returns the value of the longest keyword that is a prefix of text and
+// stores its length in *length, or returns -1 if there is none.
+int keyword_trie_match_prefix(KeywordTrie *trie, StringView text, size_t *length)
+{
+    int      ret = -1;
+    uint16_t node = (text.length > 0) ? trie->root[(uint8_t) text.ptr[0]] : 0;
+    for (size_t ix = 1; node; ++ix) {
+        if (trie->nodes[node].value >= 0) {
+            ret = trie->nodes[node].value;
+            *length = ix;
+        }
+        if (ix == text.length) {
+            break;
+        }
+        node = keyword_trie_child(trie, node, text.ptr[ix]);
+    }
+    return ret;
+}
+
+// Builds the keyword trie for a language the first time it is needed.
+// Languages are static and may be shared between threads, so the trie is
+// published with a compare-and-swap; a thread that loses the race frees
+// its copy.
+static KeywordTrie *language_keyword_trie(Language *language)
+{
+    KeywordTrie *trie = __atomic_load_n(&language->keyword_trie, __ATOMIC_ACQUIRE);
+    if (trie || !language->keywords) {
+        return trie;
+    }
+    trie = keyword_trie_create();
+    for (int kw = 0; language->keywords[kw].keyword; ++kw) {
+        keyword_trie_add(trie, sv_from(language->keywords[kw].keyword), kw);
+    }
+    KeywordTrie *expected = NULL;
+    if (!__atomic_compare_exchange_n(&language->keyword_trie, &expected, trie, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        keyword_trie_free(trie);
+        trie = expected;
+    }
+    return trie;
+}
+
 Lexer lexer_create()
 {
     Lexer ret = { 0 };
@@ -87,6 +213,7 @@ Lexer lexer_for_language(Language *language)
 {
     Lexer ret = { 0 };
     ret.language = language;
+    language_keyword_trie(language);
     return ret;
 }
 
@@ -137,14 +264,14 @@ Token directive_handle(Lexer *lexer, Token trigger)
     if (lexer->language->directives == NULL || lexer->language->directives[0] == NULL) {
         return trigger;
     }
-    while (buffer[directive_start] && isspace(buffer[directive_start])) {
+    while (buffer[directive_start] && cc_is(buffer[directive_start], CC_SPACE)) {
         ++directive_start;
     }
     if (!buffer[directive_start]) {
         return trigger;
     }
     size_t directive_end = directive_start;
-    while (buffer[directive_end] && isalpha(buffer[directive_end]))
+    while (buffer[directive_end] && cc_is(buffer[directive_end], CC_ALPHA))
         ++directive_end;
     if (directive_end == directive_start) {
         return trigger;
@@ -184,11 +311,16 @@ Token lexer_peek(Lexer *lexer)
     return lexer_set_current(lexer, lexer_peek_next(lexer));
 }
 
-Token block_comment(Lexer *lexer, char const *buffer, size_t ix)
+Token block_comment(Lexer *lexer, char const *buffer, size_t len, size_t ix)
 {
-    for (; buffer[ix] && buffer[ix] != '\n' && (buffer[ix - 1] != '*' || buffer[ix] != '/'); ++ix)
-        ;
-    if (!buffer[ix]) {
+    while (true) {
+        ix += cc_scan_to(buffer + ix, len - ix, "\n/");
+        if (ix >= len || buffer[ix] != '/' || (ix > 0 && buffer[ix - 1] == '*')) {
+            break;
+        }
+        ++ix;
+    }
+    if (ix >= len || !buffer[ix]) {
         return (Token) {
             .kind = TK_COMMENT,
             .comment = {
@@ -220,6 +352,62 @@ Token block_comment(Lexer *lexer, char const *buffer, size_t ix)
     };
 }
 
+#ifdef LEXER_TEST
+
+// The keyword lookups the lexer did before the trie: compare against every
+// keyword of the language. Kept for the benchmark in the test main.
+static bool s_linear_keywords = false;
+
+static int linear_find(Keyword *keywords, StringView text)
+{
+    for (int kw = 0; keywords[kw].keyword; ++kw) {
+        StringView keyword = sv_from(keywords[kw].keyword);
+        if (keyword.length == text.length && sv_startswith(text, keyword)) {
+            return kw;
+        }
+    }
+    return -1;
+}
+
+static int linear_match_prefix(Keyword *keywords, StringView text, size_t *length)
+{
+    int    ret = -1;
+    size_t best = 0;
+    for (int kw = 0; keywords[kw].keyword; ++kw) {
+        StringView keyword = sv_from(keywords[kw].keyword);
+        if (sv_startswith(text, keyword) && (ret < 0 || keyword.length > best)) {
+            ret = kw;
+            best = keyword.length;
+        }
+    }
+    if (ret >= 0) {
+        *length = best;
+    }
+    return ret;
+}
+
+#endif
+
+static int lexer_find_keyword(Lexer *lexer, KeywordTrie *keywords, StringView text)
+{
+#ifdef LEXER_TEST
+    if (s_linear_keywords) {
+        return (keywords) ? linear_find(lexer->language->keywords, text) : -1;
+    }
+#endif
+    return (keywords) ? keyword_trie_find(keywords, text) : -1;
+}
+
+static int lexer_match_keyword_prefix(Lexer *lexer, KeywordTrie *keywords, StringView text, size_t *length)
+{
+#ifdef LEXER_TEST
+    if (s_linear_keywords) {
+        return linear_match_prefix(lexer->language->keywords, text, length);
+    }
+#endif
+    return keyword_trie_match_prefix(keywords, text, length);
+}
+
 Token lexer_peek_next(Lexer *lexer)
 {
     if (lexer->current.kind != TK_UNKNOWN) {
@@ -227,7 +415,8 @@ Token lexer_peek_next(Lexer *lexer)
     }
     StringView  source = lexer_source(lexer);
     char const *buffer = source.ptr;
-    if (!buffer || !buffer[0]) {
+    size_t      len = source.length;
+    if (!buffer || !len || !buffer[0]) {
         return (Token) {
             .kind = TK_END_OF_FILE,
             .text = { buffer, 0 },
@@ -240,35 +429,35 @@ Token lexer_peek_next(Lexer *lexer)
                 .text = { buffer, 1 },
             };
         }
-        return block_comment(lexer, buffer, 0);
+        return block_comment(lexer, buffer, len, 0);
     }
     switch (buffer[0]) {
     case '\'':
     case '"':
     case '`': {
+        char   stops[3] = { buffer[0], '\\', '\0' };
         size_t ix = 1;
-        while (buffer[ix] && buffer[ix] != buffer[0]) {
-            if (buffer[ix] == '\\')
-                ++ix;
-            if (buffer[ix])
-                ++ix;
+        while (true) {
+            ix += cc_scan_to(buffer + ix, len - ix, stops);
+            if (ix >= len || buffer[ix] != '\\') {
+                break;
+            }
+            ix += (ix + 1 < len && buffer[ix + 1]) ? 2 : 1;
         }
         return (Token) {
             .kind = TK_QUOTED_STRING,
             .quoted_string = {
                 .quote_type = (QuoteType) buffer[0],
                 .triple = false,
-                .terminated = buffer[ix] != 0,
+                .terminated = ix < len && buffer[ix] != 0,
             },
             .text = { buffer, ix + 1 },
         };
     }
     case '/':
-        switch (buffer[1]) {
+        switch ((len > 1) ? buffer[1] : '\0') {
         case '/': {
-            size_t ix = 2;
-            for (; buffer[ix] && buffer[ix] != '\n'; ++ix)
-                ;
+            size_t ix = 2 + cc_scan_to(buffer + 2, len - 2, "\n");
             return (Token) {
                 .kind = TK_COMMENT,
                 .comment = {
@@ -279,7 +468,7 @@ Token lexer_peek_next(Lexer *lexer)
             };
         }
         case '*': {
-            return block_comment(lexer, buffer, 2);
+            return block_comment(lexer, buffer, len, 2);
         }
         default:
             break;
@@ -294,56 +483,40 @@ Token lexer_peek_next(Lexer *lexer)
             .text = { buffer, 1 },
         };
     }
-    if (isspace(buffer[0])) {
-        size_t ix = 0;
-        for (; isspace(buffer[ix]) && buffer[ix] != '\n'; ++ix)
-            ;
+    if (cc_is(buffer[0], CC_BLANK)) {
+        size_t ix = cc_span(buffer, len, CC_BLANK);
         return (Token) {
             .kind = TK_WHITESPACE,
             .text = { buffer, ix },
         };
     }
-    if (isdigit(buffer[0])) {
-        return scan_number(buffer);
-    }
-    if (isalpha(buffer[0]) || buffer[0] == '_') {
-        size_t ix = 0;
-        for (; isalnum(buffer[ix]) || buffer[ix] == '_'; ++ix)
-            ;
-        if (lexer->language && lexer->language->keywords && lexer->language->keywords[0].keyword) {
-            for (int kw = 0; lexer->language->keywords[kw].keyword; ++kw) {
-                StringView keyword = sv_from(lexer->language->keywords[kw].keyword);
-                if (keyword.length == ix && sv_startswith(source, keyword)) {
-                    return (Token) {
-                        .kind = TK_KEYWORD,
-                        .keyword_code = lexer->language->keywords[kw].code,
-                        .text = { buffer, ix },
-                    };
-                }
-            }
+    if (cc_is(buffer[0], CC_DIGIT)) {
+        return scan_number(buffer, len);
+    }
+    KeywordTrie *keywords = (lexer->language) ? language_keyword_trie(lexer->language) : NULL;
+    if (cc_is(buffer[0], CC_ALPHA | CC_UNDERSCORE)) {
+        size_t ix = cc_span(buffer, len, CC_IDENT);
+        int    kw = lexer_find_keyword(lexer, keywords, (StringView) { buffer, ix });
+        if (kw >= 0) {
+            return (Token) {
+                .kind = TK_KEYWORD,
+                .keyword_code = lexer->language->keywords[kw].code,
+                .text = { buffer, ix },
+            };
         }
         return (Token) {
             .kind = TK_IDENTIFIER,
             .text = { buffer, ix },
         };
     }
-    if (lexer->language && lexer->language->keywords && lexer->language->keywords[0].keyword) {
-        int        matched = -1;
-        StringView matched_keyword = sv_null();
-        for (int kw = 0; lexer->language->keywords[kw].keyword; ++kw) {
-            StringView keyword = sv_from(lexer->language->keywords[kw].keyword);
-            if (sv_startswith(source, keyword)) {
-                if (matched < 0 || keyword.length > matched_keyword.length) {
-                    matched = kw;
-                    matched_keyword = keyword;
-                }
-            }
-        }
-        if (matched >= 0) {
+    if (keywords) {
+        size_t matched_length = 0;
+        int    kw = lexer_match_keyword_prefix(lexer, keywords, source, &matched_length);
+        if (kw >= 0) {
             return (Token) {
                 .kind = TK_KEYWORD,
-                .keyword_code = lexer->language->keywords[matched].code,
-                .text = { buffer, matched_keyword.length },
+                .keyword_code = lexer->language->keywords[kw].code,
+                .text = { buffer, matched_length },
             };
         }
     }
@@ -451,3 +624,195 @@ bool lexer_next_matches_symbol(Lexer *lexer, int symbol)
     Token next = lexer_next(lexer);
     return next.kind == TK_SYMBOL && next.symbol == symbol;
 }
+
+#ifdef LEXER_TEST
+
+#include <stdio.h>
+#include <time.h>
+
+#include <base/fs.h>
+
+// clang-format off
+static char const *test_keywords[] = {
+    "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum", "extern",
+    "float", "for", "goto", "if", "inline", "int", "long", "register", "return", "short", "signed", "sizeof",
+    "static", "struct", "switch", "typedef", "union", "unsigned", "void", "volatile", "while",
+    "->", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "*=", "/=", "%=", "+=", "-=", "<<=", ">>=",
+    "&=", "^=", "|=", "...", "##",
+    NULL,
+};
+// clang-format on
+
+#define NUM_TEST_KEYWORDS (sizeof(test_keywords) / sizeof(test_keywords[0]))
+
+static Keyword  c_keywords[NUM_TEST_KEYWORDS];
+static Language c_language = {
+    .name = (StringView) { .ptr = "C", .length = 1 },
+    .keywords = c_keywords,
+};
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Collects the .c and .h files below dir.
+static void collect_sources(StringView dir, StringList *files)
+{
+    ErrorOrDirListing listing_maybe = fs_directory(dir, DirOptionFiles | DirOptionDirectories);
+    if (ErrorOrDirListing_is_error(listing_maybe)) {
+        return;
+    }
+    DirListing listing = listing_maybe.value;
+    for (size_t ix = 0; ix < listing.entries.size; ++ix) {
+        DirEntry  *entry = listing.entries.elements + ix;
+        StringView path = sv_printf("%.*s/%.*s", SV_ARG(dir), SV_ARG(entry->name));
+        if (entry->type == FileTypeDirectory) {
+            if (!sv_eq_cstr(entry->name, ".") && !sv_eq_cstr(entry->name, "..")) {
+                collect_sources(path, files);
+            }
+            sv_free(path);
+            continue;
+        }
+        if (entry->type == FileTypeRegularFile && (sv_endswith(entry->name, sv_from(".c")) || sv_endswith(entry->name, sv_from(".h")))) {
+            sl_push(files, path);
+            continue;
+        }
+        sv_free(path);
+    }
+    dl_free(listing);
+}
+
+// The sources are in the directory above the one this file is in.
+static StringView default_root()
+{
+    StringView file = sv_from(__FILE__);
+    int        slash = sv_last(file, '/');
+    if (slash < 0) {
+        return sv_from("..");
+    }
+    StringView dir = { file.ptr, (size_t) slash };
+    slash = sv_last(dir, '/');
+    return (slash < 0) ? sv_from(".") : (StringView) { dir.ptr, (size_t) slash };
+}
+
+static Token lex_token(Lexer *lexer)
+{
+    Token ret = lexer_peek(lexer);
+    lexer_lex(lexer);
+    return ret;
+}
+
+// Lexes text with both keyword lookups side by side and checks that they
+// produce the same tokens.
+static size_t compare_lexing(StringView text, StringView name)
+{
+    Lexer linear = lexer_for_language(&c_language);
+    Lexer trie = lexer_for_language(&c_language);
+    lexer_push_source(&linear, text, name);
+    lexer_push_source(&trie, text, name);
+    size_t tokens = 0;
+    while (true) {
+        s_linear_keywords = true;
+        Token expected = lex_token(&linear);
+        s_linear_keywords = false;
+        Token token = lex_token(&trie);
+        assert(token.kind == expected.kind && token.text.ptr == expected.text.ptr && token.text.length == expected.text.length);
+        assert(token.kind != TK_KEYWORD || token.keyword_code == expected.keyword_code);
+        if (token.kind == TK_END_OF_FILE) {
+            break;
+        }
+        ++tokens;
+    }
+    lexer_pop_source(&linear);
+    lexer_pop_source(&trie);
+    return tokens;
+}
+
+static double time_lexing(StringList *texts, int rounds, bool linear, size_t *keywords)
+{
+    s_linear_keywords = linear;
+    *keywords = 0;
+    double start = now();
+    for (int round = 0; round < rounds; ++round) {
+        for (size_t ix = 0; ix < texts->size; ++ix) {
+            Lexer lexer = lexer_for_language(&c_language);
+            lexer_push_source(&lexer, texts->strings[ix], sv_null());
+            for (Token token = lex_token(&lexer); token.kind != TK_END_OF_FILE; token = lex_token(&lexer)) {
+                *keywords += token.kind == TK_KEYWORD;
+            }
+            lexer_pop_source(&lexer);
+        }
+    }
+    s_linear_keywords = false;
+    return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+    for (size_t kw = 0; test_keywords[kw]; ++kw) {
+        c_keywords[kw] = (Keyword) { test_keywords[kw], (int) kw + 1 };
+    }
+    KeywordTrie *trie = keyword_trie_create();
+    for (int kw = 0; test_keywords[kw]; ++kw) {
+        keyword_trie_add(trie, sv_from(test_keywords[kw]), kw);
+    }
+    for (int kw = 0; test_keywords[kw]; ++kw) {
+        assert(keyword_trie_find(trie, sv_from(test_keywords[kw])) == kw);
+    }
+    assert(keyword_trie_find(trie, sv_from("whil")) == -1);
+    assert(keyword_trie_find(trie, sv_from("whiles")) == -1);
+
+    // Every position of this file is both an identifier candidate and an
+    // operator candidate.
+    StringView text = MUST(StringView, read_file_by_name(sv_from(__FILE__)));
+    for (size_t ix = 0; ix < text.length; ++ix) {
+        StringView rest = { text.ptr + ix, text.length - ix };
+        StringView ident = { rest.ptr, cc_span(rest.ptr, rest.length, CC_IDENT) };
+        assert(keyword_trie_find(trie, ident) == linear_find(c_keywords, ident));
+        size_t trie_len = 0;
+        size_t linear_len = 0;
+        assert(keyword_trie_match_prefix(trie, rest, &trie_len) == linear_match_prefix(c_keywords, rest, &linear_len));
+        assert(trie_len == linear_len);
+    }
+    sv_free(text);
+    keyword_trie_free(trie);
+
+    // Lex the sources of the repository, or of the directory given, with
+    // the linear keyword lookups and with the trie.
+    StringView root = (argc > 1) ? sv_from(argv[1]) : default_root();
+    StringList files = { 0 };
+    StringList texts = { 0 };
+    collect_sources(root, &files);
+    size_t bytes = 0;
+    size_t tokens = 0;
+    for (size_t ix = 0; ix < files.size; ++ix) {
+        ErrorOrStringView text_maybe = read_file_by_name(files.strings[ix]);
+        if (ErrorOrStringView_is_error(text_maybe)) {
+            continue;
+        }
+        tokens += compare_lexing(text_maybe.value, files.strings[ix]);
+        bytes += text_maybe.value.length;
+        sl_push(&texts, text_maybe.value);
+    }
+    assert(texts.size > 0);
+
+    int    rounds = 5;
+    size_t linear_keywords;
+    size_t trie_keywords;
+    double linear_time = time_lexing(&texts, rounds, true, &linear_keywords);
+    double trie_time = time_lexing(&texts, rounds, false, &trie_keywords);
+    assert(linear_keywords == trie_keywords);
+    double mb = (double) (rounds * bytes) / 1e6;
+    printf("%.*s: %zu files, %zu KiB, %zu tokens, %zu keywords\n",
+        SV_ARG(root), texts.size, bytes / 1024, tokens, trie_keywords / rounds);
+    printf("lexing: linear keywords %.1f MB/s, trie %.1f MB/s (%.2fx)\n",
+        mb / linear_time, mb / trie_time, linear_time / trie_time);
+    sl_free(&texts);
+    sl_free(&files);
+    return 0;
+}
+
+#endif /* LEXER_TEST */
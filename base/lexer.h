@@ -17,6 +17,14 @@
 typedef struct lexer Lexer;
 typedef int (*DirectiveHandler)(Lexer *lexer, int directive);
 
+/*
+ * Trie mapping keyword strings to non-negative values. The first level is
+ * indexed directly by the leading byte; deeper levels are short sibling
+ * lists. Supports exact lookups for identifiers and longest-prefix lookups
+ * for operators.
+ */
+typedef struct keyword_trie KeywordTrie;
+
 typedef struct {
     StringView       name;
     Keyword         *keywords;
@@ -24,6 +32,7 @@ typedef struct {
     char const     **directives;
     DirectiveHandler directive_handler;
     void            *language_data;
+    KeywordTrie     *keyword_trie; // Built from keywords by lexer_for_language
 } Language;
 
 typedef struct source {
@@ -43,6 +52,11 @@ typedef struct lexer {
     void     *language_data;
 } Lexer;
 
+extern KeywordTrie *keyword_trie_create();
+extern void         keyword_trie_free(KeywordTrie *trie);
+extern void         keyword_trie_add(KeywordTrie *trie, StringView keyword, int value);
+extern int          keyword_trie_find(KeywordTrie *trie, StringView text);
+extern int          keyword_trie_match_prefix(KeywordTrie *trie, StringView text, size_t *length);
 extern Lexer        lexer_create();
 extern Lexer        lexer_for_language(Language *language);
 extern StringView   lexer_source(Lexer *lexer);
@@ -5,26 +5,106 @@
  */
 
 #include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <base/log.h>
-#include <base/mutex.h>
 #include <base/options.h>
 
+#define LOG_RING_SIZE (128 * 1024)
+#define LOG_MAX_PAYLOAD (16 * 1024)
+#define LOG_OUTPUT_SIZE (64 * 1024)
+#define LOG_CATEGORY_OTHER (LOG_MAX_CATEGORIES - 1)
+#define LOG_NO_CATEGORY 0xFF
+
 typedef enum log_level {
     LL_TRACE,
     LL_INFO,
     LL_PANIC,
 } LogLevel;
 
-static Mutex s_mutex;
-static StringList s_categories = {0};
+/*
+ * LM_DEFERRED records the format string and a copy of the arguments and
+ * leaves the formatting to the writer thread. LM_EAGER formats on the
+ * calling thread and only leaves the I/O to the writer. LM_SYNC writes on
+ * the calling thread, as does every mode before log_init, after a fork, and
+ * for panics.
+ */
+typedef enum log_mode {
+    LM_DEFERRED,
+    LM_EAGER,
+    LM_SYNC,
+} LogMode;
+
+/*
+ * A message in a thread's ring buffer. The payload follows the record and
+ * is either the formatted message or, if deferred is set, the arguments as
+ * captured by log_capture. A size of 0 marks the unused end of the buffer
+ * before it wraps around.
+ */
+typedef struct log_record {
+    uint32_t    size;
+    uint8_t     level;
+    uint8_t     category;
+    bool        deferred;
+    uint64_t    seq;
+    char const *file_name;
+    int         line;
+    char const *msg;
+    char        thread_name[16];
+} LogRecord;
+
+/*
+ * Single-producer, single-consumer ring of LogRecords. The owning thread
+ * only moves head, the writer thread only moves tail. Both are running byte
+ * counts; the offset in the buffer is the count modulo LOG_RING_SIZE. When a
+ * thread exits its ring is released, and the next new thread adopts it.
+ */
+typedef struct log_ring {
+    _Atomic size_t   head;
+    _Atomic size_t   tail;
+    atomic_bool      owned;
+    char             thread_name[16];
+    struct log_ring *next;
+    char             scratch[LOG_MAX_PAYLOAD];
+    char             buffer[LOG_RING_SIZE];
+} LogRing;
+
+typedef struct log_output {
+    char  *buffer;
+    size_t capacity;
+    size_t length;
+} LogOutput;
+
+uint64_t log_categories_enabled = 0;
 
-static void vemit_log_message(LogLevel level, char const *file_name, int line, TraceCategory category, char const *msg, va_list args);
-static void emit_log_message(LogLevel level, char const *file_name, int line, TraceCategory category, char const *msg, ...);
+static LogLevel               log_level = LL_INFO;
+static LogMode                s_mode = LM_SYNC;
+static pthread_mutex_t        s_category_mutex = PTHREAD_MUTEX_INITIALIZER;
+static StringView             s_category_names[LOG_MAX_CATEGORIES] = { 0 };
+static int                    s_category_count = 0;
+static StringList             s_categories = { 0 };
+static bool                   s_all_categories = false;
+static pthread_mutex_t        s_output_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic(LogRing *)     s_rings = NULL;
+static pthread_key_t          s_ring_key;
+static _Thread_local LogRing *t_ring = NULL;
+static _Atomic uint64_t       s_seq = 0;
+static _Atomic uint64_t       s_written = 0;
+static atomic_bool            s_writer_running = false;
+static atomic_bool            s_writer_idle = false;
+static pthread_t              s_writer;
+static pthread_mutex_t        s_wakeup_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t         s_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t         s_flushed = PTHREAD_COND_INITIALIZER;
 
-static LogLevel log_level = LL_INFO;
+static void vemit_log_message(LogLevel level, char const *file_name, int line, int category, char const *msg, va_list args);
 
 static char const *log_level_to_string(LogLevel level)
 {
@@ -40,57 +120,597 @@ static char const *log_level_to_string(LogLevel level)
     }
 }
 
-void emit_log_message(LogLevel level, char const *file_name, int line, TraceCategory category, char const *msg, ...)
+// Output buffers are only flushed while holding s_output_mutex, so lines
+// written by the writer thread and synchronous ones don't interleave.
+static void output_flush(LogOutput *out)
 {
-    va_list args;
-    va_start(args, msg);
-    vemit_log_message(level, file_name, line, category, msg, args);
-    va_end(args);
+    pthread_mutex_lock(&s_output_mutex);
+    for (size_t written = 0; written < out->length;) {
+        ssize_t ret = write(STDERR_FILENO, out->buffer + written, out->length - written);
+        if (ret <= 0) {
+            break;
+        }
+        written += ret;
+    }
+    pthread_mutex_unlock(&s_output_mutex);
+    out->length = 0;
 }
 
-void vemit_log_message(LogLevel level, char const *file_name, int line, TraceCategory category, char const *msg, va_list args)
+static void output_write(LogOutput *out, char const *text, size_t length)
 {
-    if (level < log_level) {
+    while (length > 0) {
+        if (out->length == out->capacity) {
+            output_flush(out);
+        }
+        size_t n = out->capacity - out->length;
+        n = (length < n) ? length : n;
+        memcpy(out->buffer + out->length, text, n);
+        out->length += n;
+        text += n;
+        length -= n;
+    }
+}
+
+static void output_vprintf(LogOutput *out, char const *fmt, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    size_t available = out->capacity - out->length;
+    int    n = vsnprintf(out->buffer + out->length, available, fmt, copy);
+    va_end(copy);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t) n < available) {
+        out->length += n;
         return;
     }
-    if (!_log_category_on(category)) {
+    output_flush(out);
+    if ((size_t) n < out->capacity) {
+        out->length = vsnprintf(out->buffer, out->capacity, fmt, args);
         return;
     }
-    mutex_lock(s_mutex);
-    StringView cat = category;
-    char lvl = 'T';
-    if (level >= LL_INFO) {
+    char *text = malloc(n + 1);
+    if (text == NULL) {
+        return;
+    }
+    vsnprintf(text, n + 1, fmt, args);
+    output_write(out, text, n);
+    free(text);
+}
+
+static void output_printf(LogOutput *out, char const *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    output_vprintf(out, fmt, args);
+    va_end(args);
+}
+
+static void output_prefix(LogOutput *out, LogLevel level, char const *file_name, int line, int category, char const *thread_name)
+{
+    StringView cat = sv_null();
+    char       lvl = 'T';
+    if (level >= LL_INFO || category == LOG_NO_CATEGORY) {
         char const *level_name = log_level_to_string(level);
         cat = sv_from(level_name);
         lvl = *level_name;
+    } else {
+        cat = s_category_names[category];
     }
     char buf[32];
     snprintf(buf, 32, "%s:%d", file_name, line);
-    char thread_name[32];
+    int cat_len = (cat.length < 7) ? (int) cat.length : 7;
+    output_printf(out, "%-*.*s:[%05d:%8.8s]:%c:%7.*s:", 15, 15, buf, getpid(), thread_name, lvl, cat_len, cat.ptr);
+}
+
+/*
+ * Deferred formatting. log_capture walks the conversions in a format string
+ * and stores every argument in an 8-byte slot. Strings are copied, with a
+ * 4-byte length in front, because they are usually gone by the time the
+ * writer gets to them. log_format walks the format again and formats each
+ * conversion from its slot. Conversions that can't be captured this way,
+ * like %n, %ls and long doubles, make the message fall back to eager
+ * formatting.
+ */
+typedef struct format_spec {
+    char const *start;
+    char const *end;
+    char        length[3];
+    char        conversion;
+    bool        star_width;
+    bool        star_precision;
+    int         precision;
+} FormatSpec;
+
+static bool parse_spec(char const *fmt, FormatSpec *spec)
+{
+    *spec = (FormatSpec) { .start = fmt, .precision = -1 };
+    char const *p = fmt + 1;
+    while (*p && strchr("-+ #0'", *p)) {
+        ++p;
+    }
+    if (*p == '*') {
+        spec->star_width = true;
+        ++p;
+    } else {
+        while (*p >= '0' && *p <= '9') {
+            ++p;
+        }
+    }
+    if (*p == '.') {
+        ++p;
+        spec->precision = 0;
+        if (*p == '*') {
+            spec->star_precision = true;
+            ++p;
+        } else {
+            for (; *p >= '0' && *p <= '9'; ++p) {
+                spec->precision = 10 * spec->precision + (*p - '0');
+            }
+        }
+    }
+    size_t len = 0;
+    while (*p && strchr("hlzjt", *p) && len < 2) {
+        spec->length[len++] = *p++;
+    }
+    if (!*p || !strchr("diouxXcspfFeEgGaA%", *p)) {
+        return false;
+    }
+    spec->conversion = *p;
+    spec->end = p + 1;
+    return true;
+}
+
+static bool capture_slot(char **out, char const *end, uint64_t value)
+{
+    if (*out + sizeof(uint64_t) > end) {
+        return false;
+    }
+    memcpy(*out, &value, sizeof(uint64_t));
+    *out += sizeof(uint64_t);
+    return true;
+}
+
+static bool log_capture(char *payload, size_t capacity, size_t *length, char const *fmt, va_list args)
+{
+    char       *out = payload;
+    char const *end = payload + capacity;
+    for (char const *p = strchr(fmt, '%'); p != NULL; p = strchr(p, '%')) {
+        FormatSpec spec;
+        if (!parse_spec(p, &spec)) {
+            return false;
+        }
+        p = spec.end;
+        if (spec.conversion == '%') {
+            continue;
+        }
+        if (spec.star_width && !capture_slot(&out, end, (uint64_t) va_arg(args, int))) {
+            return false;
+        }
+        if (spec.star_precision) {
+            spec.precision = va_arg(args, int);
+            if (!capture_slot(&out, end, (uint64_t) spec.precision)) {
+                return false;
+            }
+        }
+        uint64_t value = 0;
+        switch (spec.conversion) {
+        case 's': {
+            if (spec.length[0]) {
+                return false;
+            }
+            char const *s = va_arg(args, char const *);
+            if (s == NULL) {
+                s = "(null)";
+            }
+            size_t len = (spec.precision >= 0) ? strnlen(s, spec.precision) : strlen(s);
+            size_t size = (sizeof(uint32_t) + len + 1 + 7) & ~(size_t) 7;
+            if (out + size > end) {
+                return false;
+            }
+            uint32_t len32 = (uint32_t) len;
+            memcpy(out, &len32, sizeof(uint32_t));
+            memcpy(out + sizeof(uint32_t), s, len);
+            out[sizeof(uint32_t) + len] = '\0';
+            out += size;
+            continue;
+        }
+        case 'p':
+            value = (uint64_t) (uintptr_t) va_arg(args, void *);
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A': {
+            if (spec.length[0]) {
+                return false;
+            }
+            double d = va_arg(args, double);
+            memcpy(&value, &d, sizeof(double));
+        } break;
+        default:
+            if (spec.length[0] == 'l' && spec.length[1] == 'l') {
+                value = (uint64_t) va_arg(args, long long);
+            } else if (spec.length[0] == 'l') {
+                value = (uint64_t) va_arg(args, long);
+            } else if (spec.length[0] == 'z') {
+                value = (uint64_t) va_arg(args, size_t);
+            } else if (spec.length[0] == 'j') {
+                value = (uint64_t) va_arg(args, intmax_t);
+            } else if (spec.length[0] == 't') {
+                value = (uint64_t) va_arg(args, ptrdiff_t);
+            } else {
+                value = (uint64_t) va_arg(args, int);
+            }
+            break;
+        }
+        if (!capture_slot(&out, end, value)) {
+            return false;
+        }
+    }
+    *length = out - payload;
+    return true;
+}
+
+static uint64_t format_slot(char const **payload)
+{
+    uint64_t ret;
+    memcpy(&ret, *payload, sizeof(uint64_t));
+    *payload += sizeof(uint64_t);
+    return ret;
+}
+
+static void log_format(LogOutput *out, char const *fmt, char const *payload)
+{
+    char const *p = fmt;
+    for (char const *pct = strchr(p, '%'); pct != NULL; pct = strchr(p, '%')) {
+        output_write(out, p, pct - p);
+        FormatSpec spec;
+        parse_spec(pct, &spec);
+        p = spec.end;
+        if (spec.conversion == '%') {
+            output_write(out, "%", 1);
+            continue;
+        }
+
+        // Rebuild the conversion with the captured width and precision
+        // filled in for the '*'s.
+        char   conversion[64];
+        size_t len = 0;
+        for (char const *c = spec.start; c < spec.end && len < sizeof(conversion) - 24; ++c) {
+            if (*c == '*') {
+                len += snprintf(conversion + len, sizeof(conversion) - len, "%d", (int) format_slot(&payload));
+                continue;
+            }
+            conversion[len++] = *c;
+        }
+        conversion[len] = '\0';
+
+        switch (spec.conversion) {
+        case 's': {
+            uint32_t slen;
+            memcpy(&slen, payload, sizeof(uint32_t));
+            output_printf(out, conversion, payload + sizeof(uint32_t));
+            payload += (sizeof(uint32_t) + slen + 1 + 7) & ~(size_t) 7;
+        } break;
+        case 'p':
+            output_printf(out, conversion, (void *) (uintptr_t) format_slot(&payload));
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A': {
+            uint64_t bits = format_slot(&payload);
+            double   d;
+            memcpy(&d, &bits, sizeof(double));
+            output_printf(out, conversion, d);
+        } break;
+        default: {
+            uint64_t value = format_slot(&payload);
+            if (spec.length[0] == 'l' && spec.length[1] == 'l') {
+                output_printf(out, conversion, (long long) value);
+            } else if (spec.length[0] == 'l') {
+                output_printf(out, conversion, (long) value);
+            } else if (spec.length[0] == 'z') {
+                output_printf(out, conversion, (size_t) value);
+            } else if (spec.length[0] == 'j') {
+                output_printf(out, conversion, (intmax_t) value);
+            } else if (spec.length[0] == 't') {
+                output_printf(out, conversion, (ptrdiff_t) value);
+            } else {
+                output_printf(out, conversion, (int) value);
+            }
+        } break;
+        }
+    }
+    output_write(out, p, strlen(p));
+}
+
+static void log_release_ring(void *ring)
+{
+    atomic_store(&((LogRing *) ring)->owned, false);
+}
+
+static LogRing *log_ring()
+{
+    if (t_ring != NULL) {
+        return t_ring;
+    }
+    LogRing *ring = NULL;
+    for (ring = atomic_load(&s_rings); ring != NULL; ring = ring->next) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&ring->owned, &expected, true)) {
+            break;
+        }
+    }
+    if (ring == NULL) {
+        ring = malloc(sizeof(LogRing));
+        if (ring == NULL) {
+            return NULL;
+        }
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->tail, 0);
+        atomic_init(&ring->owned, true);
+        ring->next = atomic_load(&s_rings);
+        while (!atomic_compare_exchange_weak(&s_rings, &ring->next, ring))
+            ;
+    }
+    pthread_getname_np(pthread_self(), ring->thread_name, sizeof(ring->thread_name));
+    pthread_setspecific(s_ring_key, ring);
+    t_ring = ring;
+    return ring;
+}
+
+static void log_wakeup_writer()
+{
+    if (atomic_load_explicit(&s_writer_idle, memory_order_relaxed)) {
+        pthread_cond_signal(&s_wakeup);
+    }
+}
+
+// Copies a record and its payload into the calling thread's ring. Waits
+// for the writer to make room if the ring is full.
+static void log_push(LogRing *ring, LogRecord *record, char const *payload, size_t length)
+{
+    size_t size = (sizeof(LogRecord) + length + 7) & ~(size_t) 7;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t offset = head % LOG_RING_SIZE;
+    size_t contiguous = LOG_RING_SIZE - offset;
+    size_t needed = (size <= contiguous) ? size : contiguous + size;
+    while (head + needed - atomic_load_explicit(&ring->tail, memory_order_acquire) > LOG_RING_SIZE) {
+        pthread_cond_signal(&s_wakeup);
+        sched_yield();
+    }
+    if (size > contiguous) {
+        uint32_t wrap = 0;
+        memcpy(ring->buffer + offset, &wrap, sizeof(uint32_t));
+        head += contiguous;
+        offset = 0;
+    }
+    record->size = (uint32_t) size;
+    record->seq = atomic_fetch_add(&s_seq, 1);
+    memcpy(record->thread_name, ring->thread_name, sizeof(record->thread_name));
+    memcpy(ring->buffer + offset, record, sizeof(LogRecord));
+    memcpy(ring->buffer + offset + sizeof(LogRecord), payload, length);
+    atomic_store_explicit(&ring->head, head + size, memory_order_release);
+    log_wakeup_writer();
+}
+
+static LogRecord *log_peek(LogRing *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail == head) {
+        return NULL;
+    }
+    LogRecord *record = (LogRecord *) (ring->buffer + tail % LOG_RING_SIZE);
+    if (record->size == 0) {
+        tail += LOG_RING_SIZE - tail % LOG_RING_SIZE;
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        if (tail == head) {
+            return NULL;
+        }
+        record = (LogRecord *) ring->buffer;
+    }
+    return record;
+}
+
+// Writes out everything queued, oldest first across all rings. Returns the
+// number of records written.
+static size_t log_drain(LogOutput *out)
+{
+    size_t count = 0;
+    while (true) {
+        LogRing   *oldest = NULL;
+        LogRecord *record = NULL;
+        for (LogRing *ring = atomic_load(&s_rings); ring != NULL; ring = ring->next) {
+            LogRecord *r = log_peek(ring);
+            if (r != NULL && (record == NULL || r->seq < record->seq)) {
+                oldest = ring;
+                record = r;
+            }
+        }
+        if (record == NULL) {
+            break;
+        }
+        output_prefix(out, record->level, record->file_name, record->line, record->category, record->thread_name);
+        char const *payload = (char const *) (record + 1);
+        if (record->deferred) {
+            log_format(out, record->msg, payload);
+        } else {
+            output_write(out, payload, strlen(payload));
+        }
+        output_write(out, "\n", 1);
+        atomic_fetch_add_explicit(&oldest->tail, record->size, memory_order_release);
+        ++count;
+    }
+    if (out->length > 0) {
+        output_flush(out);
+    }
+    return count;
+}
+
+static void *log_writer(void *unused)
+{
+    pthread_setname_np("log");
+    static char buffer[LOG_OUTPUT_SIZE];
+    LogOutput   out = { .buffer = buffer, .capacity = LOG_OUTPUT_SIZE };
+    while (true) {
+        size_t count = log_drain(&out);
+        if (count > 0) {
+            pthread_mutex_lock(&s_wakeup_mutex);
+            atomic_fetch_add(&s_written, count);
+            pthread_cond_broadcast(&s_flushed);
+            pthread_mutex_unlock(&s_wakeup_mutex);
+            continue;
+        }
+        if (!atomic_load(&s_writer_running)) {
+            break;
+        }
+        pthread_mutex_lock(&s_wakeup_mutex);
+        atomic_store(&s_writer_idle, true);
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 20 * 1000 * 1000;
+        if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+            ts.tv_nsec -= 1000 * 1000 * 1000;
+            ++ts.tv_sec;
+        }
+        pthread_cond_timedwait(&s_wakeup, &s_wakeup_mutex, &ts);
+        atomic_store(&s_writer_idle, false);
+        pthread_mutex_unlock(&s_wakeup_mutex);
+    }
+    return NULL;
+}
+
+// Waits until everything logged so far has been written.
+void log_flush()
+{
+    if (!atomic_load(&s_writer_running) || pthread_equal(pthread_self(), s_writer)) {
+        return;
+    }
+    uint64_t target = atomic_load(&s_seq);
+    pthread_mutex_lock(&s_wakeup_mutex);
+    while (atomic_load(&s_written) < target) {
+        pthread_cond_signal(&s_wakeup);
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ++ts.tv_sec;
+        pthread_cond_timedwait(&s_flushed, &s_wakeup_mutex, &ts);
+    }
+    pthread_mutex_unlock(&s_wakeup_mutex);
+}
+
+static void log_stop()
+{
+    if (!atomic_load(&s_writer_running)) {
+        return;
+    }
+    log_flush();
+    atomic_store(&s_writer_running, false);
+    pthread_cond_signal(&s_wakeup);
+    pthread_join(s_writer, NULL);
+}
+
+// The writer thread doesn't survive a fork, so the child writes
+// synchronously.
+static void log_atfork_child()
+{
+    atomic_store(&s_writer_running, false);
+    pthread_mutex_init(&s_output_mutex, NULL);
+    pthread_mutex_init(&s_wakeup_mutex, NULL);
+    s_mode = LM_SYNC;
+}
+
+static void emit_sync(LogLevel level, char const *file_name, int line, int category, char const *msg, va_list args)
+{
+    char      buffer[4096];
+    LogOutput out = { .buffer = buffer, .capacity = sizeof(buffer) };
+    char      thread_name[32];
     pthread_getname_np(pthread_self(), thread_name, 32);
-    fprintf(stderr, "%-*.*s:[%05d:%8.8s]:%c:%7.7s:", 15, 15, buf, getpid(), thread_name, lvl, cat.ptr);
-    vfprintf(stderr, msg, args);
-    fprintf(stderr, "\n");
-    mutex_unlock(s_mutex);
+    output_prefix(&out, level, file_name, line, category, thread_name);
+    output_vprintf(&out, msg, args);
+    output_write(&out, "\n", 1);
+    output_flush(&out);
 }
 
-void _trace(char const *file_name, int line, TraceCategory category, char const *msg, ...)
+void vemit_log_message(LogLevel level, char const *file_name, int line, int category, char const *msg, va_list args)
 {
-    if (!_log_category_on(category)) {
+    if (level < log_level) {
+        return;
+    }
+    LogRing *ring = NULL;
+    if (level >= LL_PANIC || s_mode == LM_SYNC || !atomic_load(&s_writer_running) || (ring = log_ring()) == NULL) {
+        log_flush();
+        emit_sync(level, file_name, line, category, msg, args);
         return;
     }
+    LogRecord record = {
+        .level = level,
+        .category = category,
+        .file_name = file_name,
+        .line = line,
+        .msg = msg,
+    };
+    size_t length = 0;
+    if (s_mode == LM_DEFERRED) {
+        va_list copy;
+        va_copy(copy, args);
+        record.deferred = log_capture(ring->scratch, LOG_MAX_PAYLOAD, &length, msg, copy);
+        va_end(copy);
+    }
+    if (!record.deferred) {
+        va_list copy;
+        va_copy(copy, args);
+        int n = vsnprintf(ring->scratch, LOG_MAX_PAYLOAD, msg, copy);
+        va_end(copy);
+        if (n < 0) {
+            return;
+        }
+        if (n >= LOG_MAX_PAYLOAD) {
+            // Too big for the ring; write it out here, after everything
+            // that came before it.
+            log_flush();
+            emit_sync(level, file_name, line, category, msg, args);
+            return;
+        }
+        length = n + 1;
+    }
+    log_push(ring, &record, ring->scratch, length);
+}
+
+void _trace(char const *file_name, int line, TraceCategory category, char const *msg, ...)
+{
     va_list args;
     va_start(args, msg);
     vtrace(file_name, line, category, msg, args);
     va_end(args);
 }
 
+void _trace_index(char const *file_name, int line, int category, char const *msg, ...)
+{
+    va_list args;
+    va_start(args, msg);
+    vemit_log_message(LL_TRACE, file_name, line, category, msg, args);
+    va_end(args);
+}
+
 void vtrace(char const *file_name, int line, TraceCategory category, char const *msg, va_list args)
 {
-    if (!_log_category_on(category)) {
+    int ix = log_category_index(category);
+    if (!log_index_on(ix)) {
         return;
     }
-    vemit_log_message(LL_TRACE, file_name, line, category, msg, args);
+    vemit_log_message(LL_TRACE, file_name, line, ix, msg, args);
 }
 
 void _panic(char const *file_name, int line, char const *msg, ...)
@@ -103,7 +723,7 @@ void _panic(char const *file_name, int line, char const *msg, ...)
 
 void vpanic(char const *file_name, int line, char const *msg, va_list args)
 {
-    vemit_log_message(LL_PANIC, file_name, line, sv_null(), msg, args);
+    vemit_log_message(LL_PANIC, file_name, line, LOG_NO_CATEGORY, msg, args);
 }
 
 void _info(char const *file_name, int line, char const *msg, ...)
@@ -116,40 +736,102 @@ void _info(char const *file_name, int line, char const *msg, ...)
 
 void vinfo(char const *file_name, int line, char const *msg, va_list args)
 {
-    vemit_log_message(LL_INFO, file_name, line, sv_null(), msg, args);
+    vemit_log_message(LL_INFO, file_name, line, LOG_NO_CATEGORY, msg, args);
 }
 
-bool _log_category_on(TraceCategory category)
+// Category names are copied with malloc rather than sv_copy, because the
+// string code traces, and this runs with s_category_mutex held.
+static StringView log_copy_name(StringView name)
+{
+    char *ptr = malloc_fatal(name.length + 1, "copying trace category");
+    memcpy(ptr, name.ptr, name.length);
+    ptr[name.length] = '\0';
+    return (StringView) { ptr, name.length };
+}
+
+static bool log_enabled_by_name(StringView category)
 {
-    if (sv_empty(category)) {
-        return true;
-    }
     for (size_t ix = 0; ix < s_categories.size; ++ix) {
-        if (sv_eq(s_categories.strings[ix], category) || sv_eq(s_categories.strings[ix], SV("true", 4))) {
+        if (sv_eq(s_categories.strings[ix], category)) {
             return true;
         }
     }
     return false;
 }
 
-void log_turn_on_sv(TraceCategory category)
+// Must be called with s_category_mutex held.
+static void log_update_enabled()
 {
-    for (size_t ix = 0; ix < s_categories.size; ++ix) {
-        if (sv_eq(s_categories.strings[ix], category)) {
-            return;
+    uint64_t enabled = 0;
+    if (s_all_categories) {
+        enabled = ~(uint64_t) 0;
+    } else {
+        for (int ix = 0; ix < s_category_count; ++ix) {
+            if (log_enabled_by_name(s_category_names[ix])) {
+                enabled |= (uint64_t) 1 << ix;
+            }
+        }
+    }
+    __atomic_store_n(&log_categories_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+int log_category_index(TraceCategory category)
+{
+    pthread_mutex_lock(&s_category_mutex);
+    int ret = 0;
+    for (; ret < s_category_count; ++ret) {
+        if (sv_eq(s_category_names[ret], category)) {
+            break;
+        }
+    }
+    if (ret == s_category_count) {
+        if (s_category_count < LOG_CATEGORY_OTHER) {
+            s_category_names[s_category_count++] = log_copy_name(category);
+            log_update_enabled();
+        } else {
+            ret = LOG_CATEGORY_OTHER;
         }
     }
-    sl_push(&s_categories, category);
+    pthread_mutex_unlock(&s_category_mutex);
+    return ret;
+}
+
+bool _log_category_on(TraceCategory category)
+{
+    if (sv_empty(category)) {
+        return true;
+    }
+    return log_index_on(log_category_index(category));
+}
+
+void log_turn_on_sv(TraceCategory category)
+{
+    pthread_mutex_lock(&s_category_mutex);
+    if (sv_eq(category, SV("true", 4))) {
+        s_all_categories = true;
+    } else if (!log_enabled_by_name(category)) {
+        sl_push(&s_categories, log_copy_name(category));
+    }
+    log_update_enabled();
+    pthread_mutex_unlock(&s_category_mutex);
 }
 
 void log_turn_off_sv(StringView category)
 {
+    pthread_mutex_lock(&s_category_mutex);
+    if (sv_eq(category, SV("true", 4))) {
+        s_all_categories = false;
+    }
     for (size_t ix = 0; ix < s_categories.size; ++ix) {
         if (sv_eq(s_categories.strings[ix], category)) {
-            return;
+            free((char *) s_categories.strings[ix].ptr);
+            memmove(s_categories.strings + ix, s_categories.strings + ix + 1, (s_categories.size - ix - 1) * sizeof(StringView));
+            --s_categories.size;
+            break;
         }
     }
-    sl_push(&s_categories, category);
+    log_update_enabled();
+    pthread_mutex_unlock(&s_category_mutex);
 }
 
 void _fatal(char const *file_name, int line, char const *msg, ...)
@@ -166,10 +848,13 @@ void vfatal(char const *file_name, int line, char const *msg, va_list args)
     exit(1);
 }
 
+// The log option selects how messages are written: "sync" writes them on
+// the calling thread, "eager" formats them there and leaves the writing to
+// a background thread, and the default also leaves the formatting to that
+// thread.
 void log_init()
 {
     pthread_setname_np("main");
-    s_mutex = mutex_create();
     StringList categories = get_option_values(sv_from("trace"));
     if (sl_empty(&categories)) {
         char const *cats = getenv("TRACE");
@@ -181,8 +866,120 @@ void log_init()
         return;
     }
     for (size_t ix = 0; ix < sl_size(&categories); ++ix) {
-        sl_push(&s_categories, sv_copy(categories.strings[ix]));
+        log_turn_on_sv(categories.strings[ix]);
+    }
+
+    StringView mode = get_option(sv_from("log"));
+    s_mode = LM_DEFERRED;
+    if (sv_eq_cstr(mode, "sync")) {
+        s_mode = LM_SYNC;
+    } else if (sv_eq_cstr(mode, "eager")) {
+        s_mode = LM_EAGER;
+    }
+    if (s_mode != LM_SYNC && !atomic_load(&s_writer_running)) {
+        pthread_key_create(&s_ring_key, log_release_ring);
+        atomic_store(&s_writer_running, true);
+        if (pthread_create(&s_writer, NULL, log_writer, NULL) != 0) {
+            atomic_store(&s_writer_running, false);
+            s_mode = LM_SYNC;
+        } else {
+            pthread_atfork(NULL, NULL, log_atfork_child);
+            atexit(log_stop);
+        }
     }
+
     StringView cats = sl_join(&s_categories, SV(", ", 2));
     info("Tracing initialized. Enabled categories: %.*s", SV_ARG(cats));
 }
+
+#ifdef LOG_TEST
+
+#include <fcntl.h>
+
+static void check_format(char const *expected, char const *fmt, ...)
+{
+    char    payload[1024];
+    size_t  length = 0;
+    va_list args;
+    va_start(args, fmt);
+    bool captured = log_capture(payload, sizeof(payload), &length, fmt, args);
+    va_end(args);
+    assert(captured);
+    char      buffer[1024];
+    LogOutput out = { .buffer = buffer, .capacity = sizeof(buffer) };
+    log_format(&out, fmt, payload);
+    assert(out.length == strlen(expected) && memcmp(buffer, expected, out.length) == 0);
+}
+
+static bool can_capture(char const *fmt, ...)
+{
+    char    payload[64];
+    size_t  length = 0;
+    va_list args;
+    va_start(args, fmt);
+    bool ret = log_capture(payload, sizeof(payload), &length, fmt, args);
+    va_end(args);
+    return ret;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Times bursts that fit in the ring, which is what the calling thread sees
+// as long as the writer keeps up.
+static double bench(size_t count)
+{
+    StringView sv = sv_from("semantic tokens");
+    double     elapsed = 0.0;
+    for (size_t burst = 0; burst < count; burst += 256) {
+        double start = now();
+        for (size_t ix = burst; ix < burst + 256; ++ix) {
+            trace(BENCH, "Token %zu at %d:%d '%.*s' %s %5.2f", ix, (int) ix % 80, 12, SV_ARG(sv), "type", 3.14);
+        }
+        elapsed += now() - start;
+        log_flush();
+    }
+    return elapsed / count * 1e9;
+}
+
+int main()
+{
+    char buf[8] = "abc";
+    check_format("plain", "plain");
+    check_format("100% 42 -7 ff 0x1p+0", "100%% %d %ld %x %a", 42, -7L, 255u, 1.0);
+    check_format("[  abc|ab]", "[%5s|%.*s]", buf, 2, "abcdef");
+    check_format("size 18446744073709551615 12345678901", "size %zu %lld", (size_t) -1, 12345678901LL);
+    check_format("(null) 3.142 c  -1", "%s %.3f %c %*d", (char *) NULL, 3.14159, 'c', 3, -1);
+    assert(!can_capture("%n", NULL));
+    assert(!can_capture("%ls", L"wide"));
+    assert(!can_capture("%Lf", 1.0L));
+    assert(!can_capture("%s", "a string that does not fit in the 64 bytes the payload has room for"));
+
+    int fd = open("/dev/null", O_WRONLY);
+    int saved = dup(STDERR_FILENO);
+    dup2(fd, STDERR_FILENO);
+    log_level = LL_TRACE;
+    log_turn_on(BENCH);
+    size_t count = 256 * 1024;
+    double sync_ns = bench(count);
+    s_mode = LM_DEFERRED;
+    pthread_key_create(&s_ring_key, log_release_ring);
+    atomic_store(&s_writer_running, true);
+    pthread_create(&s_writer, NULL, log_writer, NULL);
+    double deferred_ns = bench(count);
+    s_mode = LM_EAGER;
+    double eager_ns = bench(count);
+    log_stop();
+    assert(atomic_load(&s_written) == 2 * count);
+    dup2(saved, STDERR_FILENO);
+    printf("trace() per call: sync %.0f ns, eager %.0f ns, deferred %.0f ns\n", sync_ns, eager_ns, deferred_ns);
+    log_turn_off(BENCH);
+    assert(!log_category_on(BENCH));
+    return 0;
+}
+
+#endif /* LOG_TEST */
@@ -16,9 +16,19 @@
 struct string_view;
 typedef struct string_view TraceCategory;
 
+// Trace categories are numbered on first use; a category is on if its bit
+// in log_categories_enabled is set. Categories past the first 63 share the
+// last bit, which is only set when all tracing is on.
+#define LOG_MAX_CATEGORIES 64
+
+extern uint64_t log_categories_enabled;
+
 // clang-format off
 extern                            void log_init();
+extern                            void log_flush();
+extern                            int  log_category_index(TraceCategory category);
 extern format_args(4, 5)          void _trace(char const* file_name, int line, TraceCategory category, char const *msg, ...);
+extern format_args(4, 5)          void _trace_index(char const* file_name, int line, int category, char const *msg, ...);
 extern                            void vtrace(char const *file_name, int line, TraceCategory category, char const *msg, va_list args);
 extern format_args(3, 4)          void _info(char const *file_name, int line, char const *msg, ...);
 extern                            void vinfo(char const *file_name, int line, char const *msg, va_list args);
@@ -35,14 +45,40 @@ noreturn extern                   void vfatal(char const *file_name, int line, c
 #define NYI(msg, ...)             fatal("Not yet implemented in %s: " msg, __func__ __VA_OPT__(, ) __VA_ARGS__)
 #define OUT_OF_MEMORY(msg, ...)   fatal("Out of memory in %s: " msg, __func__ __VA_OPT(, ) __VA_ARGS__)
 
-#define trace(Cat, Msg, ...)      _trace(__FILE_NAME__, __LINE__, (TraceCategory) { #Cat, strlen(#Cat) }, Msg __VA_OPT__(, ) __VA_ARGS__)
 #define info(Msg, ...)            _info(__FILE_NAME__, __LINE__, Msg __VA_OPT__(, ) __VA_ARGS__)
 #define panic(Msg, ...)           _panic(__FILE_NAME__, __LINE__, Msg __VA_OPT__(, ) __VA_ARGS__)
 #define log_turn_on(Cat)          log_turn_on_sv((TraceCategory) { #Cat, strlen(#Cat) })
-#define log_turn_off(Cat)         log_turn_off_sv(TraceCategory { #Cat, strlen(#Cat) })
-#define log_category_on(Cat)      _log_category_on((TraceCategory) { #Cat, strlen(#Cat) })
+#define log_turn_off(Cat)         log_turn_off_sv((TraceCategory) { #Cat, strlen(#Cat) })
 // clang-format on
 
+static inline bool log_index_on(int category)
+{
+    return (__atomic_load_n(&log_categories_enabled, __ATOMIC_RELAXED) >> category) & 1;
+}
+
+// Every trace() and log_category_on() call site looks up the index of its
+// category once and caches it, so checking whether it is on is a bit test.
+#define LOG_CATEGORY_INDEX(Cat)                                               \
+    ({                                                                        \
+        static int _log_ix = -1;                                              \
+        int        _ix = __atomic_load_n(&_log_ix, __ATOMIC_RELAXED);         \
+        if (_ix < 0) {                                                        \
+            _ix = log_category_index((TraceCategory) { #Cat, strlen(#Cat) }); \
+            __atomic_store_n(&_log_ix, _ix, __ATOMIC_RELAXED);                \
+        }                                                                     \
+        _ix;                                                                  \
+    })
+
+#define trace(Cat, Msg, ...)                                                                  \
+    do {                                                                                      \
+        int _trace_ix = LOG_CATEGORY_INDEX(Cat);                                              \
+        if (log_index_on(_trace_ix)) {                                                        \
+            _trace_index(__FILE_NAME__, __LINE__, _trace_ix, Msg __VA_OPT__(, ) __VA_ARGS__); \
+        }                                                                                     \
+    } while (0)
+
+#define log_category_on(Cat) log_index_on(LOG_CATEGORY_INDEX(Cat))
+
 #define assert(cond)                                                       \
     do {                                                                   \
         if (!(cond)) {                                                     \
@@ -5,6 +5,8 @@
  */
 
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -13,6 +15,26 @@
 #include <mem.h>
 
 #define SENTINEL 0xBABECAFE
+#define ARENA_ALIGNMENT 16
+#define ARENA_ALIGN(sz) (((sz) + (ARENA_ALIGNMENT - 1)) & ~((size_t) ARENA_ALIGNMENT - 1))
+
+struct arena_chunk {
+    ArenaChunk *prev;
+    size_t      capacity;
+    size_t      used;
+    size_t      dirty;
+    bool        oversized;
+    _Alignas(ARENA_ALIGNMENT) char data[];
+};
+
+struct arena {
+    atomic_flag lock;
+    size_t      chunk_size;
+    ArenaChunk *current;
+    ArenaChunk *spare;
+    size_t      allocations;
+    size_t      bytes_allocated;
+};
 
 void *malloc_fatal(size_t size, char const *where, ...)
 {
@@ -34,16 +56,95 @@ void *malloc_fatal(size_t size, char const *where, ...)
     return ret;
 }
 
+static void arena_lock(Arena *arena)
+{
+    while (atomic_flag_test_and_set_explicit(&arena->lock, memory_order_acquire))
+        ;
+}
+
+static void arena_unlock(Arena *arena)
+{
+    atomic_flag_clear_explicit(&arena->lock, memory_order_release);
+}
+
+static ArenaChunk *arena_new_chunk(Arena *arena, size_t size)
+{
+    ArenaChunk *chunk = NULL;
+    if (size > arena->chunk_size / 4) {
+        chunk = calloc(1, sizeof(ArenaChunk) + size);
+        if (!chunk) {
+            fatal("Out of memory allocating %zu byte arena block", size);
+        }
+        chunk->capacity = size;
+        chunk->oversized = true;
+    } else if (arena->spare) {
+        chunk = arena->spare;
+        arena->spare = chunk->prev;
+    } else {
+        chunk = calloc(1, sizeof(ArenaChunk) + arena->chunk_size);
+        if (!chunk) {
+            fatal("Out of memory allocating arena chunk");
+        }
+        chunk->capacity = arena->chunk_size;
+    }
+    chunk->used = 0;
+    chunk->prev = arena->current;
+    arena->current = chunk;
+    return chunk;
+}
+
+static void arena_retire_chunk(Arena *arena, ArenaChunk *chunk)
+{
+    if (chunk->oversized) {
+        free(chunk);
+        return;
+    }
+    chunk->used = 0;
+    chunk->prev = arena->spare;
+    arena->spare = chunk;
+}
+
 Allocator allocator_new()
+{
+    return allocator_new_with_chunk_size(ARENA_DEFAULT_CHUNK_SIZE);
+}
+
+Allocator allocator_new_with_chunk_size(size_t chunk_size)
 {
     Allocator ret = { 0 };
     ret.sentinel = SENTINEL;
+    ret.arena = MALLOC(Arena);
+    atomic_flag_clear(&ret.arena->lock);
+    ret.arena->chunk_size = ARENA_ALIGN((chunk_size) ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE);
     return ret;
 }
 
 void *allocator_allocate(Allocator alloc, size_t size)
 {
-    return malloc_fatal(size, NULL);
+    Arena *arena = alloc.arena;
+    if (!arena) {
+        return malloc_fatal(size, NULL);
+    }
+    size = ARENA_ALIGN((size) ? size : 1);
+    arena_lock(arena);
+    ArenaChunk *chunk = arena->current;
+    if (!chunk || chunk->used + size > chunk->capacity) {
+        chunk = arena_new_chunk(arena, size);
+    }
+    char *ret = chunk->data + chunk->used;
+    if (chunk->used < chunk->dirty) {
+        // Rewound memory is handed out again; callers expect zeroed blocks.
+        size_t stale = chunk->dirty - chunk->used;
+        memset(ret, 0, (stale < size) ? stale : size);
+    }
+    chunk->used += size;
+    if (chunk->used > chunk->dirty) {
+        chunk->dirty = chunk->used;
+    }
+    ++arena->allocations;
+    arena->bytes_allocated += size;
+    arena_unlock(arena);
+    return ret;
 }
 
 void *allocator_allocate_array(Allocator alloc, size_t size, size_t num)
@@ -51,6 +152,93 @@ void *allocator_allocate_array(Allocator alloc, size_t size, size_t num)
     return allocator_allocate(alloc, size * num);
 }
 
+AllocatorMark allocator_mark(Allocator alloc)
+{
+    AllocatorMark ret = { 0 };
+    if (!alloc.arena) {
+        return ret;
+    }
+    arena_lock(alloc.arena);
+    ret.chunk = alloc.arena->current;
+    ret.used = (ret.chunk) ? ret.chunk->used : 0;
+    arena_unlock(alloc.arena);
+    return ret;
+}
+
+// Everything allocated after the mark was taken becomes invalid. Free lists
+// threaded through arena memory (FREE_LIST_IMPL, the datum block lists) must
+// be dropped by their owners before rewinding past their entries.
+void allocator_reset_to_mark(Allocator alloc, AllocatorMark mark)
+{
+    Arena *arena = alloc.arena;
+    if (!arena) {
+        return;
+    }
+    arena_lock(arena);
+    while (arena->current && arena->current != mark.chunk) {
+        ArenaChunk *chunk = arena->current;
+        arena->current = chunk->prev;
+        arena_retire_chunk(arena, chunk);
+    }
+    if (arena->current) {
+        assert(mark.used <= arena->current->used);
+        arena->current->used = mark.used;
+    }
+    arena_unlock(arena);
+}
+
+void allocator_reset(Allocator alloc)
+{
+    allocator_reset_to_mark(alloc, (AllocatorMark) { 0 });
+}
+
+void allocator_release(Allocator alloc)
+{
+    Arena *arena = alloc.arena;
+    if (!arena) {
+        return;
+    }
+    allocator_reset(alloc);
+    arena_lock(arena);
+    while (arena->spare) {
+        ArenaChunk *chunk = arena->spare;
+        arena->spare = chunk->prev;
+        free(chunk);
+    }
+    arena->allocations = 0;
+    arena->bytes_allocated = 0;
+    arena_unlock(arena);
+}
+
+void allocator_free(Allocator *alloc)
+{
+    allocator_release(*alloc);
+    free(alloc->arena);
+    *alloc = (Allocator) { 0 };
+}
+
+AllocatorStats allocator_stats(Allocator alloc)
+{
+    AllocatorStats ret = { 0 };
+    Arena         *arena = alloc.arena;
+    if (!arena) {
+        return ret;
+    }
+    arena_lock(arena);
+    for (ArenaChunk *chunk = arena->current; chunk; chunk = chunk->prev) {
+        ++ret.chunks;
+        ret.bytes_reserved += chunk->capacity;
+    }
+    for (ArenaChunk *chunk = arena->spare; chunk; chunk = chunk->prev) {
+        ++ret.spare_chunks;
+        ret.bytes_reserved += chunk->capacity;
+    }
+    ret.allocations = arena->allocations;
+    ret.bytes_allocated = arena->bytes_allocated;
+    arena_unlock(arena);
+    return ret;
+}
+
 static Allocator s_alloc = { 0 };
 
 void *mem_allocate(size_t size)
@@ -65,3 +253,103 @@ void *mem_allocate_array(size_t count, size_t element_size)
 {
     return mem_allocate(count * element_size);
 }
+
+void mem_free()
+{
+    allocator_release(s_alloc);
+}
+
+#ifdef MEM_TEST
+
+#include <time.h>
+
+#define NUM_OBJECTS (4 * 1024 * 1024)
+#define ROUNDS 5
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static size_t object_size(size_t ix)
+{
+    return 16 + (ix * 2654435761u) % 113;
+}
+
+static void **s_objects;
+
+static double bench_malloc()
+{
+    double start = now();
+    for (size_t ix = 0; ix < NUM_OBJECTS; ++ix) {
+        s_objects[ix] = malloc_fatal(object_size(ix), NULL);
+    }
+    for (size_t ix = 0; ix < NUM_OBJECTS; ++ix) {
+        free(s_objects[ix]);
+    }
+    return now() - start;
+}
+
+static double bench_arena(Allocator alloc)
+{
+    double start = now();
+    for (size_t ix = 0; ix < NUM_OBJECTS; ++ix) {
+        s_objects[ix] = allocator_allocate(alloc, object_size(ix));
+    }
+    allocator_reset(alloc);
+    return now() - start;
+}
+
+static void test_mark_reset()
+{
+    Allocator alloc = allocator_new_with_chunk_size(1024);
+    char     *first = allocator_allocate(alloc, 100);
+    memset(first, 'x', 100);
+    AllocatorMark mark = allocator_mark(alloc);
+    char         *second = allocator_allocate(alloc, 100);
+    memset(second, 'y', 100);
+    for (int ix = 0; ix < 100; ++ix) {
+        allocator_allocate(alloc, 200);
+    }
+    allocator_allocate(alloc, 10000);
+    allocator_reset_to_mark(alloc, mark);
+    char *again = allocator_allocate(alloc, 100);
+    assert(again == second);
+    for (int ix = 0; ix < 100; ++ix) {
+        assert(again[ix] == 0);
+        assert(first[ix] == 'x');
+    }
+    AllocatorStats stats = allocator_stats(alloc);
+    assert(stats.chunks == 1);
+    assert(stats.spare_chunks > 0);
+    allocator_free(&alloc);
+    assert(alloc.arena == NULL);
+    printf("mark/reset: OK\n");
+}
+
+int main()
+{
+    test_mark_reset();
+
+    s_objects = malloc(NUM_OBJECTS * sizeof(void *));
+    Allocator alloc = allocator_new();
+    double    malloc_time = 0.0;
+    double    arena_time = 0.0;
+    for (int round = 0; round < ROUNDS; ++round) {
+        malloc_time += bench_malloc();
+        arena_time += bench_arena(alloc);
+    }
+    AllocatorStats stats = allocator_stats(alloc);
+    printf("%d x %d allocations of 16-128 bytes\n", ROUNDS, NUM_OBJECTS);
+    printf("malloc_fatal + free : %8.3f ms/round\n", malloc_time * 1000.0 / ROUNDS);
+    printf("arena + reset       : %8.3f ms/round\n", arena_time * 1000.0 / ROUNDS);
+    printf("speedup             : %8.2fx\n", malloc_time / arena_time);
+    printf("arena chunks        : %zu (%zu KiB reserved)\n", stats.chunks + stats.spare_chunks, stats.bytes_reserved / 1024);
+    allocator_free(&alloc);
+    free(s_objects);
+    return 0;
+}
+
+#endif /* MEM_TEST */
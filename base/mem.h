@@ -9,17 +9,50 @@
 
 #include <stdlib.h>
 
+#define ARENA_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+typedef struct arena_chunk ArenaChunk;
+typedef struct arena       Arena;
+
+/*
+ * An Allocator is a cheap, copyable handle on a bump-pointer arena. Copies
+ * of a handle share the same arena, so handing one out by value (as
+ * get_allocator() in allocate.h does) is fine. Memory is never returned
+ * piecemeal; it is rewound with allocator_reset_to_mark/allocator_reset or
+ * handed back to the system in one go with allocator_release.
+ */
 typedef struct allocator {
     size_t sentinel;
+    Arena *arena;
 } Allocator;
 
-void     *malloc_fatal(size_t size, char const *where, ...);
-Allocator allocator_new();
-void     *allocator_allocate(Allocator alloc, size_t size);
-void     *allocator_allocate_array(Allocator alloc, size_t size, size_t num);
-void     *mem_allocate(size_t size);
-void     *mem_allocate_array(size_t count, size_t element_size);
-void      mem_free();
+typedef struct allocator_mark {
+    ArenaChunk *chunk;
+    size_t      used;
+} AllocatorMark;
+
+typedef struct allocator_stats {
+    size_t chunks;
+    size_t spare_chunks;
+    size_t allocations;
+    size_t bytes_allocated;
+    size_t bytes_reserved;
+} AllocatorStats;
+
+void          *malloc_fatal(size_t size, char const *where, ...);
+Allocator      allocator_new();
+Allocator      allocator_new_with_chunk_size(size_t chunk_size);
+void          *allocator_allocate(Allocator alloc, size_t size);
+void          *allocator_allocate_array(Allocator alloc, size_t size, size_t num);
+AllocatorMark  allocator_mark(Allocator alloc);
+void           allocator_reset_to_mark(Allocator alloc, AllocatorMark mark);
+void           allocator_reset(Allocator alloc);
+void           allocator_release(Allocator alloc);
+void           allocator_free(Allocator *alloc);
+AllocatorStats allocator_stats(Allocator alloc);
+void          *mem_allocate(size_t size);
+void          *mem_allocate_array(size_t count, size_t element_size);
+void           mem_free();
 
 #define MALLOC(t) ((t *) malloc_fatal(sizeof(t), "allocating " #t))
 #define MALLOC_ARR(t, num) ((t *) malloc_fatal((num * sizeof(t)), "allocating array of %d " #t "s", num));
@@ -4,242 +4,290 @@
  * SPDX-License-Identifier: MIT
  */
 
-#define HAVE_PTHREAD_H
-
 #include <errno.h>
 #include <string.h>
 
-#include <errorcode.h>
 #include <log.h>
-#include <mem.h>
 #include <mutex.h>
 #include <sv.h>
 
-Mutex mutex_create(void)
-{
-    Mutex mutex;
+#if defined(__linux__)
 
-#ifdef HAVE_PTHREAD_H
-    pthread_mutexattr_t attr;
-#endif /* HAVE_PTHREAD_H */
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
-#ifdef HAVE_PTHREAD_H
-    pthread_mutexattr_init(&attr);
-    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-    mutex.mutex = MALLOC(pthread_mutex_t);
-    if ((errno = pthread_mutex_init(mutex.mutex, &attr))) {
-        fatal("Error creating mutex: %s", errorcode_to_string(errno));
-    }
-    pthread_mutexattr_destroy(&attr);
-#elif defined(HAVE_INITIALIZECRITICALSECTION)
-    InitializeCriticalSection(&(mutex->cs));
-#endif /* HAVE_PTHREAD_H */
+void futex_wait(uint32_t *addr, uint32_t value)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
 
-    return mutex;
+void futex_wake(uint32_t *addr, bool all)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, (all) ? INT32_MAX : 1, NULL, NULL, 0);
 }
 
-void mutex_free(Mutex mutex)
+#elif defined(__APPLE__)
+
+// The primitives libc++ uses for std::atomic::wait.
+extern int __ulock_wait(uint32_t operation, void *addr, uint64_t value, uint32_t timeout);
+extern int __ulock_wake(uint32_t operation, void *addr, uint64_t wake_value);
+
+#define UL_COMPARE_AND_WAIT 1
+#define ULF_WAKE_ALL 0x00000100
+#define ULF_NO_ERRNO 0x01000000
+
+void futex_wait(uint32_t *addr, uint32_t value)
 {
-#ifdef HAVE_PTHREAD_H
-    pthread_mutex_destroy(mutex.mutex);
-#elif defined(HAVE_INITIALIZECRITICALSECTION)
-    DeleteCriticalSection(&(mutex->cs));
-#endif /* HAVE_PTHREAD_H */
+    __ulock_wait(UL_COMPARE_AND_WAIT | ULF_NO_ERRNO, addr, value, 0);
 }
 
-void mutex_lock(Mutex mutex)
+void futex_wake(uint32_t *addr, bool all)
 {
-    int retval = 0;
+    __ulock_wake(UL_COMPARE_AND_WAIT | ULF_NO_ERRNO | ((all) ? ULF_WAKE_ALL : 0), addr, 0);
+}
 
-    trace(THREAD, "Locking mutex");
-#ifdef HAVE_PTHREAD_H
-    errno = pthread_mutex_lock(mutex.mutex);
-    if (errno) {
-        retval = -1;
-    }
-#elif defined(HAVE_INITIALIZECRITICALSECTION)
-    EnterCriticalSection(&(mutex->cs));
-#endif /* HAVE_PTHREAD_H */
-    if (retval) {
-        fatal("Error locking mutex: %s", errorcode_to_string(errno));
-    }
-    trace(THREAD, "Mutex locked");
+#else
+
+#error "Please provide futex implementation"
+
+#endif
+
+#define MUTEX_MAX_SPIN 200
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
 }
 
-/**
- * @return 0 if the mutex was successfully locked
- *         1 if the mutex was owned by another thread
- *         -1 If an error occurred.
- */
-int mutex_try_lock(Mutex mutex)
-{
-    int retval;
-
-    trace(THREAD, "Trying to lock mutex");
-#ifdef HAVE_PTHREAD_H
-    errno = pthread_mutex_trylock(mutex.mutex);
-    switch (errno) {
-    case 0:
-        retval = 0;
-        break;
-    case EBUSY:
-        retval = 1;
-        break;
-    default:
-        retval = -1;
-        break;
-    }
-#elif defined(HAVE_INITIALIZECRITICALSECTION)
-    retval = (!TryEnterCriticalSection(&mutex->cs)) ? 0 : 1;
-#endif /* HAVE_PTHREAD_H */
-    trace(THREAD, "Trylock mutex: %s", (retval) ? "Fail" : "Success");
-    return retval;
+Mutex mutex_create(void)
+{
+    return (Mutex) { 0 };
 }
 
-void mutex_unlock(Mutex mutex)
+void mutex_free(Mutex *)
 {
-    int retval = 0;
+}
 
-    trace(THREAD, "Unlocking mutex");
-#ifdef HAVE_PTHREAD_H
-    errno = pthread_mutex_unlock(mutex.mutex);
-    if (errno) {
-        retval = -1;
+// Spins while the owner is likely to release the mutex soon, then sleeps.
+// The spin limit follows the running average of successful spins, so a
+// mutex held for long stretches stops burning cycles. Called with the
+// state word already seen non-zero.
+void mutex_lock_contended(Mutex *mutex)
+{
+    int32_t  average = __atomic_load_n(&mutex->spin_average, __ATOMIC_RELAXED);
+    uint32_t limit = (uint32_t) (2 * average + 10);
+    if (limit > MUTEX_MAX_SPIN) {
+        limit = MUTEX_MAX_SPIN;
+    }
+    uint32_t spins = 0;
+    uint32_t sleeps = 0;
+    for (; spins < limit; ++spins) {
+        cpu_relax();
+        uint32_t expected = MUTEX_UNLOCKED;
+        if (__atomic_load_n(&mutex->state, __ATOMIC_RELAXED) == MUTEX_UNLOCKED
+            && __atomic_compare_exchange_n(&mutex->state, &expected, MUTEX_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
     }
-#elif defined(HAVE_INITIALIZECRITICALSECTION)
-    EnterCriticalSection(&mutex->cs);
-#endif /* HAVE_PTHREAD_H */
-    if (retval && errno != EPERM) {
-        panic("Error unlocking mutex: %s", errorcode_to_string(errno));
+    if (spins == limit) {
+        // Marking the mutex contended makes the owner wake us on unlock.
+        while (__atomic_exchange_n(&mutex->state, MUTEX_CONTENDED, __ATOMIC_ACQUIRE) != MUTEX_UNLOCKED) {
+            ++sleeps;
+            futex_wait(&mutex->state, MUTEX_CONTENDED);
+        }
     }
-    trace(THREAD, "Mutex unlocked");
+    // We own the mutex now, so the stats can be updated without atomics.
+    ++mutex->stats.contended;
+    mutex->stats.spins += spins;
+    mutex->stats.sleeps += sleeps;
+    __atomic_store_n(&mutex->spin_average, average + ((int32_t) spins - average) / 8, __ATOMIC_RELAXED);
+}
+
+void mutex_wake(Mutex *mutex)
+{
+    futex_wake(&mutex->state, false);
+}
+
+MutexStats mutex_stats(Mutex *mutex)
+{
+    return mutex->stats;
 }
 
 /* ------------------------------------------------------------------------ */
 /* -- C O N D I T I O N _ T ----------------------------------------------- */
 /* ------------------------------------------------------------------------ */
 
-void condition_free(Condition condition)
+static Mutex *condition_mutex(Condition *condition)
+{
+    return (condition->borrowed_mutex) ? condition->borrowed_mutex : &condition->mutex;
+}
+
+void condition_free(Condition *condition)
 {
-#ifdef HAVE_PTHREAD_H
-    pthread_cond_destroy(condition.condition);
-#endif /* HAVE_PTHREAD_H */
-    if (!condition.borrowed_mutex) {
-        mutex_free(condition.mutex);
+    if (!condition->borrowed_mutex) {
+        mutex_free(&condition->mutex);
     }
 }
 
 Condition condition_create()
 {
-    Condition condition = { 0 };
-    condition.mutex = mutex_create();
-    condition.borrowed_mutex = false;
-#ifdef HAVE_PTHREAD_H
-    condition.condition = MALLOC(pthread_cond_t);
-    pthread_cond_init(condition.condition, NULL);
-#elif defined(HAVE_INITIALIZECRITICALSECTION)
-    InitializeConditionVariable(&condition->condition);
-#endif /* HAVE_PTHREAD_H */
     trace(THREAD, "Condition created");
-    return condition;
+    return (Condition) { 0 };
 }
 
-Condition condition_create_with_borrowed_mutex(Mutex mutex)
+Condition condition_create_with_borrowed_mutex(Mutex *mutex)
 {
     Condition condition = { 0 };
-    condition.mutex = mutex;
-    condition.borrowed_mutex = true;
-#ifdef HAVE_PTHREAD_H
-    condition.condition = (pthread_cond_t *) malloc(sizeof(pthread_cond_t));
-    pthread_cond_init(condition.condition, NULL);
-#elif defined(HAVE_INITIALIZECRITICALSECTION)
-    InitializeConditionVariable(&condition->condition);
-#endif /* HAVE_PTHREAD_H */
+    condition.borrowed_mutex = mutex;
     trace(THREAD, "Condition created");
     return condition;
 }
 
-void condition_acquire(Condition condition)
+void condition_acquire(Condition *condition)
 {
     trace(THREAD, "Acquiring condition");
-    mutex_lock(condition.mutex);
+    mutex_lock(condition_mutex(condition));
 }
 
-void condition_release(Condition condition)
+void condition_release(Condition *condition)
 {
     trace(THREAD, "Releasing condition");
-    mutex_unlock(condition.mutex);
+    mutex_unlock(condition_mutex(condition));
 }
 
 /**
  * @return 0 if the condition was successfully locked
  *         1 if the condition was owned by another thread
- *         -1 If an error occurred.
  */
-int condition_try_acquire(Condition condition)
+int condition_try_acquire(Condition *condition)
 {
     trace(THREAD, "Trying to acquire condition");
-    return mutex_try_lock(condition.mutex);
+    return mutex_try_lock(condition_mutex(condition));
 }
 
-void condition_wakeup(Condition condition)
+// Bumping the sequence number makes sleepers that have not reached the
+// futex yet return from it immediately. The syscall is skipped when nobody
+// sleeps. Both release the mutex, like they always have.
+static void condition_signal(Condition *condition, bool all)
 {
-    int retval = 0;
+    __atomic_add_fetch(&condition->sequence, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&condition->waiters, __ATOMIC_SEQ_CST) > 0) {
+        futex_wake(&condition->sequence, all);
+    }
+    mutex_unlock(condition_mutex(condition));
+}
 
+void condition_wakeup(Condition *condition)
+{
     trace(THREAD, "Waking up condition");
-#ifdef HAVE_PTHREAD_H
-    errno = pthread_cond_signal(condition.condition);
-    if (errno) {
-        retval = -1;
-    }
-#elif defined(HAVE_INITIALIZECRITICALSECTION)
-    WakeConditionVariable(&condition->condition);
-#endif /* HAVE_PTHREAD_H */
-    mutex_unlock(condition.mutex);
-    if (retval) {
-        fatal("Error waking condition: %s", errorcode_to_string(errno));
-    }
+    condition_signal(condition, false);
     trace(THREAD, "Condition woken up");
 }
 
-void condition_broadcast(Condition condition)
+void condition_broadcast(Condition *condition)
 {
-    int retval = 0;
-
     trace(THREAD, "Waking up condition");
-#ifdef HAVE_PTHREAD_H
-    errno = pthread_cond_broadcast(condition.condition);
-    if (errno) {
-        retval = -1;
-    }
-#elif defined(HAVE_INITIALIZECRITICALSECTION)
-#error Provide pthread_cond_broadcast equivalent
-    WakeConditionVariable(&condition->condition);
-#endif /* HAVE_PTHREAD_H */
-    mutex_unlock(condition.mutex);
-    if (retval) {
-        fatal("Error waking condition: %s", errorcode_to_string(errno));
-    }
+    condition_signal(condition, true);
     trace(THREAD, "All threads sleeping on Condition woken up");
 }
 
-void condition_sleep(Condition condition)
+// Must be called with the mutex held. Releases it completely, including
+// recursive acquisitions, for the duration of the sleep.
+void condition_sleep(Condition *condition)
 {
-    int retval = 0;
-
     trace(THREAD, "Going to sleep on condition");
-#ifdef HAVE_PTHREAD_H
-    errno = pthread_cond_wait(condition.condition, condition.mutex.mutex);
-    if (errno) {
-        retval = -1;
-    }
-#elif defined(HAVE_INITIALIZECRITICALSECTION)
-    SleepConditionVariableCS(&condition->condition, &condition->mutex->cs, INFINITE);
-#endif /* HAVE_PTHREAD_H */
-    if (retval) {
-        fatal("Error sleeping on condition: %s", errorcode_to_string(errno));
+    Mutex *mutex = condition_mutex(condition);
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) != mutex_self()) {
+        fatal("Error sleeping on condition: mutex not owned by this thread");
     }
+    __atomic_add_fetch(&condition->waiters, 1, __ATOMIC_SEQ_CST);
+    uint32_t sequence = __atomic_load_n(&condition->sequence, __ATOMIC_SEQ_CST);
+    uint32_t depth = mutex->depth;
+    mutex->depth = 1;
+    mutex_unlock(mutex);
+    futex_wait(&condition->sequence, sequence);
+    __atomic_sub_fetch(&condition->waiters, 1, __ATOMIC_SEQ_CST);
+    mutex_lock(mutex);
+    mutex->depth = depth;
     trace(THREAD, "Woke up from condition");
 }
 
 /* ------------------------------------------------------------------------ */
+
+// #define MUTEX_TEST
+#ifdef MUTEX_TEST
+
+#define THREADS 4
+#define INCREMENTS 1000000
+
+static Mutex     s_counter_mutex = { 0 };
+static uint64_t  s_counter = 0;
+static Condition s_ping = { 0 };
+static int       s_turn = 0;
+
+static void *increment(void *)
+{
+    for (int ix = 0; ix < INCREMENTS; ++ix) {
+        mutex_lock(&s_counter_mutex);
+        mutex_lock(&s_counter_mutex);
+        ++s_counter;
+        mutex_unlock(&s_counter_mutex);
+        mutex_unlock(&s_counter_mutex);
+    }
+    return NULL;
+}
+
+static void *pong(void *)
+{
+    for (int ix = 0; ix < 1000; ++ix) {
+        condition_acquire(&s_ping);
+        while (s_turn != 1) {
+            condition_sleep(&s_ping);
+        }
+        s_turn = 0;
+        condition_wakeup(&s_ping);
+    }
+    return NULL;
+}
+
+int main()
+{
+    pthread_t threads[THREADS];
+    for (int ix = 0; ix < THREADS; ++ix) {
+        pthread_create(threads + ix, NULL, increment, NULL);
+    }
+    for (int ix = 0; ix < THREADS; ++ix) {
+        pthread_join(threads[ix], NULL);
+    }
+    if (s_counter != (uint64_t) THREADS * INCREMENTS) {
+        fatal("Counter is %llu, expected %llu", s_counter, (uint64_t) THREADS * INCREMENTS);
+    }
+    MutexStats stats = mutex_stats(&s_counter_mutex);
+    printf("locks %llu, contended %llu, spins %llu, sleeps %llu\n",
+        stats.locks, stats.contended, stats.spins, stats.sleeps);
+
+    pthread_t pong_thread;
+    pthread_create(&pong_thread, NULL, pong, NULL);
+    for (int ix = 0; ix < 1000; ++ix) {
+        condition_acquire(&s_ping);
+        while (s_turn != 0) {
+            condition_sleep(&s_ping);
+        }
+        s_turn = 1;
+        condition_wakeup(&s_ping);
+    }
+    pthread_join(pong_thread, NULL);
+    if (mutex_try_lock(&s_ping.mutex) != 0) {
+        fatal("Condition mutex still locked");
+    }
+    mutex_unlock(&s_ping.mutex);
+    printf("ping-pong done\n");
+    return 0;
+}
+
+#endif
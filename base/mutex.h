@@ -4,56 +4,136 @@
  * SPDX-License-Identifier: MIT
  */
 
-#define HAVE_PTHREAD_H
-
 #ifndef __MUTEX_H__
 #define __MUTEX_H__
 
-#ifdef HAVE_PTHREAD_H
 #include <pthread.h>
-#endif /* HAVE_PTHREAD_H */
-#ifdef HAVE_INITIALIZECRITICALSECTION
-#ifdef HAVE_WINDOWS_H
-#include <windows.h>
-#endif /* HAVE_WINDOWS_H */
-#endif /* HAVE_INITIALIZECRITICALSECTION */
+#include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef struct mutex_stats {
+    uint64_t locks;     // Successful lock and try_lock calls, including recursive ones
+    uint64_t contended; // Locks that found the mutex held by another thread
+    uint64_t spins;     // Spin iterations spent waiting
+    uint64_t sleeps;    // Times a thread went to sleep on the mutex
+} MutexStats;
+
+/*
+ * Recursive mutex built on a single futex word, without heap allocation. A
+ * zero-initialized Mutex is unlocked and ready to use. The state word is 0
+ * when unlocked, 1 when locked, and 2 when locked with possible sleepers.
+ * Uncontended lock and unlock are inline compare-and-swaps. A contended lock
+ * spins for a while before sleeping; the spin limit adapts to how long the
+ * spins that succeeded took before. The stats are updated by the owner and
+ * read without synchronization, so are approximate while the mutex is busy.
+ */
 typedef struct mutex {
-#ifdef HAVE_PTHREAD_H
-    pthread_mutex_t *mutex;
-#elif defined(HAVE_INITIALIZECRITICALSECTION)
-    CRITICAL_SECTION cs;
-#endif /* HAVE_PTHREAD_H */
+    uint32_t   state;
+    uint32_t   depth;
+    uintptr_t  owner;
+    int32_t    spin_average;
+    MutexStats stats;
 } Mutex;
 
+/*
+ * Condition variable on a sequence-number futex. Either uses its own mutex
+ * or borrows one. Zero-initialized, it is ready to use with its own mutex.
+ * A Condition must not be copied while threads are using it.
+ */
 typedef struct condition {
-    Mutex mutex;
-    bool  borrowed_mutex;
-#ifdef HAVE_PTHREAD_H
-    pthread_cond_t *condition;
-#elif defined(HAVE_INITIALIZECRITICALSECTION)
-    CONDITION_VARIABLE condition;
-#endif
+    Mutex    mutex;
+    Mutex   *borrowed_mutex;
+    uint32_t sequence;
+    uint32_t waiters;
 } Condition;
 
-extern Mutex     mutex_create(void);
-extern void      mutex_free(Mutex mutex);
-extern void      mutex_lock(Mutex mutex);
-extern int       mutex_try_lock(Mutex mutex);
-extern void      mutex_unlock(Mutex mutex);
-extern Condition condition_create();
-extern Condition condition_create_with_borrowed_mutex(Mutex mutex);
-extern void      condition_free(Condition condition);
-extern void      condition_acquire(Condition);
-extern int       condition_try_acquire(Condition);
-extern void      condition_release(Condition);
-extern void      condition_wakeup(Condition);
-extern void      condition_broadcast(Condition);
-extern void      condition_sleep(Condition);
+enum {
+    MUTEX_UNLOCKED = 0,
+    MUTEX_LOCKED = 1,
+    MUTEX_CONTENDED = 2,
+};
+
+// Sleeps while *addr equals value. Wakes one or all threads sleeping on addr.
+extern void       futex_wait(uint32_t *addr, uint32_t value);
+extern void       futex_wake(uint32_t *addr, bool all);
+extern Mutex      mutex_create(void);
+extern void       mutex_free(Mutex *mutex);
+extern void       mutex_lock_contended(Mutex *mutex);
+extern void       mutex_wake(Mutex *mutex);
+extern MutexStats mutex_stats(Mutex *mutex);
+extern Condition  condition_create();
+extern Condition  condition_create_with_borrowed_mutex(Mutex *mutex);
+extern void       condition_free(Condition *condition);
+extern void       condition_acquire(Condition *condition);
+extern int        condition_try_acquire(Condition *condition);
+extern void       condition_release(Condition *condition);
+extern void       condition_wakeup(Condition *condition);
+extern void       condition_broadcast(Condition *condition);
+extern void       condition_sleep(Condition *condition);
+
+static inline uintptr_t mutex_self(void)
+{
+    return (uintptr_t) pthread_self();
+}
+
+static inline void mutex_lock(Mutex *mutex)
+{
+    uintptr_t self = mutex_self();
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) == self) {
+        ++mutex->depth;
+        ++mutex->stats.locks;
+        return;
+    }
+    uint32_t expected = MUTEX_UNLOCKED;
+    if (!__atomic_compare_exchange_n(&mutex->state, &expected, MUTEX_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        mutex_lock_contended(mutex);
+    }
+    __atomic_store_n(&mutex->owner, self, __ATOMIC_RELAXED);
+    mutex->depth = 1;
+    ++mutex->stats.locks;
+}
+
+/**
+ * @return 0 if the mutex was successfully locked
+ *         1 if the mutex was owned by another thread
+ */
+static inline int mutex_try_lock(Mutex *mutex)
+{
+    uintptr_t self = mutex_self();
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) == self) {
+        ++mutex->depth;
+        ++mutex->stats.locks;
+        return 0;
+    }
+    uint32_t expected = MUTEX_UNLOCKED;
+    if (!__atomic_compare_exchange_n(&mutex->state, &expected, MUTEX_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 1;
+    }
+    __atomic_store_n(&mutex->owner, self, __ATOMIC_RELAXED);
+    mutex->depth = 1;
+    ++mutex->stats.locks;
+    return 0;
+}
+
+// Unlocking a mutex owned by another thread is a no-op, like the EPERM the
+// pthread implementation returned and callers ignored.
+static inline void mutex_unlock(Mutex *mutex)
+{
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) != mutex_self()) {
+        return;
+    }
+    if (--mutex->depth > 0) {
+        return;
+    }
+    __atomic_store_n(&mutex->owner, 0, __ATOMIC_RELAXED);
+    if (__atomic_exchange_n(&mutex->state, MUTEX_UNLOCKED, __ATOMIC_RELEASE) == MUTEX_CONTENDED) {
+        mutex_wake(mutex);
+    }
+}
 
 #ifdef __cplusplus
 }
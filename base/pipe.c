@@ -4,26 +4,45 @@
  * SPDX-License-Identifier: MIT
  */
 
+// pipe2 is a GNU extension.
+#define _GNU_SOURCE
+
 #include <errno.h>
-#include <pthread.h>
 #include <string.h>
 #include <sys/fcntl.h>
-#include <sys/poll.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <base/errorcode.h>
 #include <base/pipe.h>
+#include <base/reactor.h>
 
 static int PipeEndRead = 0;
 static int PipeEndWrite = 1;
 
-static void read_pipe_read(ReadPipe *p);
-static void read_pipe_drain(ReadPipe *pipe);
+static void read_pipe_event(ReadPipe *pipe, int fd, int events);
+static bool read_pipe_drain(ReadPipe *pipe);
 static void read_pipe_newline(ReadPipe *pipe);
 
+// Both ends are close-on-exec. Spawned processes get their end through a
+// dup2, which clears the flag on the copy only.
+static int pipe_cloexec(int fds[2])
+{
+#if defined(__linux__)
+    return pipe2(fds, O_CLOEXEC);
+#else
+    if (pipe(fds) == -1) {
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
+
 ErrorOrReadPipe read_pipe_init(ReadPipe *p)
 {
-    if (pipe(p->pipe) == -1) {
+    if (pipe_cloexec(p->pipe) == -1) {
         ERROR(ReadPipe, ProcessError, errno, "pipe() failed");
     }
     RETURN(ReadPipe, p);
@@ -33,22 +52,16 @@ ErrorOrReadPipe read_pipe_connect(ReadPipe *p, int fd)
 {
     p->fd = fd;
     fcntl(p->fd, F_SETFL, O_NONBLOCK);
-
-    pthread_t thread;
-    int       ret;
     p->condition = condition_create();
     p->current = (StringView) { 0 };
-    if ((ret = pthread_create(&thread, NULL, (void *(*) (void *) ) read_pipe_read, (void *) p)) != 0) {
-        fatal("Could not start IPC service thread: %s", strerror(ret));
-    }
-    pthread_detach(thread);
+    reactor_watch(p->fd, (ReactorHandler) read_pipe_event, p);
     RETURN(ReadPipe, p);
 }
 
 void read_pipe_destroy(ReadPipe *pipe)
 {
     read_pipe_close(pipe);
-    condition_free(pipe->condition);
+    condition_free(&pipe->condition);
     sv_free(pipe->buffer.view);
 }
 
@@ -65,57 +78,54 @@ void read_pipe_connect_child(ReadPipe *pipe, int fd)
     close(pipe->pipe[PipeEndWrite]);
 }
 
+// Wakes up readers waiting in read_pipe_expect, which see fd < 0 and give up.
 void read_pipe_close(ReadPipe *pipe)
 {
-    condition_wakeup(pipe->condition);
+    condition_acquire(&pipe->condition);
     if (pipe->fd >= 0) {
+        reactor_unwatch(pipe->fd);
         close(pipe->fd);
     }
     pipe->fd = -1;
+    condition_broadcast(&pipe->condition);
 }
 
-void read_pipe_read(ReadPipe *pipe)
+// Called on the reactor thread. Data that arrived before the hangup is
+// drained before the pipe is closed.
+void read_pipe_event(ReadPipe *pipe, int, int events)
 {
-    struct pollfd poll_fd = { 0 };
-    poll_fd.fd = pipe->fd;
-    poll_fd.events = POLLIN;
-
-    while (true) {
-        if (poll(&poll_fd, 1, -1) == -1) {
-            if (errno == EINTR) {
-                continue;
-            }
-            break;
-        }
-        if (poll_fd.revents & POLLIN) {
-            read_pipe_drain(pipe);
-        }
-        if (poll_fd.revents & POLLHUP) {
-            break;
-        }
+    bool eof = false;
+    if (events & (RE_READABLE | RE_HANGUP)) {
+        eof = read_pipe_drain(pipe);
+    }
+    if (eof || (events & RE_HANGUP)) {
+        read_pipe_close(pipe);
     }
-    read_pipe_close(pipe);
-    condition_wakeup(pipe->condition);
 }
 
 #define DRAIN_SIZE (64 * 1024)
 
-void read_pipe_drain(ReadPipe *pipe)
+// Only the reactor thread drains pipes, so they can share one buffer.
+static char s_drain_buffer[DRAIN_SIZE];
+
+// Returns true if the writing end was closed.
+bool read_pipe_drain(ReadPipe *pipe)
 {
-    char buffer[DRAIN_SIZE];
-    condition_acquire(pipe->condition);
+    char *buffer = s_drain_buffer;
+    bool  eof = false;
+    condition_acquire(&pipe->condition);
     while (true) {
-        ssize_t count = read(pipe->fd, buffer, sizeof(buffer) - 1);
+        ssize_t count = read(pipe->fd, buffer, DRAIN_SIZE - 1);
         if (count >= 0) {
             buffer[count] = 0;
+            eof = (count == 0);
             if (count > 0) {
-                size_t ix = pipe->buffer.view.length;
+                // The append may move the buffer, so current is rebuilt from
+                // its offset.
+                size_t start = (pipe->current.ptr != NULL) ? (size_t) (pipe->current.ptr - pipe->buffer.view.ptr) : pipe->buffer.view.length;
                 sb_append_chars(&pipe->buffer, buffer, count);
-                if (pipe->current.ptr == NULL) {
-                    pipe->current.ptr = pipe->buffer.view.ptr + ix;
-                }
-                pipe->current.length = (pipe->buffer.view.ptr + pipe->buffer.view.length) - pipe->current.ptr;
-                if (count == sizeof(buffer) - 1) {
+                pipe->current = (StringView) { pipe->buffer.view.ptr + start, pipe->buffer.view.length - start };
+                if (count == DRAIN_SIZE - 1) {
                     continue;
                 }
             }
@@ -124,42 +134,45 @@ void read_pipe_drain(ReadPipe *pipe)
         if (errno == EINTR) {
             continue;
         }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
         panic("read_pipe_drain(): Error reading child process output: %s", errorcode_to_string(errno));
-        condition_wakeup(pipe->condition);
-        return;
     }
 
-    if (pipe->on_read) {
+    if (pipe->on_read && pipe->current.length > 0) {
         pipe->on_read(pipe);
     }
-    condition_wakeup(pipe->condition);
+    condition_wakeup(&pipe->condition);
+    return eof;
 }
 
 StringView read_pipe_current(ReadPipe *pipe)
 {
-    condition_acquire(pipe->condition);
+    condition_acquire(&pipe->condition);
     StringView ret = pipe->current;
     pipe->current = (StringView) { 0 };
-    condition_release(pipe->condition);
+    condition_release(&pipe->condition);
     return ret;
 }
 
 bool read_pipe_expect(ReadPipe *pipe)
 {
-    condition_acquire(pipe->condition);
+    condition_acquire(&pipe->condition);
     while (sv_empty(pipe->current)) {
-        condition_sleep(pipe->condition);
         if (pipe->fd < 0) {
+            condition_release(&pipe->condition);
             return false;
         }
+        condition_sleep(&pipe->condition);
     }
-    condition_release(pipe->condition);
+    condition_release(&pipe->condition);
     return true;
 }
 
 ErrorOrWritePipe write_pipe_init(WritePipe *p)
 {
-    if (pipe(p->pipe) == -1) {
+    if (pipe_cloexec(p->pipe) == -1) {
         ERROR(WritePipe, ProcessError, errno, "pipe() failed");
     }
     RETURN(WritePipe, p);
@@ -206,3 +219,30 @@ ErrorOrSize write_pipe_write_chars(WritePipe *pipe, char const *buf, size_t num)
     }
     RETURN(Size, total);
 }
+
+// Writes all of iov, resuming after short writes.
+ErrorOrSize write_pipe_writev(WritePipe *pipe, struct iovec const *iov, int iovcnt)
+{
+    struct iovec pending[iovcnt];
+    memcpy(pending, iov, iovcnt * sizeof(struct iovec));
+    struct iovec *current = pending;
+    size_t        total = 0;
+    while (iovcnt > 0) {
+        ssize_t count = writev(pipe->fd, current, iovcnt);
+        if (count < 0) {
+            if (errno != EINTR) {
+                ERROR(Size, ProcessError, errno, "Error writing to child process input");
+            }
+            continue;
+        }
+        total += count;
+        for (; iovcnt > 0 && (size_t) count >= current->iov_len; ++current, --iovcnt) {
+            count -= current->iov_len;
+        }
+        if (iovcnt > 0) {
+            current->iov_base = (char *) current->iov_base + count;
+            current->iov_len -= count;
+        }
+    }
+    RETURN(Size, total);
+}
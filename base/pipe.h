@@ -7,6 +7,8 @@
 #ifndef BASE_PIPE_H
 #define BASE_PIPE_H
 
+#include <sys/uio.h>
+
 #include <base/mutex.h>
 #include <base/sv.h>
 
@@ -48,5 +50,6 @@ extern void             write_pipe_connect_child(WritePipe *pipe, int fd);
 extern void             write_pipe_close(WritePipe *pipe);
 extern ErrorOrSize      write_pipe_write(WritePipe *pipe, StringView sv);
 extern ErrorOrSize      write_pipe_write_chars(WritePipe *pipe, char const *buf, size_t num);
+extern ErrorOrSize      write_pipe_writev(WritePipe *pipe, struct iovec const *iov, int iovcnt);
 
 #endif /* BASE_PIPE_H */
@@ -5,6 +5,7 @@
  */
 
 #include <errno.h>
+#include <spawn.h>
 #include <string.h>
 #include <sys/fcntl.h>
 #include <sys/wait.h>
@@ -14,6 +15,8 @@
 #include <log.h>
 #include <process.h>
 
+extern char **environ;
+
 static void process_dump(Process *p)
 {
     trace(LIB, "Command: '%.*s' #arguments: %zu", SV_ARG(p->command), p->arguments.size);
@@ -53,6 +56,28 @@ void sigchld(int)
     trace(PROCESS, "SIGCHLD caught");
 }
 
+// The child's ends of the pipes are dup2'ed onto its standard streams by
+// posix_spawn file actions. Everything else the editor has open is
+// close-on-exec, so nothing leaks into the child.
+static int process_file_actions(Process *p, posix_spawn_file_actions_t *actions, char *stdout_file, char *stderr_file)
+{
+    int ret = posix_spawn_file_actions_adddup2(actions, p->in.pipe[0], STDIN_FILENO);
+    if (ret == 0) {
+        ret = (stdout_file == NULL)
+            ? posix_spawn_file_actions_adddup2(actions, p->out.pipe[1], STDOUT_FILENO)
+            : posix_spawn_file_actions_addopen(actions, STDOUT_FILENO, stdout_file, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+    }
+    if (ret == 0) {
+        ret = (stderr_file == NULL)
+            ? posix_spawn_file_actions_adddup2(actions, p->err.pipe[1], STDERR_FILENO)
+            : posix_spawn_file_actions_addopen(actions, STDERR_FILENO, stderr_file, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+    }
+    return ret;
+}
+
+// posix_spawn uses vfork or clone(CLONE_VM) under the hood, so unlike fork()
+// it does not copy the editor's page tables. That keeps the cost of starting
+// a process independent of the size of the editor.
 ErrorOrInt process_start(Process *p)
 {
     signal(SIGCHLD, sigchld);
@@ -74,50 +99,36 @@ ErrorOrInt process_start(Process *p)
     trace(PROCESS, "[CMD] %.*s %.*s", SV_ARG(p->command), SV_ARG(args));
     sv_free(args);
 
-    // signal(SIGCHLD, SIG_IGN);
     TRY_TO(WritePipe, Int, write_pipe_init(&p->in));
     TRY_TO(ReadPipe, Int, read_pipe_init(&p->out));
     TRY_TO(ReadPipe, Int, read_pipe_init(&p->err));
 
-    pid_t pid = fork();
-    if (pid == -1) {
-        ERROR(Int, ProcessError, errno, "fork() failed");
+    char stdout_file_buffer[p->stdout_file.length + 1];
+    char stderr_file_buffer[p->stderr_file.length + 1];
+    char *stdout_file = (sv_empty(p->stdout_file)) ? NULL : (char *) sv_cstr(p->stdout_file, stdout_file_buffer);
+    char *stderr_file = (sv_empty(p->stderr_file)) ? NULL : (char *) sv_cstr(p->stderr_file, stderr_file_buffer);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    pid_t pid = 0;
+    int   ret = process_file_actions(p, &actions, stdout_file, stderr_file);
+    if (ret == 0) {
+        ret = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
     }
-    p->pid = pid;
-    if (pid == 0) {
-        write_pipe_connect_child(&p->in, STDIN_FILENO);
-        if (sv_empty(p->stdout_file)) {
-            read_pipe_connect_child(&p->out, STDOUT_FILENO);
-        } else {
-            char stdout_file_buffer[p->stdout_file.length + 1];
-            int  fd = open(sv_cstr(p->stdout_file, stdout_file_buffer), O_WRONLY | O_CREAT | O_TRUNC, 0777);
-            assert_msg(fd, "Could not open stdout stream '%.*s' for '%.*s': %s",
-                SV_ARG(p->stdout_file), SV_ARG(p->command), strerror(errno));
-            while (dup2(fd, STDOUT_FILENO) == -1 && (errno == EINTR)) { }
-        }
-        if (sv_empty(p->stderr_file)) {
-            read_pipe_connect_child(&p->err, STDERR_FILENO);
-        } else {
-            char stderr_file_buffer[p->stderr_file.length + 1];
-            int  fd = open(sv_cstr(p->stderr_file, stderr_file_buffer), O_WRONLY | O_CREAT | O_TRUNC, 0777);
-            assert_msg(fd, "Couldn not open stderr stream '%.*s' for '%.*s': %s",
-                SV_ARG(p->stderr_file), SV_ARG(p->command), strerror(errno));
-            while (dup2(fd, STDERR_FILENO) == -1 && (errno == EINTR)) { }
+    posix_spawn_file_actions_destroy(&actions);
+    if (ret != 0) {
+        // No child ever got the pipes, so both ends of all three are ours.
+        int *pipes[] = { p->in.pipe, p->out.pipe, p->err.pipe };
+        for (size_t ix = 0; ix < sizeof(pipes) / sizeof(pipes[0]); ++ix) {
+            close(pipes[ix][0]);
+            close(pipes[ix][1]);
         }
-        execvp(argv[0], argv);
-        fatal("execvp(%.*s) failed: %s", SV_ARG(p->command), errorcode_to_string(errno));
+        ERROR(Int, ProcessError, ret, "posix_spawnp(%.*s) failed", SV_ARG(p->command));
     }
+    p->pid = pid;
     write_pipe_connect_parent(&p->in);
     read_pipe_connect_parent(&p->out);
     read_pipe_connect_parent(&p->err);
-    if (!sv_is_cstr(p->command)) {
-        free(argv[0]);
-    }
-    for (size_t ix = 0; ix < sz; ++ix) {
-        if (!sv_is_cstr(p->arguments.strings[ix])) {
-            free(argv[ix + 1]);
-        }
-    }
     RETURN(Int, pid);
 }
 
@@ -177,3 +188,102 @@ ErrorOrStringView _execute_pipe(StringView input, StringView cmd, ...)
     read_pipe_expect(&p->out);
     RETURN(StringView, p->out.buffer.view);
 }
+
+// #define PROCESS_TEST
+#ifdef PROCESS_TEST
+
+#include <sys/mman.h>
+#include <time.h>
+
+#include <io.h>
+
+#define SPAWNS 200
+#define RSS_MB 1024
+
+static double now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e6 + (double) ts.tv_nsec / 1e3;
+}
+
+// Round trip until the child has exited, so that fork() is charged for
+// copying the page tables and posix_spawn for waiting on the exec.
+static double fork_exec_us(char **argv)
+{
+    double start = now_us();
+    pid_t  pid = fork();
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+    return now_us() - start;
+}
+
+static double spawn_us(char **argv)
+{
+    double start = now_us();
+    pid_t  pid;
+    if (posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ) != 0) {
+        fatal("posix_spawnp failed");
+    }
+    waitpid(pid, NULL, 0);
+    return now_us() - start;
+}
+
+static void bench(char const *label)
+{
+    char  *argv[] = { "true", NULL };
+    double fork_total = 0;
+    double spawn_total = 0;
+    for (int ix = 0; ix < SPAWNS; ++ix) {
+        fork_total += fork_exec_us(argv);
+        spawn_total += spawn_us(argv);
+    }
+    printf("%-12s fork+exec %8.1f us  posix_spawn %8.1f us\n", label, fork_total / SPAWNS, spawn_total / SPAWNS);
+}
+
+int main()
+{
+    StringView out = MUST(StringView, execute_pipe(sv_from("Hello, spawn\n"), sv_from("cat")));
+    if (!sv_eq_cstr(out, "Hello, spawn\n")) {
+        fatal("cat returned '%.*s'", SV_ARG(out));
+    }
+    Process *p = process_create(sv_from("sh"), "-c", "echo out; echo err >&2; exit 3");
+    p->stdout_file = sv_from("/tmp/process_test.out");
+    int exit_code = MUST(Int, process_execute(p));
+    read_pipe_expect(&p->err);
+    StringView written = MUST(StringView, read_file_by_name(sv_from("/tmp/process_test.out")));
+    if (exit_code != 3 || !sv_eq_cstr(written, "out\n") || !sv_eq_cstr(p->err.buffer.view, "err\n")) {
+        fatal("sh -c returned %d, '%.*s', '%.*s'", exit_code, SV_ARG(written), SV_ARG(p->err.buffer.view));
+    }
+    unlink("/tmp/process_test.out");
+    // A failed spawn closes its pipes, so the lowest free descriptor is
+    // the same before and after.
+    int      free_fd = dup(STDIN_FILENO);
+    Process *missing = process_create(sv_from("no-such-command-here"));
+    close(free_fd);
+    if (!ErrorOrInt_is_error(process_start(missing))) {
+        fatal("Starting a missing command succeeded");
+    }
+    int after = dup(STDIN_FILENO);
+    close(after);
+    if (after != free_fd) {
+        fatal("Failed spawn leaked descriptors: first free fd %d, was %d", after, free_fd);
+    }
+
+    bench("small RSS");
+    size_t size = (size_t) RSS_MB * 1024 * 1024;
+    char  *ballast = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_NOHUGEPAGE
+    // A long-running editor's heap is mostly small pages.
+    madvise(ballast, size, MADV_NOHUGEPAGE);
+#endif
+    memset(ballast, 1, size);
+    bench("1 GB RSS");
+    munmap(ballast, size);
+    return 0;
+}
+
+#endif
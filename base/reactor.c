@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) 2024, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#elif defined(__APPLE__)
+#include <sys/event.h>
+#else
+#error "Please provide reactor implementation"
+#endif
+
+#include <base/da.h>
+#include <base/errorcode.h>
+#include <base/log.h>
+#include <base/mem.h>
+#include <base/mutex.h>
+#include <base/reactor.h>
+#include <base/sv.h>
+#include <base/threadonce.h>
+
+#define REACTOR_BATCH 32
+
+typedef struct {
+    int            fd;
+    ReactorHandler handler;
+    void          *context;
+} Watch;
+
+typedef struct {
+    DIA(Watch *);
+} Watches;
+
+// Unwatched entries are retired rather than freed, because the event batch
+// the reactor is working through may still point at them. The reactor frees
+// them once the batch is done.
+static int       s_poll_fd = -1;
+static Mutex     s_mutex = { 0 };
+static Watches   s_watches = { 0 };
+static Watches   s_retired = { 0 };
+static pthread_t s_thread;
+
+THREAD_ONCE(s_reactor_once);
+
+static int reactor_wait(Watch **watches, int *events)
+{
+#if defined(__linux__)
+    struct epoll_event ev[REACTOR_BATCH];
+    int                count = epoll_wait(s_poll_fd, ev, REACTOR_BATCH, -1);
+    for (int ix = 0; ix < count; ++ix) {
+        watches[ix] = ev[ix].data.ptr;
+        events[ix] = ((ev[ix].events & EPOLLIN) ? RE_READABLE : 0)
+            | ((ev[ix].events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) ? RE_HANGUP : 0);
+    }
+#elif defined(__APPLE__)
+    struct kevent ev[REACTOR_BATCH];
+    int           count = kevent(s_poll_fd, NULL, 0, ev, REACTOR_BATCH, NULL);
+    for (int ix = 0; ix < count; ++ix) {
+        watches[ix] = ev[ix].udata;
+        events[ix] = ((ev[ix].data > 0) ? RE_READABLE : 0)
+            | ((ev[ix].flags & (EV_EOF | EV_ERROR)) ? RE_HANGUP : 0);
+    }
+#endif
+    return count;
+}
+
+static void *reactor_loop(void *)
+{
+    pthread_setname_np("Reactor");
+    trace(PROCESS, "Reactor started");
+    while (true) {
+        Watch *watches[REACTOR_BATCH];
+        int    events[REACTOR_BATCH];
+        int    count = reactor_wait(watches, events);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fatal("Reactor: waiting for events failed: %s", errorcode_to_string(errno));
+        }
+        for (int ix = 0; ix < count; ++ix) {
+            mutex_lock(&s_mutex);
+            ReactorHandler handler = watches[ix]->handler;
+            int            fd = watches[ix]->fd;
+            void          *context = watches[ix]->context;
+            mutex_unlock(&s_mutex);
+            if (handler != NULL) {
+                handler(context, fd, events[ix]);
+            }
+        }
+        mutex_lock(&s_mutex);
+        for (size_t ix = 0; ix < s_retired.size; ++ix) {
+            free(s_retired.elements[ix]);
+        }
+        s_retired.size = 0;
+        mutex_unlock(&s_mutex);
+    }
+    return NULL;
+}
+
+static void reactor_init(void)
+{
+#if defined(__linux__)
+    s_poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(__APPLE__)
+    s_poll_fd = kqueue();
+#endif
+    if (s_poll_fd < 0) {
+        fatal("Could not create reactor: %s", errorcode_to_string(errno));
+    }
+    int ret;
+    if ((ret = pthread_create(&s_thread, NULL, reactor_loop, NULL)) != 0) {
+        fatal("Could not start reactor thread: %s", strerror(ret));
+    }
+    pthread_detach(s_thread);
+}
+
+void reactor_watch(int fd, ReactorHandler handler, void *context)
+{
+    ONCE(s_reactor_once, reactor_init);
+    Watch *watch = MALLOC(Watch);
+    watch->fd = fd;
+    watch->handler = handler;
+    watch->context = context;
+    mutex_lock(&s_mutex);
+    DIA_APPEND(Watch *, &s_watches, watch);
+    mutex_unlock(&s_mutex);
+
+#if defined(__linux__)
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = watch };
+    if (epoll_ctl(s_poll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        fatal("Reactor: could not watch fd %d: %s", fd, errorcode_to_string(errno));
+    }
+#elif defined(__APPLE__)
+    struct kevent ev;
+    EV_SET(&ev, fd, EVFILT_READ, EV_ADD, 0, 0, watch);
+    if (kevent(s_poll_fd, &ev, 1, NULL, 0, NULL) < 0) {
+        fatal("Reactor: could not watch fd %d: %s", fd, errorcode_to_string(errno));
+    }
+#endif
+    trace(PROCESS, "Reactor: watching fd %d", fd);
+}
+
+// Errors are ignored: closing a descriptor already removes it.
+void reactor_unwatch(int fd)
+{
+    if (s_poll_fd < 0) {
+        return;
+    }
+    mutex_lock(&s_mutex);
+    for (size_t ix = 0; ix < s_watches.size; ++ix) {
+        Watch *watch = s_watches.elements[ix];
+        if (watch->fd != fd) {
+            continue;
+        }
+#if defined(__linux__)
+        epoll_ctl(s_poll_fd, EPOLL_CTL_DEL, fd, NULL);
+#elif defined(__APPLE__)
+        struct kevent ev;
+        EV_SET(&ev, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+        kevent(s_poll_fd, &ev, 1, NULL, 0, NULL);
+#endif
+        watch->handler = NULL;
+        s_watches.elements[ix] = s_watches.elements[--s_watches.size];
+        DIA_APPEND(Watch *, &s_retired, watch);
+        trace(PROCESS, "Reactor: unwatched fd %d", fd);
+        break;
+    }
+    mutex_unlock(&s_mutex);
+}
+
+size_t reactor_watch_count()
+{
+    mutex_lock(&s_mutex);
+    size_t ret = s_watches.size;
+    mutex_unlock(&s_mutex);
+    return ret;
+}
+
+// #define REACTOR_TEST
+#ifdef REACTOR_TEST
+
+#include <dirent.h>
+#include <time.h>
+
+#include <base/pipe.h>
+#include <base/process.h>
+
+#define PIPES 32
+#define PROCESSES 16
+#define LATENCY_ROUNDS 100
+
+// Wakeup latency: the time from writing a timestamp into a pipe to the
+// reader getting hold of it.
+typedef struct {
+    uint64_t total;
+    uint64_t max;
+    size_t   samples;
+} Latency;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void write_stamp(int fd)
+{
+    uint64_t stamp = now_ns();
+    if (write(fd, &stamp, sizeof(stamp)) != sizeof(stamp)) {
+        fatal("Writing timestamp failed");
+    }
+}
+
+static void latency_record(Latency *latency, char const *stamps, size_t length)
+{
+    uint64_t now = now_ns();
+    for (size_t ix = 0; ix + sizeof(uint64_t) <= length; ix += sizeof(uint64_t)) {
+        uint64_t stamp;
+        memcpy(&stamp, stamps + ix, sizeof(stamp));
+        latency->total += now - stamp;
+        latency->max = (now - stamp > latency->max) ? now - stamp : latency->max;
+        ++latency->samples;
+    }
+}
+
+static void latency_print(char const *what, int count, char const *unit, int threads, Latency *latency)
+{
+    printf("%-15s %2d %-9s %3d threads, wakeup latency mean %7.1f us, max %8.1f us\n", what, count, unit, threads,
+        (double) latency->total / (double) latency->samples / 1000.0, (double) latency->max / 1000.0);
+}
+
+// Runs on the reactor thread, so the clock stops as soon as the reactor
+// has been woken up and has drained the pipe.
+static void on_stamp(ReadPipe *pipe)
+{
+    latency_record((Latency *) pipe->context, pipe->current.ptr, pipe->current.length);
+}
+
+static int thread_count()
+{
+    int  ret = 0;
+    DIR *dir = opendir("/proc/self/task");
+    if (dir == NULL) {
+        return -1;
+    }
+    for (struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+        ret += (entry->d_name[0] != '.');
+    }
+    closedir(dir);
+    return ret;
+}
+
+// Sends timestamps through count pipes served by the reactor, one pipe at
+// a time, and returns the number of threads while they were connected.
+static int reactor_pipes_latency(int count, Latency *latency)
+{
+    ReadPipe pipes[PIPES] = { 0 };
+    int      write_fds[PIPES];
+    assert(count <= PIPES);
+    for (int ix = 0; ix < count; ++ix) {
+        int fds[2];
+        if (pipe(fds) < 0) {
+            fatal("pipe() failed");
+        }
+        write_fds[ix] = fds[1];
+        pipes[ix].on_read = on_stamp;
+        pipes[ix].context = latency;
+        MUST(ReadPipe, read_pipe_connect(pipes + ix, fds[0]));
+    }
+    for (int round = 0; round < LATENCY_ROUNDS; ++round) {
+        for (int ix = 0; ix < count; ++ix) {
+            write_stamp(write_fds[ix]);
+            if (!read_pipe_expect(pipes + ix)) {
+                fatal("Pipe %d closed", ix);
+            }
+            read_pipe_current(pipes + ix);
+        }
+    }
+    int threads = thread_count();
+    for (int ix = 0; ix < count; ++ix) {
+        close(write_fds[ix]);
+        while (read_pipe_expect(pipes + ix)) {
+            read_pipe_current(pipes + ix);
+        }
+        read_pipe_destroy(pipes + ix);
+    }
+    return threads;
+}
+
+// The same through running child processes: cat echoes every timestamp
+// back over its stdout pipe.
+static int reactor_processes_latency(int count, Latency *latency)
+{
+    Process *processes[PROCESSES];
+    assert(count <= PROCESSES);
+    for (int ix = 0; ix < count; ++ix) {
+        processes[ix] = process_create(sv_from("cat"));
+        MUST(Int, process_background(processes[ix]));
+        condition_acquire(&processes[ix]->out.condition);
+        processes[ix]->out.on_read = on_stamp;
+        processes[ix]->out.context = latency;
+        condition_release(&processes[ix]->out.condition);
+    }
+    for (int round = 0; round < LATENCY_ROUNDS; ++round) {
+        for (int ix = 0; ix < count; ++ix) {
+            write_stamp(processes[ix]->in.fd);
+            if (!read_pipe_expect(&processes[ix]->out)) {
+                fatal("Process %d closed its output", ix);
+            }
+            read_pipe_current(&processes[ix]->out);
+        }
+    }
+    int threads = thread_count();
+    for (int ix = 0; ix < count; ++ix) {
+        write_pipe_close(&processes[ix]->in);
+        MUST(Int, process_wait(processes[ix]));
+        while (read_pipe_expect(&processes[ix]->out)) {
+            read_pipe_current(&processes[ix]->out);
+        }
+        while (read_pipe_expect(&processes[ix]->err)) {
+            read_pipe_current(&processes[ix]->err);
+        }
+    }
+    return threads;
+}
+
+// The baseline: a blocking reader thread per pipe, as read_pipe_connect
+// did before the reactor.
+typedef struct {
+    int        fd;
+    Latency   *latency;
+    Condition *condition;
+    size_t    *delivered;
+} BaselineReader;
+
+static void *baseline_read(void *arg)
+{
+    BaselineReader *reader = arg;
+    char            stamp[sizeof(uint64_t)];
+    while (read(reader->fd, stamp, sizeof(stamp)) == sizeof(stamp)) {
+        condition_acquire(reader->condition);
+        latency_record(reader->latency, stamp, sizeof(stamp));
+        ++*reader->delivered;
+        condition_broadcast(reader->condition);
+    }
+    return NULL;
+}
+
+static int baseline_pipes_latency(int count, Latency *latency)
+{
+    BaselineReader readers[PIPES];
+    pthread_t      threads[PIPES];
+    int            write_fds[PIPES];
+    Condition      condition = condition_create();
+    size_t         delivered = 0;
+    assert(count <= PIPES);
+    for (int ix = 0; ix < count; ++ix) {
+        int fds[2];
+        if (pipe(fds) < 0) {
+            fatal("pipe() failed");
+        }
+        write_fds[ix] = fds[1];
+        readers[ix] = (BaselineReader) { fds[0], latency, &condition, &delivered };
+        pthread_create(threads + ix, NULL, baseline_read, readers + ix);
+    }
+    for (int round = 0; round < LATENCY_ROUNDS; ++round) {
+        for (int ix = 0; ix < count; ++ix) {
+            condition_acquire(&condition);
+            size_t expected = delivered + 1;
+            condition_release(&condition);
+            write_stamp(write_fds[ix]);
+            condition_acquire(&condition);
+            while (delivered < expected) {
+                condition_sleep(&condition);
+            }
+            condition_release(&condition);
+        }
+    }
+    int ret = thread_count();
+    for (int ix = 0; ix < count; ++ix) {
+        close(write_fds[ix]);
+        pthread_join(threads[ix], NULL);
+        close(readers[ix].fd);
+    }
+    condition_free(&condition);
+    return ret;
+}
+
+int main()
+{
+    ReadPipe pipes[PIPES] = { 0 };
+    int      write_fds[PIPES];
+    for (int ix = 0; ix < PIPES; ++ix) {
+        int fds[2];
+        if (pipe(fds) < 0) {
+            fatal("pipe() failed");
+        }
+        write_fds[ix] = fds[1];
+        MUST(ReadPipe, read_pipe_connect(pipes + ix, fds[0]));
+    }
+    int threads = thread_count();
+    for (int ix = 0; ix < PIPES; ++ix) {
+        char msg[32];
+        snprintf(msg, sizeof(msg), "pipe %d", ix);
+        write(write_fds[ix], msg, strlen(msg));
+        close(write_fds[ix]);
+    }
+    for (int ix = 0; ix < PIPES; ++ix) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "pipe %d", ix);
+        if (!read_pipe_expect(pipes + ix) || !sv_eq_cstr(read_pipe_current(pipes + ix), expected)) {
+            fatal("Pipe %d did not deliver '%s'", ix, expected);
+        }
+        // The hangup closes the pipe, which wakes up this second expect.
+        if (read_pipe_expect(pipes + ix)) {
+            fatal("Pipe %d delivered data after its message", ix);
+        }
+    }
+    printf("%d pipes, %d threads\n", PIPES, threads);
+
+    for (int ix = 0; ix < 16; ++ix) {
+        StringView out = MUST(StringView, execute_pipe(sv_from("Hello, reactor\n"), sv_from("cat")));
+        if (!sv_eq_cstr(out, "Hello, reactor\n")) {
+            fatal("cat returned '%.*s'", SV_ARG(out));
+        }
+    }
+    if (reactor_watch_count() != 0) {
+        fatal("%zu descriptors still watched", reactor_watch_count());
+    }
+    printf("16 processes, %d threads, %zu watched\n", thread_count(), reactor_watch_count());
+
+    // Thread count and wakeup latency should not grow with the number of
+    // pipes and processes the reactor serves. The thread per pipe baseline
+    // shows what the reactor replaced.
+    Latency one_pipe = { 0 };
+    Latency all_pipes = { 0 };
+    Latency processes = { 0 };
+    Latency baseline = { 0 };
+    int     one_pipe_threads = reactor_pipes_latency(1, &one_pipe);
+    int     all_pipes_threads = reactor_pipes_latency(PIPES, &all_pipes);
+    int     processes_threads = reactor_processes_latency(PROCESSES, &processes);
+    int     baseline_threads = baseline_pipes_latency(PIPES, &baseline);
+    latency_print("reactor", 1, "pipe", one_pipe_threads, &one_pipe);
+    latency_print("reactor", PIPES, "pipes", all_pipes_threads, &all_pipes);
+    latency_print("reactor", PROCESSES, "processes", processes_threads, &processes);
+    latency_print("thread per pipe", PIPES, "pipes", baseline_threads, &baseline);
+    if (all_pipes_threads != one_pipe_threads || processes_threads != one_pipe_threads) {
+        fatal("Thread count grew from %d to %d with pipes and %d with processes", one_pipe_threads, all_pipes_threads, processes_threads);
+    }
+    if (reactor_watch_count() != 0) {
+        fatal("%zu descriptors still watched", reactor_watch_count());
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2024, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef BASE_REACTOR_H
+#define BASE_REACTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    RE_READABLE = 0x01,
+    RE_HANGUP = 0x02,
+} ReactorEvent;
+
+typedef void (*ReactorHandler)(void *context, int fd, int events);
+
+/*
+ * One thread multiplexing all watched file descriptors with epoll on Linux
+ * and kqueue on macOS. Handlers run on the reactor thread, one at a time,
+ * and are level-triggered: a handler that leaves data unread is called
+ * again. A handler may unwatch its own descriptor. The thread is started
+ * by the first reactor_watch.
+ */
+extern void   reactor_watch(int fd, ReactorHandler handler, void *context);
+extern void   reactor_unwatch(int fd);
+extern size_t reactor_watch_count();
+
+#endif /* BASE_REACTOR_H */
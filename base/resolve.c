@@ -329,7 +329,7 @@ LibHandle *_resolve_open(Resolve *resolve, StringView image)
 {
     LibHandle *handle = NULL;
 
-    mutex_lock(_resolve_mutex);
+    mutex_lock(&_resolve_mutex);
     for (LibHandle *resolve_handle = resolve->images; resolve_handle; resolve_handle = resolve_handle->next) {
         if (sv_eq(image, resolve_handle->image)) {
             trace(LIB, "Image '%.*s' was cached", SV_ARG(image));
@@ -342,7 +342,7 @@ LibHandle *_resolve_open(Resolve *resolve, StringView image)
         handle->next = resolve->images;
         resolve->images = handle;
     }
-    mutex_unlock(_resolve_mutex);
+    mutex_unlock(&_resolve_mutex);
     return handle;
 }
 
@@ -14,22 +14,114 @@
 extern char  *allocate_for_length(size_t length, size_t *capacity);
 extern size_t buffer_capacity(char const *buffer);
 extern void   buffer_free(char *buffer, size_t length);
+extern void   buffer_release(char *buffer);
 
 #define SENTINEL 0xBABECAFE
+#define FREED 0xDEADBEEF
 
-char *allocate_for_length(size_t length, size_t *capacity)
+/*
+ * Owned string buffers carry a header with their capacity and the length
+ * of the string they hold, followed by a sentinel so buffer_capacity can
+ * tell owned buffers from borrowed pointers. Buffers of up to SMALL_MAX
+ * bytes come in SMALL_CLASSES power-of-two size classes and are recycled
+ * through per-thread free lists instead of going back to malloc. Short
+ * sv_printf results and the builders used when encoding JSON and rendering
+ * templates churn through these constantly.
+ */
+typedef struct {
+    size_t   capacity;
+    size_t   length;
+    uint64_t sentinel;
+} BufferHeader;
+
+#define SMALL_MIN 32
+#define SMALL_CLASSES 4
+#define SMALL_MAX (SMALL_MIN << (SMALL_CLASSES - 1))
+#define SMALL_POOL_DEPTH 64
+
+static _Thread_local BufferHeader     *s_small_pool[SMALL_CLASSES] = { 0 };
+static _Thread_local size_t            s_small_pool_size[SMALL_CLASSES] = { 0 };
+static _Thread_local StringBufferStats s_stats = { 0 };
+
+static BufferHeader *header_of(char const *buffer)
+{
+    return ((BufferHeader *) buffer) - 1;
+}
+
+static char *data_of(BufferHeader *block)
 {
-    char  *ret = NULL;
-    size_t cap = (!capacity || !*capacity) ? 32 : *capacity;
+    return (char *) (block + 1);
+}
+
+static int small_class(size_t cap)
+{
+    if (cap > SMALL_MAX) {
+        return -1;
+    }
+    int ret = 0;
+    for (size_t c = SMALL_MIN; c < cap; c <<= 1) {
+        ++ret;
+    }
+    return ret;
+}
+
+static size_t round_capacity(size_t cap, size_t length)
+{
+    if (cap < SMALL_MIN) {
+        cap = SMALL_MIN;
+    }
     while (cap < length + 1) {
         cap *= 2;
     }
-    size_t buffer_sz = cap + 2 * sizeof(size_t);
-    ret = MALLOC_ARR(char, buffer_sz);
-    size_t *blockptr = (size_t *) ret;
-    ret += 2 * sizeof(size_t);
-    blockptr[1] = SENTINEL;
-    blockptr[0] = cap | (length << 32);
+    if (cap <= SMALL_MAX) {
+        // Small buffers must fill their size class exactly to be recyclable.
+        size_t c = SMALL_MIN;
+        while (c < cap) {
+            c <<= 1;
+        }
+        cap = c;
+    }
+    return cap;
+}
+
+static BufferHeader *block_allocate(size_t cap)
+{
+    int cls = small_class(cap);
+    if (cls >= 0 && s_small_pool[cls]) {
+        BufferHeader *ret = s_small_pool[cls];
+        s_small_pool[cls] = *((BufferHeader **) data_of(ret));
+        --s_small_pool_size[cls];
+        ++s_stats.reuses;
+        return ret;
+    }
+    ++s_stats.mallocs;
+    return (BufferHeader *) malloc_fatal(sizeof(BufferHeader) + cap, "allocating string buffer of %zu bytes", cap);
+}
+
+static void block_release(BufferHeader *block)
+{
+    block->sentinel = FREED;
+    ++s_stats.frees;
+    int cls = small_class(block->capacity);
+    if (cls >= 0 && s_small_pool_size[cls] < SMALL_POOL_DEPTH) {
+        *((BufferHeader **) data_of(block)) = s_small_pool[cls];
+        s_small_pool[cls] = block;
+        ++s_small_pool_size[cls];
+        return;
+    }
+    free(block);
+}
+
+char *allocate_for_length(size_t length, size_t *capacity)
+{
+    size_t        cap = round_capacity((capacity) ? *capacity : 0, length);
+    BufferHeader *block = block_allocate(cap);
+    block->capacity = cap;
+    block->length = length;
+    block->sentinel = SENTINEL;
+    char *ret = data_of(block);
+    ret[0] = '\0';
+    ret[length] = '\0';
     trace(SV, "SALOC:0x%08llx:%5zu", (uint64_t) ret, cap);
     if (capacity) {
         *capacity = cap;
@@ -42,49 +134,100 @@ size_t buffer_capacity(char const *buffer)
     if (!buffer) {
         return 0;
     }
-    size_t *blockptr = ((size_t *) buffer) - 2;
-    if (blockptr[1] != SENTINEL) {
+    BufferHeader *block = header_of(buffer);
+    if (block->sentinel != SENTINEL) {
         return 0;
     }
-    size_t ret = blockptr[0] & 0xFFFFFFFF;
-    size_t length = blockptr[0] >> 32;
-    assert(ret >= length);
-    return ret;
+    assert(block->capacity >= block->length);
+    return block->capacity;
 }
 
 void buffer_free(char *buffer, size_t length)
 {
-    size_t capacity = buffer_capacity(buffer);
-    if (!capacity) {
+    if (!buffer_capacity(buffer)) {
         return;
     }
-    size_t *blockptr = ((size_t *) buffer) - 2;
-    size_t  block_cap = blockptr[0] & 0xFFFFFFFF;
-    size_t  block_length = blockptr[0] >> 32;
-    if (block_length == length) {
-        free(blockptr);
+    // Views into an owned buffer that don't cover all of it don't own it.
+    if (header_of(buffer)->length == length) {
+        block_release(header_of(buffer));
+    }
+}
+
+// Releases an owned buffer whatever the length of the view it is known by.
+// For buffers whose ownership is handed over explicitly.
+void buffer_release(char *buffer)
+{
+    if (buffer_capacity(buffer)) {
+        block_release(header_of(buffer));
     }
 }
 
 static void sb_reallocate(StringBuilder *sb, size_t new_len)
 {
-    char  *ret = NULL;
     size_t cap = buffer_capacity(sb->view.ptr);
-    size_t new_cap = (cap) ? cap : 32;
-    while (new_cap < new_len + 1)
-        new_cap *= 2;
-    if (new_cap <= cap) {
+    if (new_len + 1 <= cap) {
+        return;
+    }
+    size_t new_cap = round_capacity(cap, new_len);
+    if (cap > SMALL_MAX) {
+        // Large buffers are grown in place if the allocator allows it.
+        BufferHeader *block = realloc(header_of(sb->view.ptr), sizeof(BufferHeader) + new_cap);
+        if (!block) {
+            fatal("Out of memory: growing string buffer to %zu bytes", new_cap);
+        }
+        ++s_stats.reallocs;
+        block->capacity = new_cap;
+        block->length = new_len;
+        sb->view.ptr = data_of(block);
         return;
     }
-    size_t allocated_cap = 0;
-    ret = allocate_for_length(new_len, &allocated_cap);
+    char *ret = allocate_for_length(new_len, &new_cap);
     if (sb->view.ptr) {
         memcpy(ret, sb->view.ptr, sb->view.length);
-        buffer_free((char *) sb->view.ptr, sb->view.length);
+        if (cap) {
+            block_release(header_of(sb->view.ptr));
+        }
     }
     sb->view.ptr = ret;
 }
 
+// Keeps the header length in step with the builder, so that sv_free of the
+// builder's view releases the buffer.
+static void sb_set_length(StringBuilder *sb, size_t length)
+{
+    sb->view.length = length;
+    ((char *) sb->view.ptr)[length] = '\0';
+    if (buffer_capacity(sb->view.ptr)) {
+        header_of(sb->view.ptr)->length = length;
+    }
+}
+
+// Returns the offset of ptr in the builder's buffer, or -1 if it points
+// elsewhere.
+static size_t sb_offset_of(StringBuilder *sb, char const *ptr)
+{
+    if (ptr == NULL || sb->view.ptr == NULL || ptr < sb->view.ptr || ptr > sb->view.ptr + sb->view.length) {
+        return (size_t) -1;
+    }
+    return ptr - sb->view.ptr;
+}
+
+StringBufferStats sb_buffer_stats()
+{
+    return s_stats;
+}
+
+void sb_reserve(StringBuilder *sb, size_t capacity)
+{
+    sb_reallocate(sb, (capacity > sb->view.length) ? capacity : sb->view.length);
+}
+
+size_t sb_capacity(StringBuilder *sb)
+{
+    size_t cap = buffer_capacity(sb->view.ptr);
+    return (cap) ? cap - 1 : 0;
+}
+
 StringBuilder sb_create()
 {
     StringBuilder sb = { 0 };
@@ -93,7 +236,9 @@ StringBuilder sb_create()
 
 void sb_clear(StringBuilder *sb)
 {
-    sb->view.length = 0;
+    if (sb->view.ptr) {
+        sb_set_length(sb, 0);
+    }
 }
 
 StringBuilder sb_createf(char const *fmt, ...)
@@ -149,12 +294,16 @@ StringRef sb_append_chars(StringBuilder *sb, char const *ptr, size_t len)
     if (ptr == NULL || len == 0) {
         return (StringRef) { 0 };
     }
+    // Growing may move or release the buffer, so text taken from the
+    // builder itself is found again by its offset.
+    size_t offset = sb_offset_of(sb, ptr);
     sb_reallocate(sb, sb->view.length + len);
-    char *p = (char *) sb->view.ptr;
-    memcpy(p + sb->view.length, ptr, len);
+    if (offset != (size_t) -1) {
+        ptr = sb->view.ptr + offset;
+    }
     size_t index = sb->view.length;
-    sb->view.length += len;
-    p[sb->view.length] = '\0';
+    memcpy((char *) sb->view.ptr + index, ptr, len);
+    sb_set_length(sb, index + len);
     trace(SV, "SBAPC:0x%08llx:%5zu:%.60s", (uint64_t) sb->view.ptr, buffer_capacity(sb->view.ptr), sb->view.ptr);
     return (StringRef) { index, len };
 }
@@ -220,14 +369,30 @@ StringRef sb_append_hex_integer(StringBuilder *sb, Integer integer)
 
 StringRef sb_vprintf(StringBuilder *sb, char const *fmt, va_list args)
 {
+    // Format straight into the spare capacity, and only format a second
+    // time if that turns out to be too small.
+    size_t  index = sb->view.length;
+    size_t  avail = (buffer_capacity(sb->view.ptr)) ? sb_capacity(sb) - index : 0;
     va_list args2;
     va_copy(args2, args);
-    size_t len = vsnprintf(NULL, 0, fmt, args2);
+    size_t len = vsnprintf((avail) ? (char *) sb->view.ptr + index : NULL, (avail) ? avail + 1 : 0, fmt, args2);
     va_end(args2);
-    sb_reallocate(sb, sb->view.length + len);
-    size_t index = sb->view.length;
-    vsnprintf((char *) sb->view.ptr + sb->view.length, len + 1, fmt, args);
-    sb->view.length += len;
+    if (!avail || len > avail) {
+        // The arguments may point into the builder, so the old buffer is
+        // only released once the text has been formatted into the new one.
+        char  *old = (char *) sb->view.ptr;
+        size_t cap = buffer_capacity(old);
+        char  *ret = allocate_for_length(index + len, &cap);
+        if (index) {
+            memcpy(ret, old, index);
+        }
+        vsnprintf(ret + index, len + 1, fmt, args);
+        sb->view.ptr = ret;
+        if (buffer_capacity(old)) {
+            block_release(header_of(old));
+        }
+    }
+    sb_set_length(sb, index + len);
     trace(SV, "SBVPF:0x%08llx:%5zu:%.60s", (uint64_t) sb->view.ptr, buffer_capacity(sb->view.ptr), sb->view.ptr);
     return (StringRef) { index, len };
 }
@@ -254,13 +419,43 @@ StringRef sb_insert_chars(StringBuilder *sb, char const *ptr, size_t len, size_t
     if (at >= sb->view.length) {
         return sb_append_chars(sb, ptr, len);
     }
-    sb_reallocate(sb, sb->view.length + len);
+    return sb_splice(sb, at, 0, ptr, len);
+}
+
+// Replaces num characters at index at with the len characters at ptr. The
+// tail of the string is moved at most once, so replacing text costs the
+// same as inserting it.
+StringRef sb_splice(StringBuilder *sb, size_t at, size_t num, char const *ptr, size_t len)
+{
+    size_t length = sb->view.length;
+    if (at > length) {
+        at = length;
+    }
+    if (num > length - at) {
+        num = length - at;
+    }
+    if (num == 0 && (ptr == NULL || len == 0)) {
+        return (StringRef) { 0 };
+    }
+    // Text taken from the builder itself would be moved or released by
+    // the splice, so it is copied out first.
+    StringBuilder copy = { 0 };
+    if (sb_offset_of(sb, ptr) != (size_t) -1) {
+        copy = sb_copy_chars(ptr, len);
+        ptr = copy.view.ptr;
+    }
+    size_t new_len = length - num + len;
+    sb_reallocate(sb, (new_len > length) ? new_len : length);
     char *p = (char *) sb->view.ptr;
-    memmove(p + at + len, p + at, sb->view.length - at);
-    memcpy(p + at, ptr, len);
-    sb->view.length += len;
-    p[sb->view.length] = '\0';
-    trace(SV, "SBAPC:0x%08llx:%5zu:%.60s", (uint64_t) sb->view.ptr, buffer_capacity(sb->view.ptr), sb->view.ptr);
+    if (num != len) {
+        memmove(p + at + len, p + at + num, length - at - num);
+    }
+    if (len > 0) {
+        memcpy(p + at, ptr, len);
+    }
+    sv_free(copy.view);
+    sb_set_length(sb, new_len);
+    trace(SV, "SBSPL:0x%08llx:%5zu:%.60s", (uint64_t) sb->view.ptr, buffer_capacity(sb->view.ptr), sb->view.ptr);
     return (StringRef) { at, len };
 }
 
@@ -274,19 +469,10 @@ StringRef sb_insert_cstr(StringBuilder *sb, char const *str, size_t at)
 
 void sb_remove(StringBuilder *sb, size_t at, size_t num)
 {
-    if (at >= sb->view.length) {
-        return;
-    }
-    if (at + num >= sb->view.length) {
-        num = sb->view.length - at;
-    }
-    if (num == 0) {
+    if (at >= sb->view.length || num == 0) {
         return;
     }
-    char *p = (char *) sb->view.ptr;
-    memmove(p + at, p + at + num, sb->view.length - at);
-    sb->view.length -= num;
-    p[sb->view.length] = 0;
+    sb_splice(sb, at, num, NULL, 0);
 }
 
 StringRef sb_append_list(StringBuilder *sb, StringList *sl, StringView sep)
@@ -305,20 +491,34 @@ int sb_replace_one(StringBuilder *sb, StringView pat, StringView repl)
 {
     int loc = sv_find(sb->view, pat);
     if (loc != -1) {
-        sb_remove(sb, loc, pat.length);
-        sb_insert_sv(sb, repl, loc);
+        sb_splice(sb, loc, pat.length, repl.ptr, repl.length);
     }
     return loc;
 }
 
 int sb_replace_all(StringBuilder *sb, StringView pat, StringView repl)
 {
-    int ret = 0;
-    for (int loc = sv_find(sb->view, pat); loc != -1; loc = sv_find_from(sb->view, pat, loc + repl.length)) {
-        sb_remove(sb, loc, pat.length);
-        sb_insert_sv(sb, repl, loc);
+    int loc = sv_find(sb->view, pat);
+    if (loc == -1 || sv_empty(pat)) {
+        return 0;
+    }
+    // Build the result in a single pass instead of shifting the tail of the
+    // string once for every match.
+    StringBuilder out = { 0 };
+    size_t        from = 0;
+    int           ret = 0;
+    sb_reserve(&out, sb->view.length);
+    for (; loc != -1; loc = sv_find_from(sb->view, pat, from)) {
+        sb_append_chars(&out, sb->view.ptr + from, loc - from);
+        sb_append_sv(&out, repl);
+        from = loc + pat.length;
         ++ret;
     }
+    sb_append_chars(&out, sb->view.ptr + from, sb->view.length - from);
+    if (buffer_capacity(sb->view.ptr)) {
+        block_release(header_of(sb->view.ptr));
+    }
+    *sb = out;
     return ret;
 }
 
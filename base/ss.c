@@ -4,8 +4,7 @@
  * SPDX-License-Identifier: MIT
  */
 
-#include <ctype.h>
-
+#include <base/charclass.h>
 #include <sv.h>
 
 StringScanner ss_create(StringView sv)
@@ -65,8 +64,9 @@ StringView ss_read_from_mark(StringScanner *ss)
 
 int ss_readchar(StringScanner *ss)
 {
+    int ret = ss_peek(ss);
     ss_skip_one(ss);
-    return (ss->point.index <= ss->string.length - 1) ? ss->string.ptr[ss->point.index] : '\0';
+    return ret;
 }
 
 int ss_peek(StringScanner *ss)
@@ -100,14 +100,19 @@ void ss_skip(StringScanner *ss, size_t num)
     if (ss->point.index + num > ss->string.length) {
         num = ss->string.length - ss->point.index;
     }
-    for (size_t new_index = ss->point.index + num; ss->point.index < new_index; ++ss->point.index) {
-        if (ss->string.ptr[ss->point.index] == '\n') {
-            ++ss->point.line;
-            ss->point.column = 0;
-        } else {
-            ++ss->point.column;
-        }
+    if (num == 0) {
+        return;
+    }
+    char const *ptr = ss->string.ptr + ss->point.index;
+    char const *end = ptr + num;
+    char const *nl;
+    while ((nl = memchr(ptr, '\n', end - ptr)) != NULL) {
+        ++ss->point.line;
+        ss->point.column = 0;
+        ptr = nl + 1;
     }
+    ss->point.column += end - ptr;
+    ss->point.index += num;
 }
 
 void ss_skip_one(StringScanner *ss)
@@ -117,16 +122,15 @@ void ss_skip_one(StringScanner *ss)
 
 void ss_skip_whitespace(StringScanner *ss)
 {
-    while (isspace(ss_peek(ss))) {
-        ss_skip(ss, 1);
-    }
+    size_t index = ss->point.index;
+    ss_skip(ss, cc_span(ss->string.ptr + index, ss->string.length - index, CC_SPACE));
 }
 
 void ss_skip_until(StringScanner *ss, int ch)
 {
-    while (ss_peek(ss) && ss_peek(ss) != ch) {
-        ss_skip_one(ss);
-    }
+    char   stops[2] = { (char) ch, '\0' };
+    size_t index = ss->point.index;
+    ss_skip(ss, cc_scan_to(ss->string.ptr + index, ss->string.length - index, stops));
 }
 
 bool ss_expect_with_offset(StringScanner *ss, char ch, size_t offset)
@@ -158,7 +162,8 @@ bool ss_expect_sv(StringScanner *ss, StringView sv)
 
 bool ss_is_one_of_with_offset(StringScanner *ss, char const *expect, size_t offset)
 {
-    return strchr(expect, ss_peek_with_offset(ss, offset)) != NULL;
+    int ch = ss_peek_with_offset(ss, offset);
+    return ch != '\0' && strchr(expect, ch) != NULL;
 }
 
 bool ss_is_one_of(StringScanner *ss, char const *expect)
@@ -182,7 +187,8 @@ bool ss_expect_one_of(StringScanner *ss, char const *expect)
 
 int ss_one_of(StringScanner *ss, char const *expect)
 {
-    if (strchr(expect, ss_peek(ss)) != NULL) {
+    int ch = ss_peek(ss);
+    if (ch != '\0' && strchr(expect, ch) != NULL) {
         return ss_readchar(ss);
     }
     return 0;
@@ -190,10 +196,8 @@ int ss_one_of(StringScanner *ss, char const *expect)
 
 size_t ss_read_number(StringScanner *ss)
 {
-    size_t ix = 0;
-    while (isdigit(ss_peek_with_offset(ss, ix))) {
-        ix++;
-    }
+    size_t index = ss->point.index;
+    size_t ix = cc_span(ss->string.ptr + index, ss->string.length - index, CC_DIGIT);
     if (ix > 0) {
         StringView num = ss_read(ss, ix);
         ss_reset(ss);
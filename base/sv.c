@@ -12,9 +12,18 @@
 #include <base/hash.h>
 #include <base/sv.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 extern char  *allocate_for_length(size_t length, size_t *capacity);
 extern size_t buffer_capacity(char const *buffer);
 extern void   buffer_free(char *buffer, size_t length);
+extern void   buffer_release(char *buffer);
 extern void   buffer_setlength(char const *buffer, size_t length);
 
 StringView sv_from(char const *s)
@@ -164,6 +173,11 @@ void sv_free(StringView sv)
     buffer_free((char *) sv.ptr, sv.length);
 }
 
+void sv_release(StringView sv)
+{
+    buffer_release((char *) sv.ptr);
+}
+
 StringView sv_null()
 {
     StringView ret = { 0 };
@@ -197,14 +211,12 @@ bool sv_not_empty(StringView sv)
 
 bool sv_is_whitespace(StringView sv)
 {
-    bool ret = false;
     for (size_t ix = 0; ix < sv.length; ++ix) {
-        if (!isblank(sv.ptr[ix])) {
-            ret = true;
-            break;
+        if (!isspace(sv.ptr[ix])) {
+            return false;
         }
     }
-    return ret;
+    return true;
 }
 
 size_t sv_length(StringView sv)
@@ -217,6 +229,11 @@ unsigned int sv_hash(StringView *sv)
     return hash(sv->ptr, sv->length);
 }
 
+uint64_t sv_hash64(StringView sv)
+{
+    return hash64(sv.ptr, sv.length);
+}
+
 bool sv_is_cstr(StringView sv)
 {
     if (!sv.ptr) {
@@ -403,17 +420,217 @@ int sv_find(StringView sv, StringView sub)
     return sv_find_from(sv, sub, 0);
 }
 
-int sv_find_from(StringView sv, StringView sub, size_t from)
+// Substring search uses the "generic SIMD" first/last byte filter: a block
+// of candidate positions is tested by comparing both the first needle byte
+// and the last needle byte at once, and only positions where both match are
+// verified with a full compare. Long needles use Boyer-Moore-Horspool, whose
+// skips grow with the needle length. Case-insensitive search folds ASCII
+// only, like sv_eq_ignore_case.
+
+#define SV_FIND_HORSPOOL_THRESHOLD 64
+
+static unsigned char ascii_fold(unsigned char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+static bool ascii_eq_ignore_case(char const *s1, char const *s2, size_t n)
+{
+    for (size_t ix = 0; ix < n; ++ix) {
+        if (ascii_fold(s1[ix]) != ascii_fold(s2[ix])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline bool find_verify(char const *candidate, char const *needle, size_t n, bool fold)
+{
+    return (fold) ? ascii_eq_ignore_case(candidate, needle, n) : memcmp(candidate, needle, n) == 0;
+}
+
+static char const *find_horspool(char const *hay, size_t hay_len, char const *needle, size_t needle_len, bool fold)
+{
+    size_t skip[256];
+    for (size_t ix = 0; ix < 256; ++ix) {
+        skip[ix] = needle_len;
+    }
+    for (size_t ix = 0; ix < needle_len - 1; ++ix) {
+        unsigned char ch = needle[ix];
+        skip[(fold) ? ascii_fold(ch) : ch] = needle_len - 1 - ix;
+        if (fold) {
+            skip[toupper(ascii_fold(ch))] = needle_len - 1 - ix;
+        }
+    }
+    unsigned char last = needle[needle_len - 1];
+    if (fold) {
+        last = ascii_fold(last);
+    }
+    for (size_t pos = 0; pos + needle_len <= hay_len;) {
+        unsigned char ch = hay[pos + needle_len - 1];
+        if (((fold) ? ascii_fold(ch) : ch) == last && find_verify(hay + pos, needle, needle_len - 1, fold)) {
+            return hay + pos;
+        }
+        pos += skip[ch];
+    }
+    return NULL;
+}
+
+#if defined(__AVX2__)
+
+#define SV_FIND_BLOCK 32
+typedef __m256i SVFindVector;
+
+static inline SVFindVector find_splat(unsigned char ch)
+{
+    return _mm256_set1_epi8((char) ch);
+}
+
+static inline uint64_t find_block_mask(char const *p, size_t last_offset, SVFindVector first_lo, SVFindVector first_up, SVFindVector last_lo, SVFindVector last_up)
+{
+    __m256i b_first = _mm256_loadu_si256((__m256i const *) p);
+    __m256i b_last = _mm256_loadu_si256((__m256i const *) (p + last_offset));
+    __m256i eq_first = _mm256_or_si256(_mm256_cmpeq_epi8(b_first, first_lo), _mm256_cmpeq_epi8(b_first, first_up));
+    __m256i eq_last = _mm256_or_si256(_mm256_cmpeq_epi8(b_last, last_lo), _mm256_cmpeq_epi8(b_last, last_up));
+    return (uint32_t) _mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last));
+}
+
+#define FIND_MASK_NEXT(mask) ((size_t) __builtin_ctzll(mask))
+#define FIND_MASK_CLEAR(mask) ((mask) &= (mask) - 1)
+
+#elif defined(__SSE2__)
+
+#define SV_FIND_BLOCK 16
+typedef __m128i SVFindVector;
+
+static inline SVFindVector find_splat(unsigned char ch)
+{
+    return _mm_set1_epi8((char) ch);
+}
+
+static inline uint64_t find_block_mask(char const *p, size_t last_offset, SVFindVector first_lo, SVFindVector first_up, SVFindVector last_lo, SVFindVector last_up)
+{
+    __m128i b_first = _mm_loadu_si128((__m128i const *) p);
+    __m128i b_last = _mm_loadu_si128((__m128i const *) (p + last_offset));
+    __m128i eq_first = _mm_or_si128(_mm_cmpeq_epi8(b_first, first_lo), _mm_cmpeq_epi8(b_first, first_up));
+    __m128i eq_last = _mm_or_si128(_mm_cmpeq_epi8(b_last, last_lo), _mm_cmpeq_epi8(b_last, last_up));
+    return (uint32_t) _mm_movemask_epi8(_mm_and_si128(eq_first, eq_last));
+}
+
+#define FIND_MASK_NEXT(mask) ((size_t) __builtin_ctzll(mask))
+#define FIND_MASK_CLEAR(mask) ((mask) &= (mask) - 1)
+
+#elif defined(__ARM_NEON)
+
+#define SV_FIND_BLOCK 16
+typedef uint8x16_t SVFindVector;
+
+static inline SVFindVector find_splat(unsigned char ch)
+{
+    return vdupq_n_u8(ch);
+}
+
+// NEON has no movemask; narrowing the 16 byte-wide comparison results to
+// nibbles gives a 64-bit mask with four bits per position.
+static inline uint64_t find_block_mask(char const *p, size_t last_offset, SVFindVector first_lo, SVFindVector first_up, SVFindVector last_lo, SVFindVector last_up)
+{
+    uint8x16_t b_first = vld1q_u8((uint8_t const *) p);
+    uint8x16_t b_last = vld1q_u8((uint8_t const *) (p + last_offset));
+    uint8x16_t eq_first = vorrq_u8(vceqq_u8(b_first, first_lo), vceqq_u8(b_first, first_up));
+    uint8x16_t eq_last = vorrq_u8(vceqq_u8(b_last, last_lo), vceqq_u8(b_last, last_up));
+    uint8x8_t  nibbles = vshrn_n_u16(vreinterpretq_u16_u8(vandq_u8(eq_first, eq_last)), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) & 0x1111111111111111ULL;
+}
+
+#define FIND_MASK_NEXT(mask) ((size_t) __builtin_ctzll(mask) >> 2)
+#define FIND_MASK_CLEAR(mask) ((mask) &= (mask) - 1)
+
+#endif
+
+static char const *find_scalar(char const *hay, size_t hay_len, char const *needle, size_t needle_len, bool fold)
+{
+    unsigned char first = needle[0];
+    unsigned char last = needle[needle_len - 1];
+    if (!fold) {
+        char const *end = hay + hay_len - needle_len + 1;
+        for (char const *p = hay; p < end; ++p) {
+            p = memchr(p, first, end - p);
+            if (!p) {
+                return NULL;
+            }
+            if ((unsigned char) p[needle_len - 1] == last && memcmp(p, needle, needle_len) == 0) {
+                return p;
+            }
+        }
+        return NULL;
+    }
+    first = ascii_fold(first);
+    last = ascii_fold(last);
+    for (size_t pos = 0; pos + needle_len <= hay_len; ++pos) {
+        if (ascii_fold(hay[pos]) == first && ascii_fold(hay[pos + needle_len - 1]) == last
+            && ascii_eq_ignore_case(hay + pos, needle, needle_len)) {
+            return hay + pos;
+        }
+    }
+    return NULL;
+}
+
+static char const *find_substring(char const *hay, size_t hay_len, char const *needle, size_t needle_len, bool fold)
+{
+    if (needle_len > hay_len) {
+        return NULL;
+    }
+    if (needle_len >= SV_FIND_HORSPOOL_THRESHOLD) {
+        return find_horspool(hay, hay_len, needle, needle_len, fold);
+    }
+#ifdef SV_FIND_BLOCK
+    unsigned char first = needle[0];
+    unsigned char last = needle[needle_len - 1];
+    SVFindVector  first_lo = find_splat((fold) ? ascii_fold(first) : first);
+    SVFindVector  first_up = find_splat((fold) ? toupper(ascii_fold(first)) : first);
+    SVFindVector  last_lo = find_splat((fold) ? ascii_fold(last) : last);
+    SVFindVector  last_up = find_splat((fold) ? toupper(ascii_fold(last)) : last);
+    size_t        last_offset = needle_len - 1;
+    size_t        pos = 0;
+    for (; pos + last_offset + SV_FIND_BLOCK <= hay_len; pos += SV_FIND_BLOCK) {
+        uint64_t mask = find_block_mask(hay + pos, last_offset, first_lo, first_up, last_lo, last_up);
+        while (mask) {
+            size_t offset = FIND_MASK_NEXT(mask);
+            if (find_verify(hay + pos + offset, needle, needle_len, fold)) {
+                return hay + pos + offset;
+            }
+            FIND_MASK_CLEAR(mask);
+        }
+    }
+    return find_scalar(hay + pos, hay_len - pos, needle, needle_len, fold);
+#else
+    return find_scalar(hay, hay_len, needle, needle_len, fold);
+#endif
+}
+
+static int sv_find_from_impl(StringView sv, StringView sub, size_t from, bool fold)
 {
     assert(sv_not_empty(sub));
-    if (sv_empty(sv)) {
+    if (sv_empty(sv) || from >= sv.length) {
         return -1;
     }
-    for (int ix = from; ix <= sv.length - sub.length; ++ix) {
-        if (!memcmp(sv.ptr + ix, sub.ptr, sub.length))
-            return ix;
-    }
-    return -1;
+    char const *found = find_substring(sv.ptr + from, sv.length - from, sub.ptr, sub.length, fold);
+    return (found) ? (int) (found - sv.ptr) : -1;
+}
+
+int sv_find_from(StringView sv, StringView sub, size_t from)
+{
+    return sv_find_from_impl(sv, sub, from, false);
+}
+
+int sv_find_ignore_case(StringView sv, StringView sub)
+{
+    return sv_find_from_impl(sv, sub, 0, true);
+}
+
+int sv_find_from_ignore_case(StringView sv, StringView sub, size_t from)
+{
+    return sv_find_from_impl(sv, sub, from, true);
 }
 
 StringView sv_substring(StringView sv, size_t at, size_t len)
@@ -427,48 +644,101 @@ StringView sv_substring(StringView sv, size_t at, size_t len)
     return (StringView) { sv.ptr + at, len };
 }
 
-StringList sv_split(StringView sv, StringView sep)
+SplitIter sv_split_iter(StringView sv, StringView sep)
 {
     assert(sep.length > 0);
-    StringList ret = sl_create();
-    if (sv.length == 0) {
-        return ret;
+    return (SplitIter) { .rest = sv, .sep = sep, .done = sv.length == 0 };
+}
+
+SplitIter sv_split_by_whitespace_iter(StringView sv)
+{
+    return (SplitIter) { .rest = sv, .sep = sv_null(), .done = sv.length == 0 };
+}
+
+static bool split_next_whitespace(SplitIter *it, StringView *component)
+{
+    size_t ix = 0;
+    while (ix < it->rest.length && isspace(it->rest.ptr[ix])) {
+        ++ix;
     }
-    char const *ptr = sv.ptr;
-    char const *component_start = sv.ptr;
-    while (true) {
-        if (ptr - sv.ptr > (ptrdiff_t) sv.length - (ptrdiff_t) sep.length) {
-            sl_push(&ret, (StringView) { component_start, sv.ptr + sv.length - component_start });
-            return ret;
-        }
-        if (memcmp(ptr, sep.ptr, sep.length) == 0) {
-            sl_push(&ret, (StringView) { component_start, ptr - component_start });
-            do {
-                ptr += sep.length;
-                component_start = ptr;
-            } while (memcmp(ptr, sep.ptr, sep.length) == 0);
-            continue;
-        }
-        ++ptr;
+    if (ix == it->rest.length) {
+        it->done = true;
+        return false;
     }
-    UNREACHABLE();
+    size_t start = ix;
+    while (ix < it->rest.length && !isspace(it->rest.ptr[ix])) {
+        ++ix;
+    }
+    *component = (StringView) { it->rest.ptr + start, ix - start };
+    it->rest = (StringView) { it->rest.ptr + ix, it->rest.length - ix };
+    return true;
 }
 
-StringList sv_split_by_whitespace(StringView sv)
+// Yields the next component and returns true, or returns false when the
+// string is exhausted. Runs of consecutive separators count as one, but a
+// leading or trailing separator yields an empty component, like sv_split.
+bool sv_split_next(SplitIter *it, StringView *component)
 {
-    StringList  ret = sl_create();
-    char const *current = NULL;
-    for (size_t ix = 0; ix < sv.length; ++ix) {
-        if (isspace(sv.ptr[ix]) && current) {
-            sl_push(&ret, (StringView) { current, (sv.ptr + ix) - current });
-            current = NULL;
-        }
-        if (!isspace(sv.ptr[ix]) && !current) {
-            current = sv.ptr + ix;
-        }
+    if (it->done) {
+        return false;
+    }
+    if (sv_empty(it->sep)) {
+        return split_next_whitespace(it, component);
+    }
+    int ix = sv_find(it->rest, it->sep);
+    if (ix < 0) {
+        *component = it->rest;
+        it->rest = (StringView) { it->rest.ptr + it->rest.length, 0 };
+        it->done = true;
+        return true;
+    }
+    *component = (StringView) { it->rest.ptr, ix };
+    size_t pos = ix + it->sep.length;
+    while (it->rest.length - pos >= it->sep.length && memcmp(it->rest.ptr + pos, it->sep.ptr, it->sep.length) == 0) {
+        pos += it->sep.length;
     }
-    if (current) {
-        sl_push(&ret, (StringView) { current, (sv.ptr + sv.length) - current });
+    it->rest = (StringView) { it->rest.ptr + pos, it->rest.length - pos };
+    return true;
+}
+
+// Splits sv into at most n components, stored in the caller's components
+// array. If there are more than n components, the last one holds the
+// unsplit remainder of the string. Returns the number of components stored.
+size_t sv_split_n(StringView sv, StringView sep, StringView *components, size_t n)
+{
+    SplitIter it = sv_split_iter(sv, sep);
+    size_t    ret = 0;
+    if (n == 0) {
+        return 0;
+    }
+    while (ret + 1 < n && sv_split_next(&it, components + ret)) {
+        ++ret;
+    }
+    if (ret + 1 == n && !it.done) {
+        components[ret++] = it.rest;
+        it.done = true;
+    }
+    return ret;
+}
+
+StringList sv_split(StringView sv, StringView sep)
+{
+    StringList ret = sl_create();
+    SplitIter  it = sv_split_iter(sv, sep);
+    StringView component;
+    while (sv_split_next(&it, &component)) {
+        sl_push(&ret, component);
+    }
+    return ret;
+}
+
+StringList sv_split_by_whitespace(StringView sv)
+{
+    StringList ret = sl_create();
+    SplitIter  it = sv_split_by_whitespace_iter(sv);
+    StringView component;
+    while (sv_split_next(&it, &component)) {
+        sl_push(&ret, component);
     }
     return ret;
 }
@@ -585,6 +855,9 @@ int digit_value_in_base(int ch, size_t base)
             return ret;                                                                      \
         }                                                                                    \
         bool negative = sv.ptr[ix] == '-';                                                   \
+        if (negative) {                                                                      \
+            ++ix;                                                                            \
+        }                                                                                    \
         while (ix < sv.length && isspace(sv.ptr[ix])) {                                      \
             ++ix;                                                                            \
         }                                                                                    \
@@ -643,6 +916,8 @@ IntegerParseResult sv_parse_integer(StringView sv, IntegerType type)
 
 #ifdef SV_TEST
 
+#include <time.h>
+
 void test_split_join(StringView sv)
 {
     StringList split = sv_split_by_whitespace(sv);
@@ -654,8 +929,150 @@ void test_split_join(StringView sv)
     printf("--%.*s--\n", SV_ARG(joined));
 }
 
+static int naive_find(StringView sv, StringView sub, size_t from, bool fold)
+{
+    for (size_t ix = from; ix + sub.length <= sv.length; ++ix) {
+        if ((fold) ? sv_eq_ignore_case_chars((StringView) { sv.ptr + ix, sub.length }, sub.ptr, sub.length) : !memcmp(sv.ptr + ix, sub.ptr, sub.length))
+            return (int) ix;
+    }
+    return -1;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+void test_find()
+{
+    static char const *words[] = { "the", "buffer", "view", "of", "a", "lexer", "Token", "editor", "find", "next", "\n", "    " };
+    size_t             size = 8 * 1024 * 1024;
+    StringBuilder      text = sb_create();
+    for (size_t ix = 0; text.length < size; ++ix) {
+        sb_append_cstr(&text, words[(ix * 7 + ix / 13) % 12]);
+        sb_append_char(&text, ' ');
+    }
+    char const *needles[] = { "e", "Token editor", "VIEW OF", "find next ", "needle_not_there", "lexer Token editor find next", "the buffer view of a lexer Token editor find next the buffer view of a lexer Token editor" };
+    for (size_t ix = 0; ix < sizeof(needles) / sizeof(char const *); ++ix) {
+        StringView needle = sv_from(needles[ix]);
+        for (size_t from = 0; from < 2000; from += 37) {
+            assert(sv_find_from(text.view, needle, from) == naive_find(text.view, needle, from, false));
+            assert(sv_find_from_ignore_case(text.view, needle, from) == naive_find(text.view, needle, from, true));
+        }
+    }
+    sb_append_cstr(&text, "needle_at_the_end");
+    StringView needle = sv_from("needle_at_the_end");
+    StringView long_needle = sv_from("needle_at_the_endneedle_at_the_endneedle_at_the_endneedle_at_the_end");
+    double     start = now();
+    int        naive = naive_find(text.view, needle, 0, false);
+    double     naive_time = now() - start;
+    start = now();
+    int found = sv_find(text.view, needle);
+    double find_time = now() - start;
+    start = now();
+    int found_ci = sv_find_ignore_case(text.view, sv_from("NEEDLE_AT_THE_END"));
+    double find_ci_time = now() - start;
+    start = now();
+    sv_find(text.view, long_needle);
+    double long_time = now() - start;
+    assert(naive == found && found == found_ci);
+    double mb = (double) text.length / (1024.0 * 1024.0);
+    printf("sv_find over %.1f MiB: naive %.2f GB/s, sv_find %.2f GB/s, ignore case %.2f GB/s, %zu byte needle %.2f GB/s\n",
+        mb, text.length / naive_time / 1e9, text.length / find_time / 1e9, text.length / find_ci_time / 1e9, long_needle.length, text.length / long_time / 1e9);
+}
+
+void test_split_iter()
+{
+    StringView fields[3];
+    assert(sv_split_n(sv_from("GET /index.html HTTP/1.1"), sv_from(" "), fields, 3) == 3);
+    assert(sv_eq_cstr(fields[1], "/index.html") && sv_eq_cstr(fields[2], "HTTP/1.1"));
+    assert(sv_split_n(sv_from("Host: localhost: 8080"), sv_from(": "), fields, 2) == 2);
+    assert(sv_eq_cstr(fields[0], "Host") && sv_eq_cstr(fields[1], "localhost: 8080"));
+    assert(sv_split_n(sv_from("12"), sv_from(":"), fields, 2) == 1);
+
+    char const *cases[] = { "a::b:c", ":a:b:", "::", "abc", "a:b::c::" };
+    for (size_t ix = 0; ix < sizeof(cases) / sizeof(char const *); ++ix) {
+        StringList list = sv_split(sv_from(cases[ix]), sv_from(":"));
+        SplitIter  it = sv_split_iter(sv_from(cases[ix]), sv_from(":"));
+        StringView component;
+        size_t     count = 0;
+        while (sv_split_next(&it, &component)) {
+            assert(sv_eq(component, list.strings[count++]));
+        }
+        assert(count == list.size);
+    }
+    StringList words = sv_split_by_whitespace(sv_from("  ab \t cd \n\n ef  "));
+    assert(words.size == 3 && sv_eq_cstr(words.strings[2], "ef"));
+}
+
+void test_builder()
+{
+    StringBuilder sb = sb_copy_cstr("Hello, World");
+    sb_splice(&sb, 7, 5, "there", 5);
+    assert(sv_eq_cstr(sb.view, "Hello, there"));
+    sb_splice(&sb, 5, 7, "!", 1);
+    assert(sv_eq_cstr(sb.view, "Hello!"));
+    sb_insert_cstr(&sb, " you", 5);
+    sb_remove(&sb, 0, 1);
+    assert(sv_eq_cstr(sb.view, "ello you!") && sv_is_cstr(sb.view));
+    assert(sb_replace_all(&sb, sv_from("l"), sv_from("LL")) == 2);
+    assert(sv_eq_cstr(sb.view, "eLLLLo you!"));
+    assert(sb_replace_all(&sb, sv_from("LL"), sv_from("")) == 2);
+    assert(sv_eq_cstr(sb.view, "eo you!"));
+    sb_reserve(&sb, 100000);
+    assert(sb_capacity(&sb) >= 100000);
+    char const *ptr = sb.view.ptr;
+    for (size_t ix = 0; ix < 10000; ++ix) {
+        sb_append_cstr(&sb, "0123456789");
+    }
+    assert(sb.view.ptr == ptr && sb.view.length == 100007);
+    StringBufferStats before = sb_buffer_stats();
+    sv_free(sb.view);
+    assert(sb_buffer_stats().frees == before.frees + 1);
+
+    // Appending a builder's own text survives the buffer moving.
+    sb = (StringBuilder) { 0 };
+    sb_append_cstr(&sb, "abcdefghijklmnopqrstuvwxyz");
+    for (size_t ix = 0; ix < 6; ++ix) {
+        sb_append_sv(&sb, sb.view);
+    }
+    assert(sb.view.length == 26 * 64 && sv_eq_cstr(sv_substring(sb.view, 26 * 63, 26), "abcdefghijklmnopqrstuvwxyz"));
+    sb_insert_sv(&sb, (StringView) { sb.view.ptr, 26 }, 13);
+    assert(sv_eq_cstr(sv_substring(sb.view, 13, 26), "abcdefghijklmnopqrstuvwxyz"));
+    sv_free(sb.view);
+
+    // Formatting a builder's own text survives the buffer growing.
+    sb = sb_copy_cstr("abcdefghijklmnopqrstuvwxyz");
+    for (size_t ix = 0; ix < 6; ++ix) {
+        size_t     cap = sb_capacity(&sb);
+        StringView s = sb.view;
+        sb_printf(&sb, "'%.*s'", SV_ARG(s));
+        assert(sb_capacity(&sb) > cap);
+    }
+    assert(sv_eq_cstr(sv_substring(sb.view, 0, 26), "abcdefghijklmnopqrstuvwxyz"));
+    assert(sv_eq_cstr(sv_substring(sb.view, 27, 26), "abcdefghijklmnopqrstuvwxyz"));
+    sv_free(sb.view);
+
+    // Short-lived small strings should be served from the buffer free lists.
+    before = sb_buffer_stats();
+    for (size_t ix = 0; ix < 10000; ++ix) {
+        StringView s = sv_printf("line %zu column %zu", ix, ix * 3);
+        assert(sv_is_cstr(s));
+        sv_free(s);
+    }
+    StringBufferStats after = sb_buffer_stats();
+    printf("10000 sv_printf calls: %zu mallocs, %zu reuses\n", after.mallocs - before.mallocs, after.reuses - before.reuses);
+    assert(after.mallocs - before.mallocs <= 1);
+}
+
 int main()
 {
+    test_split_iter();
+    test_builder();
+    test_find();
+
     printf("--%.*s--\n", SV_ARG(sv_strip(sv_from("  abcd \t"))));
     printf("--%.*s--\n", SV_ARG(sv_strip(sv_from("abcd \t"))));
     printf("--%.*s--\n", SV_ARG(sv_strip(sv_from("  abcd"))));
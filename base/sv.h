@@ -46,6 +46,13 @@ typedef struct string_builder {
 
 DA(StringBuilder)
 
+typedef struct {
+    size_t mallocs;
+    size_t reuses;
+    size_t reallocs;
+    size_t frees;
+} StringBufferStats;
+
 typedef struct {
     size_t index;
     size_t length;
@@ -70,6 +77,12 @@ typedef struct {
     size_t column;
 } TextPosition;
 
+typedef struct {
+    StringView rest;
+    StringView sep;
+    bool       done;
+} SplitIter;
+
 typedef struct StringScanner {
     StringView   string;
     TextPosition mark;
@@ -81,6 +94,7 @@ typedef struct StringScanner {
 
 extern StringView         sv_null();
 extern void               sv_free(StringView sv);
+extern void               sv_release(StringView sv);
 extern StringView         sv_copy(StringView sv);
 extern StringView         sv_copy_chars(char const *ptr, size_t len);
 extern StringView         sv_copy_cstr(char const *s);
@@ -98,6 +112,7 @@ extern bool               sv_not_empty(StringView sv);
 extern bool               sv_is_whitespace(StringView sv);
 extern size_t             sv_length(StringView sv);
 extern unsigned int       sv_hash(StringView *sv);
+extern uint64_t           sv_hash64(StringView sv);
 extern bool               sv_is_cstr(StringView sv);
 extern char const        *sv_cstr(StringView sv, char *buffer);
 extern int                sv_cmp(StringView s1, StringView s2);
@@ -118,9 +133,15 @@ extern int                sv_first(StringView sv, char ch);
 extern int                sv_last(StringView sv, char ch);
 extern int                sv_find(StringView sv, StringView sub);
 extern int                sv_find_from(StringView sv, StringView sub, size_t from);
+extern int                sv_find_ignore_case(StringView sv, StringView sub);
+extern int                sv_find_from_ignore_case(StringView sv, StringView sub, size_t from);
 extern StringView         sv_substring(StringView sv, size_t at, size_t len);
 extern StringList         sv_split(StringView sv, StringView sep);
 extern StringList         sv_split_by_whitespace(StringView sv);
+extern SplitIter          sv_split_iter(StringView sv, StringView sep);
+extern SplitIter          sv_split_by_whitespace_iter(StringView sv);
+extern bool               sv_split_next(SplitIter *it, StringView *component);
+extern size_t             sv_split_n(StringView sv, StringView sep, StringView *components, size_t n);
 extern StringView         sv_strip(StringView sv);
 
 #undef INTEGER_SIZE
@@ -137,30 +158,34 @@ INTEGER_SIZES(INTEGER_SIZE)
 #define SV_ARG_RALIGN(sv, width) (int) (width - sv.length), "", (int) sv.length, sv.ptr
 #define SV_ARG_LALIGN(sv, width) (int) sv.length, sv.ptr, (int) (width - sv.length), ""
 
-extern StringBuilder sb_create();
-extern StringBuilder sb_createf(char const *fmt, ...) format_args(1, 2);
-extern StringBuilder sb_vcreatef(char const *fmt, va_list args);
-extern StringBuilder sb_copy_chars(char const *ptr, size_t len);
-extern StringBuilder sb_copy_cstr(char const *s);
-extern StringBuilder sb_copy_sv(StringView sv);
-extern void          sb_clear(StringBuilder *sb);
-extern StringRef     sb_append_chars(StringBuilder *sb, char const *ptr, size_t len);
-extern StringRef     sb_append_sv(StringBuilder *sb, StringView sv);
-extern StringRef     sb_append_cstr(StringBuilder *sb, char const *s);
-extern StringRef     sb_append_char(StringBuilder *sb, char ch);
-extern StringRef     sb_append_integer(StringBuilder *sb, Integer integer);
-extern StringRef     sb_append_hex_integer(StringBuilder *sb, Integer integer);
-extern StringRef     sb_vprintf(StringBuilder *sb, char const *fmt, va_list args);
-extern StringRef     sb_printf(StringBuilder *sb, char const *fmt, ...) format_args(2, 3);
-extern StringRef     sb_insert_sv(StringBuilder *sb, StringView sv, size_t at);
-extern StringRef     sb_insert_chars(StringBuilder *sb, char const *ptr, size_t len, size_t at);
-extern StringRef     sb_insert_cstr(StringBuilder *sb, char const *str, size_t at);
-extern void          sb_remove(StringBuilder *sb, size_t at, size_t num);
-extern StringRef     sb_append_list(StringBuilder *sb, StringList *sl, StringView sep);
-extern int           sb_replace_one(StringBuilder *sb, StringView pat, StringView repl);
-extern int           sb_replace_all(StringBuilder *sb, StringView pat, StringView repl);
-extern StringView    sb_view(StringBuilder *sb);
-extern StringView    sv(StringBuilder *sb, StringRef ref);
+extern StringBuilder     sb_create();
+extern StringBuilder     sb_createf(char const *fmt, ...) format_args(1, 2);
+extern StringBuilder     sb_vcreatef(char const *fmt, va_list args);
+extern StringBuilder     sb_copy_chars(char const *ptr, size_t len);
+extern StringBuilder     sb_copy_cstr(char const *s);
+extern StringBuilder     sb_copy_sv(StringView sv);
+extern void              sb_clear(StringBuilder *sb);
+extern void              sb_reserve(StringBuilder *sb, size_t capacity);
+extern size_t            sb_capacity(StringBuilder *sb);
+extern StringRef         sb_append_chars(StringBuilder *sb, char const *ptr, size_t len);
+extern StringRef         sb_append_sv(StringBuilder *sb, StringView sv);
+extern StringRef         sb_append_cstr(StringBuilder *sb, char const *s);
+extern StringRef         sb_append_char(StringBuilder *sb, char ch);
+extern StringRef         sb_append_integer(StringBuilder *sb, Integer integer);
+extern StringRef         sb_append_hex_integer(StringBuilder *sb, Integer integer);
+extern StringRef         sb_vprintf(StringBuilder *sb, char const *fmt, va_list args);
+extern StringRef         sb_printf(StringBuilder *sb, char const *fmt, ...) format_args(2, 3);
+extern StringRef         sb_insert_sv(StringBuilder *sb, StringView sv, size_t at);
+extern StringRef         sb_insert_chars(StringBuilder *sb, char const *ptr, size_t len, size_t at);
+extern StringRef         sb_insert_cstr(StringBuilder *sb, char const *str, size_t at);
+extern void              sb_remove(StringBuilder *sb, size_t at, size_t num);
+extern StringRef         sb_splice(StringBuilder *sb, size_t at, size_t num, char const *ptr, size_t len);
+extern StringRef         sb_append_list(StringBuilder *sb, StringList *sl, StringView sep);
+extern int               sb_replace_one(StringBuilder *sb, StringView pat, StringView repl);
+extern int               sb_replace_all(StringBuilder *sb, StringView pat, StringView repl);
+extern StringView        sb_view(StringBuilder *sb);
+extern StringView        sv(StringBuilder *sb, StringRef ref);
+extern StringBufferStats sb_buffer_stats();
 
 #define SB_SPEC SV_SPEC
 #define SB_ARG(sb) (int) (sb).view.length, (sb).view.ptr
@@ -4,9 +4,27 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <base/hm.h>
 #include <base/xml.h>
 #include <ctype.h>
 
+struct xml_store {
+    XMLNodeImpls nodes;
+    Allocator    alloc;
+    HashMap      tag_index;
+};
+
+typedef struct {
+    size_t     parent;
+    StringView tag;
+} XMLTagKey;
+
+typedef struct {
+    size_t first;
+    size_t last;
+    size_t count;
+} XMLTagEntry;
+
 typedef struct {
     StringBuilder sb;
     StringBuilder escaped;
@@ -16,19 +34,30 @@ typedef struct {
 typedef struct {
     StringScanner ss;
     StringBuilder sb;
-} XMLDeserializer;
+    StringViews   tags;
+    XMLHandler   *handler;
+} XMLParser;
+
+typedef struct {
+    XMLNode current;
+    XMLNode last; // Element or processing instruction receiving attributes
+} XMLBuilder;
 
-static XMLNode                   xml_create(XMLNodeImpls *impls, size_t parent, XMLType type);
+static XMLNode                   xml_create(XMLStore *store, size_t parent, XMLType type);
 static XMLNodeImpl              *xml_impl(XMLNode node);
+static StringView                xml_store_copy(XMLStore *store, StringView sv);
 static void                      xml_escape(StringBuilder *sb, StringView text);
 static StringView                get_string(XMLNode node, char const *fmt, ...);
 static void                      serialize_to_builder(XMLNode node, XMLSerializer *serializer);
-static ErrorOrOptionalXMLNode    deserialize_node(XMLDeserializer *deserializer, XMLNode parent);
-static ErrorOrOptionalStringView deserialize_text(XMLDeserializer *deserializer, StringView close);
-static ErrorOrStringView         deserialize_attr_value(XMLDeserializer *deserializer);
-static ErrorOrStringView         deserialize_tag(XMLDeserializer *deserializer);
-static ErrorOrOptionalXMLNode    deserialize_processing_instruction(XMLDeserializer *deserializer, XMLNode parent);
-static ErrorOrOptionalXMLNode    deserialize_element(XMLDeserializer *deserializer, XMLNode parent);
+static ErrorOrInt                parse_char_entity(XMLParser *parser);
+static ErrorOrOptionalStringView parse_text(XMLParser *parser, StringView close);
+static ErrorOrStringView         parse_attr_value(XMLParser *parser);
+static ErrorOrStringView         parse_tag(XMLParser *parser);
+static ErrorOrInt                parse_attribute(XMLParser *parser);
+static ErrorOrInt                parse_processing_instruction(XMLParser *parser);
+static ErrorOrInt                parse_element(XMLParser *parser);
+static ErrorOrInt                parse_close_tag(XMLParser *parser);
+static ErrorOrInt                parse_document(XMLParser *parser);
 
 DA_IMPL(XMLNodeImpl)
 DA_IMPL(XMLNode)
@@ -47,21 +76,46 @@ extern char const *XMLType_name(XMLType type)
     }
 }
 
-XMLNode xml_create(XMLNodeImpls *impls, size_t parent, XMLType type)
+static uint64_t tag_key_hash(void const *key)
+{
+    XMLTagKey const *k = key;
+    return sv_hash64(k->tag) ^ (k->parent * 0x9E3779B97F4A7C15ull);
+}
+
+static bool tag_key_eq(void const *key1, void const *key2)
+{
+    XMLTagKey const *k1 = key1;
+    XMLTagKey const *k2 = key2;
+    return k1->parent == k2->parent && sv_eq(k1->tag, k2->tag);
+}
+
+// Note that this invalidates XMLNodeImpl pointers obtained earlier.
+XMLNode xml_create(XMLStore *store, size_t parent, XMLType type)
 {
-    XMLNode     ret = { impls, impls->size };
+    XMLNode     ret = { store, store->nodes.size };
     XMLNodeImpl impl = { 0 };
     impl.type = type;
     impl.parent = parent;
     impl.index = ret.index;
-    da_append_XMLNodeImpl(impls, impl);
+    da_append_XMLNodeImpl(&store->nodes, impl);
     return ret;
 }
 
 XMLNodeImpl *xml_impl(XMLNode node)
 {
-    assert(node.index < node.registry->size);
-    return da_element_XMLNodeImpl(node.registry, node.index);
+    assert(node.index < node.store->nodes.size);
+    return da_element_XMLNodeImpl(&node.store->nodes, node.index);
+}
+
+// Tags and text live in the document's arena and are released with it.
+StringView xml_store_copy(XMLStore *store, StringView sv)
+{
+    if (sv_empty(sv)) {
+        return sv_null();
+    }
+    char *ptr = allocator_allocate(store->alloc, sv.length);
+    memcpy(ptr, sv.ptr, sv.length);
+    return (StringView) { ptr, sv.length };
 }
 
 XMLNode xml_document_of(XMLNode node)
@@ -69,15 +123,34 @@ XMLNode xml_document_of(XMLNode node)
     XMLNodeImpl *impl = xml_impl(node);
     assert(impl);
     while (impl->type != XML_TYPE_DOCUMENT) {
-        impl = xml_impl((XMLNode) { node.registry, impl->parent });
+        impl = xml_impl((XMLNode) { node.store, impl->parent });
     }
-    return (XMLNode) { node.registry, impl->index };
+    return (XMLNode) { node.store, impl->index };
 }
 
 void xml_escape(StringBuilder *sb, StringView text)
 {
     for (size_t ix = 0; ix < text.length; ++ix) {
         int ch = text.ptr[ix];
+        switch (ch) {
+        case '&':
+            sb_append_cstr(sb, "&amp;");
+            continue;
+        case '<':
+            sb_append_cstr(sb, "&lt;");
+            continue;
+        case '>':
+            sb_append_cstr(sb, "&gt;");
+            continue;
+        case '\'':
+            sb_append_cstr(sb, "&apos;");
+            continue;
+        case '"':
+            sb_append_cstr(sb, "&quot;");
+            continue;
+        default:
+            break;
+        }
         if (ch < ' ' || ch > '~') {
             sb_printf(sb, "&#%d;", ch);
             continue;
@@ -157,9 +230,13 @@ StringView xml_debug(XMLNode node)
 
 XMLNode xml_document()
 {
-    XMLNodeImpls *impls = MALLOC(XMLNodeImpls);
-    XMLNode       ret = xml_create(impls, -1, XML_TYPE_DOCUMENT);
-    assert(impls->size == 1);
+    XMLStore *store = MALLOC(XMLStore);
+    *store = (XMLStore) {
+        .alloc = allocator_new_with_chunk_size(16 * 1024),
+        .tag_index = hm_create(sizeof(XMLTagKey), sizeof(XMLTagEntry), tag_key_hash, tag_key_eq),
+    };
+    XMLNode ret = xml_create(store, -1, XML_TYPE_DOCUMENT);
+    assert(store->nodes.size == 1);
 
     XMLNode pi = xml_processing_instruction(ret, sv_from("xml"));
     xml_set_attribute(pi, sv_from("version"), sv_from("1.0"));
@@ -185,42 +262,56 @@ XMLNode xml_child(XMLNode node, size_t ix)
     XMLNodeImpl *impl = xml_impl(node);
     assert(impl->type == XML_TYPE_DOCUMENT || impl->type == XML_TYPE_ELEMENT);
     assert(ix < impl->element.children.size);
-    return (XMLNode) { node.registry, impl->element.children.elements[ix] };
+    return (XMLNode) { node.store, impl->element.children.elements[ix] };
+}
+
+static XMLTagEntry *xml_tag_entry(XMLNode node, StringView tag)
+{
+    assert(xml_node_type(node) == XML_TYPE_DOCUMENT || xml_node_type(node) == XML_TYPE_ELEMENT);
+    XMLTagKey key = { node.index, tag };
+    return hm_get_raw(&node.store->tag_index, &key);
 }
 
 XMLNodes xml_children_by_tag(XMLNode node, StringView tag)
 {
-    XMLNodeImpl *impl = xml_impl(node);
-    assert(impl->type == XML_TYPE_DOCUMENT || impl->type == XML_TYPE_ELEMENT);
-    XMLNodes ret = { 0 };
-    for (size_t ix = 0; ix < impl->element.children.size; ++ix) {
-        XMLNode      elem = { node.registry, impl->element.children.elements[ix] };
-        XMLNodeImpl *elem_impl = xml_impl(elem);
-        if (elem_impl->type != XML_TYPE_ELEMENT) {
-            continue;
-        }
-        if (sv_eq(elem_impl->element.tag, tag)) {
-            da_append_XMLNode(&ret, elem);
-        }
+    XMLNodes     ret = { 0 };
+    XMLTagEntry *entry = xml_tag_entry(node, tag);
+    if (entry == NULL) {
+        return ret;
+    }
+    da_reserve_XMLNode(&ret, entry->count);
+    for (size_t ix = entry->first; ix != 0; ix = xml_impl((XMLNode) { node.store, ix })->element.next_by_tag) {
+        da_append_XMLNode(&ret, (XMLNode) { node.store, ix });
     }
     return ret;
 }
 
+size_t xml_child_count_by_tag(XMLNode node, StringView tag)
+{
+    XMLTagEntry *entry = xml_tag_entry(node, tag);
+    return (entry != NULL) ? entry->count : 0;
+}
+
 OptionalXMLNode xml_first_child_by_tag(XMLNode node, StringView tag)
+{
+    XMLTagEntry *entry = xml_tag_entry(node, tag);
+    if (entry == NULL) {
+        RETURN_EMPTY(XMLNode);
+    }
+    RETURN_VALUE(XMLNode, ((XMLNode) { node.store, entry->first }));
+}
+
+// Returns the next sibling of an element with the same tag. Together with
+// xml_first_child_by_tag this walks the children with a given tag without
+// allocating.
+OptionalXMLNode xml_next_sibling_by_tag(XMLNode node)
 {
     XMLNodeImpl *impl = xml_impl(node);
-    assert(impl->type == XML_TYPE_DOCUMENT || impl->type == XML_TYPE_ELEMENT);
-    for (size_t ix = 0; ix < impl->element.children.size; ++ix) {
-        XMLNode      elem = { node.registry, impl->element.children.elements[ix] };
-        XMLNodeImpl *elem_impl = xml_impl(elem);
-        if (elem_impl->type != XML_TYPE_ELEMENT) {
-            continue;
-        }
-        if (sv_eq(elem_impl->element.tag, tag)) {
-            RETURN_VALUE(XMLNode, elem);
-        }
+    assert(impl->type == XML_TYPE_ELEMENT);
+    if (impl->element.next_by_tag == 0) {
+        RETURN_EMPTY(XMLNode);
     }
-    RETURN_EMPTY(XMLNode);
+    RETURN_VALUE(XMLNode, ((XMLNode) { node.store, impl->element.next_by_tag }));
 }
 
 size_t xml_attribute_count(XMLNode node)
@@ -235,7 +326,7 @@ XMLNode xml_attribute(XMLNode node, size_t ix)
     XMLNodeImpl *impl = xml_impl(node);
     assert(impl->type == XML_TYPE_PROCESSING_INSTRUCTION || impl->type == XML_TYPE_ELEMENT);
     assert(ix < impl->element.attributes.size);
-    return (XMLNode) { node.registry, impl->element.attributes.elements[ix] };
+    return (XMLNode) { node.store, impl->element.attributes.elements[ix] };
 }
 
 OptionalXMLNode xml_attribute_by_tag(XMLNode node, StringView tag)
@@ -243,7 +334,7 @@ OptionalXMLNode xml_attribute_by_tag(XMLNode node, StringView tag)
     XMLNodeImpl *impl = xml_impl(node);
     assert(impl->type == XML_TYPE_PROCESSING_INSTRUCTION || impl->type == XML_TYPE_ELEMENT);
     for (size_t ix = 0; ix < impl->element.attributes.size; ++ix) {
-        XMLNode      attr = { node.registry, impl->element.attributes.elements[ix] };
+        XMLNode      attr = { node.store, impl->element.attributes.elements[ix] };
         XMLNodeImpl *attr_impl = xml_impl(attr);
         if (sv_eq(attr_impl->attribute.tag, tag)) {
             RETURN_VALUE(XMLNode, attr);
@@ -285,12 +376,12 @@ XMLNode xml_processing_instruction(XMLNode parent, StringView tag)
     XMLNodeImpl *parent_impl = xml_impl(parent);
     assert(parent_impl->type == XML_TYPE_DOCUMENT);
     if (sv_eq_cstr(tag, "xml") && parent_impl->document.processing_instructions.size != 0) {
-        return (XMLNode) { parent.registry, parent_impl->document.processing_instructions.elements[0] };
+        return (XMLNode) { parent.store, parent_impl->document.processing_instructions.elements[0] };
     }
-    XMLNode      pi = xml_create(parent.registry, parent.index, XML_TYPE_PROCESSING_INSTRUCTION);
+    XMLNode      pi = xml_create(parent.store, parent.index, XML_TYPE_PROCESSING_INSTRUCTION);
     XMLNodeImpl *pi_impl = xml_impl(pi);
-    pi_impl->pi.tag = sv_copy(tag);
-    da_append_size_t(&parent_impl->document.processing_instructions, pi.index);
+    pi_impl->pi.tag = xml_store_copy(parent.store, tag);
+    da_append_size_t(&xml_impl(parent)->document.processing_instructions, pi.index);
     StringView pi_debug = xml_debug(pi);
     TRACE(parent, "xml_processing_instruction(%.*s)", SV_ARG(pi_debug));
     sv_free(pi_debug);
@@ -302,10 +393,22 @@ XMLNode xml_element(XMLNode parent, StringView tag)
     XMLNodeImpl *parent_impl = xml_impl(parent);
     assert(parent_impl->type == XML_TYPE_DOCUMENT || parent_impl->type == XML_TYPE_ELEMENT);
     assert(xml_child_count(parent) == 0 || xml_node_type(xml_child(parent, 0)) == XML_TYPE_ELEMENT);
-    XMLNode      elem = xml_create(parent.registry, parent.index, XML_TYPE_ELEMENT);
+    XMLNode      elem = xml_create(parent.store, parent.index, XML_TYPE_ELEMENT);
     XMLNodeImpl *elem_impl = xml_impl(elem);
-    elem_impl->element.tag = sv_copy(tag);
-    da_append_size_t(&parent_impl->element.children, elem.index);
+    elem_impl->element.tag = xml_store_copy(parent.store, tag);
+    da_append_size_t(&xml_impl(parent)->element.children, elem.index);
+
+    XMLTagKey    key = { parent.index, elem_impl->element.tag };
+    XMLTagEntry *entry = hm_get_raw(&parent.store->tag_index, &key);
+    if (entry == NULL) {
+        XMLTagEntry new_entry = { elem.index, elem.index, 1 };
+        hm_put_raw(&parent.store->tag_index, &key, &new_entry);
+    } else {
+        xml_impl((XMLNode) { parent.store, entry->last })->element.next_by_tag = elem.index;
+        entry->last = elem.index;
+        ++entry->count;
+    }
+
     StringView elem_debug = xml_debug(elem);
     TRACE(parent, "xml_element(%.*s)", SV_ARG(elem_debug));
     sv_free(elem_debug);
@@ -317,10 +420,10 @@ XMLNode xml_text(XMLNode parent, StringView text)
     XMLNodeImpl *parent_impl = xml_impl(parent);
     assert(parent_impl->type == XML_TYPE_DOCUMENT || parent_impl->type == XML_TYPE_ELEMENT);
     assert(xml_child_count(parent) == 0);
-    XMLNode      txt = xml_create(parent.registry, parent.index, XML_TYPE_TEXT);
+    XMLNode      txt = xml_create(parent.store, parent.index, XML_TYPE_TEXT);
     XMLNodeImpl *txt_impl = xml_impl(txt);
-    txt_impl->text = sv_copy(text);
-    da_append_size_t(&parent_impl->element.children, txt.index);
+    txt_impl->text = xml_store_copy(parent.store, text);
+    da_append_size_t(&xml_impl(parent)->element.children, txt.index);
     StringView debug = xml_debug(txt);
     TRACE(parent, "xml_text(%.*s)", SV_ARG(debug));
     sv_free(debug);
@@ -334,55 +437,35 @@ XMLNode xml_text_element(XMLNode parent, StringView tag, StringView text)
     return ret;
 }
 
-void _xml_free(XMLNode node)
-{
-    XMLNodeImpl *impl = xml_impl(node);
-    switch (impl->type) {
-    case XML_TYPE_TEXT:
-        sv_free(impl->text);
-        break;
-    case XML_TYPE_ATTRIBUTE:
-        sv_free(impl->attribute.tag);
-        sv_free(impl->attribute.text);
-        break;
-    case XML_TYPE_ELEMENT: {
-        for (size_t ix = 0; ix < impl->element.attributes.size; ++ix) {
-            _xml_free((XMLNode) { node.registry, impl->element.attributes.elements[ix] });
-        }
-        for (size_t ix = 0; ix < impl->element.children.size; ++ix) {
-            _xml_free((XMLNode) { node.registry, impl->element.children.elements[ix] });
-        }
-        da_free_size_t(&impl->element.attributes);
-        da_free_size_t(&impl->element.children);
-        sv_free(impl->element.tag);
-    } break;
-    case XML_TYPE_PROCESSING_INSTRUCTION: {
-        for (size_t ix = 0; ix < impl->pi.attributes.size; ++ix) {
-            _xml_free((XMLNode) { node.registry, impl->pi.attributes.elements[ix] });
-        }
-        da_free_size_t(&impl->pi.attributes);
-        sv_free(impl->pi.tag);
-    } break;
-    case XML_TYPE_DOCUMENT: {
-        for (size_t ix = 0; ix < impl->document.processing_instructions.size; ++ix) {
-            _xml_free((XMLNode) { node.registry, impl->document.processing_instructions.elements[ix] });
-        }
-        for (size_t ix = 0; ix < impl->element.children.size; ++ix) {
-            _xml_free((XMLNode) { node.registry, impl->element.children.elements[ix] });
-        }
-        da_free_size_t(&impl->document.processing_instructions);
-        da_free_size_t(&impl->document.children);
-        sv_free(impl->document.sb.view);
-        da_free_XMLNodeImpl(node.registry);
-        free(node.registry);
-    } break;
-    }
-}
-
+// Strings are in the store's arena, so only the index arrays need to be
+// freed node by node.
 void xml_free(XMLNode doc)
 {
     assert(xml_node_type(doc) == XML_TYPE_DOCUMENT);
-    _xml_free(doc);
+    XMLStore *store = doc.store;
+    for (size_t ix = 0; ix < store->nodes.size; ++ix) {
+        XMLNodeImpl *impl = store->nodes.elements + ix;
+        switch (impl->type) {
+        case XML_TYPE_ELEMENT:
+            da_free_size_t(&impl->element.attributes);
+            da_free_size_t(&impl->element.children);
+            break;
+        case XML_TYPE_PROCESSING_INSTRUCTION:
+            da_free_size_t(&impl->pi.attributes);
+            break;
+        case XML_TYPE_DOCUMENT:
+            da_free_size_t(&impl->document.processing_instructions);
+            da_free_size_t(&impl->document.children);
+            sv_free(impl->document.sb.view);
+            break;
+        default:
+            break;
+        }
+    }
+    da_free_XMLNodeImpl(&store->nodes);
+    hm_free(&store->tag_index);
+    allocator_free(&store->alloc);
+    free(store);
 }
 
 XMLNode xml_set_attribute(XMLNode node, StringView attr_tag, StringView text)
@@ -390,18 +473,18 @@ XMLNode xml_set_attribute(XMLNode node, StringView attr_tag, StringView text)
     XMLNodeImpl *parent_impl = xml_impl(node);
     assert(parent_impl->type == XML_TYPE_PROCESSING_INSTRUCTION || parent_impl->type == XML_TYPE_ELEMENT);
     for (size_t ix = 0; ix < parent_impl->element.attributes.size; ++ix) {
-        XMLNodeImpl *attr = xml_impl((XMLNode) { node.registry, parent_impl->element.attributes.elements[ix] });
+        XMLNodeImpl *attr = xml_impl((XMLNode) { node.store, parent_impl->element.attributes.elements[ix] });
         if (sv_eq(attr->attribute.tag, attr_tag)) {
-            sv_free(attr->attribute.text);
-            attr->attribute.text = sv_copy(text);
+            attr->attribute.text = xml_store_copy(node.store, text);
             TRACE(node, "xml_set_attribute(%.*s, '%.*s') -> overwriting %zu", SV_ARG(attr_tag), SV_ARG(text), parent_impl->element.attributes.size)
             return node;
         }
     }
-    XMLNode      a = xml_create(node.registry, node.index, XML_TYPE_ATTRIBUTE);
+    XMLNode      a = xml_create(node.store, node.index, XML_TYPE_ATTRIBUTE);
     XMLNodeImpl *impl = xml_impl(a);
-    impl->attribute.tag = sv_copy(attr_tag);
-    impl->attribute.text = sv_copy(text);
+    impl->attribute.tag = xml_store_copy(node.store, attr_tag);
+    impl->attribute.text = xml_store_copy(node.store, text);
+    parent_impl = xml_impl(node);
     da_append_size_t(&parent_impl->element.attributes, a.index);
     TRACE(node, "xml_set_attribute(%.*s, '%.*s') -> new %zu", SV_ARG(attr_tag), SV_ARG(text), parent_impl->element.attributes.size)
     return a;
@@ -413,11 +496,11 @@ void serialize_to_builder(XMLNode node, XMLSerializer *serializer)
     switch (impl->type) {
     case XML_TYPE_DOCUMENT: {
         for (size_t ix = 0; ix < impl->document.processing_instructions.size; ix++) {
-            XMLNode pi = (XMLNode) { node.registry, impl->document.processing_instructions.elements[ix] };
+            XMLNode pi = (XMLNode) { node.store, impl->document.processing_instructions.elements[ix] };
             serialize_to_builder(pi, serializer);
         }
         for (size_t ix = 0; ix < impl->document.children.size; ix++) {
-            XMLNode elem = (XMLNode) { node.registry, impl->document.children.elements[ix] };
+            XMLNode elem = (XMLNode) { node.store, impl->document.children.elements[ix] };
             serialize_to_builder(elem, serializer);
         }
     } break;
@@ -425,7 +508,7 @@ void serialize_to_builder(XMLNode node, XMLSerializer *serializer)
         sb_printf(&serializer->sb, "%*s<%.*s", serializer->indent, "", SV_ARG(impl->element.tag));
         for (size_t ix = 0; ix < impl->element.attributes.size; ix++) {
             sb_append_cstr(&serializer->sb, " ");
-            XMLNode attr = (XMLNode) { node.registry, impl->element.attributes.elements[ix] };
+            XMLNode attr = (XMLNode) { node.store, impl->element.attributes.elements[ix] };
             serialize_to_builder(attr, serializer);
         }
         if (impl->element.children.size == 0) {
@@ -438,7 +521,7 @@ void serialize_to_builder(XMLNode node, XMLSerializer *serializer)
         }
         serializer->indent += 4;
         for (size_t ix = 0; ix < impl->element.children.size; ix++) {
-            XMLNode elem = (XMLNode) { node.registry, impl->element.children.elements[ix] };
+            XMLNode elem = (XMLNode) { node.store, impl->element.children.elements[ix] };
             serialize_to_builder(elem, serializer);
         }
         serializer->indent -= 4;
@@ -458,7 +541,7 @@ void serialize_to_builder(XMLNode node, XMLSerializer *serializer)
         sb_printf(&serializer->sb, "<?%.*s", SV_ARG(impl->pi.tag));
         for (size_t ix = 0; ix < impl->element.attributes.size; ix++) {
             sb_append_cstr(&serializer->sb, " ");
-            XMLNode attr = (XMLNode) { node.registry, impl->pi.attributes.elements[ix] };
+            XMLNode attr = (XMLNode) { node.store, impl->pi.attributes.elements[ix] };
             serialize_to_builder(attr, serializer);
         }
         sb_append_cstr(&serializer->sb, "?>\n");
@@ -476,230 +559,306 @@ StringView xml_serialize(XMLNode node)
     return serializer.sb.view;
 }
 
-ErrorOrInt deserialize_char_entity(XMLDeserializer *deserializer)
+ErrorOrInt parse_char_entity(XMLParser *parser)
 {
-    ss_reset(&deserializer->ss);
-    for (int ch = ss_peek(&deserializer->ss); ch != 0 && ch != ';'; ch = ss_peek(&deserializer->ss)) {
-        ss_skip_one(&deserializer->ss);
+    ss_reset(&parser->ss);
+    for (int ch = ss_peek(&parser->ss); ch != 0 && ch != ';'; ch = ss_peek(&parser->ss)) {
+        ss_skip_one(&parser->ss);
     }
-    StringView code = ss_read_from_mark(&deserializer->ss);
+    StringView code = ss_read_from_mark(&parser->ss);
     if (sv_empty(code)) {
-        ERROR(Int, XMLError, deserializer->ss.point.line, "Bad escape- '&#;'");
+        ERROR(Int, XMLError, parser->ss.point.line, "Bad escape- '&#;'");
     }
-    if (!ss_expect(&deserializer->ss, ';')) {
-        ERROR(Int, XMLError, deserializer->ss.point.line, "Escape not termininated before end of document");
+    if (!ss_expect(&parser->ss, ';')) {
+        ERROR(Int, XMLError, parser->ss.point.line, "Escape not termininated before end of document");
     }
     IntegerParseResult parse_result = sv_parse_u32(code);
     if (!parse_result.success) {
-        ERROR(Int, XMLError, deserializer->ss.point.line, "Bad escape- '%.*' is not a character entity", SV_ARG(code));
+        ERROR(Int, XMLError, parser->ss.point.line, "Bad escape- '%.*' is not a character entity", SV_ARG(code));
     }
     uint32_t int_value = parse_result.integer.u32;
     char    *int_value_as_char = (char *) (&int_value);
     for (char *p = int_value_as_char; (p - int_value_as_char) < 4 && *p; ++p) {
-        sb_append_char(&deserializer->sb, *p);
+        sb_append_char(&parser->sb, *p);
     }
     RETURN(Int, 0);
 }
 
-ErrorOrOptionalStringView deserialize_text(XMLDeserializer *deserializer, StringView close)
+ErrorOrOptionalStringView parse_text(XMLParser *parser, StringView close)
 {
-    deserializer->sb.view.length = 0;
-    while (!ss_expect_sv(&deserializer->ss, close) && ss_peek(&deserializer->ss) != 0) {
-        int ch = ss_peek(&deserializer->ss);
+    parser->sb.view.length = 0;
+    while (!ss_expect_sv(&parser->ss, close) && ss_peek(&parser->ss) != 0) {
+        int ch = ss_peek(&parser->ss);
         switch (ch) {
         case '&': {
-            ss_skip_one(&deserializer->ss);
-            if (ss_expect_sv(&deserializer->ss, sv_from("amp;"))) {
-                sb_append_char(&deserializer->sb, '&');
-            } else if (ss_expect_sv(&deserializer->ss, sv_from("apos;"))) {
-                sb_append_char(&deserializer->sb, '\'');
-            } else if (ss_expect_sv(&deserializer->ss, sv_from("gt;"))) {
-                sb_append_char(&deserializer->sb, '>');
-            } else if (ss_expect_sv(&deserializer->ss, sv_from("lt;"))) {
-                sb_append_char(&deserializer->sb, '<');
-            } else if (ss_expect_sv(&deserializer->ss, sv_from("quot;"))) {
-                sb_append_char(&deserializer->sb, '\"');
-            } else if (ss_expect(&deserializer->ss, '#')) {
-                TRY_TO(Int, OptionalStringView, deserialize_char_entity(deserializer));
+            ss_skip_one(&parser->ss);
+            if (ss_expect_sv(&parser->ss, sv_from("amp;"))) {
+                sb_append_char(&parser->sb, '&');
+            } else if (ss_expect_sv(&parser->ss, sv_from("apos;"))) {
+                sb_append_char(&parser->sb, '\'');
+            } else if (ss_expect_sv(&parser->ss, sv_from("gt;"))) {
+                sb_append_char(&parser->sb, '>');
+            } else if (ss_expect_sv(&parser->ss, sv_from("lt;"))) {
+                sb_append_char(&parser->sb, '<');
+            } else if (ss_expect_sv(&parser->ss, sv_from("quot;"))) {
+                sb_append_char(&parser->sb, '\"');
+            } else if (ss_expect(&parser->ss, '#')) {
+                TRY_TO(Int, OptionalStringView, parse_char_entity(parser));
             } else {
-                ERROR(OptionalStringView, XMLError, deserializer->ss.point.line, "Bad escape");
+                ERROR(OptionalStringView, XMLError, parser->ss.point.line, "Bad escape");
             }
         } break;
         case '\0':
-            ERROR(OptionalStringView, XMLError, deserializer->ss.point.line, "Unterminated text");
+            ERROR(OptionalStringView, XMLError, parser->ss.point.line, "Unterminated text");
         case '<':
-            if (sv_is_whitespace(deserializer->sb.view)) {
+            if (sv_is_whitespace(parser->sb.view)) {
                 RETURN(OptionalStringView, OptionalStringView_empty());
             }
             // fall through
         case '\'':
         case '\"':
         case '>':
-            ERROR(OptionalStringView, XMLError, deserializer->ss.point.line, "Invalid character in text: '%c'", ch);
+            ERROR(OptionalStringView, XMLError, parser->ss.point.line, "Invalid character in text: '%c'", ch);
         default:
-            sb_append_char(&deserializer->sb, ch);
-            ss_skip_one(&deserializer->ss);
+            sb_append_char(&parser->sb, ch);
+            ss_skip_one(&parser->ss);
             break;
         }
     }
-    RETURN(OptionalStringView, OptionalStringView_create(deserializer->sb.view));
+    RETURN(OptionalStringView, OptionalStringView_create(parser->sb.view));
 }
 
-ErrorOrStringView deserialize_tag(XMLDeserializer *deserializer)
+ErrorOrStringView parse_tag(XMLParser *parser)
 {
-    ss_reset(&deserializer->ss);
-    for (int ch = ss_peek(&deserializer->ss); isalnum(ch) || ch == '.' || ch == '-' || ch == ':' || ch == '_'; ch = ss_peek(&deserializer->ss)) {
-        ss_skip_one(&deserializer->ss);
+    ss_reset(&parser->ss);
+    for (int ch = ss_peek(&parser->ss); isalnum(ch) || ch == '.' || ch == '-' || ch == ':' || ch == '_'; ch = ss_peek(&parser->ss)) {
+        ss_skip_one(&parser->ss);
     }
-    StringView ret = ss_read_from_mark(&deserializer->ss);
+    StringView ret = ss_read_from_mark(&parser->ss);
     if (sv_empty(ret)) {
-        ERROR(StringView, XMLError, deserializer->ss.point.line, "Expected tag name");
+        ERROR(StringView, XMLError, parser->ss.point.line, "Expected tag name");
     }
-    trace(XML, "deserialize_tag(): %.*s", SV_ARG(ret));
+    trace(XML, "parse_tag(): %.*s", SV_ARG(ret));
     RETURN(StringView, ret);
 }
 
-ErrorOrStringView deserialize_attr_value(XMLDeserializer *deserializer)
+ErrorOrStringView parse_attr_value(XMLParser *parser)
 {
-    StringScanner *ss = &deserializer->ss;
+    StringScanner *ss = &parser->ss;
     if (!ss_is_one_of(ss, "\"'")) {
-        ERROR(StringView, XMLError, deserializer->ss.point.line, "Expected opening quote");
+        ERROR(StringView, XMLError, parser->ss.point.line, "Expected opening quote");
     }
     StringView close = (StringView) ss_peek_sv(ss, 1);
-    ;
     ss_skip_one(ss);
-    OptionalStringView ret_maybe = TRY_TO(OptionalStringView, StringView, deserialize_text(deserializer, close));
+    OptionalStringView ret_maybe = TRY_TO(OptionalStringView, StringView, parse_text(parser, close));
     if (!ret_maybe.has_value) {
-        ERROR(StringView, XMLError, deserializer->ss.point.line, "No attribute value");
+        ERROR(StringView, XMLError, parser->ss.point.line, "No attribute value");
     }
-    trace(XML, "deserialize_attr_value(): %.*s", SV_ARG(ret_maybe.value));
+    trace(XML, "parse_attr_value(): %.*s", SV_ARG(ret_maybe.value));
     RETURN(StringView, ret_maybe.value);
 }
 
-ErrorOrOptionalXMLNode deserialize_processing_instruction(XMLDeserializer *deserializer, XMLNode parent)
+ErrorOrInt parse_attribute(XMLParser *parser)
 {
-    trace(XML, "Decoding pi");
-    ss_skip_whitespace(&deserializer->ss);
-    StringView tag = TRY_TO(StringView, OptionalXMLNode, deserialize_tag(deserializer));
-    XMLNode    result = xml_processing_instruction(parent, tag);
-    ss_skip_whitespace(&deserializer->ss);
-    while (ss_peek(&deserializer->ss) != '?') {
-        StringView attr = TRY_TO(StringView, OptionalXMLNode, deserialize_tag(deserializer));
-        ss_skip_whitespace(&deserializer->ss);
-        while (ss_peek(&deserializer->ss) != '=') {
-            ERROR(OptionalXMLNode, XMLError, deserializer->ss.point.line, "Expected =");
-        }
-        ss_skip_one(&deserializer->ss);
-        ss_skip_whitespace(&deserializer->ss);
-        StringView value = TRY_TO(StringView, OptionalXMLNode, deserialize_attr_value(deserializer));
-        result = xml_set_attribute(result, attr, value);
-        ss_skip_whitespace(&deserializer->ss);
+    StringScanner *ss = &parser->ss;
+    StringView     attr = TRY_TO(StringView, Int, parse_tag(parser));
+    ss_skip_whitespace(ss);
+    if (!ss_expect(ss, '=')) {
+        ERROR(Int, XMLError, parser->ss.point.line, "Expected =");
     }
-    ss_skip_one(&deserializer->ss);
-    if (!ss_expect(&deserializer->ss, '>')) {
-        ERROR(OptionalXMLNode, XMLError, deserializer->ss.point.line, "Processing instruction not closed by '?>'");
+    ss_skip_whitespace(ss);
+    StringView value = TRY_TO(StringView, Int, parse_attr_value(parser));
+    if (parser->handler->attribute) {
+        TRY(Int, parser->handler->attribute(parser->handler->ctx, attr, value));
     }
-    trace(XML, "PI '%.*s' deserialized", SV_ARG(tag));
-    RETURN(OptionalXMLNode, OptionalXMLNode_create(result));
+    ss_skip_whitespace(ss);
+    RETURN(Int, 0);
 }
 
-ErrorOrOptionalXMLNode deserialize_element(XMLDeserializer *deserializer, XMLNode parent)
+ErrorOrInt parse_processing_instruction(XMLParser *parser)
 {
-    trace(XML, "Decoding element");
-    StringScanner *ss = &deserializer->ss;
+    trace(XML, "Parsing pi");
+    StringScanner *ss = &parser->ss;
     ss_skip_whitespace(ss);
-    StringView tag = TRY_TO(StringView, OptionalXMLNode, deserialize_tag(deserializer));
-    XMLNode    result = xml_element(parent, tag);
-
+    StringView tag = TRY_TO(StringView, Int, parse_tag(parser));
+    if (parser->handler->processing_instruction) {
+        TRY(Int, parser->handler->processing_instruction(parser->handler->ctx, tag));
+    }
     ss_skip_whitespace(ss);
-    while (!ss_expect_one_of(ss, "/>")) {
-        StringView attr = TRY_TO(StringView, OptionalXMLNode, deserialize_tag(deserializer));
-        ss_skip_whitespace(ss);
-        while (ss_peek(ss) != '=') {
-            ERROR(OptionalXMLNode, XMLError, deserializer->ss.point.line, "Expected =");
+    while (ss_peek(ss) != '?') {
+        if (ss_peek(ss) == 0) {
+            ERROR(Int, XMLError, parser->ss.point.line, "Processing instruction not closed by '?>'");
         }
-        ss_skip_one(ss);
-        ss_skip_whitespace(ss);
-        StringView value = TRY_TO(StringView, OptionalXMLNode, deserialize_attr_value(deserializer));
-        xml_set_attribute(result, attr, value);
-        ss_skip_whitespace(ss);
+        TRY(Int, parse_attribute(parser));
+    }
+    ss_skip_one(ss);
+    if (!ss_expect(ss, '>')) {
+        ERROR(Int, XMLError, parser->ss.point.line, "Processing instruction not closed by '?>'");
+    }
+    ss_skip_whitespace(ss);
+    trace(XML, "PI '%.*s' parsed", SV_ARG(tag));
+    RETURN(Int, 0);
+}
+
+// Parses an opening tag and its attributes. The tag is pushed on the tag
+// stack, unless the element is closed by '/>'.
+ErrorOrInt parse_element(XMLParser *parser)
+{
+    trace(XML, "Parsing element");
+    StringScanner *ss = &parser->ss;
+    ss_skip_whitespace(ss);
+    StringView tag = TRY_TO(StringView, Int, parse_tag(parser));
+    if (parser->handler->start_element) {
+        TRY(Int, parser->handler->start_element(parser->handler->ctx, tag));
     }
-    ss_pushback(ss);
-    if (!ss_expect_sv(ss, sv_from("/>"))) {
-        assert(ss_expect(ss, '>'));
-        while (!ss_expect_sv(ss, sv_from("</"))) {
-            TRY(OptionalXMLNode, deserialize_node(deserializer, result));
+    ss_skip_whitespace(ss);
+    while (!ss_is_one_of(ss, "/>")) {
+        if (ss_peek(ss) == 0) {
+            ERROR(Int, XMLError, parser->ss.point.line, "Unterminated tag '%.*s'", SV_ARG(tag));
         }
+        TRY(Int, parse_attribute(parser));
     }
-    if (!ss_expect_sv(ss, tag)) {
-        ERROR(OptionalXMLNode, XMLError, deserializer->ss.point.line, "Expected '</%.s'>", SV_ARG(tag));
+    if (ss_expect_sv(ss, sv_from("/>"))) {
+        if (parser->handler->end_element) {
+            TRY(Int, parser->handler->end_element(parser->handler->ctx, tag));
+        }
+        ss_skip_whitespace(ss);
+        trace(XML, "Element '%.*s' parsed", SV_ARG(tag));
+        RETURN(Int, 0);
     }
     if (!ss_expect(ss, '>')) {
-        ERROR(OptionalXMLNode, XMLError, deserializer->ss.point.line, "Expected >");
+        ERROR(Int, XMLError, parser->ss.point.line, "Expected >");
     }
-    ss_skip_whitespace(&deserializer->ss);
-    trace(XML, "Element '%.*s' [%zu] [%zu] deserialized", SV_ARG(tag), xml_attribute_count(result), xml_child_count(result));
-    RETURN(OptionalXMLNode, OptionalXMLNode_create(result));
+    da_append_StringView(&parser->tags, tag);
+    RETURN(Int, 0);
 }
 
-ErrorOrOptionalXMLNode deserialize_node(XMLDeserializer *deserializer, XMLNode parent)
+ErrorOrInt parse_close_tag(XMLParser *parser)
 {
-    OptionalXMLNode ret = { 0 };
+    StringScanner *ss = &parser->ss;
+    StringView     tag = TRY_TO(StringView, Int, parse_tag(parser));
+    if (parser->tags.size == 0) {
+        ERROR(Int, XMLError, parser->ss.point.line, "Unexpected '</%.*s>'", SV_ARG(tag));
+    }
+    StringView open = parser->tags.strings[parser->tags.size - 1];
+    if (!sv_eq(tag, open)) {
+        ERROR(Int, XMLError, parser->ss.point.line, "Expected '</%.*s>'", SV_ARG(open));
+    }
+    if (!ss_expect(ss, '>')) {
+        ERROR(Int, XMLError, parser->ss.point.line, "Expected >");
+    }
+    --parser->tags.size;
+    if (parser->handler->end_element) {
+        TRY(Int, parser->handler->end_element(parser->handler->ctx, tag));
+    }
+    ss_skip_whitespace(ss);
+    trace(XML, "Element '%.*s' parsed", SV_ARG(tag));
+    RETURN(Int, 0);
+}
 
-    if (xml_node_type(parent) == XML_TYPE_ELEMENT) {
-        StringView debug = xml_debug(parent);
-        trace(XML, "deserialize_node(%zu, %.*s)", deserializer->ss.point.line, SV_ARG(debug));
-        sv_free(debug);
-    } else {
-        trace(XML, "deserialize_node(%zu, [%zu] %.*s)", deserializer->ss.point.line, parent.index, SV_ARG(xml_to_string(parent)));
-    }
-    // ss_skip_whitespace(&deserializer->ss);
-    switch (ss_peek(&deserializer->ss)) {
-    case 0:
-        ERROR(OptionalXMLNode, XMLError, deserializer->ss.point.line, "Expected node");
-    case '<': {
-        trace(XML, "Found '<'");
-        ss_skip_one(&deserializer->ss);
-        if (ss_peek(&deserializer->ss) == '?') {
-            trace(XML, "Found '<?'");
-            ss_skip_one(&deserializer->ss);
-            ret = TRY(OptionalXMLNode, deserialize_processing_instruction(deserializer, parent));
-            break;
+// Parses iteratively: the open elements are kept on the tag stack, so
+// the only memory used besides the text is the stack and one buffer for
+// text and attribute values.
+ErrorOrInt parse_document(XMLParser *parser)
+{
+    StringScanner *ss = &parser->ss;
+    ss_skip_whitespace(ss);
+    while (ss_peek(ss)) {
+        trace(XML, "parse_document(%zu, depth %zu)", ss->point.line, parser->tags.size);
+        if (ss_expect_sv(ss, sv_from("</"))) {
+            TRY(Int, parse_close_tag(parser));
+            continue;
         }
-        ret = TRY(OptionalXMLNode, deserialize_element(deserializer, parent));
-        break;
-    }
-    default: {
-        trace(XML, "Decoding text");
-        OptionalStringView txt_maybe = TRY_TO(OptionalStringView, OptionalXMLNode, deserialize_text(deserializer, sv_from("</")));
-        if (txt_maybe.has_value) {
-            ss_pushback(&deserializer->ss);
-            ss_pushback(&deserializer->ss);
-            ret = OptionalXMLNode_create(xml_text(parent, txt_maybe.value));
-        } else {
+        if (ss_expect(ss, '<')) {
+            if (ss_expect(ss, '?')) {
+                TRY(Int, parse_processing_instruction(parser));
+            } else {
+                TRY(Int, parse_element(parser));
+            }
+            continue;
+        }
+        // Text runs up to and including the '</' of the closing tag of
+        // the element it's in. Whitespace before another tag is skipped.
+        OptionalStringView txt_maybe = TRY_TO(OptionalStringView, Int, parse_text(parser, sv_from("</")));
+        if (!txt_maybe.has_value) {
             trace(XML, "Whitespace preceding element");
+            continue;
         }
-        break;
+        if (parser->tags.size == 0) {
+            ERROR(Int, XMLError, parser->ss.point.line, "Text outside of element");
+        }
+        if (parser->handler->text) {
+            TRY(Int, parser->handler->text(parser->handler->ctx, txt_maybe.value));
+        }
+        TRY(Int, parse_close_tag(parser));
     }
+    if (parser->tags.size > 0) {
+        StringView open = parser->tags.strings[parser->tags.size - 1];
+        ERROR(Int, XMLError, parser->ss.point.line, "Element '%.*s' not closed", SV_ARG(open));
     }
-    RETURN(OptionalXMLNode, ret);
+    RETURN(Int, 0);
 }
 
-ErrorOrXMLNode xml_deserialize(StringView xml)
+ErrorOrInt xml_parse(StringView xml, XMLHandler *handler)
 {
-    XMLDeserializer deserializer = { .sb = sb_create(), .ss = ss_create(xml) };
+    XMLParser parser = { .sb = sb_create(), .ss = ss_create(xml), .handler = handler };
+    ErrorOrInt ret = parse_document(&parser);
+    sv_free(parser.sb.view);
+    da_free_StringView(&parser.tags);
+    return ret;
+}
 
-    XMLNode doc = xml_document();
-    ss_skip_whitespace(&deserializer.ss);
-    while (ss_peek(&deserializer.ss)) {
-        OptionalXMLNode node = TRY_TO(OptionalXMLNode, XMLNode, deserialize_node(&deserializer, doc));
-        if (!node.has_value) {
-            trace(XML, "Deserialized NULL");
-            continue;
-        }
-        trace(XML, "Deserialized node '%.*s'", SV_ARG(xml_to_string(node.value)));
+static ErrorOrInt build_processing_instruction(XMLBuilder *builder, StringView tag)
+{
+    if (xml_node_type(builder->current) != XML_TYPE_DOCUMENT) {
+        ERROR(Int, XMLError, 0, "Processing instruction '%.*s' inside element", SV_ARG(tag));
+    }
+    builder->last = xml_processing_instruction(builder->current, tag);
+    RETURN(Int, 0);
+}
+
+static ErrorOrInt build_start_element(XMLBuilder *builder, StringView tag)
+{
+    builder->current = xml_element(builder->current, tag);
+    builder->last = builder->current;
+    RETURN(Int, 0);
+}
+
+static ErrorOrInt build_attribute(XMLBuilder *builder, StringView name, StringView value)
+{
+    xml_set_attribute(builder->last, name, value);
+    RETURN(Int, 0);
+}
+
+static ErrorOrInt build_text(XMLBuilder *builder, StringView text)
+{
+    xml_text(builder->current, text);
+    RETURN(Int, 0);
+}
+
+static ErrorOrInt build_end_element(XMLBuilder *builder, StringView tag)
+{
+    builder->current = (XMLNode) { builder->current.store, xml_impl(builder->current)->parent };
+    RETURN(Int, 0);
+}
+
+ErrorOrXMLNode xml_deserialize(StringView xml)
+{
+    XMLNode    doc = xml_document();
+    XMLBuilder builder = { .current = doc, .last = doc };
+    XMLHandler handler = {
+        .ctx = &builder,
+        .processing_instruction = (XMLTagHandler) build_processing_instruction,
+        .start_element = (XMLTagHandler) build_start_element,
+        .attribute = (XMLAttributeHandler) build_attribute,
+        .text = (XMLTextHandler) build_text,
+        .end_element = (XMLTagHandler) build_end_element,
+    };
+    ErrorOrInt ret = xml_parse(xml, &handler);
+    if (ErrorOrInt_is_error(ret)) {
+        xml_free(doc);
+        return ErrorOrXMLNode_copy(ret.error);
     }
-    sv_free(deserializer.sb.view);
     RETURN(XMLNode, doc);
 }
 
@@ -722,3 +881,168 @@ int main(int argc, char **argv)
 }
 
 #endif
+
+#ifdef XML_TEST
+
+#include <time.h>
+
+typedef struct {
+    size_t elements;
+    size_t attributes;
+    size_t texts;
+    size_t depth;
+    size_t max_depth;
+} XMLCounts;
+
+static ErrorOrInt count_start(XMLCounts *counts, StringView tag)
+{
+    ++counts->elements;
+    if (++counts->depth > counts->max_depth) {
+        counts->max_depth = counts->depth;
+    }
+    RETURN(Int, 0);
+}
+
+static ErrorOrInt count_attribute(XMLCounts *counts, StringView name, StringView value)
+{
+    ++counts->attributes;
+    RETURN(Int, 0);
+}
+
+static ErrorOrInt count_text(XMLCounts *counts, StringView text)
+{
+    ++counts->texts;
+    RETURN(Int, 0);
+}
+
+static ErrorOrInt count_end(XMLCounts *counts, StringView tag)
+{
+    --counts->depth;
+    RETURN(Int, 0);
+}
+
+static ErrorOrInt count_parse(StringView xml, XMLCounts *counts)
+{
+    XMLHandler handler = {
+        .ctx = counts,
+        .start_element = (XMLTagHandler) count_start,
+        .attribute = (XMLAttributeHandler) count_attribute,
+        .text = (XMLTextHandler) count_text,
+        .end_element = (XMLTagHandler) count_end,
+    };
+    return xml_parse(xml, &handler);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+int main()
+{
+    log_init();
+    StringView text = sv_from(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<testsuites name=\"all\">\n"
+        "  <testsuite name=\"a\" tests=\"2\">\n"
+        "    <testcase name=\"a1\"/>\n"
+        "    <testcase name=\"a2\"><failure message=\"x &lt; y\">boom &amp; bust</failure></testcase>\n"
+        "  </testsuite>\n"
+        "  <properties/>\n"
+        "  <testsuite name=\"b\" tests=\"1\">\n"
+        "    <testcase name=\"b1\"/>\n"
+        "  </testsuite>\n"
+        "</testsuites>\n");
+
+    XMLCounts counts = { 0 };
+    MUST(Int, count_parse(text, &counts));
+    assert(counts.elements == 8);
+    assert(counts.attributes == 11);
+    assert(counts.texts == 1);
+    assert(counts.depth == 0 && counts.max_depth == 4);
+
+    XMLNode doc = MUST(XMLNode, xml_deserialize(text));
+    XMLNode root = MUST_OPTIONAL(XMLNode, xml_first_child_by_tag(doc, sv_from("testsuites")));
+    assert(xml_child_count(root) == 3);
+    assert(xml_child_count_by_tag(root, sv_from("testsuite")) == 2);
+    assert(xml_child_count_by_tag(root, sv_from("testcase")) == 0);
+    assert(!xml_first_child_by_tag(root, sv_from("testcase")).has_value);
+
+    XMLNodes suites = xml_children_by_tag(root, sv_from("testsuite"));
+    assert(suites.size == 2);
+    size_t ix = 0;
+    for (OptionalXMLNode suite = xml_first_child_by_tag(root, sv_from("testsuite")); suite.has_value; suite = xml_next_sibling_by_tag(suite.value)) {
+        assert(ix < suites.size && suites.elements[ix].index == suite.value.index);
+        ++ix;
+    }
+    assert(ix == 2);
+    da_free_XMLNode(&suites);
+
+    XMLNode suite_a = MUST_OPTIONAL(XMLNode, xml_first_child_by_tag(root, sv_from("testsuite")));
+    assert(xml_child_count_by_tag(suite_a, sv_from("testcase")) == 2);
+    XMLNode a2 = MUST_OPTIONAL(XMLNode, xml_next_sibling_by_tag(MUST_OPTIONAL(XMLNode, xml_first_child_by_tag(suite_a, sv_from("testcase")))));
+    XMLNode failure = MUST_OPTIONAL(XMLNode, xml_first_child_by_tag(a2, sv_from("failure")));
+    assert(sv_eq_cstr(MUST_OPTIONAL(StringView, xml_text_of(failure)), "boom & bust"));
+    XMLNode message = MUST_OPTIONAL(XMLNode, xml_attribute_by_tag(failure, sv_from("message")));
+    assert(sv_eq_cstr(MUST_OPTIONAL(StringView, xml_text_of(message)), "x < y"));
+
+    // Round trip through the serializer.
+    StringView serialized = xml_serialize(doc);
+    XMLCounts  counts2 = { 0 };
+    MUST(Int, count_parse(serialized, &counts2));
+    assert(counts2.elements == counts.elements && counts2.attributes == counts.attributes && counts2.texts == counts.texts);
+    sv_free(serialized);
+    xml_free(doc);
+
+    char const *invalid[] = {
+        "<a>",
+        "<a></b>",
+        "</a>",
+        "<a><b></a></b>",
+        "<a x=1/>",
+        "<a x=\"1\"",
+        "<a>text<b/></a>",
+        "text</a>",
+    };
+    for (size_t iix = 0; iix < sizeof(invalid) / sizeof(invalid[0]); ++iix) {
+        XMLCounts c = { 0 };
+        assert(ErrorOrInt_is_error(count_parse(sv_from(invalid[iix]), &c)));
+    }
+    assert(ErrorOrXMLNode_is_error(xml_deserialize(sv_from("<a><?pi?></a>"))));
+
+    StringBuilder big = sb_create();
+    sb_append_cstr(&big, "<?xml version=\"1.0\"?>\n<project>\n");
+    for (size_t iix = 0; iix < 100000; ++iix) {
+        sb_printf(&big, "  <item id=\"%zu\" kind=\"%s\"><name>item %zu</name></item>\n", iix, (iix % 2) ? "odd" : "even", iix);
+    }
+    sb_append_cstr(&big, "</project>\n");
+
+    double    start = now();
+    XMLCounts big_counts = { 0 };
+    MUST(Int, count_parse(big.view, &big_counts));
+    double parse_time = now() - start;
+    assert(big_counts.elements == 200001);
+
+    start = now();
+    XMLNode big_doc = MUST(XMLNode, xml_deserialize(big.view));
+    double  tree_time = now() - start;
+    XMLNode project = MUST_OPTIONAL(XMLNode, xml_first_child_by_tag(big_doc, sv_from("project")));
+    start = now();
+    size_t found = 0;
+    for (size_t round = 0; round < 100; ++round) {
+        for (OptionalXMLNode item = xml_first_child_by_tag(project, sv_from("item")); item.has_value; item = xml_next_sibling_by_tag(item.value)) {
+            ++found;
+        }
+    }
+    double lookup_time = now() - start;
+    assert(found == 100 * 100000);
+    xml_free(big_doc);
+    printf("%zu bytes: xml_parse %.2f MB/s, xml_deserialize %.2f MB/s, %.1f ns per child by tag\n",
+        big.view.length, big.view.length / parse_time / 1e6, big.view.length / tree_time / 1e6, lookup_time / found * 1e9);
+    sv_free(big.view);
+    return 0;
+}
+
+#endif /* XML_TEST */
@@ -34,6 +34,7 @@ typedef struct {
             StringView tag;
             Sizes      attributes;
             Sizes      children;
+            size_t     next_by_tag; // Next sibling element with the same tag, 0 if none
         } element;
         struct {
             StringView tag;
@@ -55,9 +56,16 @@ typedef struct {
 
 DA_WITH_NAME(XMLNodeImpl, XMLNodeImpls);
 
+/*
+ * A document's nodes, the arena holding their tags and text, and the index
+ * from (parent, tag) to the first, last and number of child elements with
+ * that tag.
+ */
+typedef struct xml_store XMLStore;
+
 typedef struct {
-    XMLNodeImpls *registry;
-    size_t        index;
+    XMLStore *store;
+    size_t    index;
 } XMLNode;
 
 DA_WITH_NAME(XMLNode, XMLNodes);
@@ -65,6 +73,26 @@ OPTIONAL(XMLNode)
 ERROR_OR(XMLNode)
 ERROR_OR(OptionalXMLNode)
 
+typedef ErrorOrInt (*XMLTagHandler)(void *ctx, StringView tag);
+typedef ErrorOrInt (*XMLAttributeHandler)(void *ctx, StringView name, StringView value);
+typedef ErrorOrInt (*XMLTextHandler)(void *ctx, StringView text);
+
+/*
+ * Callbacks for xml_parse; any of them can be NULL. Tags are views into the
+ * parsed text. Attribute values and text have their escapes resolved and
+ * are only valid during the callback. Attributes are reported right after
+ * the start_element or processing_instruction they belong to. An error
+ * returned by a callback aborts the parse.
+ */
+typedef struct {
+    void               *ctx;
+    XMLTagHandler       processing_instruction;
+    XMLTagHandler       start_element;
+    XMLAttributeHandler attribute;
+    XMLTextHandler      text;
+    XMLTagHandler       end_element;
+} XMLHandler;
+
 extern char const        *XMLType_name(XMLType type);
 extern StringView         xml_to_string(XMLNode node);
 extern StringView         xml_debug(XMLNode node);
@@ -81,7 +109,9 @@ extern XMLType            xml_node_type(XMLNode node);
 extern size_t             xml_child_count(XMLNode node);
 extern XMLNode            xml_child(XMLNode node, size_t ix);
 extern XMLNodes           xml_children_by_tag(XMLNode node, StringView tag);
+extern size_t             xml_child_count_by_tag(XMLNode node, StringView tag);
 extern OptionalXMLNode    xml_first_child_by_tag(XMLNode node, StringView tag);
+extern OptionalXMLNode    xml_next_sibling_by_tag(XMLNode node);
 extern size_t             xml_attribute_count(XMLNode node);
 extern XMLNode            xml_attribute(XMLNode node, size_t ix);
 extern OptionalXMLNode    xml_attribute_by_tag(XMLNode node, StringView tag);
@@ -89,5 +119,6 @@ extern StringView         xml_tag(XMLNode node);
 extern OptionalStringView xml_text_of(XMLNode node);
 extern StringView         xml_serialize(XMLNode node);
 extern ErrorOrXMLNode     xml_deserialize(StringView xml_text);
+extern ErrorOrInt         xml_parse(StringView xml_text, XMLHandler *handler);
 
 #endif /* __BASE_XML_H__ */
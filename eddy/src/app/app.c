@@ -197,7 +197,7 @@ void handle_characters(App *app, Widget *w)
 
 void app_submit(App *app, void *target, StringView command, JSONValue args)
 {
-    mutex_lock(app->commands_mutex);
+    mutex_lock(&app->commands_mutex);
     trace(EDIT, "app_submit: Pushing command '%.*s' for widget of class '%s'", SV_ARG(command), ((Widget *) target)->classname);
     da_append_PendingCommand(
         &app->pending_commands,
@@ -206,15 +206,15 @@ void app_submit(App *app, void *target, StringView command, JSONValue args)
             .command = sv_copy(command),
             .arguments = args,
         });
-    mutex_unlock(app->commands_mutex);
+    mutex_unlock(&app->commands_mutex);
 }
 
 void app_process_input(App *app)
 {
     if (app->pending_commands.size > 0) {
-        mutex_lock(app->commands_mutex);
+        mutex_lock(&app->commands_mutex);
         PendingCommand pending = da_pop_front_PendingCommand(&app->pending_commands);
-        mutex_unlock(app->commands_mutex);
+        mutex_unlock(&app->commands_mutex);
         trace(EDIT, "app_process_input: Popped command '%.*s' for widget of class '%s'", SV_ARG(pending.command), pending.target->classname);
         widget_command_execute(pending.target, pending.command, pending.arguments);
         sv_free(pending.command);
@@ -215,6 +215,25 @@ StringView buffer_sv_from_ref(Buffer *buffer, StringRef ref)
     return (StringView) { buffer->undo_buffer.view.ptr + ref.index, ref.length };
 }
 
+// The line views point into the text, which may move when an edit grows
+// it. Until the next buffer_build_indices the offsets are those of the
+// previous version, so the views are clamped to the current text.
+static void buffer_rebase_lines(Buffer *buffer)
+{
+    if (buffer->lines.size == 0 || buffer->lines.elements[0].line.ptr == buffer->text.view.ptr) {
+        return;
+    }
+    size_t length = buffer->text.view.length;
+    for (size_t ix = 0; ix < buffer->lines.size; ++ix) {
+        Index *line = buffer->lines.elements + ix;
+        size_t index_of = (line->index_of < length) ? line->index_of : length;
+        line->line.ptr = buffer->text.view.ptr + index_of;
+        if (line->line.length > length - index_of) {
+            line->line.length = length - index_of;
+        }
+    }
+}
+
 void buffer_apply(Buffer *buffer, BufferEvent event)
 {
     switch (event.type) {
@@ -247,13 +266,8 @@ void buffer_apply(Buffer *buffer, BufferEvent event)
         }
         event.range.start = buffer_index_to_position(buffer, event.position);
         event.range.end = buffer_index_to_position(buffer, event.position + event.replace.overwritten.length);
-        sb_remove(&buffer->text, event.position, event.replace.overwritten.length);
         StringView sv = buffer_sv_from_ref(buffer, event.replace.replacement);
-        if (event.position < buffer->text.view.length) {
-            sb_insert_sv(&buffer->text, sv, event.position);
-        } else {
-            sb_append_sv(&buffer->text, sv);
-        }
+        sb_splice(&buffer->text, event.position, event.replace.overwritten.length, sv.ptr, sv.length);
         ++buffer->version;
     } break;
     case ETSave: {
@@ -294,6 +308,7 @@ void buffer_apply(Buffer *buffer, BufferEvent event)
     default:
         break;
     }
+    buffer_rebase_lines(buffer);
     for (BufferEventListenerList *list_entry = buffer->listeners; list_entry != NULL; list_entry = list_entry->next) {
         list_entry->listener(buffer, event);
     }
@@ -504,17 +519,18 @@ void lsp_semantic_tokens(Buffer *buffer)
     MUST(Int, lsp_message(&buffer->mode->lsp, buffer, "textDocument/semanticTokens/full", semantic_tokens_params_json));
 }
 
+// The response arrives as the text of the message, and is decoded with a
+// JSONReader, without building a document.
 void buffer_semantic_tokens_response(Buffer *buffer, JSONValue resp)
 {
-    Response response = response_decode(&resp);
-    if (!response_success(&response)) {
-        return;
-    }
-    if (!response.result.has_value) {
+    JSONReader reader = json_reader(resp.string);
+    if (!json_reader_member(&reader, sv_from("result"))) {
         trace(LSP, "No response to textDocument/semanticTokens/full");
+        json_reader_free(&reader);
         return;
     }
-    OptionalSemanticTokens result_maybe = SemanticTokens_decode(response.result);
+    OptionalSemanticTokens result_maybe = SemanticTokens_read(&reader);
+    json_reader_free(&reader);
     if (!result_maybe.has_value) {
         trace(LSP, "Couldn't decode response to textDocument/semanticTokens/full");
         return;
@@ -579,9 +595,10 @@ void lsp_on_open(Buffer *buffer)
         .uri = buffer_uri(buffer),
         .languageId = sv_from("c"),
         .version = 0,
-        .text = buffer->text.view
     };
     OptionalJSONValue did_open_json = DidOpenTextDocumentParams_encode(did_open);
+    // The text is sent as a view of the buffer, not a copy of it.
+    json_set(json_get_ref(&did_open_json.value, sv_from("textDocument")), "text", json_string_view(buffer->text.view));
     lsp_notification(&buffer->mode->lsp, "textDocument/didOpen", did_open_json);
 }
 
@@ -597,8 +614,8 @@ void lsp_did_save(Buffer *buffer)
     did_save.textDocument = (TextDocumentIdentifier) {
         .uri = buffer_uri(buffer),
     };
-    did_save.text = OptionalStringView_create(buffer->text.view);
     OptionalJSONValue did_save_json = DidSaveTextDocumentParams_encode(did_save);
+    json_set(&did_save_json.value, "text", json_string_view(buffer->text.view));
     lsp_notification(&buffer->mode->lsp, "textDocument/didSave", did_save_json);
 }
 
@@ -278,7 +278,9 @@ static void fill_completions_list(ListBox *listbox, JSONValue resp)
         return;
     }
 
-    OptionalJSONValue result = response.result;
+    // The list box holds on to the items, which would otherwise borrow
+    // their strings from the message.
+    OptionalJSONValue result = OptionalJSONValue_create(json_copy(response.result.value));
     CompletionItems   items = { 0 };
     switch (result.value.type) {
     case JSON_TYPE_NULL:
@@ -290,7 +292,7 @@ static void fill_completions_list(ListBox *listbox, JSONValue resp)
         items = items_maybe.value;
     } break;
     case JSON_TYPE_OBJECT: {
-        OptionalCompletionList completionlist_maybe = CompletionList_decode(response.result);
+        OptionalCompletionList completionlist_maybe = CompletionList_decode(result);
         assert(completionlist_maybe.has_value);
         items = completionlist_maybe.value.items;
     } break;
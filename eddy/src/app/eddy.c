@@ -516,8 +516,14 @@ void eddy_cmd_select_theme(Eddy *e, JSONValue)
 
 void eddy_publish_diagnostics_handler(Eddy *eddy, JSONValue notif)
 {
-    Notification                     notification = notification_decode(&notif);
-    OptionalPublishDiagnosticsParams params_maybe = PublishDiagnosticsParams_decode(notification.params);
+    // The notification arrives as the text of the message. The reader
+    // copies strings, so the diagnostics can be kept with the buffer.
+    JSONReader                       reader = json_reader(notif.string);
+    OptionalPublishDiagnosticsParams params_maybe = { 0 };
+    if (json_reader_member(&reader, sv_from("params"))) {
+        params_maybe = PublishDiagnosticsParams_read(&reader);
+    }
+    json_reader_free(&reader);
     if (!params_maybe.has_value) {
         info("Could not decode textdocument/publishDiagnostics notification");
         return;
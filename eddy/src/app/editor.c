@@ -1050,16 +1050,19 @@ void editor_cmd_find_replace(Editor *editor, JSONValue unused)
 
 MiniBufferChain do_goto(Editor *editor, StringView query)
 {
-    StringList coords = sv_split(query, SV(":", 1));
+    // The last component gets the remainder of the query, so a third one
+    // keeps anything after a second ':' out of the column.
+    StringView coords[3];
+    size_t     num_coords = sv_split_n(query, SV(":", 1), coords, 3);
     int        line = -1;
     int        col = -1;
-    if (coords.size > 0) {
-        IntegerParseResult line_maybe = sv_parse_u32(sv_strip(coords.strings[0]));
+    if (num_coords > 0) {
+        IntegerParseResult line_maybe = sv_parse_u32(sv_strip(coords[0]));
         if (line_maybe.success) {
             line = line_maybe.integer.i32;
-            if (coords.size > 1) {
-                IntegerParseResult col_maybe = sv_parse_u32(sv_strip(coords.strings[1]));
-                if (line_maybe.success) {
+            if (num_coords > 1) {
+                IntegerParseResult col_maybe = sv_parse_u32(sv_strip(coords[1]));
+                if (col_maybe.success) {
                     col = (int) col_maybe.integer.u32;
                 }
             }
@@ -19,12 +19,6 @@ MODE_CLASS_DEF(ScribbleMode, scribble_mode);
 bool message_handler(socket_t conn_fd, HttpRequest request, JSONValue config)
 {
     trace(IPC, "[S] Got %.*s", SV_ARG(request.url));
-    if (sv_eq_cstr(request.url, "/hello")) {
-        HttpResponse response = { 0 };
-        response.status = HTTP_STATUS_HELLO;
-        http_response_send(conn_fd, &response);
-        return false;
-    }
     if (sv_eq_cstr(request.url, "/bootstrap/config")) {
         HttpResponse response = { 0 };
         response.status = HTTP_STATUS_OK;
@@ -84,6 +78,7 @@ void scribble_cmd_execute(ScribbleMode *mode, JSONValue unused)
 
     JSONValue config = json_object();
     json_set(&config, "threaded", json_bool(has_option("threaded")));
+    json_set(&config, "http-ipc", json_bool(has_option("http-ipc")));
     JSONValue stages = json_array();
     JSONValue stage = json_object();
     json_set_cstr(&stage, "name", "parse");
@@ -7,6 +7,8 @@
 #include <ctype.h>
 
 #include <base/json.h>
+#include <base/lexer.h>
+#include <base/threadonce.h>
 #include <template/template.h>
 
 DA_IMPL(Macro);
@@ -30,6 +32,23 @@ static TplKeywordMapping s_keyword_mapping[] = {
 #undef S
 };
 
+static KeywordTrie *s_keyword_trie = NULL;
+static KeywordTrie *s_operator_trie = NULL;
+
+THREAD_ONCE(s_tries_once);
+
+static void build_tries()
+{
+    s_keyword_trie = keyword_trie_create();
+    for (int ix = 0; ix < TKWCount; ++ix) {
+        keyword_trie_add(s_keyword_trie, sv_from(s_keyword_mapping[ix].string), ix);
+    }
+    s_operator_trie = keyword_trie_create();
+    for (int ix = 0; ix < TOCount; ++ix) {
+        keyword_trie_add(s_operator_trie, sv_from(s_operator_mapping[ix].string), ix);
+    }
+}
+
 #define IS_IDENTIFIER_START(ch) (isalpha(ch) || ch == '$' || ch == '_')
 #define IS_IDENTIFIER_CHAR(ch) (isalpha(ch) || isdigit(ch) || ch == '$' || ch == '_')
 
@@ -111,6 +130,7 @@ ErrorOrTplToken template_lexer_peek(TemplateParserContext *ctx)
         RETURN(TplToken, ctx->token);
     }
 
+    ONCE(s_tries_once, build_tries);
     StringScanner *ss = &ctx->ss;
     int            ch = ss_peek(ss);
     size_t         current_index = ctx->sb.length;
@@ -184,21 +204,11 @@ ErrorOrTplToken template_lexer_peek(TemplateParserContext *ctx)
             }
             break;
         default: {
-            int        matched = -1;
-            StringView matched_kw = { 0 };
-            StringView s = ss_peek_tail(ss);
-            for (int ix = 0; ix < TKWCount; ++ix) {
-                StringView kw = sv_from(s_keyword_mapping[ix].string);
-                if (sv_startswith(s, kw)) {
-                    if (matched < 0 || sv_length(kw) > sv_length(matched_kw)) {
-                        matched = ix;
-                        matched_kw = kw;
-                    }
-                }
-            }
+            size_t matched_length = 0;
+            int    matched = keyword_trie_match_prefix(s_keyword_trie, ss_peek_tail(ss), &matched_length);
             token.type = TTTKeyword;
             if (matched >= 0) {
-                ss_skip(ss, matched_kw.length);
+                ss_skip(ss, matched_length);
                 token.keyword = matched;
             } else {
                 token.keyword = TKWClose;
@@ -206,20 +216,10 @@ ErrorOrTplToken template_lexer_peek(TemplateParserContext *ctx)
         } break;
         }
     } else {
-        int        matched = -1;
-        StringView matched_op = { 0 };
-        StringView s = ss_peek_tail(ss);
-        for (int ix = 0; ix < TOCount; ++ix) {
-            StringView op = sv_from(s_operator_mapping[ix].string);
-            if (sv_startswith(s, op)) {
-                if (matched < 0 || sv_length(op) > sv_length(matched_op)) {
-                    matched = ix;
-                    matched_op = op;
-                }
-            }
-        }
+        size_t matched_length = 0;
+        int    matched = keyword_trie_match_prefix(s_operator_trie, ss_peek_tail(ss), &matched_length);
         if (matched >= 0) {
-            ss_skip(ss, matched_op.length);
+            ss_skip(ss, matched_length);
             token.type = TTTOperator;
             token.op = matched;
         } else {
@@ -31,6 +31,7 @@ JSONValue notification_encode(Notification *notification)
     return ret;
 }
 
+// The params of the returned notification are borrowed from json.
 Notification notification_decode(JSONValue *json)
 {
     Notification ret = { 0 };
@@ -40,7 +41,7 @@ Notification notification_decode(JSONValue *json)
     ret.method = sv_copy(mth.string);
     OptionalJSONValue params = json_get(json, "params");
     if (params.has_value) {
-        ret.params = OptionalJSONValue_create(json_copy(params.value));
+        ret.params = params;
     }
     return ret;
 }
@@ -49,10 +50,7 @@ void notification_free(Notification *notification)
 {
     sv_free(notification->method);
     notification->method = sv_null();
-    if (notification->params.has_value) {
-        json_free(notification->params.value);
-        notification->params = (OptionalJSONValue) { 0 };
-    }
+    notification->params = (OptionalJSONValue) { 0 };
 }
 
 JSONValue request_encode(Request *request)
@@ -87,6 +85,7 @@ bool response_error(Response *response)
     return response->error.has_value;
 }
 
+// The result or error of the returned response are borrowed from json.
 Response response_decode(JSONValue *json)
 {
     Response ret = { 0 };
@@ -96,11 +95,11 @@ Response response_decode(JSONValue *json)
     ret.id = json_int_value(id);
     OptionalJSONValue result = json_get(json, "result");
     if (result.has_value) {
-        ret.result = OptionalJSONValue_create(json_copy(result.value));
+        ret.result = result;
     }
     OptionalJSONValue error = json_get(json, "error");
     if (error.has_value) {
-        ret.error = OptionalJSONValue_create(json_copy(error.value));
+        ret.error = error;
     }
     assert(response_success(&ret) ^ response_error(&ret));
     return ret;
@@ -124,6 +123,21 @@ void trace_json(OptionalJSONValue json, char const *msg, ...)
     sv_free(s);
 }
 
+static ErrorOrSize lsp_writev(void *context, struct iovec const *iov, int iovcnt)
+{
+    return write_pipe_writev((WritePipe *) context, iov, iovcnt);
+}
+
+// Streams the message to the server, header and all, straight from the
+// JSON value, instead of encoding it into a string first.
+static ErrorOrInt lsp_send(LSP *lsp, JSONValue message)
+{
+    char header[64];
+    int  header_len = snprintf(header, sizeof(header), "Content-Length: %zu\r\n\r\n", json_encoded_length(message));
+    TRY_TO(Size, Int, json_write(message, (StringView) { header, header_len }, lsp_writev, &lsp->lsp->in));
+    RETURN(Int, 0);
+}
+
 ErrorOrInt lsp_message(LSP *lsp, void *sender, char const *method, OptionalJSONValue params)
 {
     static int id = 1;
@@ -148,19 +162,12 @@ ErrorOrInt lsp_message(LSP *lsp, void *sender, char const *method, OptionalJSONV
     assert(lsp->lsp);
     JSONValue json = request_encode(&req);
     trace(LSP, "==> %s (%d)", method, req.id);
-    StringView request_json = json_encode(json);
-    StringView req_content_length = sv_printf("Content-Length: %zu\r\n\r\n", request_json.length + 2);
-    TRY_TO(Size, Int, write_pipe_write(&lsp->lsp->in, req_content_length));
-    sv_free(req_content_length);
-    TRY_TO(Size, Int, write_pipe_write(&lsp->lsp->in, request_json));
-    TRY_TO(Size, Int, write_pipe_write(&lsp->lsp->in, sv_from("\r\n")));
-    sv_free(request_json);
-    RETURN(Int, 0);
+    return lsp_send(lsp, json);
 }
 
 void handle_initialize_response(LSP *lsp, Widget *, JSONValue response_json)
 {
-    condition_acquire(lsp->init_condition);
+    condition_acquire(&lsp->init_condition);
     Response response = response_decode(&response_json);
     if (response_success(&response)) {
         InitializeResult result = MUST_OPTIONAL(InitializeResult, InitializeResult_decode(response.result));
@@ -177,7 +184,63 @@ void handle_initialize_response(LSP *lsp, Widget *, JSONValue response_json)
     }
     MUST(Int, lsp_notification(lsp, "initialized", OptionalJSONValue_create(json_object())));
     lsp->lsp_ready = true;
-    condition_broadcast(lsp->init_condition);
+    condition_broadcast(&lsp->init_condition);
+}
+
+// Semantic tokens and diagnostics can run into megabytes. Their handlers
+// decode them with a JSONReader straight from the text, so these messages
+// are submitted as text, without building a document first. Returns true
+// if message was one of them.
+//
+// Responses are routed by their id, and everything else carries a method.
+// Servers send both in front of the payload, and the reader only indexes
+// as far as it has read, so the peek stops at the first of the two and
+// leaves indexing the rest of the message to whoever decodes it.
+static bool lsp_submit_text(LSP *lsp, StringView message)
+{
+    JSONReader reader = json_reader(message);
+    int        id = -1;
+    StringView method = sv_null();
+    if (json_reader_expect(&reader, JSON_EVENT_BEGIN_OBJECT)) {
+        while (id < 0 && sv_empty(method) && json_reader_next(&reader) == JSON_EVENT_KEY) {
+            bool is_id = sv_eq_cstr(reader.key, "id");
+            bool is_method = sv_eq_cstr(reader.key, "method");
+            if (!is_id && !is_method) {
+                json_reader_skip(&reader);
+                continue;
+            }
+            if (!json_reader_expect(&reader, JSON_EVENT_VALUE)) {
+                continue;
+            }
+            if (is_id && reader.value.type == JSON_TYPE_INT) {
+                id = json_int_value(reader.value);
+            }
+            if (is_method && reader.value.type == JSON_TYPE_STRING) {
+                method = reader.value.string;
+            }
+        }
+    }
+    void *sender = app;
+    if (id >= 0) {
+        method = sv_null();
+        for (size_t ix = 0; ix < lsp->request_queue.size; ++ix) {
+            Request *req = lsp->request_queue.elements + ix;
+            if (req->id == id) {
+                sender = req->sender;
+                method = req->method;
+                break;
+            }
+        }
+    }
+    bool ret = sv_eq_cstr(method, "textDocument/semanticTokens/full") || sv_eq_cstr(method, "textDocument/publishDiagnostics");
+    if (ret) {
+        trace(LSP, "<== %.*s (%zu bytes)", SV_ARG(method), message.length);
+        StringView cmd = sv_printf("lsp-%.*s", SV_ARG(method));
+        app_submit(app, sender, cmd, json_string(message));
+        sv_free(cmd);
+    }
+    json_reader_free(&reader);
+    return ret;
 }
 
 void lsp_read(ReadPipe *pipe)
@@ -209,7 +272,10 @@ void lsp_read(ReadPipe *pipe)
                 ss_rewind(&lsp->lsp_scanner);
                 return;
             }
-            ErrorOrJSONValue ret_maybe = json_decode(response_json);
+            if (lsp_submit_text(lsp, response_json)) {
+                goto defer_0;
+            }
+            ErrorOrJSONValue ret_maybe = json_decode_arena(response_json);
             if (ErrorOrJSONValue_is_error(ret_maybe)) {
                 info("ERROR Parsing incoming JSON: %s", Error_to_string(ret_maybe.error));
                 trace(LSP, "****** <== %.*s", SV_ARG(response_json));
@@ -260,13 +326,11 @@ ErrorOrInt lsp_notification(LSP *lsp, char const *method, OptionalJSONValue para
     Notification notification = { sv_from(method), OptionalJSONValue_empty() };
     notification.params = params;
     assert(lsp->lsp);
-    StringView  json = json_encode(notification_encode(&notification));
-    char const *content_length = TextFormat("Content-Length: %zu\r\n\r\n", json.length + 2);
-    TRY_TO(Size, Int, write_pipe_write(&lsp->lsp->in, sv_from(content_length)));
-    TRY_TO(Size, Int, write_pipe_write(&lsp->lsp->in, json));
-    TRY_TO(Size, Int, write_pipe_write(&lsp->lsp->in, sv_from("\r\n")));
+    JSONValue  json = notification_encode(&notification);
+    ErrorOrInt ret = lsp_send(lsp, json);
+    json_free(json);
     trace(LSP, "==| %s", method);
-    RETURN(Int, 0);
+    return ret;
 }
 
 void lsp_initialize_theme_internal(LSP *lsp)
@@ -291,21 +355,23 @@ void lsp_initialize_theme(LSP *lsp)
     lsp_initialize_theme_internal(lsp);
 }
 
+// init_condition is zero-initialized with the LSP and needs no setup.
 void lsp_initialize(LSP *lsp)
 {
-    lsp->init_condition = condition_create();
     if (lsp->lsp_ready) {
         return;
     }
-    condition_acquire(lsp->init_condition);
+    condition_acquire(&lsp->init_condition);
     if (lsp->lsp_ready) {
-        condition_release(lsp->init_condition);
+        condition_release(&lsp->init_condition);
         assert(lsp->lsp_ready);
         return;
     }
     if (lsp->lsp != NULL) {
-        condition_sleep(lsp->init_condition);
-        assert(lsp->lsp_ready);
+        while (!lsp->lsp_ready) {
+            condition_sleep(&lsp->init_condition);
+        }
+        condition_release(&lsp->init_condition);
         return;
     }
     trace(LSP, "Initializing LSP");
@@ -348,5 +414,8 @@ void lsp_initialize(LSP *lsp)
 
     OptionalJSONValue params_json = InitializeParams_encode(params);
     MUST(Int, lsp_message(lsp, &eddy, "initialize", params_json));
-    condition_sleep(lsp->init_condition);
+    while (!lsp->lsp_ready) {
+        condition_sleep(&lsp->init_condition);
+    }
+    condition_release(&lsp->init_condition);
 }
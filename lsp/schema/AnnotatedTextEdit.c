@@ -30,6 +30,7 @@ OptionalAnnotatedTextEdits AnnotatedTextEdits_decode(OptionalJSONValue json)
         OptionalJSONValue         elem = json_at(&json.value, ix);
         OptionalAnnotatedTextEdit val = AnnotatedTextEdit_decode(elem);
         if (!val.has_value) {
+            da_free_AnnotatedTextEdit(&ret);
             RETURN_EMPTY(AnnotatedTextEdits);
         }
         da_append_AnnotatedTextEdit(&ret, val.value);
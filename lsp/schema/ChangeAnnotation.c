@@ -30,6 +30,7 @@ OptionalChangeAnnotations ChangeAnnotations_decode(OptionalJSONValue json)
         OptionalJSONValue        elem = json_at(&json.value, ix);
         OptionalChangeAnnotation val = ChangeAnnotation_decode(elem);
         if (!val.has_value) {
+            da_free_ChangeAnnotation(&ret);
             RETURN_EMPTY(ChangeAnnotations);
         }
         da_append_ChangeAnnotation(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalClientCapabilitiess ClientCapabilitiess_decode(OptionalJSONValue json)
         OptionalJSONValue          elem = json_at(&json.value, ix);
         OptionalClientCapabilities val = ClientCapabilities_decode(elem);
         if (!val.has_value) {
+            da_free_ClientCapabilities(&ret);
             RETURN_EMPTY(ClientCapabilitiess);
         }
         da_append_ClientCapabilities(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalCodeDescriptions CodeDescriptions_decode(OptionalJSONValue json)
         OptionalJSONValue       elem = json_at(&json.value, ix);
         OptionalCodeDescription val = CodeDescription_decode(elem);
         if (!val.has_value) {
+            da_free_CodeDescription(&ret);
             RETURN_EMPTY(CodeDescriptions);
         }
         da_append_CodeDescription(&ret, val.value);
@@ -37,6 +38,28 @@ OptionalCodeDescriptions CodeDescriptions_decode(OptionalJSONValue json)
     RETURN_VALUE(CodeDescriptions, ret);
 }
 
+OptionalCodeDescriptions CodeDescriptions_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(CodeDescriptions);
+    }
+    CodeDescriptions ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalCodeDescription val = CodeDescription_read(reader);
+        if (!val.has_value) {
+            da_free_CodeDescription(&ret);
+            json_reader_leave(reader);
+            RETURN_EMPTY(CodeDescriptions);
+        }
+        da_append_CodeDescription(&ret, val.value);
+    }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        da_free_CodeDescription(&ret);
+        RETURN_EMPTY(CodeDescriptions);
+    }
+    RETURN_VALUE(CodeDescriptions, ret);
+}
+
 OptionalCodeDescription CodeDescription_decode(OptionalJSONValue json)
 {
     if (!json.has_value || json.value.type != JSON_TYPE_OBJECT) {
@@ -50,6 +73,36 @@ OptionalCodeDescription CodeDescription_decode(OptionalJSONValue json)
     RETURN_VALUE(CodeDescription, value);
 }
 
+static OptionalCodeDescription CodeDescription_read_value(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_OBJECT)) {
+        RETURN_EMPTY(CodeDescription);
+    }
+    CodeDescription value = { 0 };
+    bool            has_href = false;
+    while (json_reader_next(reader) == JSON_EVENT_KEY) {
+        if (sv_eq_cstr(reader->key, "href")) {
+            value.href = FORWARD_OPTIONAL(URI, CodeDescription, URI_read(reader));
+            has_href = true;
+        } else {
+            json_reader_skip(reader);
+        }
+    }
+    if (reader->event != JSON_EVENT_END_OBJECT || !has_href) {
+        RETURN_EMPTY(CodeDescription);
+    }
+    RETURN_VALUE(CodeDescription, value);
+}
+
+// Reads the whole value, even if it can't be decoded.
+OptionalCodeDescription CodeDescription_read(JSONReader *reader)
+{
+    size_t                  depth = json_reader_depth(reader);
+    OptionalCodeDescription ret = CodeDescription_read_value(reader);
+    json_reader_unwind(reader, depth);
+    return ret;
+}
+
 OptionalJSONValue CodeDescription_encode(CodeDescription value)
 {
     JSONValue v1 = json_object();
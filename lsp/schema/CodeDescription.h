@@ -25,5 +25,7 @@ extern OptionalJSONValue        CodeDescription_encode(CodeDescription value);
 extern OptionalCodeDescription  CodeDescription_decode(OptionalJSONValue json);
 extern OptionalJSONValue        CodeDescriptions_encode(CodeDescriptions value);
 extern OptionalCodeDescriptions CodeDescriptions_decode(OptionalJSONValue json);
+extern OptionalCodeDescription  CodeDescription_read(JSONReader *reader);
+extern OptionalCodeDescriptions CodeDescriptions_read(JSONReader *reader);
 
 #endif /* __LSP_CODEDESCRIPTION_H__ */
@@ -30,6 +30,7 @@ OptionalCommands Commands_decode(OptionalJSONValue json)
         OptionalJSONValue elem = json_at(&json.value, ix);
         OptionalCommand   val = Command_decode(elem);
         if (!val.has_value) {
+            da_free_Command(&ret);
             RETURN_EMPTY(Commands);
         }
         da_append_Command(&ret, val.value);
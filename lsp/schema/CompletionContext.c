@@ -30,6 +30,7 @@ OptionalCompletionContexts CompletionContexts_decode(OptionalJSONValue json)
         OptionalJSONValue         elem = json_at(&json.value, ix);
         OptionalCompletionContext val = CompletionContext_decode(elem);
         if (!val.has_value) {
+            da_free_CompletionContext(&ret);
             RETURN_EMPTY(CompletionContexts);
         }
         da_append_CompletionContext(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalCompletionItems CompletionItems_decode(OptionalJSONValue json)
         OptionalJSONValue      elem = json_at(&json.value, ix);
         OptionalCompletionItem val = CompletionItem_decode(elem);
         if (!val.has_value) {
+            da_free_CompletionItem(&ret);
             RETURN_EMPTY(CompletionItems);
         }
         da_append_CompletionItem(&ret, val.value);
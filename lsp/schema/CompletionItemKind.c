@@ -30,6 +30,7 @@ OptionalCompletionItemKinds CompletionItemKinds_decode(OptionalJSONValue json)
         OptionalJSONValue          elem = json_at(&json.value, ix);
         OptionalCompletionItemKind val = CompletionItemKind_decode(elem);
         if (!val.has_value) {
+            da_free_CompletionItemKind(&ret);
             RETURN_EMPTY(CompletionItemKinds);
         }
         da_append_CompletionItemKind(&ret, val.value);
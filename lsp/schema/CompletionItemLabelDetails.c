@@ -30,6 +30,7 @@ OptionalCompletionItemLabelDetailss CompletionItemLabelDetailss_decode(OptionalJ
         OptionalJSONValue                  elem = json_at(&json.value, ix);
         OptionalCompletionItemLabelDetails val = CompletionItemLabelDetails_decode(elem);
         if (!val.has_value) {
+            da_free_CompletionItemLabelDetails(&ret);
             RETURN_EMPTY(CompletionItemLabelDetailss);
         }
         da_append_CompletionItemLabelDetails(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalCompletionItemTags CompletionItemTags_decode(OptionalJSONValue json)
         OptionalJSONValue         elem = json_at(&json.value, ix);
         OptionalCompletionItemTag val = CompletionItemTag_decode(elem);
         if (!val.has_value) {
+            da_free_CompletionItemTag(&ret);
             RETURN_EMPTY(CompletionItemTags);
         }
         da_append_CompletionItemTag(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalCompletionLists CompletionLists_decode(OptionalJSONValue json)
         OptionalJSONValue      elem = json_at(&json.value, ix);
         OptionalCompletionList val = CompletionList_decode(elem);
         if (!val.has_value) {
+            da_free_CompletionList(&ret);
             RETURN_EMPTY(CompletionLists);
         }
         da_append_CompletionList(&ret, val.value);
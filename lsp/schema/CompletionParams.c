@@ -30,6 +30,7 @@ OptionalCompletionParamss CompletionParamss_decode(OptionalJSONValue json)
         OptionalJSONValue        elem = json_at(&json.value, ix);
         OptionalCompletionParams val = CompletionParams_decode(elem);
         if (!val.has_value) {
+            da_free_CompletionParams(&ret);
             RETURN_EMPTY(CompletionParamss);
         }
         da_append_CompletionParams(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalCompletionTriggerKinds CompletionTriggerKinds_decode(OptionalJSONValue j
         OptionalJSONValue             elem = json_at(&json.value, ix);
         OptionalCompletionTriggerKind val = CompletionTriggerKind_decode(elem);
         if (!val.has_value) {
+            da_free_CompletionTriggerKind(&ret);
             RETURN_EMPTY(CompletionTriggerKinds);
         }
         da_append_CompletionTriggerKind(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalDiagnostics Diagnostics_decode(OptionalJSONValue json)
         OptionalJSONValue  elem = json_at(&json.value, ix);
         OptionalDiagnostic val = Diagnostic_decode(elem);
         if (!val.has_value) {
+            da_free_Diagnostic(&ret);
             RETURN_EMPTY(Diagnostics);
         }
         da_append_Diagnostic(&ret, val.value);
@@ -37,6 +38,28 @@ OptionalDiagnostics Diagnostics_decode(OptionalJSONValue json)
     RETURN_VALUE(Diagnostics, ret);
 }
 
+OptionalDiagnostics Diagnostics_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(Diagnostics);
+    }
+    Diagnostics ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalDiagnostic val = Diagnostic_read(reader);
+        if (!val.has_value) {
+            da_free_Diagnostic(&ret);
+            json_reader_leave(reader);
+            RETURN_EMPTY(Diagnostics);
+        }
+        da_append_Diagnostic(&ret, val.value);
+    }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        da_free_Diagnostic(&ret);
+        RETURN_EMPTY(Diagnostics);
+    }
+    RETURN_VALUE(Diagnostics, ret);
+}
+
 OptionalDiagnostic Diagnostic_decode(OptionalJSONValue json)
 {
     if (!json.has_value || json.value.type != JSON_TYPE_OBJECT) {
@@ -103,6 +126,76 @@ OptionalDiagnostic Diagnostic_decode(OptionalJSONValue json)
     RETURN_VALUE(Diagnostic, value);
 }
 
+static OptionalDiagnostic Diagnostic_read_value(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_OBJECT)) {
+        RETURN_EMPTY(Diagnostic);
+    }
+    Diagnostic value = { 0 };
+    bool       has_range = false;
+    bool       has_message = false;
+    while (json_reader_next(reader) == JSON_EVENT_KEY) {
+        if (sv_eq_cstr(reader->key, "range")) {
+            value.range = FORWARD_OPTIONAL(Range, Diagnostic, Range_read(reader));
+            has_range = true;
+        } else if (sv_eq_cstr(reader->key, "severity")) {
+            value.severity = DiagnosticSeverity_read(reader);
+        } else if (sv_eq_cstr(reader->key, "code")) {
+            OptionalJSONValue v0 = json_reader_decode(reader);
+            if (v0.has_value) {
+                value.code.has_value = true;
+                while (true) {
+                    {
+                        OptionalInt decoded = Int_decode(v0);
+                        if (decoded.has_value) {
+                            value.code.tag = 0;
+                            value.code._0 = decoded.value;
+                            break;
+                        }
+                    }
+                    {
+                        OptionalStringView decoded = StringView_decode(v0);
+                        if (decoded.has_value) {
+                            value.code.tag = 1;
+                            value.code._1 = decoded.value;
+                            break;
+                        }
+                    }
+                    RETURN_EMPTY(Diagnostic);
+                }
+            }
+        } else if (sv_eq_cstr(reader->key, "codeDescription")) {
+            value.codeDescription = CodeDescription_read(reader);
+        } else if (sv_eq_cstr(reader->key, "source")) {
+            value.source = StringView_read(reader);
+        } else if (sv_eq_cstr(reader->key, "message")) {
+            value.message = FORWARD_OPTIONAL(StringView, Diagnostic, StringView_read(reader));
+            has_message = true;
+        } else if (sv_eq_cstr(reader->key, "tags")) {
+            value.tags = DiagnosticTags_read(reader);
+        } else if (sv_eq_cstr(reader->key, "relatedInformation")) {
+            value.relatedInformation = DiagnosticRelatedInformations_read(reader);
+        } else if (sv_eq_cstr(reader->key, "data")) {
+            value.data = JSONValue_read(reader);
+        } else {
+            json_reader_skip(reader);
+        }
+    }
+    if (reader->event != JSON_EVENT_END_OBJECT || !has_range || !has_message) {
+        RETURN_EMPTY(Diagnostic);
+    }
+    RETURN_VALUE(Diagnostic, value);
+}
+
+// Reads the whole value, even if it can't be decoded.
+OptionalDiagnostic Diagnostic_read(JSONReader *reader)
+{
+    size_t             depth = json_reader_depth(reader);
+    OptionalDiagnostic ret = Diagnostic_read_value(reader);
+    json_reader_unwind(reader, depth);
+    return ret;
+}
+
 OptionalJSONValue Diagnostic_encode(Diagnostic value)
 {
     JSONValue v1 = json_object();
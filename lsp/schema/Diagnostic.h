@@ -44,5 +44,7 @@ extern OptionalJSONValue   Diagnostic_encode(Diagnostic value);
 extern OptionalDiagnostic  Diagnostic_decode(OptionalJSONValue json);
 extern OptionalJSONValue   Diagnostics_encode(Diagnostics value);
 extern OptionalDiagnostics Diagnostics_decode(OptionalJSONValue json);
+extern OptionalDiagnostic  Diagnostic_read(JSONReader *reader);
+extern OptionalDiagnostics Diagnostics_read(JSONReader *reader);
 
 #endif /* __LSP_DIAGNOSTIC_H__ */
@@ -30,6 +30,7 @@ OptionalDiagnosticRelatedInformations DiagnosticRelatedInformations_decode(Optio
         OptionalJSONValue                    elem = json_at(&json.value, ix);
         OptionalDiagnosticRelatedInformation val = DiagnosticRelatedInformation_decode(elem);
         if (!val.has_value) {
+            da_free_DiagnosticRelatedInformation(&ret);
             RETURN_EMPTY(DiagnosticRelatedInformations);
         }
         da_append_DiagnosticRelatedInformation(&ret, val.value);
@@ -37,6 +38,28 @@ OptionalDiagnosticRelatedInformations DiagnosticRelatedInformations_decode(Optio
     RETURN_VALUE(DiagnosticRelatedInformations, ret);
 }
 
+OptionalDiagnosticRelatedInformations DiagnosticRelatedInformations_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(DiagnosticRelatedInformations);
+    }
+    DiagnosticRelatedInformations ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalDiagnosticRelatedInformation val = DiagnosticRelatedInformation_read(reader);
+        if (!val.has_value) {
+            da_free_DiagnosticRelatedInformation(&ret);
+            json_reader_leave(reader);
+            RETURN_EMPTY(DiagnosticRelatedInformations);
+        }
+        da_append_DiagnosticRelatedInformation(&ret, val.value);
+    }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        da_free_DiagnosticRelatedInformation(&ret);
+        RETURN_EMPTY(DiagnosticRelatedInformations);
+    }
+    RETURN_VALUE(DiagnosticRelatedInformations, ret);
+}
+
 OptionalDiagnosticRelatedInformation DiagnosticRelatedInformation_decode(OptionalJSONValue json)
 {
     if (!json.has_value || json.value.type != JSON_TYPE_OBJECT) {
@@ -54,6 +77,40 @@ OptionalDiagnosticRelatedInformation DiagnosticRelatedInformation_decode(Optiona
     RETURN_VALUE(DiagnosticRelatedInformation, value);
 }
 
+static OptionalDiagnosticRelatedInformation DiagnosticRelatedInformation_read_value(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_OBJECT)) {
+        RETURN_EMPTY(DiagnosticRelatedInformation);
+    }
+    DiagnosticRelatedInformation value = { 0 };
+    bool                         has_location = false;
+    bool                         has_message = false;
+    while (json_reader_next(reader) == JSON_EVENT_KEY) {
+        if (sv_eq_cstr(reader->key, "location")) {
+            value.location = FORWARD_OPTIONAL(Location, DiagnosticRelatedInformation, Location_read(reader));
+            has_location = true;
+        } else if (sv_eq_cstr(reader->key, "message")) {
+            value.message = FORWARD_OPTIONAL(StringView, DiagnosticRelatedInformation, StringView_read(reader));
+            has_message = true;
+        } else {
+            json_reader_skip(reader);
+        }
+    }
+    if (reader->event != JSON_EVENT_END_OBJECT || !has_location || !has_message) {
+        RETURN_EMPTY(DiagnosticRelatedInformation);
+    }
+    RETURN_VALUE(DiagnosticRelatedInformation, value);
+}
+
+// Reads the whole value, even if it can't be decoded.
+OptionalDiagnosticRelatedInformation DiagnosticRelatedInformation_read(JSONReader *reader)
+{
+    size_t                               depth = json_reader_depth(reader);
+    OptionalDiagnosticRelatedInformation ret = DiagnosticRelatedInformation_read_value(reader);
+    json_reader_unwind(reader, depth);
+    return ret;
+}
+
 OptionalJSONValue DiagnosticRelatedInformation_encode(DiagnosticRelatedInformation value)
 {
     JSONValue v1 = json_object();
@@ -26,5 +26,7 @@ extern OptionalJSONValue                     DiagnosticRelatedInformation_encode
 extern OptionalDiagnosticRelatedInformation  DiagnosticRelatedInformation_decode(OptionalJSONValue json);
 extern OptionalJSONValue                     DiagnosticRelatedInformations_encode(DiagnosticRelatedInformations value);
 extern OptionalDiagnosticRelatedInformations DiagnosticRelatedInformations_decode(OptionalJSONValue json);
+extern OptionalDiagnosticRelatedInformation  DiagnosticRelatedInformation_read(JSONReader *reader);
+extern OptionalDiagnosticRelatedInformations DiagnosticRelatedInformations_read(JSONReader *reader);
 
 #endif /* __LSP_DIAGNOSTICRELATEDINFORMATION_H__ */
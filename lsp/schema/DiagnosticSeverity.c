@@ -30,6 +30,7 @@ OptionalDiagnosticSeveritys DiagnosticSeveritys_decode(OptionalJSONValue json)
         OptionalJSONValue          elem = json_at(&json.value, ix);
         OptionalDiagnosticSeverity val = DiagnosticSeverity_decode(elem);
         if (!val.has_value) {
+            da_free_DiagnosticSeverity(&ret);
             RETURN_EMPTY(DiagnosticSeveritys);
         }
         da_append_DiagnosticSeverity(&ret, val.value);
@@ -37,6 +38,28 @@ OptionalDiagnosticSeveritys DiagnosticSeveritys_decode(OptionalJSONValue json)
     RETURN_VALUE(DiagnosticSeveritys, ret);
 }
 
+OptionalDiagnosticSeveritys DiagnosticSeveritys_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(DiagnosticSeveritys);
+    }
+    DiagnosticSeveritys ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalDiagnosticSeverity val = DiagnosticSeverity_read(reader);
+        if (!val.has_value) {
+            da_free_DiagnosticSeverity(&ret);
+            json_reader_leave(reader);
+            RETURN_EMPTY(DiagnosticSeveritys);
+        }
+        da_append_DiagnosticSeverity(&ret, val.value);
+    }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        da_free_DiagnosticSeverity(&ret);
+        RETURN_EMPTY(DiagnosticSeveritys);
+    }
+    RETURN_VALUE(DiagnosticSeveritys, ret);
+}
+
 OptionalDiagnosticSeverity DiagnosticSeverity_decode(OptionalJSONValue json)
 {
     if (!json.has_value) {
@@ -54,6 +77,23 @@ OptionalDiagnosticSeverity DiagnosticSeverity_decode(OptionalJSONValue json)
     RETURN_EMPTY(DiagnosticSeverity);
 }
 
+static OptionalDiagnosticSeverity DiagnosticSeverity_read_value(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_VALUE)) {
+        RETURN_EMPTY(DiagnosticSeverity);
+    }
+    return DiagnosticSeverity_decode(OptionalJSONValue_create(reader->value));
+}
+
+// Reads the whole value, even if it can't be decoded.
+OptionalDiagnosticSeverity DiagnosticSeverity_read(JSONReader *reader)
+{
+    size_t                     depth = json_reader_depth(reader);
+    OptionalDiagnosticSeverity ret = DiagnosticSeverity_read_value(reader);
+    json_reader_unwind(reader, depth);
+    return ret;
+}
+
 OptionalJSONValue DiagnosticSeverity_encode(DiagnosticSeverity value)
 {
     RETURN_VALUE(JSONValue, json_int(value));
@@ -26,4 +26,6 @@ extern OptionalJSONValue           DiagnosticSeverity_encode(DiagnosticSeverity
 extern OptionalDiagnosticSeverity  DiagnosticSeverity_decode(OptionalJSONValue json);
 extern OptionalJSONValue           DiagnosticSeveritys_encode(DiagnosticSeveritys value);
 extern OptionalDiagnosticSeveritys DiagnosticSeveritys_decode(OptionalJSONValue json);
+extern OptionalDiagnosticSeverity  DiagnosticSeverity_read(JSONReader *reader);
+extern OptionalDiagnosticSeveritys DiagnosticSeveritys_read(JSONReader *reader);
 #endif /* __LSP_DIAGNOSTICSEVERITY_H__ */
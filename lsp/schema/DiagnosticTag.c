@@ -30,6 +30,7 @@ OptionalDiagnosticTags DiagnosticTags_decode(OptionalJSONValue json)
         OptionalJSONValue     elem = json_at(&json.value, ix);
         OptionalDiagnosticTag val = DiagnosticTag_decode(elem);
         if (!val.has_value) {
+            da_free_DiagnosticTag(&ret);
             RETURN_EMPTY(DiagnosticTags);
         }
         da_append_DiagnosticTag(&ret, val.value);
@@ -37,6 +38,28 @@ OptionalDiagnosticTags DiagnosticTags_decode(OptionalJSONValue json)
     RETURN_VALUE(DiagnosticTags, ret);
 }
 
+OptionalDiagnosticTags DiagnosticTags_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(DiagnosticTags);
+    }
+    DiagnosticTags ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalDiagnosticTag val = DiagnosticTag_read(reader);
+        if (!val.has_value) {
+            da_free_DiagnosticTag(&ret);
+            json_reader_leave(reader);
+            RETURN_EMPTY(DiagnosticTags);
+        }
+        da_append_DiagnosticTag(&ret, val.value);
+    }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        da_free_DiagnosticTag(&ret);
+        RETURN_EMPTY(DiagnosticTags);
+    }
+    RETURN_VALUE(DiagnosticTags, ret);
+}
+
 OptionalDiagnosticTag DiagnosticTag_decode(OptionalJSONValue json)
 {
     if (!json.has_value) {
@@ -50,6 +73,23 @@ OptionalDiagnosticTag DiagnosticTag_decode(OptionalJSONValue json)
     RETURN_EMPTY(DiagnosticTag);
 }
 
+static OptionalDiagnosticTag DiagnosticTag_read_value(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_VALUE)) {
+        RETURN_EMPTY(DiagnosticTag);
+    }
+    return DiagnosticTag_decode(OptionalJSONValue_create(reader->value));
+}
+
+// Reads the whole value, even if it can't be decoded.
+OptionalDiagnosticTag DiagnosticTag_read(JSONReader *reader)
+{
+    size_t                depth = json_reader_depth(reader);
+    OptionalDiagnosticTag ret = DiagnosticTag_read_value(reader);
+    json_reader_unwind(reader, depth);
+    return ret;
+}
+
 OptionalJSONValue DiagnosticTag_encode(DiagnosticTag value)
 {
     RETURN_VALUE(JSONValue, json_int(value));
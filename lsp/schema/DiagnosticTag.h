@@ -24,4 +24,6 @@ extern OptionalJSONValue      DiagnosticTag_encode(DiagnosticTag value);
 extern OptionalDiagnosticTag  DiagnosticTag_decode(OptionalJSONValue json);
 extern OptionalJSONValue      DiagnosticTags_encode(DiagnosticTags value);
 extern OptionalDiagnosticTags DiagnosticTags_decode(OptionalJSONValue json);
+extern OptionalDiagnosticTag  DiagnosticTag_read(JSONReader *reader);
+extern OptionalDiagnosticTags DiagnosticTags_read(JSONReader *reader);
 #endif /* __LSP_DIAGNOSTICTAG_H__ */
@@ -30,6 +30,7 @@ OptionalDidChangeTextDocumentParamss DidChangeTextDocumentParamss_decode(Optiona
         OptionalJSONValue                   elem = json_at(&json.value, ix);
         OptionalDidChangeTextDocumentParams val = DidChangeTextDocumentParams_decode(elem);
         if (!val.has_value) {
+            da_free_DidChangeTextDocumentParams(&ret);
             RETURN_EMPTY(DidChangeTextDocumentParamss);
         }
         da_append_DidChangeTextDocumentParams(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalDidCloseTextDocumentParamss DidCloseTextDocumentParamss_decode(OptionalJ
         OptionalJSONValue                  elem = json_at(&json.value, ix);
         OptionalDidCloseTextDocumentParams val = DidCloseTextDocumentParams_decode(elem);
         if (!val.has_value) {
+            da_free_DidCloseTextDocumentParams(&ret);
             RETURN_EMPTY(DidCloseTextDocumentParamss);
         }
         da_append_DidCloseTextDocumentParams(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalDidOpenTextDocumentParamss DidOpenTextDocumentParamss_decode(OptionalJSO
         OptionalJSONValue                 elem = json_at(&json.value, ix);
         OptionalDidOpenTextDocumentParams val = DidOpenTextDocumentParams_decode(elem);
         if (!val.has_value) {
+            da_free_DidOpenTextDocumentParams(&ret);
             RETURN_EMPTY(DidOpenTextDocumentParamss);
         }
         da_append_DidOpenTextDocumentParams(&ret, val.value);
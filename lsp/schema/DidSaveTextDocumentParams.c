@@ -30,6 +30,7 @@ OptionalDidSaveTextDocumentParamss DidSaveTextDocumentParamss_decode(OptionalJSO
         OptionalJSONValue                 elem = json_at(&json.value, ix);
         OptionalDidSaveTextDocumentParams val = DidSaveTextDocumentParams_decode(elem);
         if (!val.has_value) {
+            da_free_DidSaveTextDocumentParams(&ret);
             RETURN_EMPTY(DidSaveTextDocumentParamss);
         }
         da_append_DidSaveTextDocumentParams(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalDocumentFilters DocumentFilters_decode(OptionalJSONValue json)
         OptionalJSONValue      elem = json_at(&json.value, ix);
         OptionalDocumentFilter val = DocumentFilter_decode(elem);
         if (!val.has_value) {
+            da_free_DocumentFilter(&ret);
             RETURN_EMPTY(DocumentFilters);
         }
         da_append_DocumentFilter(&ret, val.value);
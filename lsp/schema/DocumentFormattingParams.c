@@ -30,6 +30,7 @@ OptionalDocumentFormattingParamss DocumentFormattingParamss_decode(OptionalJSONV
         OptionalJSONValue                elem = json_at(&json.value, ix);
         OptionalDocumentFormattingParams val = DocumentFormattingParams_decode(elem);
         if (!val.has_value) {
+            da_free_DocumentFormattingParams(&ret);
             RETURN_EMPTY(DocumentFormattingParamss);
         }
         da_append_DocumentFormattingParams(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalDocumentRangeFormattingParamss DocumentRangeFormattingParamss_decode(Opt
         OptionalJSONValue                     elem = json_at(&json.value, ix);
         OptionalDocumentRangeFormattingParams val = DocumentRangeFormattingParams_decode(elem);
         if (!val.has_value) {
+            da_free_DocumentRangeFormattingParams(&ret);
             RETURN_EMPTY(DocumentRangeFormattingParamss);
         }
         da_append_DocumentRangeFormattingParams(&ret, val.value);
@@ -21,5 +21,7 @@ typedef OptionalStringViews OptionalDocumentUris;
 #define DocumentUri_decode(V) StringView_decode(V)
 #define DocumentUris_encode(V) StringViews_encode(V)
 #define DocumentUris_decode(V) StringViews_decode(V)
+#define DocumentUri_read(R) StringView_read(R)
+#define DocumentUris_read(R) StringViews_read(R)
 
 #endif /* __LSP_DOCUMENTURI_H__ */
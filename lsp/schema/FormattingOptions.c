@@ -30,6 +30,7 @@ OptionalFormattingOptionss FormattingOptionss_decode(OptionalJSONValue json)
         OptionalJSONValue         elem = json_at(&json.value, ix);
         OptionalFormattingOptions val = FormattingOptions_decode(elem);
         if (!val.has_value) {
+            da_free_FormattingOptions(&ret);
             RETURN_EMPTY(FormattingOptionss);
         }
         da_append_FormattingOptions(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalInitializeParamss InitializeParamss_decode(OptionalJSONValue json)
         OptionalJSONValue        elem = json_at(&json.value, ix);
         OptionalInitializeParams val = InitializeParams_decode(elem);
         if (!val.has_value) {
+            da_free_InitializeParams(&ret);
             RETURN_EMPTY(InitializeParamss);
         }
         da_append_InitializeParams(&ret, val.value);
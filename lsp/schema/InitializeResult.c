@@ -30,6 +30,7 @@ OptionalInitializeResults InitializeResults_decode(OptionalJSONValue json)
         OptionalJSONValue        elem = json_at(&json.value, ix);
         OptionalInitializeResult val = InitializeResult_decode(elem);
         if (!val.has_value) {
+            da_free_InitializeResult(&ret);
             RETURN_EMPTY(InitializeResults);
         }
         da_append_InitializeResult(&ret, val.value);
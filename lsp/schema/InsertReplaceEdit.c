@@ -30,6 +30,7 @@ OptionalInsertReplaceEdits InsertReplaceEdits_decode(OptionalJSONValue json)
         OptionalJSONValue         elem = json_at(&json.value, ix);
         OptionalInsertReplaceEdit val = InsertReplaceEdit_decode(elem);
         if (!val.has_value) {
+            da_free_InsertReplaceEdit(&ret);
             RETURN_EMPTY(InsertReplaceEdits);
         }
         da_append_InsertReplaceEdit(&ret, val.value);
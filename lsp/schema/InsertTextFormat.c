@@ -30,6 +30,7 @@ OptionalInsertTextFormats InsertTextFormats_decode(OptionalJSONValue json)
         OptionalJSONValue        elem = json_at(&json.value, ix);
         OptionalInsertTextFormat val = InsertTextFormat_decode(elem);
         if (!val.has_value) {
+            da_free_InsertTextFormat(&ret);
             RETURN_EMPTY(InsertTextFormats);
         }
         da_append_InsertTextFormat(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalInsertTextModes InsertTextModes_decode(OptionalJSONValue json)
         OptionalJSONValue      elem = json_at(&json.value, ix);
         OptionalInsertTextMode val = InsertTextMode_decode(elem);
         if (!val.has_value) {
+            da_free_InsertTextMode(&ret);
             RETURN_EMPTY(InsertTextModes);
         }
         da_append_InsertTextMode(&ret, val.value);
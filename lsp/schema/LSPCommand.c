@@ -30,6 +30,7 @@ OptionalLSPCommands LSPCommands_decode(OptionalJSONValue json)
         OptionalJSONValue  elem = json_at(&json.value, ix);
         OptionalLSPCommand val = LSPCommand_decode(elem);
         if (!val.has_value) {
+            da_free_LSPCommand(&ret);
             RETURN_EMPTY(LSPCommands);
         }
         da_append_LSPCommand(&ret, val.value);
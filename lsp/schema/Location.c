@@ -30,6 +30,7 @@ OptionalLocations Locations_decode(OptionalJSONValue json)
         OptionalJSONValue elem = json_at(&json.value, ix);
         OptionalLocation  val = Location_decode(elem);
         if (!val.has_value) {
+            da_free_Location(&ret);
             RETURN_EMPTY(Locations);
         }
         da_append_Location(&ret, val.value);
@@ -37,6 +38,28 @@ OptionalLocations Locations_decode(OptionalJSONValue json)
     RETURN_VALUE(Locations, ret);
 }
 
+OptionalLocations Locations_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(Locations);
+    }
+    Locations ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalLocation val = Location_read(reader);
+        if (!val.has_value) {
+            da_free_Location(&ret);
+            json_reader_leave(reader);
+            RETURN_EMPTY(Locations);
+        }
+        da_append_Location(&ret, val.value);
+    }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        da_free_Location(&ret);
+        RETURN_EMPTY(Locations);
+    }
+    RETURN_VALUE(Locations, ret);
+}
+
 OptionalLocation Location_decode(OptionalJSONValue json)
 {
     if (!json.has_value || json.value.type != JSON_TYPE_OBJECT) {
@@ -54,6 +77,40 @@ OptionalLocation Location_decode(OptionalJSONValue json)
     RETURN_VALUE(Location, value);
 }
 
+static OptionalLocation Location_read_value(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_OBJECT)) {
+        RETURN_EMPTY(Location);
+    }
+    Location value = { 0 };
+    bool     has_uri = false;
+    bool     has_range = false;
+    while (json_reader_next(reader) == JSON_EVENT_KEY) {
+        if (sv_eq_cstr(reader->key, "uri")) {
+            value.uri = FORWARD_OPTIONAL(DocumentUri, Location, DocumentUri_read(reader));
+            has_uri = true;
+        } else if (sv_eq_cstr(reader->key, "range")) {
+            value.range = FORWARD_OPTIONAL(Range, Location, Range_read(reader));
+            has_range = true;
+        } else {
+            json_reader_skip(reader);
+        }
+    }
+    if (reader->event != JSON_EVENT_END_OBJECT || !has_uri || !has_range) {
+        RETURN_EMPTY(Location);
+    }
+    RETURN_VALUE(Location, value);
+}
+
+// Reads the whole value, even if it can't be decoded.
+OptionalLocation Location_read(JSONReader *reader)
+{
+    size_t           depth = json_reader_depth(reader);
+    OptionalLocation ret = Location_read_value(reader);
+    json_reader_unwind(reader, depth);
+    return ret;
+}
+
 OptionalJSONValue Location_encode(Location value)
 {
     JSONValue v1 = json_object();
@@ -27,5 +27,7 @@ extern OptionalJSONValue Location_encode(Location value);
 extern OptionalLocation  Location_decode(OptionalJSONValue json);
 extern OptionalJSONValue Locations_encode(Locations value);
 extern OptionalLocations Locations_decode(OptionalJSONValue json);
+extern OptionalLocation  Location_read(JSONReader *reader);
+extern OptionalLocations Locations_read(JSONReader *reader);
 
 #endif /* __LSP_LOCATION_H__ */
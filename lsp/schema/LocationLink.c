@@ -30,6 +30,7 @@ OptionalLocationLinks LocationLinks_decode(OptionalJSONValue json)
         OptionalJSONValue    elem = json_at(&json.value, ix);
         OptionalLocationLink val = LocationLink_decode(elem);
         if (!val.has_value) {
+            da_free_LocationLink(&ret);
             RETURN_EMPTY(LocationLinks);
         }
         da_append_LocationLink(&ret, val.value);
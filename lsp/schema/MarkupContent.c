@@ -30,6 +30,7 @@ OptionalMarkupContents MarkupContents_decode(OptionalJSONValue json)
         OptionalJSONValue     elem = json_at(&json.value, ix);
         OptionalMarkupContent val = MarkupContent_decode(elem);
         if (!val.has_value) {
+            da_free_MarkupContent(&ret);
             RETURN_EMPTY(MarkupContents);
         }
         da_append_MarkupContent(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalMarkupKinds MarkupKinds_decode(OptionalJSONValue json)
         OptionalJSONValue  elem = json_at(&json.value, ix);
         OptionalMarkupKind val = MarkupKind_decode(elem);
         if (!val.has_value) {
+            da_free_MarkupKind(&ret);
             RETURN_EMPTY(MarkupKinds);
         }
         da_append_MarkupKind(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalOptionalVersionedTextDocumentIdentifiers OptionalVersionedTextDocumentId
         OptionalJSONValue                               elem = json_at(&json.value, ix);
         OptionalOptionalVersionedTextDocumentIdentifier val = OptionalVersionedTextDocumentIdentifier_decode(elem);
         if (!val.has_value) {
+            da_free_OptionalVersionedTextDocumentIdentifier(&ret);
             RETURN_EMPTY(OptionalVersionedTextDocumentIdentifiers);
         }
         da_append_OptionalVersionedTextDocumentIdentifier(&ret, val.value);
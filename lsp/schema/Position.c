@@ -30,6 +30,7 @@ OptionalPositions Positions_decode(OptionalJSONValue json)
         OptionalJSONValue elem = json_at(&json.value, ix);
         OptionalPosition  val = Position_decode(elem);
         if (!val.has_value) {
+            da_free_Position(&ret);
             RETURN_EMPTY(Positions);
         }
         da_append_Position(&ret, val.value);
@@ -37,6 +38,28 @@ OptionalPositions Positions_decode(OptionalJSONValue json)
     RETURN_VALUE(Positions, ret);
 }
 
+OptionalPositions Positions_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(Positions);
+    }
+    Positions ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalPosition val = Position_read(reader);
+        if (!val.has_value) {
+            da_free_Position(&ret);
+            json_reader_leave(reader);
+            RETURN_EMPTY(Positions);
+        }
+        da_append_Position(&ret, val.value);
+    }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        da_free_Position(&ret);
+        RETURN_EMPTY(Positions);
+    }
+    RETURN_VALUE(Positions, ret);
+}
+
 OptionalPosition Position_decode(OptionalJSONValue json)
 {
     if (!json.has_value || json.value.type != JSON_TYPE_OBJECT) {
@@ -54,6 +77,40 @@ OptionalPosition Position_decode(OptionalJSONValue json)
     RETURN_VALUE(Position, value);
 }
 
+static OptionalPosition Position_read_value(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_OBJECT)) {
+        RETURN_EMPTY(Position);
+    }
+    Position value = { 0 };
+    bool     has_line = false;
+    bool     has_character = false;
+    while (json_reader_next(reader) == JSON_EVENT_KEY) {
+        if (sv_eq_cstr(reader->key, "line")) {
+            value.line = FORWARD_OPTIONAL(UInt32, Position, UInt32_read(reader));
+            has_line = true;
+        } else if (sv_eq_cstr(reader->key, "character")) {
+            value.character = FORWARD_OPTIONAL(UInt32, Position, UInt32_read(reader));
+            has_character = true;
+        } else {
+            json_reader_skip(reader);
+        }
+    }
+    if (reader->event != JSON_EVENT_END_OBJECT || !has_line || !has_character) {
+        RETURN_EMPTY(Position);
+    }
+    RETURN_VALUE(Position, value);
+}
+
+// Reads the whole value, even if it can't be decoded.
+OptionalPosition Position_read(JSONReader *reader)
+{
+    size_t           depth = json_reader_depth(reader);
+    OptionalPosition ret = Position_read_value(reader);
+    json_reader_unwind(reader, depth);
+    return ret;
+}
+
 OptionalJSONValue Position_encode(Position value)
 {
     JSONValue v1 = json_object();
@@ -24,5 +24,7 @@ extern OptionalJSONValue Position_encode(Position value);
 extern OptionalPosition  Position_decode(OptionalJSONValue json);
 extern OptionalJSONValue Positions_encode(Positions value);
 extern OptionalPositions Positions_decode(OptionalJSONValue json);
+extern OptionalPosition  Position_read(JSONReader *reader);
+extern OptionalPositions Positions_read(JSONReader *reader);
 
 #endif /* __LSP_POSITION_H__ */
@@ -30,6 +30,7 @@ OptionalPositionEncodingKinds PositionEncodingKinds_decode(OptionalJSONValue jso
         OptionalJSONValue            elem = json_at(&json.value, ix);
         OptionalPositionEncodingKind val = PositionEncodingKind_decode(elem);
         if (!val.has_value) {
+            da_free_PositionEncodingKind(&ret);
             RETURN_EMPTY(PositionEncodingKinds);
         }
         da_append_PositionEncodingKind(&ret, val.value);
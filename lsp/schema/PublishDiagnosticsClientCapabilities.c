@@ -30,6 +30,7 @@ OptionalPublishDiagnosticsClientCapabilitiess PublishDiagnosticsClientCapabiliti
         OptionalJSONValue                            elem = json_at(&json.value, ix);
         OptionalPublishDiagnosticsClientCapabilities val = PublishDiagnosticsClientCapabilities_decode(elem);
         if (!val.has_value) {
+            da_free_PublishDiagnosticsClientCapabilities(&ret);
             RETURN_EMPTY(PublishDiagnosticsClientCapabilitiess);
         }
         da_append_PublishDiagnosticsClientCapabilities(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalPublishDiagnosticsParamss PublishDiagnosticsParamss_decode(OptionalJSONV
         OptionalJSONValue                elem = json_at(&json.value, ix);
         OptionalPublishDiagnosticsParams val = PublishDiagnosticsParams_decode(elem);
         if (!val.has_value) {
+            da_free_PublishDiagnosticsParams(&ret);
             RETURN_EMPTY(PublishDiagnosticsParamss);
         }
         da_append_PublishDiagnosticsParams(&ret, val.value);
@@ -37,6 +38,28 @@ OptionalPublishDiagnosticsParamss PublishDiagnosticsParamss_decode(OptionalJSONV
     RETURN_VALUE(PublishDiagnosticsParamss, ret);
 }
 
+OptionalPublishDiagnosticsParamss PublishDiagnosticsParamss_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(PublishDiagnosticsParamss);
+    }
+    PublishDiagnosticsParamss ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalPublishDiagnosticsParams val = PublishDiagnosticsParams_read(reader);
+        if (!val.has_value) {
+            da_free_PublishDiagnosticsParams(&ret);
+            json_reader_leave(reader);
+            RETURN_EMPTY(PublishDiagnosticsParamss);
+        }
+        da_append_PublishDiagnosticsParams(&ret, val.value);
+    }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        da_free_PublishDiagnosticsParams(&ret);
+        RETURN_EMPTY(PublishDiagnosticsParamss);
+    }
+    RETURN_VALUE(PublishDiagnosticsParamss, ret);
+}
+
 OptionalPublishDiagnosticsParams PublishDiagnosticsParams_decode(OptionalJSONValue json)
 {
     if (!json.has_value || json.value.type != JSON_TYPE_OBJECT) {
@@ -58,6 +81,42 @@ OptionalPublishDiagnosticsParams PublishDiagnosticsParams_decode(OptionalJSONVal
     RETURN_VALUE(PublishDiagnosticsParams, value);
 }
 
+static OptionalPublishDiagnosticsParams PublishDiagnosticsParams_read_value(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_OBJECT)) {
+        RETURN_EMPTY(PublishDiagnosticsParams);
+    }
+    PublishDiagnosticsParams value = { 0 };
+    bool                     has_uri = false;
+    bool                     has_diagnostics = false;
+    while (json_reader_next(reader) == JSON_EVENT_KEY) {
+        if (sv_eq_cstr(reader->key, "uri")) {
+            value.uri = FORWARD_OPTIONAL(DocumentUri, PublishDiagnosticsParams, DocumentUri_read(reader));
+            has_uri = true;
+        } else if (sv_eq_cstr(reader->key, "version")) {
+            value.version = Int_read(reader);
+        } else if (sv_eq_cstr(reader->key, "diagnostics")) {
+            value.diagnostics = FORWARD_OPTIONAL(Diagnostics, PublishDiagnosticsParams, Diagnostics_read(reader));
+            has_diagnostics = true;
+        } else {
+            json_reader_skip(reader);
+        }
+    }
+    if (reader->event != JSON_EVENT_END_OBJECT || !has_uri || !has_diagnostics) {
+        RETURN_EMPTY(PublishDiagnosticsParams);
+    }
+    RETURN_VALUE(PublishDiagnosticsParams, value);
+}
+
+// Reads the whole value, even if it can't be decoded.
+OptionalPublishDiagnosticsParams PublishDiagnosticsParams_read(JSONReader *reader)
+{
+    size_t                           depth = json_reader_depth(reader);
+    OptionalPublishDiagnosticsParams ret = PublishDiagnosticsParams_read_value(reader);
+    json_reader_unwind(reader, depth);
+    return ret;
+}
+
 OptionalJSONValue PublishDiagnosticsParams_encode(PublishDiagnosticsParams value)
 {
     JSONValue v1 = json_object();
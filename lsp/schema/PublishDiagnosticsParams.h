@@ -28,5 +28,7 @@ extern OptionalJSONValue                 PublishDiagnosticsParams_encode(Publish
 extern OptionalPublishDiagnosticsParams  PublishDiagnosticsParams_decode(OptionalJSONValue json);
 extern OptionalJSONValue                 PublishDiagnosticsParamss_encode(PublishDiagnosticsParamss value);
 extern OptionalPublishDiagnosticsParamss PublishDiagnosticsParamss_decode(OptionalJSONValue json);
+extern OptionalPublishDiagnosticsParams  PublishDiagnosticsParams_read(JSONReader *reader);
+extern OptionalPublishDiagnosticsParamss PublishDiagnosticsParamss_read(JSONReader *reader);
 
 #endif /* __LSP_PUBLISHDIAGNOSTICSPARAMS_H__ */
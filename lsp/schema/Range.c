@@ -30,6 +30,7 @@ OptionalRanges Ranges_decode(OptionalJSONValue json)
         OptionalJSONValue elem = json_at(&json.value, ix);
         OptionalRange     val = Range_decode(elem);
         if (!val.has_value) {
+            da_free_Range(&ret);
             RETURN_EMPTY(Ranges);
         }
         da_append_Range(&ret, val.value);
@@ -37,6 +38,28 @@ OptionalRanges Ranges_decode(OptionalJSONValue json)
     RETURN_VALUE(Ranges, ret);
 }
 
+OptionalRanges Ranges_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(Ranges);
+    }
+    Ranges ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalRange val = Range_read(reader);
+        if (!val.has_value) {
+            da_free_Range(&ret);
+            json_reader_leave(reader);
+            RETURN_EMPTY(Ranges);
+        }
+        da_append_Range(&ret, val.value);
+    }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        da_free_Range(&ret);
+        RETURN_EMPTY(Ranges);
+    }
+    RETURN_VALUE(Ranges, ret);
+}
+
 OptionalRange Range_decode(OptionalJSONValue json)
 {
     if (!json.has_value || json.value.type != JSON_TYPE_OBJECT) {
@@ -54,6 +77,40 @@ OptionalRange Range_decode(OptionalJSONValue json)
     RETURN_VALUE(Range, value);
 }
 
+static OptionalRange Range_read_value(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_OBJECT)) {
+        RETURN_EMPTY(Range);
+    }
+    Range value = { 0 };
+    bool  has_start = false;
+    bool  has_end = false;
+    while (json_reader_next(reader) == JSON_EVENT_KEY) {
+        if (sv_eq_cstr(reader->key, "start")) {
+            value.start = FORWARD_OPTIONAL(Position, Range, Position_read(reader));
+            has_start = true;
+        } else if (sv_eq_cstr(reader->key, "end")) {
+            value.end = FORWARD_OPTIONAL(Position, Range, Position_read(reader));
+            has_end = true;
+        } else {
+            json_reader_skip(reader);
+        }
+    }
+    if (reader->event != JSON_EVENT_END_OBJECT || !has_start || !has_end) {
+        RETURN_EMPTY(Range);
+    }
+    RETURN_VALUE(Range, value);
+}
+
+// Reads the whole value, even if it can't be decoded.
+OptionalRange Range_read(JSONReader *reader)
+{
+    size_t        depth = json_reader_depth(reader);
+    OptionalRange ret = Range_read_value(reader);
+    json_reader_unwind(reader, depth);
+    return ret;
+}
+
 OptionalJSONValue Range_encode(Range value)
 {
     JSONValue v1 = json_object();
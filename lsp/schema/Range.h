@@ -26,5 +26,7 @@ extern OptionalJSONValue Range_encode(Range value);
 extern OptionalRange     Range_decode(OptionalJSONValue json);
 extern OptionalJSONValue Ranges_encode(Ranges value);
 extern OptionalRanges    Ranges_decode(OptionalJSONValue json);
+extern OptionalRange     Range_read(JSONReader *reader);
+extern OptionalRanges    Ranges_read(JSONReader *reader);
 
 #endif /* __LSP_RANGE_H__ */
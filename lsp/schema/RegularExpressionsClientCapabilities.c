@@ -30,6 +30,7 @@ OptionalRegularExpressionsClientCapabilitiess RegularExpressionsClientCapabiliti
         OptionalJSONValue                            elem = json_at(&json.value, ix);
         OptionalRegularExpressionsClientCapabilities val = RegularExpressionsClientCapabilities_decode(elem);
         if (!val.has_value) {
+            da_free_RegularExpressionsClientCapabilities(&ret);
             RETURN_EMPTY(RegularExpressionsClientCapabilitiess);
         }
         da_append_RegularExpressionsClientCapabilities(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalSaveOptionss SaveOptionss_decode(OptionalJSONValue json)
         OptionalJSONValue   elem = json_at(&json.value, ix);
         OptionalSaveOptions val = SaveOptions_decode(elem);
         if (!val.has_value) {
+            da_free_SaveOptions(&ret);
             RETURN_EMPTY(SaveOptionss);
         }
         da_append_SaveOptions(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalSemanticTokenModifierss SemanticTokenModifierss_decode(OptionalJSONValue
         OptionalJSONValue              elem = json_at(&json.value, ix);
         OptionalSemanticTokenModifiers val = SemanticTokenModifiers_decode(elem);
         if (!val.has_value) {
+            da_free_SemanticTokenModifiers(&ret);
             RETURN_EMPTY(SemanticTokenModifierss);
         }
         da_append_SemanticTokenModifiers(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalSemanticTokenTypess SemanticTokenTypess_decode(OptionalJSONValue json)
         OptionalJSONValue          elem = json_at(&json.value, ix);
         OptionalSemanticTokenTypes val = SemanticTokenTypes_decode(elem);
         if (!val.has_value) {
+            da_free_SemanticTokenTypes(&ret);
             RETURN_EMPTY(SemanticTokenTypess);
         }
         da_append_SemanticTokenTypes(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalSemanticTokenss SemanticTokenss_decode(OptionalJSONValue json)
         OptionalJSONValue      elem = json_at(&json.value, ix);
         OptionalSemanticTokens val = SemanticTokens_decode(elem);
         if (!val.has_value) {
+            da_free_SemanticTokens(&ret);
             RETURN_EMPTY(SemanticTokenss);
         }
         da_append_SemanticTokens(&ret, val.value);
@@ -37,6 +38,28 @@ OptionalSemanticTokenss SemanticTokenss_decode(OptionalJSONValue json)
     RETURN_VALUE(SemanticTokenss, ret);
 }
 
+OptionalSemanticTokenss SemanticTokenss_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(SemanticTokenss);
+    }
+    SemanticTokenss ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalSemanticTokens val = SemanticTokens_read(reader);
+        if (!val.has_value) {
+            da_free_SemanticTokens(&ret);
+            json_reader_leave(reader);
+            RETURN_EMPTY(SemanticTokenss);
+        }
+        da_append_SemanticTokens(&ret, val.value);
+    }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        da_free_SemanticTokens(&ret);
+        RETURN_EMPTY(SemanticTokenss);
+    }
+    RETURN_VALUE(SemanticTokenss, ret);
+}
+
 OptionalSemanticTokens SemanticTokens_decode(OptionalJSONValue json)
 {
     if (!json.has_value || json.value.type != JSON_TYPE_OBJECT) {
@@ -54,6 +77,38 @@ OptionalSemanticTokens SemanticTokens_decode(OptionalJSONValue json)
     RETURN_VALUE(SemanticTokens, value);
 }
 
+static OptionalSemanticTokens SemanticTokens_read_value(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_OBJECT)) {
+        RETURN_EMPTY(SemanticTokens);
+    }
+    SemanticTokens value = { 0 };
+    bool           has_data = false;
+    while (json_reader_next(reader) == JSON_EVENT_KEY) {
+        if (sv_eq_cstr(reader->key, "resultId")) {
+            value.resultId = StringView_read(reader);
+        } else if (sv_eq_cstr(reader->key, "data")) {
+            value.data = FORWARD_OPTIONAL(UInt32s, SemanticTokens, UInt32s_read(reader));
+            has_data = true;
+        } else {
+            json_reader_skip(reader);
+        }
+    }
+    if (reader->event != JSON_EVENT_END_OBJECT || !has_data) {
+        RETURN_EMPTY(SemanticTokens);
+    }
+    RETURN_VALUE(SemanticTokens, value);
+}
+
+// Reads the whole value, even if it can't be decoded.
+OptionalSemanticTokens SemanticTokens_read(JSONReader *reader)
+{
+    size_t                 depth = json_reader_depth(reader);
+    OptionalSemanticTokens ret = SemanticTokens_read_value(reader);
+    json_reader_unwind(reader, depth);
+    return ret;
+}
+
 OptionalJSONValue SemanticTokens_encode(SemanticTokens value)
 {
     JSONValue v1 = json_object();
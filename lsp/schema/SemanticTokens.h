@@ -24,5 +24,7 @@ extern OptionalJSONValue       SemanticTokens_encode(SemanticTokens value);
 extern OptionalSemanticTokens  SemanticTokens_decode(OptionalJSONValue json);
 extern OptionalJSONValue       SemanticTokenss_encode(SemanticTokenss value);
 extern OptionalSemanticTokenss SemanticTokenss_decode(OptionalJSONValue json);
+extern OptionalSemanticTokens  SemanticTokens_read(JSONReader *reader);
+extern OptionalSemanticTokenss SemanticTokenss_read(JSONReader *reader);
 
 #endif /* __LSP_SEMANTICTOKENS_H__ */
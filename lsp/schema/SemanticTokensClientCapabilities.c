@@ -30,6 +30,7 @@ OptionalSemanticTokensClientCapabilitiess SemanticTokensClientCapabilitiess_deco
         OptionalJSONValue                        elem = json_at(&json.value, ix);
         OptionalSemanticTokensClientCapabilities val = SemanticTokensClientCapabilities_decode(elem);
         if (!val.has_value) {
+            da_free_SemanticTokensClientCapabilities(&ret);
             RETURN_EMPTY(SemanticTokensClientCapabilitiess);
         }
         da_append_SemanticTokensClientCapabilities(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalSemanticTokensLegends SemanticTokensLegends_decode(OptionalJSONValue jso
         OptionalJSONValue            elem = json_at(&json.value, ix);
         OptionalSemanticTokensLegend val = SemanticTokensLegend_decode(elem);
         if (!val.has_value) {
+            da_free_SemanticTokensLegend(&ret);
             RETURN_EMPTY(SemanticTokensLegends);
         }
         da_append_SemanticTokensLegend(&ret, val.value);
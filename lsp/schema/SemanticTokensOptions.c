@@ -30,6 +30,7 @@ OptionalSemanticTokensOptionss SemanticTokensOptionss_decode(OptionalJSONValue j
         OptionalJSONValue             elem = json_at(&json.value, ix);
         OptionalSemanticTokensOptions val = SemanticTokensOptions_decode(elem);
         if (!val.has_value) {
+            da_free_SemanticTokensOptions(&ret);
             RETURN_EMPTY(SemanticTokensOptionss);
         }
         da_append_SemanticTokensOptions(&ret, val.value);
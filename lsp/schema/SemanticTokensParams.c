@@ -30,6 +30,7 @@ OptionalSemanticTokensParamss SemanticTokensParamss_decode(OptionalJSONValue jso
         OptionalJSONValue            elem = json_at(&json.value, ix);
         OptionalSemanticTokensParams val = SemanticTokensParams_decode(elem);
         if (!val.has_value) {
+            da_free_SemanticTokensParams(&ret);
             RETURN_EMPTY(SemanticTokensParamss);
         }
         da_append_SemanticTokensParams(&ret, val.value);
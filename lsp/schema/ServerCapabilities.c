@@ -30,6 +30,7 @@ OptionalServerCapabilitiess ServerCapabilitiess_decode(OptionalJSONValue json)
         OptionalJSONValue          elem = json_at(&json.value, ix);
         OptionalServerCapabilities val = ServerCapabilities_decode(elem);
         if (!val.has_value) {
+            da_free_ServerCapabilities(&ret);
             RETURN_EMPTY(ServerCapabilitiess);
         }
         da_append_ServerCapabilities(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalTextDocumentClientCapabilitiess TextDocumentClientCapabilitiess_decode(O
         OptionalJSONValue                      elem = json_at(&json.value, ix);
         OptionalTextDocumentClientCapabilities val = TextDocumentClientCapabilities_decode(elem);
         if (!val.has_value) {
+            da_free_TextDocumentClientCapabilities(&ret);
             RETURN_EMPTY(TextDocumentClientCapabilitiess);
         }
         da_append_TextDocumentClientCapabilities(&ret, val.value);
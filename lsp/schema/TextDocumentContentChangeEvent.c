@@ -30,6 +30,7 @@ OptionalTextDocumentContentChangeEvents TextDocumentContentChangeEvents_decode(O
         OptionalJSONValue                      elem = json_at(&json.value, ix);
         OptionalTextDocumentContentChangeEvent val = TextDocumentContentChangeEvent_decode(elem);
         if (!val.has_value) {
+            da_free_TextDocumentContentChangeEvent(&ret);
             RETURN_EMPTY(TextDocumentContentChangeEvents);
         }
         da_append_TextDocumentContentChangeEvent(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalTextDocumentIdentifiers TextDocumentIdentifiers_decode(OptionalJSONValue
         OptionalJSONValue              elem = json_at(&json.value, ix);
         OptionalTextDocumentIdentifier val = TextDocumentIdentifier_decode(elem);
         if (!val.has_value) {
+            da_free_TextDocumentIdentifier(&ret);
             RETURN_EMPTY(TextDocumentIdentifiers);
         }
         da_append_TextDocumentIdentifier(&ret, val.value);
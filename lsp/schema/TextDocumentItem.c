@@ -30,6 +30,7 @@ OptionalTextDocumentItems TextDocumentItems_decode(OptionalJSONValue json)
         OptionalJSONValue        elem = json_at(&json.value, ix);
         OptionalTextDocumentItem val = TextDocumentItem_decode(elem);
         if (!val.has_value) {
+            da_free_TextDocumentItem(&ret);
             RETURN_EMPTY(TextDocumentItems);
         }
         da_append_TextDocumentItem(&ret, val.value);
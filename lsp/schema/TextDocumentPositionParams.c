@@ -30,6 +30,7 @@ OptionalTextDocumentPositionParamss TextDocumentPositionParamss_decode(OptionalJ
         OptionalJSONValue                  elem = json_at(&json.value, ix);
         OptionalTextDocumentPositionParams val = TextDocumentPositionParams_decode(elem);
         if (!val.has_value) {
+            da_free_TextDocumentPositionParams(&ret);
             RETURN_EMPTY(TextDocumentPositionParamss);
         }
         da_append_TextDocumentPositionParams(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalTextDocumentSyncClientCapabilitiess TextDocumentSyncClientCapabilitiess_
         OptionalJSONValue                          elem = json_at(&json.value, ix);
         OptionalTextDocumentSyncClientCapabilities val = TextDocumentSyncClientCapabilities_decode(elem);
         if (!val.has_value) {
+            da_free_TextDocumentSyncClientCapabilities(&ret);
             RETURN_EMPTY(TextDocumentSyncClientCapabilitiess);
         }
         da_append_TextDocumentSyncClientCapabilities(&ret, val.value);
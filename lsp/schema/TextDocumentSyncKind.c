@@ -30,6 +30,7 @@ OptionalTextDocumentSyncKinds TextDocumentSyncKinds_decode(OptionalJSONValue jso
         OptionalJSONValue            elem = json_at(&json.value, ix);
         OptionalTextDocumentSyncKind val = TextDocumentSyncKind_decode(elem);
         if (!val.has_value) {
+            da_free_TextDocumentSyncKind(&ret);
             RETURN_EMPTY(TextDocumentSyncKinds);
         }
         da_append_TextDocumentSyncKind(&ret, val.value);
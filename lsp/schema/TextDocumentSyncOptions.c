@@ -30,6 +30,7 @@ OptionalTextDocumentSyncOptionss TextDocumentSyncOptionss_decode(OptionalJSONVal
         OptionalJSONValue               elem = json_at(&json.value, ix);
         OptionalTextDocumentSyncOptions val = TextDocumentSyncOptions_decode(elem);
         if (!val.has_value) {
+            da_free_TextDocumentSyncOptions(&ret);
             RETURN_EMPTY(TextDocumentSyncOptionss);
         }
         da_append_TextDocumentSyncOptions(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalTextEdits TextEdits_decode(OptionalJSONValue json)
         OptionalJSONValue elem = json_at(&json.value, ix);
         OptionalTextEdit  val = TextEdit_decode(elem);
         if (!val.has_value) {
+            da_free_TextEdit(&ret);
             RETURN_EMPTY(TextEdits);
         }
         da_append_TextEdit(&ret, val.value);
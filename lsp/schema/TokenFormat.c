@@ -30,6 +30,7 @@ OptionalTokenFormats TokenFormats_decode(OptionalJSONValue json)
         OptionalJSONValue   elem = json_at(&json.value, ix);
         OptionalTokenFormat val = TokenFormat_decode(elem);
         if (!val.has_value) {
+            da_free_TokenFormat(&ret);
             RETURN_EMPTY(TokenFormats);
         }
         da_append_TokenFormat(&ret, val.value);
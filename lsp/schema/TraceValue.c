@@ -30,6 +30,7 @@ OptionalTraceValues TraceValues_decode(OptionalJSONValue json)
         OptionalJSONValue  elem = json_at(&json.value, ix);
         OptionalTraceValue val = TraceValue_decode(elem);
         if (!val.has_value) {
+            da_free_TraceValue(&ret);
             RETURN_EMPTY(TraceValues);
         }
         da_append_TraceValue(&ret, val.value);
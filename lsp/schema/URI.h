@@ -21,5 +21,7 @@ typedef OptionalStringViews OptionalURIs;
 #define URI_decode(V) StringView_decode(V)
 #define URIs_encode(V) StringViews_encode(V)
 #define URIs_decode(V) StringViews_decode(V)
+#define URI_read(R) StringView_read(R)
+#define URIs_read(R) StringViews_read(R)
 
 #endif /* __LSP_URI_H__ */
@@ -30,6 +30,7 @@ OptionalVersionedTextDocumentIdentifiers VersionedTextDocumentIdentifiers_decode
         OptionalJSONValue                       elem = json_at(&json.value, ix);
         OptionalVersionedTextDocumentIdentifier val = VersionedTextDocumentIdentifier_decode(elem);
         if (!val.has_value) {
+            da_free_VersionedTextDocumentIdentifier(&ret);
             RETURN_EMPTY(VersionedTextDocumentIdentifiers);
         }
         da_append_VersionedTextDocumentIdentifier(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalWorkDoneProgressParamss WorkDoneProgressParamss_decode(OptionalJSONValue
         OptionalJSONValue              elem = json_at(&json.value, ix);
         OptionalWorkDoneProgressParams val = WorkDoneProgressParams_decode(elem);
         if (!val.has_value) {
+            da_free_WorkDoneProgressParams(&ret);
             RETURN_EMPTY(WorkDoneProgressParamss);
         }
         da_append_WorkDoneProgressParams(&ret, val.value);
@@ -30,6 +30,7 @@ OptionalWorkspaceFolders WorkspaceFolders_decode(OptionalJSONValue json)
         OptionalJSONValue       elem = json_at(&json.value, ix);
         OptionalWorkspaceFolder val = WorkspaceFolder_decode(elem);
         if (!val.has_value) {
+            da_free_WorkspaceFolder(&ret);
             RETURN_EMPTY(WorkspaceFolders);
         }
         da_append_WorkspaceFolder(&ret, val.value);
@@ -17,11 +17,16 @@ ts_path = os.path.join(eddy_bin_dir, "ts")
 
 templates = {}
 
+# Types that get a _read function, which decodes them straight from a
+# JSONReader. The types they depend on get one as well.
+readers = ["SemanticTokens", "PublishDiagnosticsParams"]
+
 def parse_typescript(name):
     os.path.exists("stdout") and os.remove("stdout")
     os.path.exists("stderr") and os.remove("stderr")
     with open("stdout", "w+") as out, open("stderr", "w+") as err:
-        ex = subprocess.call([ts_path, name + ".ts"], stdout=out, stderr=err)
+        args = [ts_path] + [f"--reader={r}" for r in readers] + [name + ".ts"]
+        ex = subprocess.call(args, stdout=out, stderr=err)
         if ex != 0:
             print(f"Parse of '{name}' failed: {ex}")
             subprocess.call(["cat", "stdout"])
@@ -10,6 +10,18 @@
 
 DECLARE_SHARED_ALLOCATOR(LSP)
 
+// The _read functions decode straight from a JSONReader. They always read
+// a whole value, also when it has the wrong type. Strings are copied,
+// because the text a reader works on is usually a transient buffer.
+
+static OptionalJSONValue read_scalar(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_VALUE)) {
+        RETURN_EMPTY(JSONValue);
+    }
+    RETURN_VALUE(JSONValue, reader->value);
+}
+
 // -- JSONValue -------------------------------------------------------------
 
 OptionalJSONValue JSONValue_encode(JSONValue value)
@@ -22,6 +34,11 @@ OptionalJSONValue JSONValue_decode(OptionalJSONValue value)
     return value;
 }
 
+OptionalJSONValue JSONValue_read(JSONReader *reader)
+{
+    return json_reader_decode(reader);
+}
+
 OptionalJSONValue JSONValues_encode(JSONValues value)
 {
     JSONValue ret = json_array();
@@ -48,6 +65,15 @@ OptionalJSONValues JSONValues_decode(OptionalJSONValue json)
     RETURN_VALUE(JSONValues, ret);
 }
 
+OptionalJSONValues JSONValues_read(JSONReader *reader)
+{
+    OptionalJSONValue json = json_reader_decode(reader);
+    if (!json.has_value || json.value.type != JSON_TYPE_ARRAY) {
+        RETURN_EMPTY(JSONValues);
+    }
+    RETURN_VALUE(JSONValues, json.value.array);
+}
+
 // -- Int -------------------------------------------------------------------
 
 OptionalJSONValue Int_encode(int value)
@@ -66,6 +92,11 @@ OptionalInt Int_decode(OptionalJSONValue json)
     RETURN_VALUE(Int, json.value.int_number.i32);
 }
 
+OptionalInt Int_read(JSONReader *reader)
+{
+    return Int_decode(read_scalar(reader));
+}
+
 OptionalJSONValue Ints_encode(Ints value)
 {
     JSONValue ret = json_array();
@@ -86,10 +117,33 @@ OptionalInts Ints_decode(OptionalJSONValue json)
         OptionalJSONValue elem = json_at(&json.value, ix);
         OptionalInt       val = Int_decode(elem);
         if (!val.has_value) {
+            da_free_int(&ret);
+            RETURN_EMPTY(Ints);
+        }
+        da_append_int(&ret, val.value);
+    }
+    RETURN_VALUE(Ints, ret);
+}
+
+OptionalInts Ints_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(Ints);
+    }
+    Ints ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalInt val = Int_read(reader);
+        if (!val.has_value) {
+            da_free_int(&ret);
+            json_reader_leave(reader);
             RETURN_EMPTY(Ints);
         }
         da_append_int(&ret, val.value);
     }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        da_free_int(&ret);
+        RETURN_EMPTY(Ints);
+    }
     RETURN_VALUE(Ints, ret);
 }
 
@@ -111,6 +165,11 @@ OptionalUInt32 UInt32_decode(OptionalJSONValue json)
     RETURN_VALUE(UInt32, json.value.int_number.u32);
 }
 
+OptionalUInt32 UInt32_read(JSONReader *reader)
+{
+    return UInt32_decode(read_scalar(reader));
+}
+
 OptionalJSONValue UInt32s_encode(UInt32s value)
 {
     JSONValue ret = json_array();
@@ -130,10 +189,33 @@ OptionalUInt32s UInt32s_decode(OptionalJSONValue json)
         OptionalJSONValue elem = json_at(&json.value, ix);
         OptionalUInt32    val = UInt32_decode(elem);
         if (!val.has_value) {
+            da_free_uint32_t(&ret);
+            RETURN_EMPTY(UInt32s);
+        }
+        da_append_uint32_t(&ret, val.value);
+    }
+    RETURN_VALUE(UInt32s, ret);
+}
+
+OptionalUInt32s UInt32s_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(UInt32s);
+    }
+    UInt32s ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalUInt32 val = UInt32_read(reader);
+        if (!val.has_value) {
+            da_free_uint32_t(&ret);
+            json_reader_leave(reader);
             RETURN_EMPTY(UInt32s);
         }
         da_append_uint32_t(&ret, val.value);
     }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        da_free_uint32_t(&ret);
+        RETURN_EMPTY(UInt32s);
+    }
     RETURN_VALUE(UInt32s, ret);
 }
 
@@ -152,6 +234,11 @@ OptionalBool Bool_decode(OptionalJSONValue json)
     RETURN_VALUE(Bool, json.value.boolean);
 }
 
+OptionalBool Bool_read(JSONReader *reader)
+{
+    return Bool_decode(read_scalar(reader));
+}
+
 // -- StringView ------------------------------------------------------------
 
 OptionalJSONValue StringView_encode(StringView sv)
@@ -167,6 +254,15 @@ OptionalStringView StringView_decode(OptionalJSONValue json)
     RETURN_VALUE(StringView, json.value.string);
 }
 
+OptionalStringView StringView_read(JSONReader *reader)
+{
+    OptionalStringView ret = StringView_decode(read_scalar(reader));
+    if (ret.has_value) {
+        ret.value = sv_copy(ret.value);
+    }
+    return ret;
+}
+
 OptionalJSONValue StringViews_encode(StringViews value)
 {
     JSONValue ret = json_array();
@@ -187,10 +283,34 @@ OptionalStringViews StringViews_decode(OptionalJSONValue json)
         OptionalJSONValue  elem = json_at(&json.value, ix);
         OptionalStringView val = StringView_decode(elem);
         if (!val.has_value) {
+            // The elements are borrowed from the JSON document.
+            da_free_StringView(&ret);
+            RETURN_EMPTY(StringViews);
+        }
+        da_append_StringView(&ret, val.value);
+    }
+    RETURN_VALUE(StringViews, ret);
+}
+
+OptionalStringViews StringViews_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_ARRAY)) {
+        RETURN_EMPTY(StringViews);
+    }
+    StringViews ret = { 0 };
+    while (json_reader_more(reader)) {
+        OptionalStringView val = StringView_read(reader);
+        if (!val.has_value) {
+            sl_free(&ret);
+            json_reader_leave(reader);
             RETURN_EMPTY(StringViews);
         }
         da_append_StringView(&ret, val.value);
     }
+    if (reader->event != JSON_EVENT_END_ARRAY) {
+        sl_free(&ret);
+        RETURN_EMPTY(StringViews);
+    }
     RETURN_VALUE(StringViews, ret);
 }
 
@@ -209,6 +329,18 @@ OptionalEmpty Empty_decode(OptionalJSONValue json)
     RETURN_VALUE(Empty, (Empty) {});
 }
 
+OptionalEmpty Empty_read(JSONReader *reader)
+{
+    if (!json_reader_expect(reader, JSON_EVENT_BEGIN_OBJECT)) {
+        RETURN_EMPTY(Empty);
+    }
+    if (json_reader_next(reader) != JSON_EVENT_END_OBJECT) {
+        json_reader_leave(reader);
+        RETURN_EMPTY(Empty);
+    }
+    RETURN_VALUE(Empty, (Empty) {});
+}
+
 // -- Null ------------------------------------------------------------------
 
 OptionalJSONValue Null_encode(Null value)
@@ -224,4 +356,9 @@ OptionalNull Null_decode(OptionalJSONValue json)
     RETURN_VALUE(Null, (Null) {});
 }
 
+OptionalNull Null_read(JSONReader *reader)
+{
+    return Null_decode(read_scalar(reader));
+}
+
 // ---------------------------------------------------------------------------
@@ -21,25 +21,36 @@ OPTIONAL(Null)
 
 extern OptionalJSONValue   JSONValue_encode(JSONValue value);
 extern OptionalJSONValue   JSONValue_decode(OptionalJSONValue value);
+extern OptionalJSONValue   JSONValue_read(JSONReader *reader);
 extern OptionalJSONValue   JSONValues_encode(JSONValues value);
 extern OptionalJSONValues  JSONValues_decode(OptionalJSONValue json);
+extern OptionalJSONValues  JSONValues_read(JSONReader *reader);
 extern OptionalJSONValue   Int_encode(int value);
 extern OptionalInt         Int_decode(OptionalJSONValue value);
+extern OptionalInt         Int_read(JSONReader *reader);
 extern OptionalJSONValue   Ints_encode(Ints value);
 extern OptionalInts        Ints_decode(OptionalJSONValue value);
+extern OptionalInts        Ints_read(JSONReader *reader);
 extern OptionalJSONValue   UInt32_encode(uint32_t value);
 extern OptionalUInt32      UInt32_decode(OptionalJSONValue value);
+extern OptionalUInt32      UInt32_read(JSONReader *reader);
 extern OptionalJSONValue   UInt32s_encode(UInt32s value);
 extern OptionalUInt32s     UInt32s_decode(OptionalJSONValue value);
+extern OptionalUInt32s     UInt32s_read(JSONReader *reader);
 extern OptionalJSONValue   Bool_encode(bool value);
 extern OptionalBool        Bool_decode(OptionalJSONValue value);
+extern OptionalBool        Bool_read(JSONReader *reader);
 extern OptionalJSONValue   StringView_encode(StringView value);
 extern OptionalStringView  StringView_decode(OptionalJSONValue value);
+extern OptionalStringView  StringView_read(JSONReader *reader);
 extern OptionalJSONValue   StringViews_encode(StringViews value);
 extern OptionalStringViews StringViews_decode(OptionalJSONValue value);
+extern OptionalStringViews StringViews_read(JSONReader *reader);
 extern OptionalJSONValue   Empty_encode(Empty value);
 extern OptionalEmpty       Empty_decode(OptionalJSONValue value);
+extern OptionalEmpty       Empty_read(JSONReader *reader);
 extern OptionalJSONValue   Null_encode(Null value);
 extern OptionalNull        Null_decode(OptionalJSONValue value);
+extern OptionalNull        Null_read(JSONReader *reader);
 
 #endif /* __LSP_LSP_BASE_H__ */
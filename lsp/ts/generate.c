@@ -5,14 +5,49 @@
  */
 
 #include <base/io.h>
+#include <base/options.h>
 #include <lsp/ts/ts.h>
 #include <template/template.h>
 
+static StringList readers = { 0 };
+static bool       readers_collected = false;
+
+static void add_reader(StringView name)
+{
+    if (sl_has(&readers, name)) {
+        return;
+    }
+    TypeDef *t = get_typedef(name);
+    if (t == NULL) {
+        fatal("--reader: unknown type '%.*s'", SV_ARG(name));
+    }
+    sl_push(&readers, name);
+    for (size_t ix = 0; ix < t->dependencies.size; ++ix) {
+        add_reader(t->dependencies.strings[ix]);
+    }
+}
+
+// Types named with --reader get a _read function, which decodes straight
+// from a JSONReader. So do the types they depend on, because that is what
+// their readers call.
+static bool has_reader(StringView name)
+{
+    if (!readers_collected) {
+        StringList names = get_option_values(sv_from("reader"));
+        for (size_t ix = 0; ix < names.size; ++ix) {
+            add_reader(names.strings[ix]);
+        }
+        readers_collected = true;
+    }
+    return sl_has(&readers, name);
+}
+
 void generate_typedef(StringView name)
 {
     TypeDef *t = get_typedef(name);
     assert(t != NULL);
     JSONValue ctx = typedef_serialize(*t);
+    json_set(&ctx, "reader", json_bool(has_reader(name)));
 
     StringView json = json_encode(ctx);
     StringView json_file = sv_printf("%.*s.json", SV_ARG(name));
@@ -24,7 +24,9 @@
 noreturn void shutdown_backend(BackendConnection *conn, int code)
 {
     socket_close(conn->fd);
-    fs_unlink(conn->socket);
+    if (!sv_empty(conn->socket)) {
+        fs_unlink(conn->socket);
+    }
     if (!conn->threaded) {
         exit(1);
     } else {
@@ -40,7 +42,7 @@ noreturn void exit_backend(BackendConnection *conn, StringView error)
 
 bool bootstrap_backend(BackendConnection *conn)
 {
-    if (http_get_message(conn->fd, sv_from("/hello"), (StringList) { 0 }) != HTTP_STATUS_HELLO) {
+    if (http_hello(conn->fd, true) != HTTP_STATUS_HELLO) {
         fatal("/hello failed");
     }
     conn->config = HTTP_GET_REQUEST_MUST(conn->fd, "/bootstrap/config", (StringList) { 0 });
@@ -153,7 +155,12 @@ void compile_program(BackendConnection *conn)
 
 int scribble_backend(StringView path, bool threaded)
 {
-    socket_t          conn_fd = MUST(Socket, unix_socket_connect(path));
+    return scribble_backend_run(MUST(Socket, unix_socket_connect(path)), path, threaded);
+}
+
+// path is empty for in-process sockets.
+int scribble_backend_run(socket_t conn_fd, StringView path, bool threaded)
+{
     BackendConnection conn = { 0 };
 
     conn.fd = conn_fd;
@@ -161,7 +168,8 @@ int scribble_backend(StringView path, bool threaded)
     conn.socket = path;
     conn.threaded = threaded;
 
-    if (http_get_message(conn.fd, sv_from("/hello"), (StringList) { 0 }) != HTTP_STATUS_HELLO) {
+    // The frontend decides whether binary framing is used.
+    if (http_hello(conn.fd, true) != HTTP_STATUS_HELLO) {
         fatal("/hello failed");
     }
     conn.config = HTTP_GET_REQUEST_MUST(conn.fd, "/bootstrap/config", (StringList) { 0 });
@@ -301,9 +301,13 @@ Datum *datum_copy(Datum *dest, Datum *src)
     default:
         UNREACHABLE();
     }
-    if (src->type == VAR_POINTER_ID && src->datum_pointer.size > 0) {
-        dest->datum_pointer.components = allocate_array(size_t, dest->datum_pointer.cap);
-        memcpy(dest->datum_pointer.components, src->datum_pointer.components, src->datum_pointer.size * sizeof(size_t));
+    if (src->type == VAR_POINTER_ID) {
+        dest->datum_pointer.components = NULL;
+        dest->datum_pointer.cap = 0;
+        if (src->datum_pointer.size > 0) {
+            DIA_RESERVE_ELEMENTS(size_t, components, (&dest->datum_pointer), src->datum_pointer.size);
+            memcpy(dest->datum_pointer.components, src->datum_pointer.components, src->datum_pointer.size * sizeof(size_t));
+        }
     }
     return dest;
 }
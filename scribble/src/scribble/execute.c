@@ -10,6 +10,7 @@
 #define STATIC_ALLOCATOR
 #include <base/allocate.h>
 #include <base/http.h>
+#include <base/intern.h>
 #include <execute.h>
 #include <native.h>
 
@@ -140,8 +141,11 @@ JSONValue call_stack_to_json(CallStack *stack)
 
 VarList *scope_variable(Scope *scope, StringView name)
 {
+    // Declared names are interned by scope_declare_variable, and the names
+    // in PUSH_VAR_ADDRESS operations by add_operation in intermediate.c,
+    // which every operation goes through. Comparing pointers is enough.
     for (VarList *var = scope->var_list; var; var = var->next) {
-        if (sv_eq(var->name, name)) {
+        if (sv_interned_eq(var->name, name)) {
             return var;
         }
     }
@@ -151,8 +155,9 @@ VarList *scope_variable(Scope *scope, StringView name)
 VarList *scope_declare_variable(Scope *scope, StringView name, type_id type)
 {
     VarList *end;
+    name = sv_intern(name);
     for (end = scope->var_list; end && end->next; end = end->next) {
-        if (sv_eq(end->name, name)) {
+        if (sv_interned_eq(end->name, name)) {
             return NULL;
         }
     }
@@ -815,7 +820,7 @@ FunctionReturn execute_function(ExecutionContext *ctx, IRFunction *function)
         scope_declare_variable(ctx->scope, var_decl->name, var_decl->type.type_id);
     }
     if (ctx->debug) {
-        HttpResponse resp = http_post_request(
+        http_post_pipelined(
             ctx->conn->fd,
             SV("/execute/function/entry"),
             ir_function_to_json(function));
@@ -823,7 +828,7 @@ FunctionReturn execute_function(ExecutionContext *ctx, IRFunction *function)
     while (ix < function->operations.size) {
         ctx->index = function->operations.elements[ix].index;
         if (ctx->debug) {
-            HttpResponse resp = http_post_request(
+            http_post_pipelined(
                 ctx->conn->fd,
                 SV("/execute/function/on"),
                 ir_operation_to_json(function->operations.elements[ix]));
@@ -832,7 +837,7 @@ FunctionReturn execute_function(ExecutionContext *ctx, IRFunction *function)
         NextInstructionPointer pointer = execute_operation(ctx, function->operations.elements + ix);
 
         if (ctx->debug) {
-            HttpResponse resp = http_post_request(
+            http_post_pipelined(
                 ctx->conn->fd,
                 SV("/execute/function/after"),
                 ir_operation_to_json(function->operations.elements[ix]));
@@ -872,7 +877,7 @@ FunctionReturn execute_function(ExecutionContext *ctx, IRFunction *function)
     }
 
     if (ctx->debug) {
-        HttpResponse resp = http_post_request(
+        http_post_pipelined(
             ctx->conn->fd,
             SV("/execute/function/exit"),
             ir_function_to_json(function));
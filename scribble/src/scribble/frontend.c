@@ -34,49 +34,60 @@ ErrorOrSocket start_backend_process(StringView path)
     return socket_accept(listen_fd);
 }
 
-void *backend_main_wrapper(void *path)
+void *backend_main_wrapper(void *socket)
 {
     pthread_setname_np("Backend");
     trace(IPC, "Threaded backend started");
-    scribble_backend((StringView) { (char const *) path, strlen(path) }, true);
+    scribble_backend_run((socket_t) socket, sv_null(), true);
     trace(IPC, "Threaded backend finished");
     return NULL;
 }
 
-ErrorOrSocket start_backend_thread(StringView path)
+// The backend thread shares our address space, so messages are handed over
+// through an in-process socket instead of going through the kernel.
+ErrorOrSocket start_backend_thread()
 {
-    socket_t const listen_fd = MUST(Socket, unix_socket_listen(path));
-    pthread_t      thread;
-    int            ret;
+    socket_t  frontend;
+    socket_t  backend;
+    pthread_t thread;
+    int       ret;
 
-    if ((ret = pthread_create(&thread, NULL, backend_main_wrapper, (void *) path.ptr)) != 0) {
+    socket_in_process_pair(&frontend, &backend);
+    if ((ret = pthread_create(&thread, NULL, backend_main_wrapper, (void *) backend)) != 0) {
         fatal("Could not start backend thread: %s", strerror(ret));
     }
     trace(IPC, "Started client thread");
-    return socket_accept(listen_fd);
+    RETURN(Socket, frontend);
 }
 
 void scribble_frontend(JSONValue config, FrontEndMessageHandler handler)
 {
-    StringView path = sv_printf("/tmp/scribble-engine-%d", getpid());
+    StringView path = sv_null();
     socket_t   socket = { 0 };
     if (json_get_bool(&config, "threaded", false)) {
-        socket = MUST(Socket, start_backend_thread(path));
+        socket = MUST(Socket, start_backend_thread());
     } else {
+        path = sv_printf("/tmp/scribble-engine-%d", getpid());
         socket = MUST(Socket, start_backend_process(path));
     }
 
     while (true) {
         trace(IPC, "[S] Waiting for request");
         HttpRequest request = MUST(HttpRequest, http_request_receive(socket));
+        if (sv_eq_cstr(request.url, "/hello")) {
+            MUST(Int, http_hello_respond(socket, &request, !json_get_bool(&config, "http-ipc", false)));
+            continue;
+        }
         if (handler(socket, request, config)) {
             break;
         }
     }
     trace(IPC, "[S] Closing socket");
     socket_close(socket);
-    fs_unlink(path);
-    sv_free(path);
+    if (!sv_empty(path)) {
+        fs_unlink(path);
+        sv_free(path);
+    }
 }
 
 bool handle_parser_message(socket_t socket, HttpRequest request)
@@ -269,12 +280,6 @@ void handle_arm64_message(socket_t socket, HttpRequest request)
 bool frontend_message_handler(socket_t conn_fd, HttpRequest request, JSONValue config)
 {
     trace(IPC, "[S] Got %.*s", SV_ARG(request.url));
-    if (sv_eq_cstr(request.url, "/hello")) {
-        HttpResponse response = { 0 };
-        response.status = HTTP_STATUS_HELLO;
-        http_response_send(conn_fd, &response);
-        return false;
-    }
     if (sv_eq_cstr(request.url, "/bootstrap/config")) {
         HttpResponse response = { 0 };
         response.status = HTTP_STATUS_OK;
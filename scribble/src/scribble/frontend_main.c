@@ -44,6 +44,7 @@ int main(int argc, char **argv)
 
     JSONValue stage = json_object();
     json_set(&config, "threaded", json_bool(has_option("threaded")));
+    json_set(&config, "http-ipc", json_bool(has_option("http-ipc")));
     json_set_cstr(&stage, "name", "parse");
     json_set_cstr(&stage, "target", program_dir_or_file);
     json_set(&stage, "debug", json_bool(true));
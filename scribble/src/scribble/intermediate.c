@@ -7,6 +7,7 @@
 #define STATIC_ALLOCATOR
 #include <base/allocate.h>
 #include <base/http.h>
+#include <base/intern.h>
 #include <base/options.h>
 #include <intermediate.h>
 
@@ -53,6 +54,16 @@ unsigned int next_label()
 void add_operation(IRContext *ctx, IROperation op)
 {
     assert(ctx->target->obj_type == OT_FUNCTION);
+    switch (op.operation) {
+    case IR_PUSH_VAR_ADDRESS:
+        op.sv = sv_intern(op.sv);
+        break;
+    case IR_DECL_VAR:
+        op.var_decl.name = sv_intern(op.var_decl.name);
+        break;
+    default:
+        break;
+    }
     if (ctx->conn && ctx->debug) {
         JSONValue op_json = json_object();
         json_set(&op_json, "operation", json_string(ir_operation_to_string(&op)));
@@ -6,6 +6,7 @@
 
 #define STATIC_ALLOCATOR
 #include <base/allocate.h>
+#include <base/intern.h>
 #include <base/sv.h>
 #include <type.h>
 
@@ -160,8 +161,14 @@ ErrorOrTypeID type_registry_add_builtin(StringView name, BuiltinType builtin_typ
 
 ExpressionType *type_registry_get_type_by_name(StringView name)
 {
+    // Type names are interned when the type is registered, so a name that
+    // was never interned cannot name a type.
+    name = sv_intern_find(name);
+    if (sv_empty(name)) {
+        return NULL;
+    }
     for (int ix = 0; ix < type_registry.size; ++ix) {
-        if (sv_eq(type_registry.elements[ix]->name, name)) {
+        if (sv_interned_eq(type_registry.elements[ix]->name, name)) {
             return type_registry.elements[ix];
         }
     }
@@ -218,7 +225,7 @@ ErrorOrTypeID type_registry_make_type(StringView name, TypeKind kind, BuiltinTyp
     }
     ExpressionType *type = allocate_new(ExpressionType);
     DIA_APPEND(ExpressionType *, (&type_registry), type);
-    type->name = sv_copy(name);
+    type->name = sv_intern(name);
     type->type_id = (type_registry.size - 1) | (kind << 28) | (builtin_type << 16);
     type->builtin_type = builtin_type;
     NEXT_CUSTOM_IX = type_registry.size;